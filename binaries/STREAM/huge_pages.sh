@@ -0,0 +1,17 @@
+#!/bin/bash
+# Compares STREAM bandwidth with and without huge pages backing the
+# memory arena. Build STREAM (build.sh) and the emulator first.
+# Usage: ./huge_pages.sh [-L] (use -L for explicitly reserved huge pages)
+set -e
+EMULATOR=${EMULATOR:-../../emulator/rvlinux}
+PROGRAM=${PROGRAM:-build/stream}
+HUGE=${1:--H}
+
+function run() {
+	$EMULATOR "$@" $PROGRAM | grep -E "^(Copy|Scale|Add|Triad):|Runtime"
+}
+
+echo "== 4KB pages"
+run
+echo "== Huge pages ($HUGE)"
+run $HUGE
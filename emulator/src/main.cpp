@@ -37,11 +37,14 @@ struct Arguments {
 	bool ignore_text = false;
 	bool background = false; // Run binary translation in background thread
 	bool proxy_mode = false;  // Proxy mode for system calls
+	bool huge_pages = false; // Transparent huge pages for the memory arena
+	bool hugetlb = false;    // Explicit huge pages for the memory arena
 	uint64_t fuel = 30'000'000'000ULL; // Default: Timeout after ~30bn instructions
 	std::vector<std::string> allowed_files;
 	std::string output_file;
 	std::string call_function;
 	std::string jump_hints_file;
+	std::string profile_file;
 };
 
 #ifdef HAVE_GETOPT_LONG
@@ -63,6 +66,7 @@ static const struct option long_options[] = {
 	{"no-translate-future", no_argument, 0, 'N'},
 	{"translate-regcache", no_argument, 0, 'R'},
 	{"jump-hints", required_argument, 0, 'J'},
+	{"profile", required_argument, 0, 'p'},
 	{"background", no_argument, 0, 'B'},
 	{"mingw", no_argument, 0, 'm'},
 	{"output", required_argument, 0, 'o'},
@@ -73,6 +77,8 @@ static const struct option long_options[] = {
 	{"execute-only", no_argument, 0, 'X'},
 	{"ignore-text", no_argument, 0, 'I'},
 	{"call", required_argument, 0, 'c'},
+	{"huge-pages", no_argument, 0, 'H'},
+	{"hugetlb", no_argument, 0, 'L'},
 	{0, 0, 0, 0}
 };
 
@@ -95,6 +101,7 @@ static void print_help(const char* name)
 		"  -N, --no-translate-future Disable binary translation of non-initial segments\n"
 		"  -R, --translate-regcache Enable register caching in binary translator\n"
 		"  -J, --jump-hints file  Load jump location hints from file, unless empty then record instead\n"
+		"  -p, --profile file Store the hottest blocks in file (requires RISCV_BLOCK_PROFILING)\n"
 		"  -B  --background   Run binary translation in background thread\n"
 		"  -m, --mingw        Cross-compile for Windows (MinGW)\n"
 		"  -o, --output file  Output embeddable binary translated code (C99)\n"
@@ -105,6 +112,8 @@ static void print_help(const char* name)
 		"  -X, --execute-only Enforce execute-only segments (no read/write)\n"
 		"  -I, --ignore-text  Ignore .text section, and use segments only\n"
 		"  -c, --call func    Call a function after loading the program\n"
+		"  -H, --huge-pages   Use transparent huge pages for the memory arena\n"
+		"  -L, --hugetlb      Use explicitly reserved huge pages for the memory arena\n"
 		"\n"
 	);
 	printf("libriscv is compiled with:\n"
@@ -134,6 +143,9 @@ static void print_help(const char* name)
 #ifdef RISCV_DEBUG
 		"-  Extra debugging features are enabled\n"
 #endif
+#ifdef RISCV_BLOCK_PROFILING
+		"-  Block profiling is enabled\n"
+#endif
 #ifdef RISCV_FLAT_RW_ARENA
 		"-  Flat sequential memory arena is enabled\n"
 #endif
@@ -152,7 +164,7 @@ static void print_help(const char* name)
 static int parse_arguments(int argc, const char** argv, Arguments& args)
 {
 	int c;
-	while ((c = getopt_long(argc, (char**)argv, "hvQad1f:gstTnNRJ:Bmo:FSPA:XIc:", long_options, nullptr)) != -1)
+	while ((c = getopt_long(argc, (char**)argv, "hvQad1f:gstTnNRJ:p:Bmo:FSPA:XIc:HL", long_options, nullptr)) != -1)
 	{
 		switch (c)
 		{
@@ -171,6 +183,7 @@ static int parse_arguments(int argc, const char** argv, Arguments& args)
 			case 'N': args.translate_future = false; break;
 			case 'R': args.translate_regcache = true; break;
 			case 'J': break;
+			case 'p': break;
 			case 'B': args.background = true; break;
 			case 'm': args.mingw = true; break;
 			case 'o': break;
@@ -181,6 +194,8 @@ static int parse_arguments(int argc, const char** argv, Arguments& args)
 			case 'X': args.execute_only = true; break;
 			case 'I': args.ignore_text = true; break;
 			case 'c': break;
+			case 'H': args.huge_pages = true; break;
+			case 'L': args.hugetlb = true; break;
 			default:
 				fprintf(stderr, "Unknown option: %c\n", c);
 				return -1;
@@ -214,6 +229,11 @@ static int parse_arguments(int argc, const char** argv, Arguments& args)
 			if (args.verbose) {
 				printf("* Jump hints file: %s\n", args.jump_hints_file.c_str());
 			}
+		} else if (c == 'p') {
+			args.profile_file = optarg;
+			if (args.verbose) {
+				printf("* Block profile file: %s\n", args.profile_file.c_str());
+			}
 		}
 	}
 
@@ -256,6 +276,8 @@ static void run_program(
 		.enforce_exec_only = cli_args.execute_only,
 		.ignore_text_section = cli_args.ignore_text,
 		.verbose_loader = cli_args.verbose,
+		.use_arena_huge_pages = cli_args.huge_pages,
+		.use_arena_hugetlb = cli_args.hugetlb,
 		.use_shared_execute_segments = false, // We are only creating one machine, disabling this can enable some optimizations
 #ifdef NODEJS_WORKAROUND
 		.ebreak_locations = {
@@ -615,6 +637,10 @@ static void run_program(
 		}
 	}
 
+	if (!cli_args.profile_file.empty()) {
+		store_block_profile<W>(cli_args.profile_file, machine.memory);
+	}
+
 #ifdef RISCV_BINARY_TRANSLATION
 	if (!cli_args.jump_hints_file.empty()) {
 		const auto jump_hints = machine.memory.gather_jump_hints();
@@ -829,3 +855,27 @@ void store_jump_hints(const std::string& filename, const std::vector<riscv::addr
 		file << "0x" << std::hex << addr << std::endl;
 	}
 }
+
+// The profile is sorted by instructions executed. Each line starts with
+// a hex address, so that the file can also be loaded as jump hints.
+template <int W>
+void store_block_profile(const std::string& filename, const riscv::Memory<W>& memory)
+{
+	if constexpr (!riscv::block_profiling_enabled) {
+		fprintf(stderr, "Block profiling is not enabled (RISCV_BLOCK_PROFILING)\n");
+		return;
+	}
+	std::ofstream file(filename);
+	if (!file.is_open()) {
+		fprintf(stderr, "Could not open block profile file for writing: %s\n", filename.c_str());
+		return;
+	}
+
+	file << "# address count instructions symbol" << std::endl;
+	for (const auto& block : memory.block_profile()) {
+		file << "0x" << std::hex << block.address << std::dec
+			<< " " << block.count << " " << block.instructions
+			<< " " << block.callsite.name << "+0x" << std::hex << block.callsite.offset
+			<< std::dec << std::endl;
+	}
+}
@@ -54,12 +54,20 @@ INSTRUCTION(RV32I_BC_FAST_JAL, rv32i_fast_jal) {
 	}
 	NEXT_BLOCK(int32_t(DECODER().instr), true);
 }
+INSTRUCTION(RV32I_BC_FAST_JAL_FW, rv32i_fast_jal_fw) {
+	if constexpr (VERBOSE_JUMPS) {
+		VIEW_INSTR();
+		fprintf(stderr, "FAST_JAL_FW PC 0x%lX => 0x%lX\n", long(pc), long(pc + int32_t(instr.whole)));
+	}
+	NEXT_BLOCK(int32_t(DECODER().instr), false);
+}
 INSTRUCTION(RV32I_BC_FAST_CALL, rv32i_fast_call) {
 	if constexpr (VERBOSE_JUMPS) {
 		VIEW_INSTR();
 		fprintf(stderr, "FAST_CALL PC 0x%lX => 0x%lX\n", long(pc), long(pc + int32_t(instr.whole)));
 	}
 	REG(REG_RA) = pc + 4;
+	RETURN_STACK_PUSH(pc + 4);
 	NEXT_BLOCK(int32_t(DECODER().instr), true);
 }
 
@@ -132,6 +140,24 @@ INSTRUCTION(RV32C_BC_JMP, rv32c_jmp) {
 	VIEW_INSTR_AS(fi, FasterItype);
 	PERFORM_BRANCH();
 }
+INSTRUCTION(RV32C_BC_BNEZ_FW, rv32c_bnez_fw) {
+	VIEW_INSTR_AS(fi, FasterItype);
+	if (REG(fi.get_rs1()) != 0) {
+		PERFORM_FORWARD_BRANCH();
+	}
+	NEXT_BLOCK(2, false);
+}
+INSTRUCTION(RV32C_BC_BEQZ_FW, rv32c_beqz_fw) {
+	VIEW_INSTR_AS(fi, FasterItype);
+	if (REG(fi.get_rs1()) == 0) {
+		PERFORM_FORWARD_BRANCH();
+	}
+	NEXT_BLOCK(2, false);
+}
+INSTRUCTION(RV32C_BC_JMP_FW, rv32c_jmp_fw) {
+	VIEW_INSTR_AS(fi, FasterItype);
+	PERFORM_FORWARD_BRANCH();
+}
 INSTRUCTION(RV32C_BC_JAL_ADDIW, rv32c_jal_addiw) {
 	if constexpr (W >= 8) { // C.ADDIW
 		VIEW_INSTR_AS(fi, FasterItype);
@@ -141,6 +167,7 @@ INSTRUCTION(RV32C_BC_JAL_ADDIW, rv32c_jal_addiw) {
 	} else { // C.JAL
 		VIEW_INSTR_AS(fi, FasterItype);
 		REG(REG_RA) = pc + 2;
+		RETURN_STACK_PUSH(pc + 2);
 		PERFORM_BRANCH();
 	}
 }
@@ -151,6 +178,9 @@ INSTRUCTION(RV32C_BC_JR, rv32c_jr) {
 			long(pc), long(REG(instr.whole)));
 	}
 	pc = REG(instr.whole) & ~addr_t(1);
+	if (instr.whole == REG_RA) { // C.JR ra (ret)
+		PREDICTED_RETURN();
+	}
 	OVERFLOW_CHECKED_JUMP();
 }
 INSTRUCTION(RV32C_BC_JALR, rv32c_jalr) {
@@ -159,8 +189,10 @@ INSTRUCTION(RV32C_BC_JALR, rv32c_jalr) {
 		fprintf(stderr, "C.JALR from 0x%lX to 0x%lX\n",
 			long(pc), long(REG(instr.whole)));
 	}
+	const auto address = REG(instr.whole) & ~addr_t(1);
 	REG(REG_RA) = pc + 2;
-	pc = REG(instr.whole) & ~addr_t(1);
+	RETURN_STACK_PUSH(pc + 2);
+	pc = address;
 	OVERFLOW_CHECKED_JUMP();
 }
 #endif // RISCV_EXT_COMPRESSED
@@ -172,6 +204,9 @@ INSTRUCTION(RV32I_BC_JAL, rv32i_jal)
 		printf("JAL PC 0x%lX => 0x%lX\n", (long)pc, (long)pc + fi.signed_imm());
 	}
 	REG(fi.rd) = pc + 4;
+	if (fi.rd == REG_RA) {
+		RETURN_STACK_PUSH(pc + 4);
+	}
 	NEXT_BLOCK(fi.signed_imm(), true);
 }
 
@@ -231,6 +266,34 @@ INSTRUCTION(RV32I_BC_BGEU, rv32i_bgeu) {
 	}
 	NEXT_BLOCK(4, false);
 }
+INSTRUCTION(RV32I_BC_BLT_FW, rv32i_blt_fw) {
+	VIEW_INSTR_AS(fi, FasterItype);
+	if ((saddr_t)REG(fi.get_rs1()) < (saddr_t)REG(fi.get_rs2())) {
+		PERFORM_FORWARD_BRANCH();
+	}
+	NEXT_BLOCK(4, false);
+}
+INSTRUCTION(RV32I_BC_BGE_FW, rv32i_bge_fw) {
+	VIEW_INSTR_AS(fi, FasterItype);
+	if ((saddr_t)REG(fi.get_rs1()) >= (saddr_t)REG(fi.get_rs2())) {
+		PERFORM_FORWARD_BRANCH();
+	}
+	NEXT_BLOCK(4, false);
+}
+INSTRUCTION(RV32I_BC_BLTU_FW, rv32i_bltu_fw) {
+	VIEW_INSTR_AS(fi, FasterItype);
+	if (REG(fi.get_rs1()) < REG(fi.get_rs2())) {
+		PERFORM_FORWARD_BRANCH();
+	}
+	NEXT_BLOCK(4, false);
+}
+INSTRUCTION(RV32I_BC_BGEU_FW, rv32i_bgeu_fw) {
+	VIEW_INSTR_AS(fi, FasterItype);
+	if (REG(fi.get_rs1()) >= REG(fi.get_rs2())) {
+		PERFORM_FORWARD_BRANCH();
+	}
+	NEXT_BLOCK(4, false);
+}
 
 
 INSTRUCTION(RV32I_BC_LDW, rv32i_ldw) {
@@ -579,6 +642,8 @@ INSTRUCTION(RV32I_BC_FUNCTION, execute_decoded_function)
 INSTRUCTION(RV32I_BC_FUNCBLOCK, execute_function_block) {
 	VIEW_INSTR();
 	auto handler = DECODER().get_handler();
+	// The instruction may read PC, eg. AUIPC
+	REGISTERS().pc = pc;
 	handler(CPU(), instr);
 	NEXT_BLOCK(instr.length(), true);
 }
@@ -597,7 +662,13 @@ INSTRUCTION(RV32I_BC_JALR, rv32i_jalr) {
 			fi.rs2, fi.signed_imm(), fi.rs1, long(pc), long(address));
 	}
 	static constexpr addr_t ALIGN_MASK = (compressed_enabled) ? 0x1 : 0x3;
+	if (fi.rs1 == REG_RA) { // Call
+		RETURN_STACK_PUSH(pc + 4);
+	}
 	pc = address & ~ALIGN_MASK;
+	if (fi.rs1 == 0 && fi.rs2 == REG_RA) { // ret
+		PREDICTED_RETURN();
+	}
 	OVERFLOW_CHECKED_JUMP();
 }
 
@@ -806,3 +877,278 @@ INSTRUCTION(RV32V_BC_VFMUL_VF, rv32v_vfmul_vf) {
 	NEXT_INSTR();
 }
 #endif // RISCV_EXT_VECTOR
+
+/**
+ * Superinstructions
+ * 
+ * The first instruction is executed from the fused entry, after which
+ * the decoder steps into the (unmodified) entry of the second instruction.
+ * Both instructions are always in the same block.
+*/
+
+#define FUSED_BRANCH()                                        \
+	VIEW_INSTR_AS(fi, FasterItype);                           \
+	const bool is_bne = DECODER().get_bytecode() == RV32I_BC_BNE \
+		|| DECODER().get_bytecode() == RV32I_BC_BNE_FW;       \
+	if ((REG(fi.get_rs1()) == REG(fi.get_rs2())) != is_bne) { \
+		PERFORM_BRANCH();                                     \
+	}                                                         \
+	NEXT_BLOCK(4, false);
+
+INSTRUCTION(RV32I_BC_FUSED_LUI_ADDI, rv32i_fused_lui_addi) {
+	{
+		VIEW_INSTR();
+		REG(instr.Utype.rd) = instr.Utype.upper_imm();
+	}
+	FUSED_INSTR();
+	VIEW_INSTR_AS(fi, FasterItype);
+	REG(fi.get_rs1()) = REG(fi.get_rs2()) + fi.signed_imm();
+	NEXT_INSTR();
+}
+INSTRUCTION(RV32I_BC_FUSED_AUIPC_ADDI, rv32i_fused_auipc_addi) {
+	{
+		VIEW_INSTR();
+		REG(instr.Utype.rd) = (pc - DECODER().block_bytes()) + instr.Utype.upper_imm();
+	}
+	FUSED_INSTR();
+	VIEW_INSTR_AS(fi, FasterItype);
+	REG(fi.get_rs1()) = REG(fi.get_rs2()) + fi.signed_imm();
+	NEXT_INSTR();
+}
+INSTRUCTION(RV32I_BC_FUSED_AUIPC_LDW, rv32i_fused_auipc_ldw) {
+	{
+		VIEW_INSTR();
+		REG(instr.Utype.rd) = (pc - DECODER().block_bytes()) + instr.Utype.upper_imm();
+	}
+	FUSED_INSTR();
+	VIEW_INSTR_AS(fi, FasterItype);
+	const auto addr = REG(fi.get_rs2()) + fi.signed_imm();
+	REG(fi.get_rs1()) =
+		(int32_t)CPU().memory().template read<uint32_t>(addr);
+	NEXT_INSTR();
+}
+INSTRUCTION(RV32I_BC_FUSED_AUIPC_JALR, rv32i_fused_auipc_jalr) {
+	{
+		VIEW_INSTR();
+		REG(instr.Utype.rd) = (pc - DECODER().block_bytes()) + instr.Utype.upper_imm();
+	}
+	FUSED_INSTR();
+	VIEW_INSTR_AS(fi, FasterItype);
+	// The JALR reads the AUIPC register, so the target is known
+	// and it was verified to be inside this execute segment.
+	const auto address = REG(fi.rs2) + fi.signed_imm();
+	if (fi.rs1 != 0) {
+		REG(fi.rs1) = pc + 4;
+	}
+	if (fi.rs1 == REG_RA) {
+		RETURN_STACK_PUSH(pc + 4);
+	}
+	if constexpr (VERBOSE_JUMPS) {
+		fprintf(stderr, "AUIPC+JALR PC 0x%lX => 0x%lX\n", long(pc), long(address));
+	}
+	const int32_t offset = address - pc;
+	NEXT_BLOCK(offset, true);
+}
+INSTRUCTION(RV32I_BC_FUSED_ADDI_BRANCH, rv32i_fused_addi_branch) {
+	{
+		VIEW_INSTR_AS(fa, FasterItype);
+		REG(fa.get_rs1()) = REG(fa.get_rs2()) + fa.signed_imm();
+	}
+	FUSED_INSTR();
+	FUSED_BRANCH();
+}
+INSTRUCTION(RV32I_BC_FUSED_SLT_BRANCH, rv32i_fused_slt_branch) {
+	{
+		OP_INSTR();
+		dst = (saddr_t(src1) < saddr_t(src2));
+	}
+	FUSED_INSTR();
+	FUSED_BRANCH();
+}
+INSTRUCTION(RV32I_BC_FUSED_SLTU_BRANCH, rv32i_fused_sltu_branch) {
+	{
+		OP_INSTR();
+		dst = (src1 < src2);
+	}
+	FUSED_INSTR();
+	FUSED_BRANCH();
+}
+INSTRUCTION(RV32I_BC_FUSED_ADD_LDW, rv32i_fused_add_ldw) {
+	{
+		OP_INSTR();
+		dst = src1 + src2;
+	}
+	FUSED_INSTR();
+	VIEW_INSTR_AS(fi, FasterItype);
+	const auto addr = REG(fi.get_rs2()) + fi.signed_imm();
+	REG(fi.get_rs1()) =
+		(int32_t)CPU().memory().template read<uint32_t>(addr);
+	NEXT_INSTR();
+}
+INSTRUCTION(RV32I_BC_FUSED_SH2ADD_LDW, rv32i_fused_sh2add_ldw) {
+	{
+		OP_INSTR();
+		dst = src2 + (src1 << 2);
+	}
+	FUSED_INSTR();
+	VIEW_INSTR_AS(fi, FasterItype);
+	const auto addr = REG(fi.get_rs2()) + fi.signed_imm();
+	REG(fi.get_rs1()) =
+		(int32_t)CPU().memory().template read<uint32_t>(addr);
+	NEXT_INSTR();
+}
+INSTRUCTION(RV32I_BC_FUSED_LDW_LDW, rv32i_fused_ldw_ldw) {
+	{
+		VIEW_INSTR_AS(fa, FasterItype);
+		const auto addr = REG(fa.get_rs2()) + fa.signed_imm();
+		REG(fa.get_rs1()) =
+			(int32_t)CPU().memory().template read<uint32_t>(addr);
+	}
+	FUSED_INSTR();
+	VIEW_INSTR_AS(fi, FasterItype);
+	const auto addr = REG(fi.get_rs2()) + fi.signed_imm();
+	REG(fi.get_rs1()) =
+		(int32_t)CPU().memory().template read<uint32_t>(addr);
+	NEXT_INSTR();
+}
+INSTRUCTION(RV32I_BC_FUSED_STW_STW, rv32i_fused_stw_stw) {
+	{
+		VIEW_INSTR_AS(fa, FasterItype);
+		const auto addr = REG(fa.get_rs1()) + fa.signed_imm();
+		CPU().memory().template write<uint32_t>(addr, REG(fa.get_rs2()));
+	}
+	FUSED_INSTR();
+	VIEW_INSTR_AS(fi, FasterItype);
+	const auto addr = REG(fi.get_rs1()) + fi.signed_imm();
+	CPU().memory().template write<uint32_t>(addr, REG(fi.get_rs2()));
+	NEXT_INSTR();
+}
+
+#ifdef RISCV_64I
+INSTRUCTION(RV64I_BC_FUSED_LUI_ADDIW, rv64i_fused_lui_addiw) {
+	if constexpr (W >= 8) {
+		{
+			VIEW_INSTR();
+			REG(instr.Utype.rd) = instr.Utype.upper_imm();
+		}
+		FUSED_INSTR();
+		VIEW_INSTR_AS(fi, FasterItype);
+		REG(fi.get_rs1()) = (int32_t)
+			((uint32_t)REG(fi.get_rs2()) + fi.signed_imm());
+		NEXT_INSTR();
+	}
+	else UNUSED_FUNCTION();
+}
+INSTRUCTION(RV64I_BC_FUSED_AUIPC_LDD, rv64i_fused_auipc_ldd) {
+	if constexpr (W >= 8) {
+		{
+			VIEW_INSTR();
+			REG(instr.Utype.rd) = (pc - DECODER().block_bytes()) + instr.Utype.upper_imm();
+		}
+		FUSED_INSTR();
+		VIEW_INSTR_AS(fi, FasterItype);
+		const auto addr = REG(fi.get_rs2()) + fi.signed_imm();
+		REG(fi.get_rs1()) =
+			(int64_t)CPU().memory().template read<uint64_t>(addr);
+		NEXT_INSTR();
+	}
+	else UNUSED_FUNCTION();
+}
+INSTRUCTION(RV64I_BC_FUSED_ADD_LDD, rv64i_fused_add_ldd) {
+	if constexpr (W >= 8) {
+		{
+			OP_INSTR();
+			dst = src1 + src2;
+		}
+		FUSED_INSTR();
+		VIEW_INSTR_AS(fi, FasterItype);
+		const auto addr = REG(fi.get_rs2()) + fi.signed_imm();
+		REG(fi.get_rs1()) =
+			(int64_t)CPU().memory().template read<uint64_t>(addr);
+		NEXT_INSTR();
+	}
+	else UNUSED_FUNCTION();
+}
+INSTRUCTION(RV64I_BC_FUSED_SH3ADD_LDD, rv64i_fused_sh3add_ldd) {
+	if constexpr (W >= 8) {
+		{
+			OP_INSTR();
+			dst = src2 + (src1 << 3);
+		}
+		FUSED_INSTR();
+		VIEW_INSTR_AS(fi, FasterItype);
+		const auto addr = REG(fi.get_rs2()) + fi.signed_imm();
+		REG(fi.get_rs1()) =
+			(int64_t)CPU().memory().template read<uint64_t>(addr);
+		NEXT_INSTR();
+	}
+	else UNUSED_FUNCTION();
+}
+INSTRUCTION(RV64I_BC_FUSED_LDD_LDD, rv64i_fused_ldd_ldd) {
+	if constexpr (W >= 8) {
+		{
+			VIEW_INSTR_AS(fa, FasterItype);
+			const auto addr = REG(fa.get_rs2()) + fa.signed_imm();
+			REG(fa.get_rs1()) =
+				(int64_t)CPU().memory().template read<uint64_t>(addr);
+		}
+		FUSED_INSTR();
+		VIEW_INSTR_AS(fi, FasterItype);
+		const auto addr = REG(fi.get_rs2()) + fi.signed_imm();
+		REG(fi.get_rs1()) =
+			(int64_t)CPU().memory().template read<uint64_t>(addr);
+		NEXT_INSTR();
+	}
+	else UNUSED_FUNCTION();
+}
+INSTRUCTION(RV64I_BC_FUSED_STD_STD, rv64i_fused_std_std) {
+	if constexpr (W >= 8) {
+		{
+			VIEW_INSTR_AS(fa, FasterItype);
+			const auto addr = REG(fa.get_rs1()) + fa.signed_imm();
+			CPU().memory().template write<uint64_t>(addr, REG(fa.get_rs2()));
+		}
+		FUSED_INSTR();
+		VIEW_INSTR_AS(fi, FasterItype);
+		const auto addr = REG(fi.get_rs1()) + fi.signed_imm();
+		CPU().memory().template write<uint64_t>(addr, REG(fi.get_rs2()));
+		NEXT_INSTR();
+	}
+	else UNUSED_FUNCTION();
+}
+#endif // RISCV_64I
+
+#ifdef RISCV_EXT_COMPRESSED
+INSTRUCTION(RV32C_BC_FUSED_LDD_LDD, rv32c_fused_ldd_ldd) {
+	if constexpr (W >= 8) {
+		{
+			VIEW_INSTR_AS(fa, FasterItype);
+			const auto addr = REG(fa.get_rs2()) + fa.signed_imm();
+			REG(fa.get_rs1()) =
+				(int64_t)CPU().memory().template read<uint64_t>(addr);
+		}
+		FUSED_C_INSTR();
+		VIEW_INSTR_AS(fi, FasterItype);
+		const auto addr = REG(fi.get_rs2()) + fi.signed_imm();
+		REG(fi.get_rs1()) =
+			(int64_t)CPU().memory().template read<uint64_t>(addr);
+		NEXT_C_INSTR();
+	}
+	else UNUSED_FUNCTION();
+}
+INSTRUCTION(RV32C_BC_FUSED_STD_STD, rv32c_fused_std_std) {
+	if constexpr (W >= 8) {
+		{
+			VIEW_INSTR_AS(fa, FasterItype);
+			const auto addr = REG(fa.get_rs1()) + fa.signed_imm();
+			CPU().memory().template write<uint64_t>(addr, REG(fa.get_rs2()));
+		}
+		FUSED_C_INSTR();
+		VIEW_INSTR_AS(fi, FasterItype);
+		const auto addr = REG(fi.get_rs1()) + fi.signed_imm();
+		CPU().memory().template write<uint64_t>(addr, REG(fi.get_rs2()));
+		NEXT_C_INSTR();
+	}
+	else UNUSED_FUNCTION();
+}
+#endif // RISCV_EXT_COMPRESSED
@@ -36,6 +36,14 @@
 #define RISCV_BRK_MEMORY_SIZE  (16ull << 20) // 16MB
 #endif
 
+#ifndef RISCV_TLB_SIZE
+#define RISCV_TLB_SIZE  16 // Software TLB entries (power of two)
+#endif
+
+#ifndef RISCV_RETURN_STACK_SIZE
+#define RISCV_RETURN_STACK_SIZE  16 // Return-address stack entries (power of two, 0 = off)
+#endif
+
 namespace riscv
 {
 	template <int W> struct Memory;
@@ -68,6 +76,19 @@ namespace riscv
 	};
 	using MachineTranslationOptions = std::variant<MachineTranslationCrossOptions, MachineTranslationEmbeddableCodeOptions>;
 
+	/// @brief Statistics of a managed translation cache directory, shared by
+	/// all the processes that use it. See translation_cache_directory.
+	struct TranslationCacheStatistics
+	{
+		uint64_t hits = 0;
+		uint64_t misses = 0;
+		uint64_t stores = 0;
+		uint64_t evictions = 0;
+		/// @brief The translations currently in the cache, and their total size.
+		uint64_t entries = 0;
+		uint64_t bytes = 0;
+	};
+
 	/// @brief Options passed to Machine constructor
 	/// @tparam W The RISC-V architecture
 	template <int W>
@@ -116,6 +137,26 @@ namespace riscv
 		/// locality and also enables read-write arena if the CMake option is ON.
 		bool use_memory_arena = true;
 
+		/// @brief Back the memory arena with an in-memory file, so that forks can
+		/// map a private copy-on-write view of it and keep using the flat arena.
+		/// @details Linux only. Forks of a machine without a forkable arena
+		/// share the arena with it, and their writes are visible to it.
+		/// The arena is then shared memory: it holds a file descriptor, host
+		/// fork() shares it between processes, and it is accounted as shmem.
+		bool use_forkable_arena = false;
+
+		/// @brief Align the memory arena to 2MB and advise the kernel to back it
+		/// with transparent huge pages, reducing host TLB misses for large guests.
+		/// @details Linux only. A forkable arena is shared memory, which only gets
+		/// huge pages when the host allows it (transparent_hugepage/shmem_enabled).
+		bool use_arena_huge_pages = false;
+
+		/// @brief Allocate the memory arena from the explicitly reserved huge page
+		/// pool (MAP_HUGETLB, see vm.nr_hugepages). Falls back to transparent huge
+		/// pages when the pool is too small. An explicit huge page arena is not
+		/// forkable, and partial page discards are done by zeroing memory.
+		bool use_arena_hugetlb = false;
+
 		/// @brief Enable sharing of execute segments between machines.
 		/// @details This will allow multiple machines to share the same execute
 		/// segment, reducing memory usage and increasing performance.
@@ -123,6 +164,53 @@ namespace riscv
 		/// translated code between machines. (Prevents some optimizations)
 		bool use_shared_execute_segments = true;
 
+		/// @brief Fuse common pairs of instructions into superinstructions
+		/// when generating the decoder cache, eg. LUI+ADDI or AUIPC+JALR.
+		/// @details Each fused pair is dispatched once instead of twice.
+		/// Instruction counting is unaffected. A shared execute segment
+		/// keeps the setting of the machine that created it.
+		bool fuse_instructions = true;
+
+		/// @brief Run the machine with tail-call (musttail) dispatch instead of
+		/// the threaded or switch-based dispatch.
+		/// @details Only available when the library is built with
+		/// RISCV_TAILCALL_DISPATCH (Clang 13+), otherwise it is ignored.
+		/// Can be changed between simulate() calls through options().
+		/// Off by default, as it is still experimental.
+		bool use_tailcall_dispatch = false;
+
+		/// @brief Decode each page of an execute segment the first time
+		/// execution enters it, instead of decoding the whole segment up front.
+		/// @details Large programs often run only a small part of their code.
+		/// The number of decoded pages is reported by decoded_pages() of the
+		/// execute segment. Blocks end at page boundaries in this mode. With
+		/// binary translation enabled, segments are always decoded up front.
+		bool lazy_decoding = false;
+
+		/// @brief The number of threads used to generate the decoder cache
+		/// of a large execute segment. 0 means one thread per CPU core.
+		/// @details The segment is split into page-aligned chunks that are
+		/// decoded on a shared thread pool. The resulting decoder cache is
+		/// identical to the one produced by a single thread. Small segments
+		/// are always decoded on the calling thread.
+		unsigned decoder_threads = 1;
+
+		/// @brief Directory where decoded execute segments are stored, so that
+		/// later runs of the same program can load them instead of decoding.
+		/// @details Disabled when empty. Each file is named after the CRC32-C
+		/// of its execute segment, and is validated against the program, the
+		/// build configuration and the bytecode table before use. Not used
+		/// with lazy decoding, ebreak locations or binary translation.
+		std::string decoder_cache_directory {};
+
+		/// @brief Memory budget in bytes for the decoded execute segments of
+		/// a machine. 0 means no limit.
+		/// @details When a new segment goes over the budget, the least recently
+		/// entered segments are evicted and decoded again if they are needed
+		/// later. The current segment is never evicted. There is no limit
+		/// on the number of execute segments.
+		uint64_t execute_segments_memory_max = 0;
+
 		/// @brief Override a default-injected exit function with another function
 		/// that is found by looking up the provided symbol name in the current program.
 		/// Eg. if default_exit_function is "fast_exit", then the ELF binary must have
@@ -152,6 +240,31 @@ namespace riscv
 		bool translate_invoke_compiler = false;
 #else
 		bool translate_invoke_compiler = true;
+#endif
+		/// @brief The number of compiler invocations a large translation is split
+		/// into, when compiling with the system compiler. 0 means one per CPU core.
+		/// @details The shards are compiled concurrently and linked into one shared
+		/// object. Small translations are always compiled in one invocation.
+		unsigned translate_compiler_shards = 1;
+#ifdef RISCV_NATIVE_JIT
+		/// @brief Translate directly into x86-64 machine code instead of invoking a compiler.
+		/// @details Embedded and previously compiled translations are still preferred.
+		/// Only 32- and 64-bit machines are translated by the native JIT.
+		bool translate_native_jit = true;
+#endif
+#ifdef RISCV_TIERED_TRANSLATION
+		/// @brief Translate execute segments once they become hot, instead of when they are loaded.
+		/// @details Segments start out interpreted. When a block has been entered
+		/// translate_tier1_threshold times, the code that has run so far is translated with
+		/// the fast backend (the native JIT or libtcc) and live-patched in. When translated
+		/// code has retired translate_tier2_threshold instructions from one entry point, the
+		/// blocks that reached the first threshold are compiled with the system compiler through
+		/// translate_background_callback, and replace their fast translations while running.
+		/// Without a background callback, execution stays on the fast backend.
+		/// Existing translations in the translation cache are still loaded directly.
+		bool translate_tiered = true;
+		uint64_t translate_tier1_threshold = 1'000;
+		uint64_t translate_tier2_threshold = 100'000'000;
 #endif
 		/// @brief Enable tracing during emulation of the binary translated parts of the program.
 		bool translate_trace  = false;
@@ -161,6 +274,15 @@ namespace riscv
 		/// Translated shared objects will be stored in a file and can be re-used later.
 		/// @details When TCC is enabled, the translation cache will be disabled.
 		bool translation_cache = true;
+		/// @brief Keep translations in a managed cache directory, instead of using
+		/// translation_prefix and translation_suffix.
+		/// @details An index in the directory records the hash, compiler flags, translator
+		/// version, size and last use of each translation. Translations produced with other
+		/// compiler flags or another version are discarded, and the least recently used ones
+		/// are evicted to stay within translation_cache_max_bytes. Processes sharing the
+		/// directory never compile the same translation at the same time.
+		std::string translation_cache_directory {};
+		uint64_t translation_cache_max_bytes = 256ull << 20; // 256MB
 		/// @brief Enable the use of the memory arena for the binary translator.
 		/// @details If disabled, remote machines will be able to make remote
 		/// calls to this machine. In most cases, this is not needed.
@@ -224,6 +346,8 @@ namespace riscv
 		/// @note The hash is a CRC32-C of the execute segment + emulator settings.
 		/// @note The hash can be found with machine.current_execute_segment().translation_hash()
 		static std::string translation_filename(const std::string& prefix, uint32_t hash, const std::string& suffix);
+		/// @brief Read the statistics of a managed translation cache directory.
+		static TranslationCacheStatistics translation_cache_statistics(const std::string& directory);
 
 #ifdef RISCV_LIBTCC
 		/// @brief Provide a custom libtcc1 location for the binary translator.
@@ -236,12 +360,41 @@ namespace riscv
 
 	static constexpr size_t PageSize = RISCV_PAGE_SIZE;
 	static constexpr size_t PageMask = RISCV_PAGE_SIZE-1;
+	static constexpr unsigned TLBSize = RISCV_TLB_SIZE;
+	static constexpr unsigned ReturnStackSize = RISCV_RETURN_STACK_SIZE;
+	static constexpr bool return_stack_enabled = ReturnStackSize > 0;
 
 #ifdef RISCV_MEMORY_TRAPS
 	static constexpr bool memory_traps_enabled = true;
 #else
 	static constexpr bool memory_traps_enabled = false;
 #endif
+#ifdef RISCV_TLB_STATS
+	static constexpr bool tlb_stats_enabled = true;
+#else
+	static constexpr bool tlb_stats_enabled = false;
+#endif
+#ifdef RISCV_RETURN_STACK_STATS
+	static constexpr bool return_stack_stats_enabled = true;
+#else
+	static constexpr bool return_stack_stats_enabled = false;
+#endif
+#ifdef RISCV_BLOCK_PROFILING
+	static constexpr bool block_profiling_enabled = true;
+#else
+	static constexpr bool block_profiling_enabled = false;
+#endif
+#ifdef RISCV_TIERED_TRANSLATION
+	static constexpr bool tiered_translation_enabled = true;
+	static_assert(block_profiling_enabled, "Tiered translation requires block profiling");
+#else
+	static constexpr bool tiered_translation_enabled = false;
+#endif
+#ifdef RISCV_TAILCALL_DISPATCH
+	static constexpr bool tailcall_dispatch_enabled = true;
+#else
+	static constexpr bool tailcall_dispatch_enabled = false;
+#endif
 
 #if RISCV_FORCE_ALIGN_MEMORY
 	static constexpr bool force_align_memory = true;
@@ -304,6 +457,11 @@ namespace riscv
 #else
 	static constexpr bool flat_readwrite_arena = false;
 #endif
+#if defined(RISCV_ARENA_DIRTY_TRACKING) && defined(RISCV_FLAT_RW_ARENA)
+	static constexpr bool arena_dirty_tracking = true;
+#else
+	static constexpr bool arena_dirty_tracking = false;
+#endif
 #ifdef RISCV_ENCOMPASSING_ARENA_BITS
 	static constexpr int encompassing_Nbit_arena = RISCV_ENCOMPASSING_ARENA_BITS;
 	static constexpr uint64_t encompassing_arena_mask = (1ull << RISCV_ENCOMPASSING_ARENA_BITS) - 1;
@@ -321,6 +479,11 @@ namespace riscv
 #else
 	static constexpr bool libtcc_enabled = false;
 #endif
+#ifdef RISCV_NATIVE_JIT
+	static constexpr bool native_jit_enabled = true;
+#else
+	static constexpr bool native_jit_enabled = false;
+#endif
 
 
 	template <int W> struct MultiThreading;
@@ -49,6 +49,14 @@ namespace riscv
 		this->registers().copy_from(Registers<W>::Options::NoVectors, other.cpu.registers());
 	}
 	template <int W>
+	void CPU<W>::reset_to_parent(const CPU<W>& parent)
+	{
+		this->registers().copy_from(Registers<W>::Options::NoVectors, parent.registers());
+		this->m_exec = parent.m_exec;
+		this->m_cache = {};
+		this->m_return_stack.clear();
+	}
+	template <int W>
 	void CPU<W>::reset()
 	{
 		this->m_regs = {};
@@ -80,6 +88,7 @@ namespace riscv
 		// Create a new *non-initial* execute segment
 		this->m_exec = &machine().memory.create_execute_segment(
 			machine().options(), vdata, begin, vlength, false, is_likely_jit);
+		this->m_return_stack.clear();
 		return *this->m_exec;
 	} // CPU::init_execute_area
 
@@ -88,6 +97,8 @@ namespace riscv
 	{
 		static constexpr int MAX_RESTARTS = 4;
 		int restarts = 0;
+		// Predicted returns belong to the previous execute segment
+		this->m_return_stack.clear();
 restart_next_execute_segment:
 
 		// Immediately look at the page in order to
@@ -201,10 +212,10 @@ restart_next_execute_segment:
 		// Fallback: Read directly from page memory
 		const auto pageno = this->pc() / address_t(Page::size());
 		// Page cache
-		auto& entry = this->m_cache;
+		auto& entry = this->m_cache[pageno & (TLBSize-1)];
 		if (entry.pageno != pageno || entry.page == nullptr) {
 			// delay setting entry until we know it's good!
-			auto e = decltype(m_cache){pageno, &machine().memory.get_exec_pageno(pageno)};
+			auto e = CachedPage<W, const Page>{pageno, &machine().memory.get_exec_pageno(pageno)};
 			if (UNLIKELY(!e.page->attr.exec)) {
 				trigger_exception(EXECUTION_SPACE_PROTECTION_FAULT, this->pc());
 			}
@@ -353,10 +364,14 @@ restart_precise_sim:
 
 		auto* exec = this->m_exec;
 		auto* exec_decoder = exec->decoder_cache();
+		// The page must be decoded first, or decoding it would remove the ebreak
+		if (exec->is_lazily_decoded())
+			machine().memory.decode_execute_page(*exec, addr);
 
 		// Install an ebreak instruction at the given address
 		// This is used to break into the debugger
 		// when the instruction is executed
+		unfuse_instruction_before(exec_decoder, exec->exec_begin(), addr);
 		auto& cache_entry = exec_decoder[addr / DecoderCache<W>::DIVISOR];
 		cache_entry.set_bytecode(RV32I_BC_SYSTEM);
 		const auto old_instruction = cache_entry.instr;
@@ -2,6 +2,7 @@
 #include "common.hpp"
 #include "page.hpp"
 #include "registers.hpp"
+#include "return_stack.hpp"
 #ifdef RISCV_EXT_ATOMICS
 #include "rva.hpp"
 #endif
@@ -27,8 +28,10 @@ namespace riscv
 		// 2. Threaded: Uses computed gotos to jump around at a faster speed, but
 		//    is only supported on GCC and Clang. Very fast dispatch.
 		// 3. TCO: Uses musttail to jump around at the fastest speed, but
-		//    is only supported on Clang. Very fast dispatch.
-		/// Executes RISC-V code using the configure-time dispatch mode.
+		//    is only supported on Clang. Very fast dispatch. It is built in
+		//    addition to 1. or 2., and is selected per machine with
+		//    MachineOptions::use_tailcall_dispatch.
+		/// Executes RISC-V code using the dispatch mode of the machine.
 		/// @param pc The starting address
 		/// @param icounter The instruction counter start value (usually 0)
 		/// @param maxcounter The instruction limit value (usually several millions)
@@ -41,6 +44,12 @@ namespace riscv
 		/// @param pc The starting address
 		void simulate_inaccurate(address_t pc);
 
+#ifdef RISCV_TAILCALL_DISPATCH
+		// The tail-call dispatch implementations of simulate() and simulate_inaccurate()
+		bool simulate_tailcall(address_t pc, uint64_t icounter, uint64_t maxcounter);
+		void simulate_tailcall_inaccurate(address_t pc);
+#endif
+
 		// Step precisely one instruction forward from current PC.
 		void step_one(bool use_instruction_counter = true);
 
@@ -120,15 +129,23 @@ namespace riscv
 		// Binary translation functions
 		int  load_translation(const MachineOptions<W>&, std::string* filename, DecodedExecuteSegment<W>&) const;
 		void try_translate(const MachineOptions<W>&, const std::string&, std::shared_ptr<DecodedExecuteSegment<W>>&) const;
+#ifdef RISCV_TIERED_TRANSLATION
+		// Tiered translation: Translate the segment when it becomes hot, returns false if not possible
+		bool defer_translation(const MachineOptions<W>&, DecodedExecuteSegment<W>&) const;
+		// Called from dispatch when a block count reaches the next tier threshold
+		void tier_up(DecodedExecuteSegment<W>&) RISCV_COLD_PATH();
+#endif
 
 		void reset();
 		void reset_stack_pointer() noexcept;
+		// Restore registers and execute segment from the CPU this one was forked from
+		void reset_to_parent(const CPU& parent);
 
 		CPU(Machine<W>&, unsigned cpu_id);
 		CPU(Machine<W>&, unsigned cpu_id, const Machine<W>& other); // Fork
 
 		DecodedExecuteSegment<W>& init_execute_area(const void* data, address_t begin, address_t length, bool is_likely_jit = false);
-		void set_execute_segment(DecodedExecuteSegment<W>& seg) noexcept { m_exec = &seg; }
+		void set_execute_segment(DecodedExecuteSegment<W>& seg) noexcept { m_exec = &seg; m_return_stack.clear(); }
 		auto& current_execute_segment() noexcept { return *m_exec; }
 		auto& current_execute_segment() const noexcept { return *m_exec; }
 		struct NextExecuteReturn {
@@ -139,6 +156,12 @@ namespace riscv
 		static std::shared_ptr<DecodedExecuteSegment<W>>& empty_execute_segment() noexcept;
 		bool is_executable(address_t addr) const noexcept;
 
+		// Return-address stack used to predict function returns during dispatch
+		auto& return_stack() noexcept { return m_return_stack; }
+		// Predicted return hit/miss counters (requires RISCV_RETURN_STACK_STATS)
+		const auto& return_stack_stats() const noexcept { return m_return_stack.stats(); }
+		void reset_return_stack_stats() noexcept { m_return_stack.reset_stats(); }
+
 		//-- Debugging functions --//
 		/// @brief Install a breakpoint at a specific address, returning the old instruction
 		uint32_t install_ebreak_at(address_t addr);
@@ -168,8 +191,11 @@ namespace riscv
 		// ELF programs linear .text segment (initialized as empty segment)
 		DecodedExecuteSegment<W>* m_exec;
 
-		// Page cache for execution on virtual memory
-		mutable CachedPage<W, const Page> m_cache;
+		// Direct-mapped page cache for execution on virtual memory
+		mutable std::array<CachedPage<W, const Page>, TLBSize> m_cache;
+
+		// Return addresses of calls made in the current execute segment
+		ReturnStack<W, (ReturnStackSize > 0) ? ReturnStackSize : 1> m_return_stack;
 
 		const unsigned m_cpuid;
 
@@ -192,6 +218,10 @@ namespace riscv
 		static void activate_dylib(const MachineOptions<W>&, DecodedExecuteSegment<W>&, void*, void*, bool, bool) RISCV_INTERNAL;
 		static bool initialize_translated_segment(DecodedExecuteSegment<W>&, void*, void*, bool) RISCV_INTERNAL;
 		static void produce_embeddable_code(const MachineOptions<W>&, DecodedExecuteSegment<W>&, const TransOutput<W>&, const MachineTranslationEmbeddableCodeOptions&) RISCV_INTERNAL;
+#ifdef RISCV_NATIVE_JIT
+		void emit_native(const MachineOptions<W>&, const std::vector<TransInfo<W>>&, const CallbackTable<W>&, NativeTranslation<W>&) const;
+		static void activate_native(const MachineOptions<W>&, DecodedExecuteSegment<W>&, NativeTranslation<W>&, bool) RISCV_INTERNAL;
+#endif
 #endif
 		static_assert((W == 4 || W == 8 || W == 16), "Must be either 32-bit, 64-bit or 128-bit ISA");
 	};
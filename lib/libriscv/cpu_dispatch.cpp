@@ -40,6 +40,25 @@ namespace riscv
 #define NEXT_C_INSTR() \
 	decoder += 1;      \
 	EXECUTE_INSTR();
+// Step into the second instruction of a fused pair
+#define FUSED_INSTR()                 \
+	if constexpr (compressed_enabled) \
+		decoder += 2;                 \
+	else                              \
+		decoder += 1;
+#define FUSED_C_INSTR() \
+	decoder += 1;
+
+// Count the entries of each block when profiling
+#ifdef RISCV_TIERED_TRANSLATION
+#define BLOCK_PROFILE()                                          \
+	if (UNLIKELY(exec->tier_count(decoder - exec_decoder, 1)))  \
+		this->tier_up(*exec);
+#else
+#define BLOCK_PROFILE()                          \
+	if constexpr (block_profiling_enabled)       \
+		exec->count_block(decoder - exec_decoder);
+#endif
 
 #define NEXT_BLOCK(len, OF)                 \
 	pc += len;                              \
@@ -50,6 +69,7 @@ namespace riscv
 		if (UNLIKELY(counter.overflowed())) \
 			goto check_jump;				\
 	}										\
+	BLOCK_PROFILE();                                         \
 	pc += decoder->block_bytes();                            \
 	counter.increment_counter(decoder->instruction_count()); \
 	EXECUTE_INSTR();
@@ -61,6 +81,7 @@ namespace riscv
 
 #define NEXT_SEGMENT()                                       \
 	decoder = &exec_decoder[pc >> DecoderCache<W>::SHIFT];  \
+	BLOCK_PROFILE();                                         \
 	pc += decoder->block_bytes();                            \
 	counter.increment_counter(decoder->instruction_count()); \
 	EXECUTE_INSTR();
@@ -80,6 +101,31 @@ namespace riscv
 #define OVERFLOW_CHECKED_JUMP() \
 	goto check_jump
 
+// Remember the return address of a call
+#define RETURN_STACK_PUSH(addr)                                 \
+	if constexpr (return_stack_enabled) {                       \
+		const addr_t ret_addr = (addr);                         \
+		CPU().return_stack().push(ret_addr,                     \
+			ret_addr - current_begin < current_end - current_begin, \
+			&exec_decoder[ret_addr >> DecoderCache<W>::SHIFT]); \
+	}
+
+// Continue at the predicted decoder entry when a function
+// returns to where it was called from. Falls through on a miss.
+#define PREDICTED_RETURN()                                         \
+	if constexpr (return_stack_enabled) {                          \
+		auto* predicted = CPU().return_stack().pop(pc,             \
+			&exec_decoder[current_begin >> DecoderCache<W>::SHIFT], \
+			&exec_decoder[current_end >> DecoderCache<W>::SHIFT]); \
+		if (LIKELY(predicted != nullptr && !counter.overflowed())) { \
+			decoder = predicted;                                   \
+			BLOCK_PROFILE();                                       \
+			pc += decoder->block_bytes();                          \
+			counter.increment_counter(decoder->instruction_count()); \
+			EXECUTE_INSTR();                                       \
+		}                                                          \
+	}
+
 
 template <int W> DISPATCH_ATTR
 bool CPU<W>::simulate(address_t pc, uint64_t inscounter, uint64_t maxcounter)
@@ -88,6 +134,10 @@ bool CPU<W>::simulate(address_t pc, uint64_t inscounter, uint64_t maxcounter)
 	using addr_t  = address_type<W>;
 	using saddr_t = signed_address_type<W>;
 
+#ifdef RISCV_TAILCALL_DISPATCH
+	if (machine().options().use_tailcall_dispatch)
+		return this->simulate_tailcall(pc, inscounter, maxcounter);
+#endif
 #ifdef DISPATCH_MODE_THREADED
 #include "threaded_bytecode_array.hpp"
 #endif
@@ -115,6 +165,7 @@ bool CPU<W>::simulate(address_t pc, uint64_t inscounter, uint64_t maxcounter)
 continue_segment:
 	decoder = &exec_decoder[pc >> DecoderCache<W>::SHIFT];
 
+	BLOCK_PROFILE();
 	pc += decoder->block_bytes();
 	counter.increment_counter(decoder->instruction_count());
 
@@ -170,6 +221,11 @@ retry_translated_function:
 	// Invoke translated code
 	auto bintr_results = 
 		exec->unchecked_mapping_at(decoder->instr)(*this, cnt, max, pc);
+#ifdef RISCV_TIERED_TRANSLATION
+	// Instructions retired by translated code count towards the next tier
+	if (UNLIKELY(exec->tier_count(decoder - exec_decoder, bintr_results.counter - cnt)))
+		this->tier_up(*exec);
+#endif
 	pc = REGISTERS().pc;
 	cnt = bintr_results.counter;
 	max = bintr_results.max_counter;
@@ -190,8 +246,13 @@ INSTRUCTION(RV32I_BC_LIVEPATCH, execute_livepatch) {
 	pc = pc - decoder->block_bytes();
 	// 2. Find the correct decoder pointer in the patched decoder cache
 	exec_decoder = exec->patched_decoder_cache();
-	decoder = &exec_decoder[pc / DecoderCache<W>::DIVISOR];
-	// 3. Execute the instruction
+	// Predicted returns point into the original decoder cache
+	CPU().return_stack().clear();
+	auto* patched = &exec_decoder[pc / DecoderCache<W>::DIVISOR];
+	// 3. The rest of the original block was already counted
+	counter.increment_counter(patched->instruction_count() - decoder->instruction_count());
+	decoder = patched;
+	// 4. Execute the instruction
 	EXECUTE_INSTR();
 }
 #endif // RISCV_BINARY_TRANSLATION
@@ -243,7 +304,7 @@ check_jump:
 		goto new_execute_segment;
 
 counter_overflow:
-#ifdef RISCV_LIBTCC
+#if defined(RISCV_LIBTCC) || defined(RISCV_NATIVE_JIT)
 	// We need to check if we have a current exception
 	if (UNLIKELY(CPU().has_current_exception()))
 		goto handle_rethrow_exception;
@@ -269,6 +330,17 @@ new_execute_segment: {
 execute_invalid:
 	// Calculate the current PC from the decoder pointer
 	pc = (decoder - exec_decoder) << DecoderCache<W>::SHIFT;
+	// Pages of lazily decoded segments are decoded when first entered
+	if (exec->is_lazily_decoded() && MACHINE().memory.decode_execute_page(*exec, pc)) {
+		counter.increment_counter(-1);
+		goto continue_segment;
+	}
+	// JIT pages that were written to are decoded again on their own
+	if (exec->is_likely_jit() && MACHINE().memory.refresh_execute_page(*exec, pc)
+		&& MACHINE().memory.decode_execute_page(*exec, pc)) {
+		counter.increment_counter(-1);
+		goto continue_segment;
+	}
 	// Check if the instruction is still invalid
 	try {
 		if (exec->is_likely_jit() && MACHINE().memory.template read<uint16_t>(pc) != uint16_t(decoder->instr)) {
@@ -280,7 +352,7 @@ execute_invalid:
 	registers().pc = pc;
 	trigger_exception(ILLEGAL_OPCODE, decoder->instr);
 
-#ifdef RISCV_LIBTCC
+#if defined(RISCV_LIBTCC) || defined(RISCV_NATIVE_JIT)
 handle_rethrow_exception:
 	// We have an exception, so we need to rethrow it
 	const auto except = CPU().current_exception();
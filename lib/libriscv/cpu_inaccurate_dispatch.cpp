@@ -29,6 +29,9 @@ namespace riscv
 #undef PERFORM_BRANCH
 #undef PERFORM_FORWARD_BRANCH
 #undef OVERFLOW_CHECKED_JUMP
+#undef RETURN_STACK_PUSH
+#undef PREDICTED_RETURN
+#undef BLOCK_PROFILE
 
 #define VIEW_INSTR() \
 	auto instr = *(rv32i_instruction *)&decoder->instr;
@@ -44,11 +47,23 @@ namespace riscv
 	decoder += 1;      \
 	EXECUTE_INSTR();
 
+// Count the entries of each block when profiling
+#ifdef RISCV_TIERED_TRANSLATION
+#define BLOCK_PROFILE()                                          \
+	if (UNLIKELY(exec->tier_count(decoder - exec_decoder, 1)))  \
+		this->tier_up(*exec);
+#else
+#define BLOCK_PROFILE()                          \
+	if constexpr (block_profiling_enabled)       \
+		exec->count_block(decoder - exec_decoder);
+#endif
+
 #define NEXT_BLOCK(len, OF)                                    \
 	pc += len;                                                 \
 	decoder += len >> DecoderCache<W>::SHIFT;                  \
 	if constexpr (FUZZING) /* Give OOB-aid to ASAN */          \
 		decoder = &exec_decoder[pc >> DecoderCache<W>::SHIFT]; \
+	BLOCK_PROFILE();                                           \
 	pc += decoder->block_bytes();                              \
 	EXECUTE_INSTR();
 
@@ -58,6 +73,7 @@ namespace riscv
 
 #define NEXT_SEGMENT()                                       \
 	decoder = &exec_decoder[pc >> DecoderCache<W>::SHIFT];   \
+	BLOCK_PROFILE();                                         \
 	pc += decoder->block_bytes();                            \
 	EXECUTE_INSTR();
 
@@ -74,6 +90,27 @@ namespace riscv
 	else                                                          \
 		goto new_execute_segment;
 
+#define RETURN_STACK_PUSH(addr)                                 \
+	if constexpr (return_stack_enabled) {                       \
+		const addr_t ret_addr = (addr);                         \
+		CPU().return_stack().push(ret_addr,                     \
+			ret_addr - current_begin < current_end - current_begin, \
+			&exec_decoder[ret_addr >> DecoderCache<W>::SHIFT]); \
+	}
+
+#define PREDICTED_RETURN()                              \
+	if constexpr (return_stack_enabled) {               \
+		auto* predicted = CPU().return_stack().pop(pc,  \
+			&exec_decoder[current_begin >> DecoderCache<W>::SHIFT], \
+			&exec_decoder[current_end >> DecoderCache<W>::SHIFT]); \
+		if (LIKELY(predicted != nullptr)) {             \
+			decoder = predicted;                        \
+			BLOCK_PROFILE();                            \
+			pc += decoder->block_bytes();               \
+			EXECUTE_INSTR();                            \
+		}                                               \
+	}
+
 	template <int W>
 	DISPATCH_ATTR void CPU<W>::simulate_inaccurate(address_t pc)
 	{
@@ -81,6 +118,10 @@ namespace riscv
 		using addr_t = address_type<W>;
 		using saddr_t = signed_address_type<W>;
 
+#ifdef RISCV_TAILCALL_DISPATCH
+		if (machine().options().use_tailcall_dispatch)
+			return this->simulate_tailcall_inaccurate(pc);
+#endif
 #ifdef DISPATCH_MODE_THREADED
 #include "threaded_bytecode_array.hpp"
 #endif
@@ -108,6 +149,7 @@ namespace riscv
 	continue_segment:
 		decoder = &exec_decoder[pc >> DecoderCache<W>::SHIFT];
 
+		BLOCK_PROFILE();
 		pc += decoder->block_bytes();
 
 #ifdef DISPATCH_MODE_SWITCH_BASED
@@ -160,6 +202,11 @@ retry_translated_function:
 	// Invoke translated code
 	auto bintr_results =
 		exec->unchecked_mapping_at(decoder->instr)(*this, 0, 1, pc);
+#ifdef RISCV_TIERED_TRANSLATION
+	// Instructions retired by translated code count towards the next tier
+	if (UNLIKELY(exec->tier_count(decoder - exec_decoder, bintr_results.counter)))
+		this->tier_up(*exec);
+#endif
 	pc = REGISTERS().pc;
 	if (LIKELY(bintr_results.max_counter != 0 && (pc - current_begin < current_end - current_begin)))
 	{
@@ -181,6 +228,8 @@ INSTRUCTION(RV32I_BC_LIVEPATCH, execute_livepatch) {
 	pc = pc - decoder->block_bytes();
 	// 2. Find the correct decoder pointer in the patched decoder cache
 	exec_decoder = exec->patched_decoder_cache();
+	// Predicted returns point into the original decoder cache
+	CPU().return_stack().clear();
 	decoder = &exec_decoder[pc / DecoderCache<W>::DIVISOR];
 	// 3. Execute the instruction
 	EXECUTE_INSTR();
@@ -242,7 +291,7 @@ INSTRUCTION(RV32I_BC_STOP, rv32i_stop)
 
 #ifdef RISCV_BINARY_TRANSLATION
 	exit_check:
-#ifdef RISCV_LIBTCC
+#if defined(RISCV_LIBTCC) || defined(RISCV_NATIVE_JIT)
 		// We need to check if we have a current exception
 		if (UNLIKELY(CPU().has_current_exception()))
 			goto handle_rethrow_exception;
@@ -253,6 +302,13 @@ INSTRUCTION(RV32I_BC_STOP, rv32i_stop)
 	execute_invalid:
 		// Calculate the current PC from the decoder pointer
 		pc = (decoder - exec_decoder) << DecoderCache<W>::SHIFT;
+		// Pages of lazily decoded segments are decoded when first entered
+		if (exec->is_lazily_decoded() && MACHINE().memory.decode_execute_page(*exec, pc))
+			goto continue_segment;
+		// JIT pages that were written to are decoded again on their own
+		if (exec->is_likely_jit() && MACHINE().memory.refresh_execute_page(*exec, pc)
+			&& MACHINE().memory.decode_execute_page(*exec, pc))
+			goto continue_segment;
 		// Check if the instruction is still invalid
 		try {
 			if (exec->is_likely_jit() && MACHINE().memory.template read<uint16_t>(pc) != uint16_t(decoder->instr)) {
@@ -263,7 +319,7 @@ INSTRUCTION(RV32I_BC_STOP, rv32i_stop)
 		registers().pc = pc;
 		trigger_exception(ILLEGAL_OPCODE, decoder->instr);
 
-#if defined(RISCV_BINARY_TRANSLATION) && defined(RISCV_LIBTCC)
+#if defined(RISCV_BINARY_TRANSLATION) && (defined(RISCV_LIBTCC) || defined(RISCV_NATIVE_JIT))
 	handle_rethrow_exception:
 		// We have an exception, so we need to rethrow it
 		const auto except = CPU().current_exception();
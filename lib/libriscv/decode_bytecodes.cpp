@@ -447,6 +447,9 @@ size_t CPU<W>::computed_index_for(rv32i_instruction instr) noexcept
 			}
 			return RV32I_BC_SYSTEM;
 		case RV32I_FENCE:
+			// FENCE.I re-reads code written by the program
+			if (instr.Itype.funct3 == 0x1)
+				return RV32I_BC_FUNCTION;
 			return RV32I_BC_NOP;
 		case RV32F_LOAD: {
 			const rv32f_instruction fi{instr};
@@ -1,13 +1,45 @@
 #pragma once
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
 #include "types.hpp"
 #include <unordered_set>
+#include <vector>
 
 namespace riscv
 {
 	template<int W> struct DecoderCache;
 	template<int W> struct DecoderData;
 
+	// State of an execute segment that is decoded one page at a time
+	template <int W>
+	struct LazyDecoding
+	{
+		static constexpr uint8_t PAGE_DECODED = 0x1;
+		// The page starts with the second half of an instruction
+		static constexpr uint8_t PAGE_CONTINUES = 0x2;
+
+		std::mutex mutex;
+		std::vector<uint8_t> pages;
+		std::atomic<size_t> decoded_pages = 0;
+		// Decoding options of the machine that created the segment
+		bool fuse_instructions = false;
+		std::unordered_set<address_type<W>> ebreak_locations;
+	};
+
+	// State of an execute segment that is translated once it becomes hot
+	template <int W>
+	struct TieredTranslation
+	{
+		std::mutex mutex;
+		// 0: Interpreted, 1: Fast translation, 2: Optimizing compilation started
+		unsigned tier = 0;
+		// Output filename of the optimizing compilation
+		std::string filename;
+	};
+
 	// A fully decoded execute segment
 	template <int W>
 	struct DecodedExecuteSegment
@@ -46,6 +78,24 @@ namespace riscv
 		}
 		void set_decoder(DecoderData<W>* dec) { m_exec_decoder = dec; }
 
+		// Block profiling: Execution counts indexed like the decoder cache
+		auto* block_counts() noexcept { return m_exec_block_counts; }
+		const auto* block_counts() const noexcept { return m_exec_block_counts; }
+		void create_block_counts(size_t entries, size_t first_index) {
+			m_block_counts.reset(new uint64_t[entries] {});
+			m_exec_block_counts = m_block_counts.get() - first_index;
+		}
+		// Machines sharing the segment count blocks concurrently
+		uint64_t count_block(size_t index, uint64_t n = 1) noexcept {
+			return std::atomic_ref<uint64_t>(m_exec_block_counts[index]).fetch_add(n, std::memory_order_relaxed);
+		}
+
+		// Lazily decoded segments decode each page the first time it is entered
+		bool is_lazily_decoded() const noexcept { return m_lazy != nullptr; }
+		auto* lazy_decoding() noexcept { return m_lazy.get(); }
+		void set_lazy_decoding(std::unique_ptr<LazyDecoding<W>> lazy) { m_lazy = std::move(lazy); }
+		size_t decoded_pages() const noexcept { return m_lazy ? m_lazy->decoded_pages.load() : m_decoder_cache_size; }
+
 		size_t size_bytes() const noexcept {
 			return sizeof(*this) + m_exec_pagedata_size + m_decoder_cache_size; // * sizeof(DecoderCache<W>);
 		}
@@ -62,17 +112,46 @@ namespace riscv
 		void set_crc32c_hash(uint32_t hash) { m_crc32c_hash = hash; }
 
 #ifdef RISCV_BINARY_TRANSLATION
-		bool is_binary_translated() const noexcept { return !m_translator_mappings.empty(); }
+		bool is_binary_translated() const noexcept { return m_translator_mapping_count != 0; }
 		bool is_libtcc() const noexcept { return m_is_libtcc; }
 		void* binary_translation_so() const { return m_bintr_dl; }
 		void set_binary_translated(void* dl, bool is_libtcc) const { m_bintr_dl = dl; m_is_libtcc = is_libtcc; }
 		uint32_t translation_hash() const { return m_bintr_hash; }
 		void set_translation_hash(uint32_t hash) { m_bintr_hash = hash; }
-		void create_mappings(size_t mappings) { m_translator_mappings.resize(mappings); }
-		void set_mapping(unsigned i, bintr_block_func<W> handler) { m_translator_mappings.at(i) = handler; }
-		bintr_block_func<W> mapping_at(unsigned i) const { return m_translator_mappings.at(i); }
-		bintr_block_func<W> unchecked_mapping_at(unsigned i) const { return m_translator_mappings[i]; }
-		size_t translator_mappings() const noexcept { return m_translator_mappings.size(); }
+		void create_mappings(size_t mappings) {
+			m_translator_mappings.reset(new std::atomic<bintr_block_func<W>>[mappings] {});
+			m_translator_mapping_count = mappings;
+		}
+		void set_mapping(unsigned i, bintr_block_func<W> handler) {
+			mapping_slot(i).store(handler, std::memory_order_relaxed);
+		}
+		bintr_block_func<W> mapping_at(unsigned i) const {
+			return mapping_slot(i).load(std::memory_order_acquire);
+		}
+		bintr_block_func<W> unchecked_mapping_at(unsigned i) const {
+			return m_translator_mappings[i].load(std::memory_order_acquire);
+		}
+		// Replace an active mapping, which is picked up by running machines on their next call.
+		// The release store publishes the new code, and everything it was initialized with.
+		void replace_mapping(unsigned i, bintr_block_func<W> handler) {
+			mapping_slot(i).store(handler, std::memory_order_release);
+		}
+		size_t translator_mappings() const noexcept { return m_translator_mapping_count; }
+#ifdef RISCV_NATIVE_JIT
+		// Native machine code is owned by the segment
+		void set_native_code(std::shared_ptr<void> code) { m_native_code = std::move(code); }
+#endif
+#ifdef RISCV_TIERED_TRANSLATION
+		// Tiered translation: Adds to a block count, returning true when it reaches the next tier
+		bool tier_count(size_t index, uint64_t n) noexcept {
+			// Compared on the value before the add, so only one machine tiers up
+			const uint64_t previous = count_block(index, n);
+			return previous < m_tier_threshold && previous + n >= m_tier_threshold;
+		}
+		void set_tier_threshold(uint64_t threshold) noexcept { m_tier_threshold = threshold; }
+		auto* tiered_translation() noexcept { return m_tiered.get(); }
+		void set_tiered_translation(std::unique_ptr<TieredTranslation<W>> tiered) { m_tiered = std::move(tiered); }
+#endif
 		auto* patched_decoder_cache() noexcept { return m_patched_exec_decoder; }
 		void set_patched_decoder_cache(std::unique_ptr<DecoderCache<W>[]> cache, DecoderData<W>* dec)
 			{ m_patched_decoder_cache = std::move(cache); m_patched_exec_decoder = dec; }
@@ -95,6 +174,13 @@ namespace riscv
 		void set_stale(bool is_stale) { m_is_stale = is_stale; }
 
 	private:
+#ifdef RISCV_BINARY_TRANSLATION
+		std::atomic<bintr_block_func<W>>& mapping_slot(unsigned i) const {
+			if (i >= m_translator_mapping_count)
+				throw std::out_of_range("Translator mapping index out of range");
+			return m_translator_mappings[i];
+		}
+#endif
 		address_t m_vaddr_begin = 0;
 		address_t m_vaddr_end   = 0;
 		DecoderData<W>* m_exec_decoder = nullptr;
@@ -110,12 +196,24 @@ namespace riscv
 		// Decoder cache is used to run bytecode simulation at a high speed
 		size_t          m_decoder_cache_size = 0;
 		std::unique_ptr<DecoderCache<W>[]> m_decoder_cache = nullptr;
+		std::unique_ptr<LazyDecoding<W>> m_lazy = nullptr;
+		std::unique_ptr<uint64_t[]> m_block_counts = nullptr;
+		uint64_t* m_exec_block_counts = nullptr;
 
 #ifdef RISCV_BINARY_TRANSLATION
-		std::vector<bintr_block_func<W>> m_translator_mappings;
+		// Mappings are replaced while other machines call through them
+		std::unique_ptr<std::atomic<bintr_block_func<W>>[]> m_translator_mappings = nullptr;
+		size_t m_translator_mapping_count = 0;
 		std::unique_ptr<DecoderCache<W>[]> m_patched_decoder_cache = nullptr;
 		DecoderData<W>* m_patched_exec_decoder = nullptr;
 		mutable void* m_bintr_dl = nullptr;
+#ifdef RISCV_NATIVE_JIT
+		std::shared_ptr<void> m_native_code = nullptr;
+#endif
+#ifdef RISCV_TIERED_TRANSLATION
+		std::unique_ptr<TieredTranslation<W>> m_tiered = nullptr;
+		uint64_t m_tier_threshold = UINT64_MAX;
+#endif
 		std::unordered_set<address_t> m_slowpath_addresses;
 		uint32_t m_bintr_hash = 0x0; // CRC32-C of the execute segment + compiler options
 #endif
@@ -156,13 +254,25 @@ namespace riscv
 
 		m_decoder_cache_size = other.m_decoder_cache_size;
 		m_decoder_cache = std::move(other.m_decoder_cache);
+		m_lazy = std::move(other.m_lazy);
+		m_block_counts = std::move(other.m_block_counts);
+		m_exec_block_counts = other.m_exec_block_counts;
 
 #ifdef RISCV_BINARY_TRANSLATION
 		m_translator_mappings = std::move(other.m_translator_mappings);
+		m_translator_mapping_count = other.m_translator_mapping_count;
+		other.m_translator_mapping_count = 0;
 		m_bintr_dl = other.m_bintr_dl;
 		other.m_bintr_dl = nullptr;
 		m_bintr_hash = other.m_bintr_hash;
 		m_is_libtcc = other.m_is_libtcc;
+#ifdef RISCV_NATIVE_JIT
+		m_native_code = std::move(other.m_native_code);
+#endif
+#ifdef RISCV_TIERED_TRANSLATION
+		m_tiered = std::move(other.m_tiered);
+		m_tier_threshold = other.m_tier_threshold;
+#endif
 		m_patched_decoder_cache = std::move(other.m_patched_decoder_cache);
 		m_patched_exec_decoder = other.m_patched_exec_decoder;
 #endif
@@ -7,14 +7,19 @@
 #include "threaded_rewriter.cpp"
 #include "threaded_bytecodes.hpp"
 #include "util/crc32.hpp"
+#include "util/threadpool.h"
+#include <cstdio>
 #include <inttypes.h>
 #include <mutex>
+#include <random>
 #include <unordered_set>
 //#define ENABLE_TIMINGS
 
 namespace riscv
 {
 	static constexpr bool VERBOSE_DECODER = false;
+	// Smaller execute segments are always decoded on the calling thread
+	static constexpr size_t PARALLEL_DECODING_MINIMUM = 256 * 1024;
 #ifdef ENABLE_TIMINGS
 	static inline timespec time_now();
 	static inline long nanodiff(timespec, timespec);
@@ -113,6 +118,16 @@ namespace riscv
 		return false;
 	}
 
+	// All instructions that can modify PC or stop the machine end a block
+	template <int W>
+	static bool is_block_ending(rv32i_instruction instruction) {
+		if (compressed_enabled && instruction.length() == 2)
+			return !is_regular_compressed<W>(instruction.half[0]);
+		const auto opcode = instruction.opcode();
+		return opcode == RV32I_BRANCH || is_stopping_system(instruction)
+			|| opcode == RV32I_JAL || opcode == RV32I_JALR;
+	}
+
 	template <int W>
 	static void realize_fastsim(
 		address_type<W> base_pc, address_type<W> last_pc,
@@ -141,7 +156,6 @@ namespace riscv
 				while (true) {
 					const auto instruction = read_instruction(
 						exec_segment, pc, last_pc);
-					const auto opcode = instruction.opcode();
 					const auto length = instruction.length();
 
 					// Record the instruction
@@ -163,21 +177,16 @@ namespace riscv
 					datalength += length / 2;
 
 					// All opcodes that can modify PC
-					if (length == 2)
-					{
-						if (!is_regular_compressed<W>(instruction.half[0]))
-							break;
-					} else {
-						if (opcode == RV32I_BRANCH || is_stopping_system(instruction)
-							|| opcode == RV32I_JAL || opcode == RV32I_JALR)
-							break;
-					}
+					if (is_block_ending<W>(instruction))
+						break;
 				#ifdef RISCV_BINARY_TRANSLATION
 					if (entry->get_bytecode() == translator_op)
 						break;
 				#endif
-					// Catch-all for SYSTEM and patched EBREAK instructions
-					if (entry->get_bytecode() == RV32I_BC_SYSTEM)
+					// Catch-all for SYSTEM and patched EBREAK instructions,
+					// as well as blocks that were ended at a page boundary
+					if (entry->get_bytecode() == RV32I_BC_SYSTEM
+						|| entry->get_bytecode() == RV32I_BC_FUNCBLOCK)
 						break;
 
 					// A last test for the last instruction, which should have been a block-ending
@@ -249,18 +258,18 @@ namespace riscv
 				const auto instruction = read_instruction(
 					exec_segment, pc, last_pc);
 				auto& entry = exec_decoder[pc / DecoderCache<W>::DIVISOR];
-				const auto opcode = instruction.opcode();
 
 				// All opcodes that can modify PC and stop the machine
-				if (opcode == RV32I_BRANCH || is_stopping_system(instruction)
-					|| opcode == RV32I_JAL || opcode == RV32I_JALR)
+				if (is_block_ending<W>(instruction))
 					idxend = 0;
 			#ifdef RISCV_BINARY_TRANSLATION
 				if (entry.get_bytecode() == translator_op)
 					idxend = 0;
 			#endif
-				// Catch-all for SYSTEM and patched EBREAK instructions
-				if (entry.get_bytecode() == RV32I_BC_SYSTEM)
+				// Catch-all for SYSTEM and patched EBREAK instructions,
+				// as well as blocks that were ended at a page boundary
+				if (entry.get_bytecode() == RV32I_BC_SYSTEM
+					|| entry.get_bytecode() == RV32I_BC_FUNCBLOCK)
 					idxend = 0;
 				// Ends at *one instruction before* the block ends
 				entry.idxend = idxend;
@@ -272,6 +281,499 @@ namespace riscv
 		}
 	}
 
+	template <int W>
+	static unsigned fused_bytecode_for(const DecodedExecuteSegment<W>& exec,
+		address_type<W> pc, const DecoderData<W>& first, const DecoderData<W>& second)
+	{
+		static constexpr unsigned PCAL = compressed_enabled ? 2 : 4;
+		const unsigned next = second.get_bytecode();
+		const bool next_is_branch = next == RV32I_BC_BEQ || next == RV32I_BC_BNE
+			|| next == RV32I_BC_BEQ_FW || next == RV32I_BC_BNE_FW;
+
+		switch (first.get_bytecode()) {
+		case RV32I_BC_LUI: // Constants
+			if (next == RV32I_BC_ADDI)
+				return RV32I_BC_FUSED_LUI_ADDI;
+#ifdef RISCV_64I
+			if (W >= 8 && next == RV64I_BC_ADDIW)
+				return RV64I_BC_FUSED_LUI_ADDIW;
+#endif
+			break;
+		case RV32I_BC_AUIPC: // PC-relative addresses, loads and calls
+			if (next == RV32I_BC_ADDI)
+				return RV32I_BC_FUSED_AUIPC_ADDI;
+			if (next == RV32I_BC_LDW)
+				return RV32I_BC_FUSED_AUIPC_LDW;
+#ifdef RISCV_64I
+			if (W >= 8 && next == RV32I_BC_LDD)
+				return RV64I_BC_FUSED_AUIPC_LDD;
+#endif
+			if (next == RV32I_BC_JALR) {
+				// Calls and tail calls through the AUIPC register
+				// have a known target, which must be in this segment.
+				rv32i_instruction auipc;
+				auipc.whole = first.instr;
+				const FasterItype jalr { second.instr };
+				if (jalr.get_rs2() != auipc.Utype.rd)
+					break;
+				const address_type<W> target =
+					pc + auipc.Utype.upper_imm() + jalr.signed_imm();
+				if (target % PCAL == 0 && exec.is_within(target, 4))
+					return RV32I_BC_FUSED_AUIPC_JALR;
+			}
+			break;
+		case RV32I_BC_ADDI: // Loop counters
+			if (next_is_branch)
+				return RV32I_BC_FUSED_ADDI_BRANCH;
+			break;
+		case RV32I_BC_OP_SLT:
+			if (next_is_branch)
+				return RV32I_BC_FUSED_SLT_BRANCH;
+			break;
+		case RV32I_BC_OP_SLTU:
+			if (next_is_branch)
+				return RV32I_BC_FUSED_SLTU_BRANCH;
+			break;
+		case RV32I_BC_OP_ADD: // Indexed loads
+			if (next == RV32I_BC_LDW)
+				return RV32I_BC_FUSED_ADD_LDW;
+#ifdef RISCV_64I
+			if (W >= 8 && next == RV32I_BC_LDD)
+				return RV64I_BC_FUSED_ADD_LDD;
+#endif
+			break;
+		case RV32I_BC_OP_SH2ADD:
+			if (next == RV32I_BC_LDW)
+				return RV32I_BC_FUSED_SH2ADD_LDW;
+			break;
+#ifdef RISCV_64I
+		case RV32I_BC_OP_SH3ADD:
+			if (W >= 8 && next == RV32I_BC_LDD)
+				return RV64I_BC_FUSED_SH3ADD_LDD;
+			break;
+#endif
+		case RV32I_BC_LDW: // Register save and restore
+			if (next == RV32I_BC_LDW)
+				return RV32I_BC_FUSED_LDW_LDW;
+			break;
+		case RV32I_BC_STW:
+			if (next == RV32I_BC_STW)
+				return RV32I_BC_FUSED_STW_STW;
+			break;
+#ifdef RISCV_64I
+		case RV32I_BC_LDD:
+			if (W >= 8 && next == RV32I_BC_LDD)
+				return RV64I_BC_FUSED_LDD_LDD;
+			break;
+		case RV32I_BC_STD:
+			if (W >= 8 && next == RV32I_BC_STD)
+				return RV64I_BC_FUSED_STD_STD;
+			break;
+#endif
+#ifdef RISCV_EXT_COMPRESSED
+		case RV32C_BC_LDD:
+			if (W >= 8 && next == RV32C_BC_LDD)
+				return RV32C_BC_FUSED_LDD_LDD;
+			break;
+		case RV32C_BC_STD:
+			if (W >= 8 && next == RV32C_BC_STD)
+				return RV32C_BC_FUSED_STD_STD;
+			break;
+#endif
+		}
+		return 0;
+	}
+
+	// Superinstruction fusion: Pairs of instructions that compilers
+	// commonly emit back-to-back are dispatched together from the entry
+	// of the first instruction. The entry of the second instruction is
+	// left unmodified, so that it can still be jumped to. Both instructions
+	// must be in the same block, which leaves instruction counting as-is.
+	template <int W>
+	static size_t fuse_instructions(const DecodedExecuteSegment<W>& exec,
+		address_type<W> base_pc, address_type<W> last_pc,
+		const uint8_t* exec_segment, DecoderData<W>* exec_decoder)
+	{
+		size_t fused = 0;
+		address_type<W> pc = base_pc;
+		while (pc < last_pc)
+		{
+			const auto instruction = read_instruction(exec_segment, pc, last_pc);
+			const unsigned length = compressed_enabled ? instruction.length() : 4;
+			const address_type<W> next_pc = pc + length;
+			auto& first = exec_decoder[pc / DecoderCache<W>::DIVISOR];
+
+			// The first instruction may not end its block
+			if (first.block_bytes() != 0 && next_pc < last_pc)
+			{
+				const auto& second = exec_decoder[next_pc / DecoderCache<W>::DIVISOR];
+				const unsigned bytecode = fused_bytecode_for(exec, pc, first, second);
+				if (bytecode != 0) {
+					first.set_bytecode(bytecode);
+					fused++;
+					// Don't start another pair on the second instruction
+					const auto next = read_instruction(exec_segment, next_pc, last_pc);
+					pc = next_pc + (compressed_enabled ? next.length() : 4);
+					continue;
+				}
+			}
+			pc = next_pc;
+		}
+		return fused;
+	}
+
+	// Decode the instructions from begin to end into the decoder cache
+	template <int W>
+	static void decode_instructions(DecodedExecuteSegment<W>& exec,
+		address_type<W> begin, address_type<W> end,
+		const std::unordered_set<address_type<W>>& ebreak_locations,
+		DecoderData<W>* exec_decoder, bool begins_with_instruction = true)
+	{
+		// PC-relative pointer to instruction bits
+		auto* exec_segment = exec.exec_data();
+		// When compressed instructions are enabled, many decoder
+		// entries are illegal because they between instructions.
+		bool was_full_instruction = begins_with_instruction;
+
+		address_type<W> dst = begin;
+		for (; dst < end;)
+		{
+			auto& entry = exec_decoder[dst / DecoderCache<W>::DIVISOR];
+			entry.m_handler = 0;
+			entry.idxend = 0;
+
+			// Load unaligned instruction from execute segment
+			const auto instruction = read_instruction(
+				exec_segment, dst, exec.exec_end());
+			rv32i_instruction rewritten = instruction;
+
+#ifdef RISCV_BINARY_TRANSLATION
+			// Translator activation uses a special bytecode
+			// but we must still validate the mapping index.
+			if (entry.get_bytecode() == RV32I_BC_TRANSLATOR && entry.is_invalid_handler() && entry.instr < exec.translator_mappings()) {
+				if constexpr (compressed_enabled) {
+					dst += 2;
+					if (was_full_instruction) {
+						was_full_instruction = (instruction.length() == 2);
+					} else {
+						was_full_instruction = true;
+					}
+				} else
+					dst += 4;
+				continue;
+			}
+#endif // RISCV_BINARY_TRANSLATION
+
+			if (was_full_instruction) {
+				// Cache the (modified) instruction bits
+				auto bytecode = CPU<W>::computed_index_for(instruction);
+				// Threaded rewrites are **always** enabled
+				bytecode = exec.threaded_rewrite(bytecode, dst, rewritten);
+				entry.set_bytecode(bytecode);
+				entry.instr = rewritten.whole;
+			} else {
+				// WARNING: If we don't ignore this instruction,
+				// it will get *wrong* idxend values, and cause *invalid jumps*
+				entry = DecoderData<W>{};
+				// ^ Must be made invalid, even if technically possible to jump to!
+			}
+			if constexpr (VERBOSE_DECODER) {
+				if (entry.get_bytecode() >= RV32I_BC_BEQ && entry.get_bytecode() <= RV32I_BC_BGEU) {
+					fprintf(stderr, "Detected branch bytecode at 0x%lX\n", dst);
+				}
+				if (entry.get_bytecode() >= RV32I_BC_BEQ_FW && entry.get_bytecode() <= RV32I_BC_BGEU_FW) {
+					fprintf(stderr, "Detected forward branch bytecode at 0x%lX\n", dst);
+				}
+			}
+
+			if (!ebreak_locations.empty()) {
+				[[unlikely]];
+				if (ebreak_locations.count(dst)) {
+					[[unlikely]];
+					// Insert EBREAK bytecode and handler at ebreak locations
+					entry.set_bytecode(RV32I_BC_SYSTEM);
+					rv32i_instruction ebreak;
+					ebreak.Itype.opcode = RV32I_SYSTEM;
+					ebreak.Itype.funct3 = 0;
+					ebreak.Itype.rd = 0;
+					ebreak.Itype.rs1 = 0;
+					ebreak.Itype.imm = 0x1; // EBREAK
+					entry.instr = ebreak.whole;
+					entry.set_handler(CPU<W>::decode(ebreak));
+				}
+			}
+
+			// Increment PC after everything
+			if constexpr (compressed_enabled) {
+				// With compressed we always step forward 2 bytes at a time
+				dst += 2;
+				if (was_full_instruction) {
+					// For it to be a full instruction again,
+					// the length needs to match.
+					was_full_instruction = (instruction.length() == 2);
+				} else {
+					// If it wasn't a full instruction last time, it
+					// will for sure be one now.
+					was_full_instruction = true;
+				}
+			} else
+				dst += 4;
+		}
+	}
+
+	// Returns the address after the first instruction at or after pc that
+	// always ends its block. No block can continue past this address.
+	template <int W>
+	static address_type<W> next_block_boundary(const DecodedExecuteSegment<W>& exec,
+		address_type<W> pc, const DecoderData<W>* exec_decoder)
+	{
+		auto* exec_segment = exec.exec_data();
+		while (pc < exec.exec_end())
+		{
+			const auto instruction = read_instruction(exec_segment, pc, exec.exec_end());
+			const auto bytecode = exec_decoder[pc / DecoderCache<W>::DIVISOR].get_bytecode();
+			pc += compressed_enabled ? instruction.length() : 4;
+
+			if (is_block_ending<W>(instruction)
+				|| bytecode == RV32I_BC_SYSTEM || bytecode == RV32I_BC_FUNCBLOCK)
+				break;
+		#ifdef RISCV_BINARY_TRANSLATION
+			if (bytecode == RV32I_BC_TRANSLATOR)
+				break;
+		#endif
+		}
+		return std::min(pc, exec.exec_end());
+	}
+
+	// Calls work(0) to work(count-1) from the calling thread and up to
+	// threads-1 threads of a shared thread pool. The first exception
+	// thrown by any work item is rethrown once all items have finished.
+	static void parallel_for(unsigned threads, size_t count, std::function<void(size_t)> work)
+	{
+		struct State {
+			std::function<void(size_t)> work;
+			size_t count;
+			std::atomic<size_t> next = 0;
+			std::mutex mutex;
+			std::condition_variable finished;
+			size_t done = 0;
+			std::exception_ptr exception = nullptr;
+		};
+		auto state = std::make_shared<State>();
+		state->work = std::move(work);
+		state->count = count;
+
+		auto run = [state] {
+			for (size_t i = state->next++; i < state->count; i = state->next++)
+			{
+				std::exception_ptr exception = nullptr;
+				try {
+					state->work(i);
+				} catch (...) {
+					exception = std::current_exception();
+				}
+				std::scoped_lock lock(state->mutex);
+				if (exception && !state->exception)
+					state->exception = exception;
+				if (++state->done == state->count)
+					state->finished.notify_all();
+			}
+		};
+
+		static ThreadPool thread_pool;
+		for (size_t i = 1; i < std::min(size_t(threads), count); i++)
+			thread_pool.enqueue(run);
+		run();
+
+		std::unique_lock lock(state->mutex);
+		state->finished.wait(lock, [&] { return state->done == state->count; });
+		if (state->exception)
+			std::rethrow_exception(state->exception);
+	}
+
+	// Parallel decoding: The segment is split into page-aligned chunks
+	// that are decoded separately. A chunk may begin with the second half
+	// of an instruction, which is found with a quick pass over the
+	// instruction lengths. Blocks are then realized in regions that begin
+	// after a block-ending instruction, so that no block crosses a region.
+	// Blocks are measured from their first instruction, so each region
+	// ends up exactly as if the whole segment was realized at once.
+	template <int W>
+	static void decode_instructions_parallel(DecodedExecuteSegment<W>& exec,
+		unsigned threads, bool fuse,
+		const std::unordered_set<address_type<W>>& ebreak_locations,
+		DecoderData<W>* exec_decoder)
+	{
+		using address_t = address_type<W>;
+		auto* exec_segment = exec.exec_data();
+		const address_t addr = exec.exec_begin();
+		const address_t end  = exec.exec_end();
+		// Aim for a few chunks per thread, so that threads finish together
+		const size_t chunk_pages = std::max(size_t(16),
+			size_t((end - addr) / Page::size() / (threads * 4)));
+		const size_t chunk_size = chunk_pages * Page::size();
+
+		struct Chunk {
+			address_t begin;
+			address_t end;
+			bool begins_with_instruction;
+		};
+		std::vector<Chunk> chunks;
+		for (address_t begin = addr; begin < end;) {
+			const address_t next = (begin - exec.pagedata_base()) / chunk_size * chunk_size
+				+ chunk_size + exec.pagedata_base();
+			chunks.push_back({begin, std::min(next, end), true});
+			begin = next;
+		}
+		if constexpr (compressed_enabled) {
+			size_t chunk = 1;
+			for (address_t dst = addr; dst < end && chunk < chunks.size();) {
+				const bool is_full = (exec_segment[dst] & 0x3) == 0x3;
+				if (dst + 2 == chunks[chunk].begin)
+					chunks[chunk].begins_with_instruction = !is_full;
+				dst += is_full ? 4 : 2;
+				if (dst > chunks[chunk].begin)
+					chunk++;
+			}
+		}
+
+		parallel_for(threads, chunks.size(), [&] (size_t i) {
+			decode_instructions<W>(exec, chunks[i].begin, chunks[i].end,
+				ebreak_locations, exec_decoder, chunks[i].begins_with_instruction);
+		});
+
+		// Regions begin after the first block-ending instruction of each chunk
+		std::vector<address_t> regions { addr };
+		for (size_t i = 1; i < chunks.size(); i++) {
+			address_t begin = chunks[i].begin;
+			if (compressed_enabled && !chunks[i].begins_with_instruction)
+				begin += 2;
+			const address_t boundary = next_block_boundary(exec, begin, exec_decoder);
+			if (boundary > regions.back() && boundary < end)
+				regions.push_back(boundary);
+		}
+		regions.push_back(end);
+
+		parallel_for(threads, regions.size() - 1, [&] (size_t i) {
+			realize_fastsim<W>(regions[i], regions[i + 1], exec_segment, exec_decoder);
+			if (fuse)
+				fuse_instructions<W>(exec, regions[i], regions[i + 1], exec_segment, exec_decoder);
+		});
+	}
+
+	// Persistent decoder cache: The decoded entries of an execute segment
+	// are stored in a file named after its hash. Handler indices are only
+	// valid in the current process, so they are stored as a flag instead,
+	// and the handlers are looked up again from the instruction bits.
+	struct DecoderCacheFileHeader {
+		char     magic[8];
+		uint32_t configuration;
+		uint32_t segment_hash;
+		uint32_t code_hash;
+		uint32_t entries_hash;
+		uint64_t exec_begin;
+		uint64_t exec_end;
+		uint64_t entries;
+	};
+	static constexpr char DECODER_CACHE_MAGIC[8] = {'R', 'V', 'D', 'E', 'C', 'O', 'D', 'E'};
+
+	// Everything the decoded entries depend on, besides the program itself
+	template <int W>
+	static uint32_t decoder_cache_configuration(const MachineOptions<W>& options)
+	{
+		const uint32_t configuration[] = {
+			uint32_t(W), BYTECODE_VERSION, BYTECODES_MAX, uint32_t(sizeof(DecoderData<W>)),
+			uint32_t(PageSize), compressed_enabled, atomics_enabled, vector_extension,
+			binary_translation_enabled, options.fuse_instructions
+		};
+		return crc32c(configuration, sizeof(configuration));
+	}
+
+	template <int W>
+	static std::string decoder_cache_filename(const MachineOptions<W>& options, uint32_t hash)
+	{
+		char buffer[32];
+		const int len = snprintf(buffer, sizeof(buffer), "/rv%d-%08X.decoder", W * 8, hash);
+		return options.decoder_cache_directory + std::string(buffer, len);
+	}
+
+	template <int W>
+	static bool load_decoder_cache(const MachineOptions<W>& options,
+		DecodedExecuteSegment<W>& exec, DecoderData<W>* exec_decoder)
+	{
+		const std::string filename = decoder_cache_filename(options, exec.crc32c_hash());
+		std::unique_ptr<FILE, int(*)(FILE*)> file { fopen(filename.c_str(), "rb"), fclose };
+		if (file == nullptr)
+			return false;
+
+		const size_t entries = (exec.exec_end() - exec.exec_begin()) / DecoderCache<W>::DIVISOR + 1;
+		auto* first = &exec_decoder[exec.exec_begin() / DecoderCache<W>::DIVISOR];
+		DecoderCacheFileHeader header;
+		if (fread(&header, sizeof(header), 1, file.get()) != 1
+			|| std::memcmp(header.magic, DECODER_CACHE_MAGIC, sizeof(header.magic)) != 0
+			|| header.configuration != decoder_cache_configuration(options)
+			|| header.segment_hash != exec.crc32c_hash()
+			|| header.exec_begin != exec.exec_begin() || header.exec_end != exec.exec_end()
+			|| header.entries != entries
+			|| fread(first, sizeof(DecoderData<W>), entries, file.get()) != entries
+			|| header.entries_hash != crc32c(first, entries * sizeof(DecoderData<W>))
+			|| header.code_hash != crc32c(exec.exec_data(exec.exec_begin()), exec.exec_end() - exec.exec_begin()))
+		{
+			if (options.verbose_loader) {
+				printf("libriscv: Ignoring mismatching decoder cache %s\n", filename.c_str());
+			}
+			return false;
+		}
+
+		for (size_t i = 0; i < entries; i++) {
+			if (first[i].m_handler != 0)
+				first[i].set_handler(CPU<W>::decode(rv32i_instruction{first[i].instr}));
+		}
+		if (options.verbose_loader) {
+			printf("libriscv: Loaded decoder cache %s\n", filename.c_str());
+		}
+		return true;
+	}
+
+	template <int W>
+	static void store_decoder_cache(const MachineOptions<W>& options,
+		const DecodedExecuteSegment<W>& exec, const DecoderData<W>* exec_decoder)
+	{
+		const size_t entries = (exec.exec_end() - exec.exec_begin()) / DecoderCache<W>::DIVISOR + 1;
+		std::vector<DecoderData<W>> data(
+			&exec_decoder[exec.exec_begin() / DecoderCache<W>::DIVISOR],
+			&exec_decoder[exec.exec_begin() / DecoderCache<W>::DIVISOR] + entries);
+		for (auto& entry : data)
+			entry.m_handler = (entry.m_handler != 0);
+
+		DecoderCacheFileHeader header;
+		std::memcpy(header.magic, DECODER_CACHE_MAGIC, sizeof(header.magic));
+		header.configuration = decoder_cache_configuration(options);
+		header.segment_hash = exec.crc32c_hash();
+		header.code_hash = crc32c(exec.exec_data(exec.exec_begin()), exec.exec_end() - exec.exec_begin());
+		header.entries_hash = crc32c(data.data(), entries * sizeof(DecoderData<W>));
+		header.exec_begin = exec.exec_begin();
+		header.exec_end = exec.exec_end();
+		header.entries = entries;
+
+		// Write to a temporary file first, so that other processes
+		// never see a partially written decoder cache
+		const std::string filename = decoder_cache_filename(options, exec.crc32c_hash());
+		const std::string temporary = filename + "." + std::to_string(std::random_device{}());
+		FILE* file = fopen(temporary.c_str(), "wb");
+		if (file == nullptr)
+			return;
+		const bool written = fwrite(&header, sizeof(header), 1, file) == 1
+			&& fwrite(data.data(), sizeof(DecoderData<W>), entries, file) == entries;
+		if (fclose(file) != 0 || !written || std::rename(temporary.c_str(), filename.c_str()) != 0) {
+			std::remove(temporary.c_str());
+			return;
+		}
+		if (options.verbose_loader) {
+			printf("libriscv: Stored decoder cache %s\n", filename.c_str());
+		}
+	}
+
 	// The decoder cache is a sequential array of DecoderData<W> entries
 	// each of which (currently) serves a dual purpose of enabling
 	// threaded dispatch (m_bytecode) and fallback to callback function
@@ -319,6 +821,10 @@ namespace riscv
 		auto* exec_decoder = 
 			decoder_cache[0].get_base() - pbase / DecoderCache<W>::DIVISOR;
 		exec.set_decoder(exec_decoder);
+		if constexpr (block_profiling_enabled) {
+			exec.create_block_counts(n_pages * (Page::size() / DecoderCache<W>::DIVISOR),
+				pbase / DecoderCache<W>::DIVISOR);
+		}
 
 		DecoderData<W> invalid_op;
 		invalid_op.set_handler(this->machine().cpu.decode({0}));
@@ -332,16 +838,26 @@ namespace riscv
 		TIME_POINT(t1);
 
 #ifdef RISCV_BINARY_TRANSLATION
+		// Background compilation live-patches the decoder cache, which
+		// must be fully decoded by then, so it is started after decoding
+		std::string bintr_filename;
+		bool translate_after_decoding = false;
 		// We do not support binary translation for RV128I
 		// Also, avoid binary translation for execute segments that are likely JIT-compiled
 		const bool allow_translation = is_initial || options.translate_future_segments;
 		if (!exec.is_binary_translated() && allow_translation && !exec.is_likely_jit()) {
 			// Attempt to load binary translation
 			// Also, fill out the binary translation SO filename for later
-			std::string bintr_filename;
 			int result = machine().cpu.load_translation(options, &bintr_filename, exec);
-			const bool must_translate = result > 0;
-			if (must_translate)
+			bool must_translate = result > 0;
+#ifdef RISCV_TIERED_TRANSLATION
+			// Hot code is translated later, during emulation
+			if (must_translate && machine().cpu.defer_translation(options, exec))
+				must_translate = false;
+#endif
+			if (must_translate && options.translate_background_callback)
+				translate_after_decoding = true;
+			else if (must_translate)
 			{
 				machine().cpu.try_translate(
 					options, bintr_filename, shared_segment);
@@ -364,129 +880,279 @@ namespace riscv
 				}
 			}
 		}
-		const bool has_ebreak_locations = !ebreak_locations.empty();
-
-		// When compressed instructions are enabled, many decoder
-		// entries are illegal because they between instructions.
-		bool was_full_instruction = true;
-
-		/* Generate all instruction pointers for executable code.
-		   Cannot step outside of this area when pregen is enabled,
-		   so it's fine to leave the boundries alone. */
 		TIME_POINT(t2);
-		address_t dst = addr;
-		const address_t end_addr = addr + len;
-		for (; dst < addr + len;)
-		{
-			auto& entry = exec_decoder[dst / DecoderCache<W>::DIVISOR];
-			entry.m_handler = 0;
-			entry.idxend = 0;
-
-			// Load unaligned instruction from execute segment
-			const auto instruction = read_instruction(
-				exec_segment, dst, end_addr);
-			rv32i_instruction rewritten = instruction;
-
+		// JIT segments are always decoded lazily, so that pages
+		// written by the program can be decoded again on their own.
+		bool lazy = options.lazy_decoding || exec.is_likely_jit();
 #ifdef RISCV_BINARY_TRANSLATION
-			// Translator activation uses a special bytecode
-			// but we must still validate the mapping index.
-			if (entry.get_bytecode() == RV32I_BC_TRANSLATOR && entry.is_invalid_handler() && entry.instr < exec.translator_mappings()) {
-				if constexpr (compressed_enabled) {
-					dst += 2;
-					if (was_full_instruction) {
-						was_full_instruction = (instruction.length() == 2);
-					} else {
-						was_full_instruction = true;
-					}
-				} else
-					dst += 4;
-				continue;
-			}
-#endif // RISCV_BINARY_TRANSLATION
-
-			if (was_full_instruction) {
-				// Cache the (modified) instruction bits
-				auto bytecode = CPU<W>::computed_index_for(instruction);
-				// Threaded rewrites are **always** enabled
-				bytecode = exec.threaded_rewrite(bytecode, dst, rewritten);
-				entry.set_bytecode(bytecode);
-				entry.instr = rewritten.whole;
-			} else {
-				// WARNING: If we don't ignore this instruction,
-				// it will get *wrong* idxend values, and cause *invalid jumps*
-				entry.m_handler = 0;
-				entry.set_bytecode(0);
-				// ^ Must be made invalid, even if technically possible to jump to!
-			}
-			if constexpr (VERBOSE_DECODER) {
-				if (entry.get_bytecode() >= RV32I_BC_BEQ && entry.get_bytecode() <= RV32I_BC_BGEU) {
-					fprintf(stderr, "Detected branch bytecode at 0x%lX\n", dst);
-				}
-				if (entry.get_bytecode() == RV32I_BC_BEQ_FW || entry.get_bytecode() == RV32I_BC_BNE_FW) {
-					fprintf(stderr, "Detected forward branch bytecode at 0x%lX\n", dst);
-				}
-			}
-
-			if (has_ebreak_locations) {
-				[[unlikely]];
-				if (ebreak_locations.count(dst)) {
-					[[unlikely]];
-					// Insert EBREAK bytecode and handler at ebreak locations
-					entry.set_bytecode(RV32I_BC_SYSTEM);
-					rv32i_instruction ebreak;
-					ebreak.Itype.opcode = RV32I_SYSTEM;
-					ebreak.Itype.funct3 = 0;
-					ebreak.Itype.rd = 0;
-					ebreak.Itype.rs1 = 0;
-					ebreak.Itype.imm = 0x1; // EBREAK
-					entry.instr = ebreak.whole;
-					entry.set_handler(CPU<W>::decode(ebreak));
+		// The binary translator needs a fully decoded segment
+		if (!exec.is_likely_jit())
+			lazy = lazy && !options.translate_enabled;
+		lazy = lazy && !exec.is_binary_translated();
+#endif
+		if (lazy)
+		{
+			auto lazy_decoding = std::make_unique<LazyDecoding<W>>();
+			lazy_decoding->pages.resize(n_pages);
+			lazy_decoding->fuse_instructions = options.fuse_instructions;
+			lazy_decoding->ebreak_locations = std::move(ebreak_locations);
+			if constexpr (compressed_enabled) {
+				// A page may start with the second half of an instruction.
+				// Only the instruction lengths are needed to find out.
+				for (address_t dst = addr; dst < addr + len;) {
+					const bool is_full = (exec_segment[dst] & 0x3) == 0x3;
+					if (is_full && (dst + 2) % Page::size() == 0)
+						lazy_decoding->pages[(dst + 2 - pbase) / Page::size()] |= LazyDecoding<W>::PAGE_CONTINUES;
+					dst += is_full ? 4 : 2;
 				}
 			}
+			// Every entry starts out as an invalid instruction, which
+			// decodes its page when it is executed.
+			std::memset(decoder_cache, 0, n_pages * sizeof(DecoderCache<W>));
+			exec.set_lazy_decoding(std::move(lazy_decoding));
+			return;
+		}
 
-			// Increment PC after everything
-			if constexpr (compressed_enabled) {
-				// With compressed we always step forward 2 bytes at a time
-				dst += 2;
-				if (was_full_instruction) {
-					// For it to be a full instruction again,
-					// the length needs to match.
-					was_full_instruction = (instruction.length() == 2);
-				} else {
-					// If it wasn't a full instruction last time, it
-					// will for sure be one now.
-					was_full_instruction = true;
-				}
-			} else
-				dst += 4;
+		/* Generate all instruction pointers for executable code.
+		   Cannot step outside of this area when pregen is enabled,
+		   so it's fine to leave the boundries alone. */
+		bool persistent = !options.decoder_cache_directory.empty() && ebreak_locations.empty();
+#ifdef RISCV_BINARY_TRANSLATION
+		// Translated blocks are activated from the decoder cache
+		persistent = persistent && !exec.is_binary_translated();
+#endif
+		if (persistent && load_decoder_cache(options, exec, exec_decoder)) {
+#ifdef RISCV_BINARY_TRANSLATION
+			if (translate_after_decoding)
+				machine().cpu.try_translate(options, bintr_filename, shared_segment);
+#endif
+			return;
 		}
+
 		// Make sure the last entry is an invalid instruction
 		// This simplifies many other sub-systems
 		auto& entry = exec_decoder[(addr + len) / DecoderCache<W>::DIVISOR];
 		entry.set_bytecode(0);
 		entry.m_handler = 0;
 		entry.idxend = 0;
-		TIME_POINT(t3);
 
-		realize_fastsim<W>(addr, dst, exec_segment, exec_decoder);
+		const unsigned threads = (options.decoder_threads != 0)
+			? options.decoder_threads : std::thread::hardware_concurrency();
+		if (threads > 1 && len >= PARALLEL_DECODING_MINIMUM
+			&& addr % DecoderCache<W>::DIVISOR == 0)
+		{
+			decode_instructions_parallel<W>(exec, threads,
+				options.fuse_instructions, ebreak_locations, exec_decoder);
+		}
+		else
+		{
+			decode_instructions<W>(exec, addr, addr + len, ebreak_locations, exec_decoder);
+
+			realize_fastsim<W>(addr, addr + len, exec_segment, exec_decoder);
+
+			if (options.fuse_instructions) {
+				[[maybe_unused]] const size_t fused =
+					fuse_instructions<W>(exec, addr, addr + len, exec_segment, exec_decoder);
+				if constexpr (VERBOSE_DECODER) {
+					fprintf(stderr, "Fused %zu instruction pairs\n", fused);
+				}
+			}
+		}
+
+		if (persistent)
+			store_decoder_cache(options, exec, exec_decoder);
 
-		TIME_POINT(t4);
+#ifdef RISCV_BINARY_TRANSLATION
+		if (translate_after_decoding)
+			machine().cpu.try_translate(options, bintr_filename, shared_segment);
+#endif
+		TIME_POINT(t3);
 #ifdef ENABLE_TIMINGS
 		const long t1t0 = nanodiff(t0, t1);
 		const long t2t1 = nanodiff(t1, t2);
 		const long t3t2 = nanodiff(t2, t3);
-		const long t3t4 = nanodiff(t3, t4);
 		printf("libriscv: Decoder cache allocation took %ld ns\n", t1t0);
 		printf("libriscv: Decoder cache bintr activation took %ld ns\n", t2t1);
 		printf("libriscv: Decoder cache generation took %ld ns\n", t3t2);
-		printf("libriscv: Decoder cache realization took %ld ns\n", t3t4);
-		printf("libriscv: Decoder cache totals: %ld us\n", nanodiff(t0, t4) / 1000);
+		printf("libriscv: Decoder cache totals: %ld us\n", nanodiff(t0, t3) / 1000);
 #endif
 	}
 
+	// Lazy decoding: Each page is decoded on its own, the first time
+	// execution enters it. Until then, all its entries are invalid
+	// instructions, and the invalid instruction handler decodes the page.
+	// Blocks cannot continue into the next page, as it may not be decoded
+	// yet, so the last instruction of each page always ends its block.
+	// The page is decoded into a separate cache first, because another
+	// machine may be executing the shared segment at the same time.
+	template <int W>
+	bool Memory<W>::decode_execute_page(DecodedExecuteSegment<W>& exec, address_t pc)
+	{
+		auto& lazy = *exec.lazy_decoding();
+		std::scoped_lock lock(lazy.mutex);
+		auto* exec_decoder = exec.decoder_cache();
+
+		const size_t page = (pc - exec.pagedata_base()) / Page::size();
+		if (page >= lazy.pages.size())
+			return false;
+		if (lazy.pages[page] & LazyDecoding<W>::PAGE_DECODED)
+			return exec_decoder[pc / DecoderCache<W>::DIVISOR].get_bytecode() != RV32I_BC_INVALID;
+
+		// JIT code may have been written since the segment was created
+		if (exec.is_likely_jit())
+			this->refresh_page(exec, page, false);
+
+		const address_t page_begin = exec.pagedata_base() + page * Page::size();
+		const address_t page_end = page_begin + Page::size();
+		address_t begin = std::max(page_begin, exec.exec_begin());
+		const address_t end = std::min(page_end, exec.exec_end());
+		if (compressed_enabled && (lazy.pages[page] & LazyDecoding<W>::PAGE_CONTINUES))
+			begin += 2;
+
+		DecoderCache<W> page_cache {};
+		auto* page_decoder = page_cache.get_base() - page_begin / DecoderCache<W>::DIVISOR;
+		if (begin < end)
+		{
+			auto* exec_segment = exec.exec_data();
+			decode_instructions<W>(exec, begin, end, lazy.ebreak_locations, page_decoder);
+
+			// Find the last instruction of the page
+			address_t last = begin;
+			rv32i_instruction instruction = read_instruction(exec_segment, last, exec.exec_end());
+			address_t last_end = last + (compressed_enabled ? instruction.length() : 4);
+			while (last_end < end) {
+				last = last_end;
+				instruction = read_instruction(exec_segment, last, exec.exec_end());
+				last_end = last + (compressed_enabled ? instruction.length() : 4);
+			}
+			// End the block at the page boundary, unless this is the end of the segment
+			auto& entry = page_decoder[last / DecoderCache<W>::DIVISOR];
+			if (last_end < exec.exec_end() && !is_block_ending<W>(instruction)
+				&& entry.get_bytecode() != RV32I_BC_SYSTEM && entry.get_bytecode() != RV32I_BC_INVALID)
+			{
+				entry.set_bytecode(RV32I_BC_FUNCBLOCK);
+				entry.set_handler(CPU<W>::decode(instruction));
+				entry.instr = instruction.whole;
+			}
+
+			realize_fastsim<W>(begin, std::min(last_end, exec.exec_end()), exec_segment, page_decoder);
+			if (lazy.fuse_instructions)
+				fuse_instructions<W>(exec, begin, end, exec_segment, page_decoder);
+		}
+
+		const size_t first = page_begin / DecoderCache<W>::DIVISOR;
+		for (size_t i = first; i < first + page_cache.cache.size(); i++)
+			exec_decoder[i].atomic_overwrite(page_decoder[i]);
+		lazy.pages[page] |= LazyDecoding<W>::PAGE_DECODED;
+		lazy.decoded_pages++;
+		if constexpr (VERBOSE_DECODER) {
+			fprintf(stderr, "Decoded page 0x%lX (%zu pages)\n", long(page_begin), lazy.decoded_pages.load());
+		}
+		return exec_decoder[pc / DecoderCache<W>::DIVISOR].get_bytecode() != RV32I_BC_INVALID;
+	}
+
+	// JIT segments: A page whose instruction bits changed in guest memory
+	// is copied into the segment again and forgotten, so that it is decoded
+	// when next entered. Pages that are not decoded yet are refreshed right
+	// before they are decoded. Blocks never cross pages in lazily decoded
+	// segments, so no other page has to be touched, unless the page that
+	// follows now starts at a different instruction boundary.
+	template <int W>
+	bool Memory<W>::refresh_execute_page(DecodedExecuteSegment<W>& exec, address_t pc)
+	{
+		if (!exec.is_lazily_decoded())
+			return false;
+		auto& lazy = *exec.lazy_decoding();
+		std::scoped_lock lock(lazy.mutex);
+
+		const size_t page = (pc - exec.pagedata_base()) / Page::size();
+		if (page >= lazy.pages.size() || !(lazy.pages[page] & LazyDecoding<W>::PAGE_DECODED))
+			return false;
+		return refresh_page(exec, page, false);
+	}
+
+	// Called with the lazy decoding mutex held
+	template <int W>
+	bool Memory<W>::refresh_page(DecodedExecuteSegment<W>& exec, size_t page, bool force)
+	{
+		auto& lazy = *exec.lazy_decoding();
+		auto* exec_decoder = exec.decoder_cache();
+		auto* exec_segment = exec.exec_data();
+		bool changed = false;
+		for (; page < lazy.pages.size(); page++, force = true)
+		{
+			const address_t page_begin = exec.pagedata_base() + page * Page::size();
+			const address_t begin = std::max(page_begin, exec.exec_begin());
+			const address_t end = std::min(address_t(page_begin + Page::size()), exec.exec_end());
+			if (begin >= end)
+				break;
+
+			const uint8_t* data = this->get_pageno(page_begin / Page::size()).data();
+			const size_t offset = begin - page_begin;
+			if (!force && std::memcmp(&exec_segment[begin], &data[offset], end - begin) == 0)
+				break;
+			std::memcpy(&exec_segment[begin], &data[offset], end - begin);
+			changed = true;
+
+			// Forget the decoded page
+			if (lazy.pages[page] & LazyDecoding<W>::PAGE_DECODED) {
+				const DecoderData<W> invalid {};
+				const size_t first = page_begin / DecoderCache<W>::DIVISOR;
+				for (size_t i = first; i < first + Page::size() / DecoderCache<W>::DIVISOR; i++)
+					exec_decoder[i].atomic_overwrite(invalid);
+				lazy.pages[page] &= ~LazyDecoding<W>::PAGE_DECODED;
+				lazy.decoded_pages--;
+				if constexpr (VERBOSE_DECODER) {
+					fprintf(stderr, "Forgot page 0x%lX\n", long(page_begin));
+				}
+			}
+
+			if constexpr (!compressed_enabled)
+				break;
+			if (page + 1 >= lazy.pages.size())
+				break;
+			// The last instruction may now continue into the next page,
+			// which must then be decoded again from its new first instruction
+			address_t dst = begin;
+			if (lazy.pages[page] & LazyDecoding<W>::PAGE_CONTINUES)
+				dst += 2;
+			while (dst < end)
+				dst += ((exec_segment[dst] & 0x3) == 0x3) ? 4 : 2;
+			const bool continues = dst > end;
+			const bool continued = (lazy.pages[page + 1] & LazyDecoding<W>::PAGE_CONTINUES) != 0;
+			if (continues == continued)
+				break;
+			lazy.pages[page + 1] ^= LazyDecoding<W>::PAGE_CONTINUES;
+		}
+		return changed;
+	}
+
+	template <int W>
+	size_t Memory<W>::invalidate_execute_pages(address_t addr, address_t len)
+	{
+		const address_t end = (addr + len < addr) ? ~address_t(0) : addr + len;
+		size_t changed = 0;
+		for (auto& entry : m_exec) {
+			auto& exec = *entry.segment;
+			if (!exec.is_likely_jit() || !exec.is_lazily_decoded())
+				continue;
+			const address_t begin = std::max(addr, exec.exec_begin());
+			const address_t seg_end = std::min(end, exec.exec_end());
+			if (begin >= seg_end)
+				continue;
+			for (address_t p = begin / Page::size(); p <= (seg_end - 1) / Page::size(); p++)
+				changed += this->refresh_execute_page(exec, std::max(address_t(p * Page::size()), begin));
+		}
+		return changed;
+	}
+
 	template <int W> RISCV_INTERNAL
 	size_t DecoderData<W>::handler_index_for(Handler new_handler)
 	{
+		// Decoder caches may be generated on several threads at once
+		static std::mutex handler_mutex;
+		std::scoped_lock lock(handler_mutex);
+
 		auto it = handler_cache.find(new_handler);
 		if (it != handler_cache.end())
 			return it->second;
@@ -547,62 +1213,77 @@ namespace riscv
 		// Create CRC32-C hash of the execute segment
 		const uint32_t hash = crc32c(exec_data, current_exec->exec_end() - current_exec->exec_begin());
 
-		// Get a free slot to reference the execute segment
-		auto& free_slot = this->next_execute_segment();
-
-
-		if (options.use_shared_execute_segments)
+		// JIT segments are refreshed from the memory of their own machine
+		if (options.use_shared_execute_segments && !is_likely_jit)
 		{
-			// In order to prevent others from creating the same execute segment
-			// we need to lock the shared execute segments mutex.
-			auto& segment = shared_execute_segments<W>.get_segment(hash);
-			std::scoped_lock lock(segment.mutex);
-
-			if (segment.segment != nullptr) {
-				free_slot = segment.segment;
-				return *free_slot;
-			}
-
-			// We need to create a new execute segment, as there is no shared
-			// execute segment with the same hash.
-			free_slot = std::move(current_exec);
-			free_slot->set_likely_jit(is_likely_jit);
+			std::shared_ptr<DecodedExecuteSegment<W>> shared;
+			{
+				// In order to prevent others from creating the same execute segment
+				// we need to lock the shared execute segments mutex.
+				auto& segment = shared_execute_segments<W>.get_segment(hash);
+				std::scoped_lock lock(segment.mutex);
+
+				// Identical code at another address cannot be shared
+				if (segment.segment != nullptr && segment.segment->exec_begin() == current_exec->exec_begin()
+					&& segment.segment->exec_end() == current_exec->exec_end()) {
+					shared = segment.segment;
+				} else {
+					// We need to create a new execute segment, as there is no shared
+					// execute segment with the same hash.
+					current_exec->set_likely_jit(is_likely_jit);
 #ifdef RISCV_BINARY_TRANSLATION
-			free_slot->set_record_slowpaths(options.record_slowpaths_to_jump_hints && !is_likely_jit);
+					current_exec->set_record_slowpaths(options.record_slowpaths_to_jump_hints && !is_likely_jit);
 #endif
-			// Store the hash in the decoder cache
-			free_slot->set_crc32c_hash(hash);
+					// Store the hash in the decoder cache
+					current_exec->set_crc32c_hash(hash);
 
-			this->generate_decoder_cache(options, free_slot, is_initial);
+					this->generate_decoder_cache(options, current_exec, is_initial);
 
-			// Share the execute segment
-			shared_execute_segments<W>.get_segment(hash).unlocked_set(free_slot);
+					// Share the execute segment
+					segment.unlocked_set(current_exec);
+					shared = std::move(current_exec);
+				}
+			}
+			// Eviction takes the shared execute segments locks
+			return *this->insert_execute_segment(options, std::move(shared));
 		}
 		else
 		{
-			free_slot = std::move(current_exec);
-			free_slot->set_likely_jit(is_likely_jit);
+			current_exec->set_likely_jit(is_likely_jit);
 #ifdef RISCV_BINARY_TRANSLATION
-			free_slot->set_record_slowpaths(options.record_slowpaths_to_jump_hints && !is_likely_jit);
+			current_exec->set_record_slowpaths(options.record_slowpaths_to_jump_hints && !is_likely_jit);
 #endif
 			// Store the hash in the decoder cache
-			free_slot->set_crc32c_hash(hash);
+			current_exec->set_crc32c_hash(hash);
 
-			this->generate_decoder_cache(options, free_slot, is_initial);
-		}
+			this->generate_decoder_cache(options, current_exec, is_initial);
 
-		return *free_slot;
+			return *this->insert_execute_segment(options, std::move(current_exec));
+		}
 	}
 
 	template <int W>
-	std::shared_ptr<DecodedExecuteSegment<W>>& Memory<W>::next_execute_segment()
+	std::shared_ptr<DecodedExecuteSegment<W>>& Memory<W>::insert_execute_segment(
+		const MachineOptions<W>& options, std::shared_ptr<DecodedExecuteSegment<W>> segment)
 	{
-		if (LIKELY(m_exec_segs < MAX_EXECUTE_SEGS)) {
-			auto& result = this->m_exec.at(m_exec_segs);
-			m_exec_segs ++;
-			return result;
+		DecodedExecuteSegment<W>* inserted = segment.get();
+		this->m_exec.insert(std::move(segment));
+
+		// Evict the least recently used segments until the decoded
+		// segments fit in the budget. The current segment is kept.
+		if (options.execute_segments_memory_max != 0)
+		{
+			const auto* current = &machine().cpu.current_execute_segment();
+			while (m_exec.size_bytes() > options.execute_segments_memory_max)
+			{
+				auto* lru = m_exec.least_recently_used(current, inserted);
+				if (lru == nullptr)
+					break;
+				this->evict_execute_segment(*lru);
+			}
 		}
-		throw MachineException(INVALID_PROGRAM, "Max execute segments reached");
+		// The segment may have moved when others were evicted
+		return *m_exec.get(*inserted);
 	}
 
 	template <int W>
@@ -617,17 +1298,12 @@ namespace riscv
 		// destructor could throw, so let's invalidate early
 		machine().cpu.set_execute_segment(*CPU<W>::empty_execute_segment());
 
-		m_exec_segs = std::min(m_exec_segs, m_exec.size());
-		while (m_exec_segs > 0) {
-			m_exec_segs--;
-
+		while (!m_exec.empty()) {
 			try {
-				auto& segment = m_exec.at(m_exec_segs);
-				if (segment) {
-					const uint32_t hash = segment->crc32c_hash();
-					segment = nullptr;
-					shared_execute_segments<W>.remove_if_unique(hash);
-				}
+				auto segment = m_exec.pop_back();
+				const uint32_t hash = segment->crc32c_hash();
+				segment = nullptr;
+				shared_execute_segments<W>.remove_if_unique(hash);
 			} catch (...) {
 				// Ignore exceptions
 			}
@@ -638,14 +1314,8 @@ namespace riscv
 	void Memory<W>::evict_execute_segment(DecodedExecuteSegment<W>& segment)
 	{
 		const uint32_t hash = segment.crc32c_hash();
-		for (size_t i = 0; i < m_exec_segs; i++) {
-			if (m_exec[i].get() == &segment) {
-				m_exec[i] = nullptr;
-				if (i == m_exec_segs - 1)
-					m_exec_segs--;
-				break;
-			}
-		}
+		// The segment may be destroyed here
+		m_exec.erase(segment);
 		shared_execute_segments<W>.remove_if_unique(hash);
 	}
 
@@ -656,15 +1326,16 @@ namespace riscv
 		std::unordered_set<address_type<W>> addresses;
 		for (auto addr : machine().options().translator_jump_hints)
 			addresses.insert(addr);
-		for (size_t i = 0; i < m_exec_segs; i++) {
-			auto& segment = m_exec[i];
-			if (segment) {
-				if (segment->is_recording_slowpaths()) {
-					for (auto addr : segment->slowpath_addresses())
-						addresses.insert(addr);
-				}
+		for (const auto& entry : m_exec) {
+			auto& segment = entry.segment;
+			if (segment->is_recording_slowpaths()) {
+				for (auto addr : segment->slowpath_addresses())
+					addresses.insert(addr);
 			}
 		}
+		// Every block that was entered is a possible jump target
+		for (const auto& block : this->block_profile())
+			addresses.insert(block.address);
 		std::vector<address_t> result;
 		for (auto addr : addresses)
 			result.push_back(addr);
@@ -672,6 +1343,59 @@ namespace riscv
 	}
 #endif
 
+	template <int W>
+	std::vector<typename Memory<W>::BlockProfile> Memory<W>::block_profile(size_t max_blocks) const
+	{
+		std::vector<BlockProfile> result;
+		if constexpr (block_profiling_enabled) {
+			for (const auto& entry : m_exec) {
+				const auto& segment = *entry.segment;
+				const auto* counts = segment.block_counts();
+				const auto* decoder = segment.decoder_cache();
+				if (counts == nullptr)
+					continue;
+				const size_t first = segment.exec_begin() / DecoderCache<W>::DIVISOR;
+				const size_t last  = segment.exec_end() / DecoderCache<W>::DIVISOR;
+				for (size_t i = first; i < last; i++) {
+					if (counts[i] == 0)
+						continue;
+					result.push_back(BlockProfile{
+						.address = address_t(i * DecoderCache<W>::DIVISOR),
+						.callsite = {},
+						.count = counts[i],
+						.instructions = counts[i] * decoder[i].instruction_count(),
+					});
+				}
+			}
+			std::sort(result.begin(), result.end(),
+				[] (const BlockProfile& a, const BlockProfile& b) {
+					if (a.instructions != b.instructions)
+						return a.instructions > b.instructions;
+					return a.address < b.address;
+				});
+			if (result.size() > max_blocks)
+				result.resize(max_blocks);
+			// Symbol lookups are only done for the blocks that are kept
+			for (auto& block : result)
+				block.callsite = this->lookup(block.address);
+		}
+		return result;
+	}
+
+	template <int W>
+	void Memory<W>::reset_block_profile()
+	{
+		if constexpr (block_profiling_enabled) {
+			for (const auto& entry : m_exec) {
+				auto& segment = *entry.segment;
+				if (segment.block_counts() == nullptr)
+					continue;
+				const size_t first = segment.pagedata_base() / DecoderCache<W>::DIVISOR;
+				std::fill_n(&segment.block_counts()[first], segment.decoder_cache_size() * (Page::size() / DecoderCache<W>::DIVISOR), uint64_t(0));
+			}
+		}
+	}
+
 #ifdef ENABLE_TIMINGS
 	timespec time_now()
 	{
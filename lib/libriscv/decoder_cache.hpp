@@ -1,5 +1,6 @@
 #pragma once
 #include "common.hpp"
+#include "threaded_bytecodes.hpp"
 #include "types.hpp"
 #include <unordered_map>
 #include <vector>
@@ -106,4 +107,18 @@ struct alignas(64) DecoderCache
 	std::array<DecoderData<W>, PageSize / DIVISOR> cache;
 };
 
+// A superinstruction also executes the instruction after it. Before
+// the entry at addr is replaced, split any fused pair that ends there.
+template <int W>
+inline void unfuse_instruction_before(DecoderData<W>* exec_decoder,
+	address_type<W> begin, address_type<W> addr) noexcept
+{
+	for (const unsigned len : {2u, 4u}) {
+		if ((compressed_enabled || len == 4) && addr >= begin + len) {
+			auto& entry = exec_decoder[(addr - len) / DecoderCache<W>::DIVISOR];
+			entry.set_bytecode(unfused_bytecode(entry.get_bytecode()));
+		}
+	}
+}
+
 }
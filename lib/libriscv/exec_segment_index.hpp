@@ -0,0 +1,129 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "decoded_exec_segment.hpp"
+
+namespace riscv
+{
+	// The execute segments of a machine, sorted by start address.
+	// Lookups are a binary search. Segments may overlap, in which case
+	// the containing segment with the highest start address is found.
+	// Each successful lookup marks the segment as recently used, so
+	// that the least recently used segments can be evicted first.
+	template <int W>
+	struct ExecuteSegmentIndex
+	{
+		using address_t = address_type<W>;
+		using segment_t = std::shared_ptr<DecodedExecuteSegment<W>>;
+
+		struct Entry {
+			segment_t segment;
+			address_t max_end = 0;   // Highest end address up to and including this entry
+			uint64_t  last_used = 0;
+		};
+
+		// Returns the segment containing vaddr, or nullptr
+		segment_t* find(address_t vaddr) noexcept
+		{
+			auto it = std::upper_bound(m_entries.begin(), m_entries.end(), vaddr,
+				[] (address_t addr, const Entry& e) { return addr < e.segment->exec_begin(); });
+			while (it != m_entries.begin()) {
+				--it;
+				// No earlier segment reaches vaddr
+				if (it->max_end <= vaddr)
+					break;
+				if (it->segment->is_within(vaddr)) {
+					it->last_used = ++m_clock;
+					return &it->segment;
+				}
+			}
+			return nullptr;
+		}
+
+		// Returns the entry holding the given segment, or nullptr
+		segment_t* get(const DecodedExecuteSegment<W>& segment) noexcept
+		{
+			for (auto& e : m_entries) {
+				if (e.segment.get() == &segment)
+					return &e.segment;
+			}
+			return nullptr;
+		}
+
+		segment_t& insert(segment_t segment)
+		{
+			const address_t begin = segment->exec_begin();
+			auto it = std::upper_bound(m_entries.begin(), m_entries.end(), begin,
+				[] (address_t addr, const Entry& e) { return addr < e.segment->exec_begin(); });
+			it = m_entries.insert(it, Entry{std::move(segment), 0, ++m_clock});
+			const size_t index = it - m_entries.begin();
+			this->update_max_end(index);
+			return m_entries[index].segment;
+		}
+
+		// Removes and returns the given segment, or nullptr if not found
+		segment_t erase(const DecodedExecuteSegment<W>& segment)
+		{
+			for (size_t i = 0; i < m_entries.size(); i++) {
+				if (m_entries[i].segment.get() == &segment) {
+					segment_t result = std::move(m_entries[i].segment);
+					m_entries.erase(m_entries.begin() + i);
+					this->update_max_end(i);
+					return result;
+				}
+			}
+			return nullptr;
+		}
+
+		// Removes and returns the segment with the highest start address
+		segment_t pop_back()
+		{
+			segment_t result = std::move(m_entries.back().segment);
+			m_entries.pop_back();
+			return result;
+		}
+
+		// The least recently used segment that is neither a nor b
+		DecodedExecuteSegment<W>* least_recently_used(const DecodedExecuteSegment<W>* a, const DecodedExecuteSegment<W>* b) const noexcept
+		{
+			const Entry* lru = nullptr;
+			for (const auto& e : m_entries) {
+				if (e.segment.get() == a || e.segment.get() == b)
+					continue;
+				if (lru == nullptr || e.last_used < lru->last_used)
+					lru = &e;
+			}
+			return (lru != nullptr) ? lru->segment.get() : nullptr;
+		}
+
+		// Total memory used by the decoded segments
+		size_t size_bytes() const noexcept
+		{
+			size_t total = 0;
+			for (const auto& e : m_entries)
+				total += e.segment->size_bytes();
+			return total;
+		}
+
+		size_t size() const noexcept { return m_entries.size(); }
+		bool empty() const noexcept { return m_entries.empty(); }
+		auto begin() const noexcept { return m_entries.begin(); }
+		auto end() const noexcept { return m_entries.end(); }
+
+	private:
+		void update_max_end(size_t index) noexcept
+		{
+			address_t max_end = (index > 0) ? m_entries[index-1].max_end : 0;
+			for (size_t i = index; i < m_entries.size(); i++) {
+				max_end = std::max(max_end, m_entries[i].segment->exec_end());
+				m_entries[i].max_end = max_end;
+			}
+		}
+
+		std::vector<Entry> m_entries;
+		uint64_t m_clock = 0;
+	};
+
+} // riscv
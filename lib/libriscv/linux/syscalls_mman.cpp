@@ -14,6 +14,7 @@ static void add_mman_syscalls()
 		if (addr + len < addr)
 			throw MachineException(SYSTEM_CALL_FAILED, "munmap() arguments overflow");
 		machine.memory.free_pages(addr, len);
+		machine.memory.munmap_file(addr, len);
 		if (addr >= machine.memory.mmap_start() && addr + len <= machine.memory.mmap_address()) {
 			machine.memory.mmap_unmap(addr, len);
 		}
@@ -62,7 +63,16 @@ static void add_mman_syscalls()
 					nextfree += length;
 				} else {
 					dst = addr_g;
+					machine.memory.mmap_cache().invalidate(dst, length);
 				}
+				// Map the file directly, paging it in on first access
+				if (machine.memory.mmap_file(dst, length, int(real_fd), voff, attr)) {
+					machine.set_result(dst);
+					SYSPRINT("<<< mmap(addr 0x%lX, len %zu, ...) = 0x%lX (file)\n",
+							(long)addr_g, (size_t)length, (long)dst);
+					return;
+				}
+				machine.memory.munmap_file(dst, length);
 				// Make the area read-write
 				machine.memory.set_page_attr(dst, length, PageAttributes{});
 				// Readv into the area
@@ -122,6 +132,8 @@ static void add_mman_syscalls()
 		} else if (addr_g >= machine.memory.mmap_start() && addr_g + length <= nextfree) {
 			// Fixed mapping inside mmap arena
 			result = addr_g;
+			// The range may have been freed earlier
+			machine.memory.mmap_cache().invalidate(result, length);
 		} else if (addr_g > nextfree) {
 			// Fixed mapping after current end of mmap arena
 			// TODO: Evaluate if relaxation is counter-productive with the new cache
@@ -138,6 +150,8 @@ static void add_mman_syscalls()
 			MMAP_HAS_FAILED();
 		}
 
+		// A new mapping replaces any file that was mapped here
+		machine.memory.munmap_file(result, length);
 		// anon pages need to be zeroed
 		if (flags & MAP_ANONYMOUS) {
 			machine.memory.memdiscard(result, length, true);
@@ -1063,6 +1063,21 @@ static void syscall_brk(Machine<W>& machine)
 	machine.set_result(new_end);
 }
 
+template <int W>
+static void syscall_riscv_flush_icache(Machine<W>& machine)
+{
+	const auto start = machine.sysarg(0);
+	const auto end = machine.sysarg(1);
+	// Pages of JIT execute segments that were written to are decoded again
+	if (end > start)
+		machine.memory.invalidate_execute_pages(start, end - start);
+
+	if constexpr (verbose_syscalls) {
+		printf("SYSCALL riscv_flush_icache, start: 0x%lX end: 0x%lX\n", (long)start, (long)end);
+	}
+	machine.set_result(0);
+}
+
 #if defined(__APPLE__)
 	#include <Security/Security.h>
 #endif
@@ -1324,7 +1339,7 @@ void Machine<W>::setup_linux_syscalls(bool filesystem, bool sockets)
 	// riscv_hwprobe
 	install_syscall_handler(258, syscall_stub_zero<W>);
 	// riscv_flush_icache
-	install_syscall_handler(259, syscall_stub_zero<W>);
+	install_syscall_handler(259, syscall_riscv_flush_icache<W>);
 
 	install_syscall_handler(278, syscall_getrandom<W>);
 
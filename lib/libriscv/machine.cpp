@@ -35,10 +35,20 @@ namespace riscv
 		cpu.reset();
 	}
 	template <int W>
+	inline Machine<W>::Machine(const ProgramFile& file, const MachineOptions<W>& options)
+		: cpu(*this, options.cpu_id),
+		  memory(*this, file, options),
+		  m_arena(nullptr),
+		  m_options(options)
+	{
+		cpu.reset();
+	}
+	template <int W>
 	inline Machine<W>::Machine(const Machine& other, const MachineOptions<W>& options)
 		: cpu(*this, options.cpu_id, other),
 		  memory(*this, other, options),
 		  m_arena(nullptr),
+		  m_parent(&other),
 		  m_options(options)
 	{
 		this->m_counter = other.m_counter;
@@ -62,6 +72,29 @@ namespace riscv
 	{
 	}
 
+	template <int W>
+	void Machine<W>::reset_to_parent()
+	{
+		if (UNLIKELY(m_parent == nullptr))
+			throw MachineException(ILLEGAL_OPERATION, "Machine is not a fork");
+		const Machine& parent = *m_parent;
+
+		memory.reset_to_parent(parent.memory, !options().minimal_fork);
+		cpu.reset_to_parent(parent.cpu);
+		this->m_counter = parent.m_counter;
+		this->m_max_counter = parent.m_max_counter;
+
+		if (parent.m_mt) {
+			m_mt.reset(new MultiThreading {*this, *parent.m_mt});
+		} else {
+			m_mt.reset();
+		}
+		// The native heap is restored only when the parent has one
+		if (parent.m_arena) {
+			m_arena.reset(new Arena(*parent.m_arena));
+		}
+	}
+
 	template <int W>
 	void Machine<W>::unknown_syscall_handler(Machine<W>& machine)
 	{
@@ -47,6 +47,17 @@ namespace riscv
 		Machine(std::string_view binary, const MachineOptions<W>& = {});
 		Machine(const std::vector<uint8_t>& binary, const MachineOptions<W>& = {});
 
+		/// The ELF file is memory-mapped and owned by the machine, instead of
+		/// being read into memory. Read-only segments are mapped directly,
+		/// and are paged in on first access. Writable segments outside of the
+		/// memory arena are copied on their first write.
+		///
+		///  Machine<RISCV64> machine { ProgramFile{"riscv_program.elf"} };
+		///
+		/// @brief Construct a machine from a RISC-V ELF file on disk
+		/// @param file The path or open file descriptor of the RISC-V binary
+		Machine(const ProgramFile& file, const MachineOptions<W>& = {});
+
 		/// @brief Create an empty RISC-V machine
 		/// @param opts Machine options
 		Machine(const MachineOptions<W>& opts = {});
@@ -430,6 +441,16 @@ namespace riscv
 		// quickly creating and destroying a machine.
 		void reset();
 
+		/// @brief Rewind a fork to the state of the machine it was forked from.
+		/// Registers, instruction counters, the mmap and brk cursors, threads and
+		/// the native heap are restored, and only the pages that were written to,
+		/// copy-on-write broken or otherwise changed since the fork are dropped.
+		/// The cost grows with the number of changed pages, not the total.
+		/// @note The main machine must not have been modified since the fork.
+		/// Writes to a flat read-write arena shared with the main machine
+		/// cannot be rewound, so forks that are reset should not use the arena.
+		void reset_to_parent();
+
 		/// @brief Serializes the current machine state into a vector
 		/// @param vec The vector to serialize into (append)
 		/// @return Returns the total number of serialized bytes
@@ -464,6 +485,7 @@ namespace riscv
 		std::unique_ptr<FileDescriptors> m_fds = nullptr;
 		std::unique_ptr<Multiprocessing<W>> m_smp = nullptr;
 		std::unique_ptr<Signals<W>> m_signals = nullptr;
+		const Machine* m_parent = nullptr;
 
 #ifdef RISCV_TIMED_VMCALLS
 	public:
@@ -2,10 +2,14 @@
 
 #include "decoder_cache.hpp"
 #include "internal_common.hpp"
+#include <algorithm>
 #include <inttypes.h>
 #ifdef __linux__
 #define DEMANGLE_ENABLED
+#include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 extern "C" char *
 __cxa_demangle(const char *name, char *buf, size_t *n, int *status);
 #endif
@@ -17,9 +21,19 @@ namespace riscv
 	template <int W>
 	Memory<W>::Memory(Machine<W>& mach, std::string_view bin,
 					MachineOptions<W> options)
+		: Memory(mach, bin, MappedProgram{}, std::move(options)) {}
+	template <int W>
+	Memory<W>::Memory(Machine<W>& mach, const ProgramFile& file,
+					MachineOptions<W> options)
+		: Memory(mach, {}, MappedProgram{file}, std::move(options)) {}
+
+	template <int W>
+	Memory<W>::Memory(Machine<W>& mach, std::string_view bin,
+					MappedProgram program, MachineOptions<W> options)
 		: m_machine{mach},
 		  m_original_machine {true},
-		  m_binary {bin}
+		  m_program {std::move(program)},
+		  m_binary {m_program.data.empty() ? bin : m_program.data}
 	{
 		if (options.page_fault_handler != nullptr)
 		{
@@ -45,8 +59,7 @@ namespace riscv
 					// TODO: Allocate unpresent pages for the whole address space,
 					// and only allocate real memory according to pages_max. Then handle
 					// page faults for the rest of the address space using userfaultfd.
-					this->m_arena.data = (PageData *)mmap(NULL, UNBOUNDED_ARENA_SIZE, PROT_READ | PROT_WRITE,
-						MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+					this->m_arena.data = (PageData *)create_arena(UNBOUNDED_ARENA_SIZE, options);
 					if (UNLIKELY(this->m_arena.data == MAP_FAILED)) {
 						// We probably reached a limit on the number of mappings
 						this->m_arena.data = nullptr;
@@ -61,8 +74,7 @@ namespace riscv
 				} else {
 					// Over-allocate by 1 page in order to avoid bounds-checking with size
 					const size_t len = (pages_max + 1) * Page::size();
-					this->m_arena.data = (PageData *)mmap(NULL, len, PROT_READ | PROT_WRITE,
-						MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+					this->m_arena.data = (PageData *)create_arena(len, options);
 					this->m_arena.pages = pages_max;
 					// mmap() returns MAP_FAILED (-1) when mapping fails
 					if (UNLIKELY(this->m_arena.data == MAP_FAILED)) {
@@ -72,13 +84,16 @@ namespace riscv
 				}
 #else
 				// TODO: XXX: Investigate if this is a time sink
-				this->m_arena.data = new PageData[pages_max + 1];
+				this->m_arena.data = (PageData *)create_arena((pages_max + 1) * Page::size(), options);
 				this->m_arena.pages = pages_max;
 #endif
 			}
 
 			if (this->m_arena.pages > 0)
 			{
+				if constexpr (arena_dirty_tracking)
+					this->m_arena_dirty.resize((m_arena.pages + 63) / 64);
+
 				this->m_page_fault_handler =
 				[pages_max] (auto& mem, const address_t page, bool init) -> Page&
 				{
@@ -143,22 +158,137 @@ namespace riscv
 		} catch (...) {}
 		// Potentially deallocate execute segments that are no longer referenced
 		this->evict_execute_segments();
-		// only the original machine owns arena
-		if (this->m_arena.data != nullptr && !is_forked()) {
 #ifdef __linux__
-			if constexpr (riscv::encompassing_Nbit_arena != 0)
-			{
-				// munmap() the entire address space
-				munmap(this->m_arena.data, UNBOUNDED_ARENA_SIZE);
-			} else {
-				munmap(this->m_arena.data, (this->m_arena.pages + 1) * Page::size());
-			}
+		for (const auto& mapping : this->m_file_mappings)
+			munmap(mapping.data, mapping.length);
+#endif
+		// A fork owns its private view of the arena, unless it borrowed the original
+		if (this->m_arena.data != nullptr && !this->m_arena.borrowed) {
+#ifdef __linux__
+			munmap(this->m_arena.data, this->m_arena.length);
+			if (this->m_arena.fd >= 0)
+				close(this->m_arena.fd);
 #else
 			delete[] this->m_arena.data;
 #endif
 		}
 	}
 
+	MappedProgram::MappedProgram(const ProgramFile& file)
+	{
+#ifdef __linux__
+		// We keep our own descriptor, so that forks can map the file
+		this->fd = (file.fd >= 0) ? fcntl(file.fd, F_DUPFD_CLOEXEC, 0)
+			: open(file.path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (this->fd < 0)
+			throw MachineException(INVALID_PROGRAM, "Unable to open program file");
+		struct stat st;
+		if (fstat(this->fd, &st) != 0 || st.st_size <= 0) {
+			close(this->fd);
+			throw MachineException(INVALID_PROGRAM, "Program file is empty");
+		}
+		// A private mapping is copy-on-write, so that pages loaned
+		// to the machine can be written to without changing the file.
+		void* ptr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, this->fd, 0);
+		if (ptr == MAP_FAILED) {
+			close(this->fd);
+			throw MachineException(OUT_OF_MEMORY, "Unable to map program file", st.st_size);
+		}
+		this->data = { (const char *)ptr, size_t(st.st_size) };
+#else
+		(void)file;
+		throw MachineException(FEATURE_DISABLED, "Memory-mapped programs require Linux");
+#endif
+	}
+	MappedProgram::MappedProgram(MappedProgram&& other) noexcept
+		: data(other.data), fd(other.fd)
+	{
+		other.data = {};
+		other.fd = -1;
+	}
+	MappedProgram::~MappedProgram()
+	{
+#ifdef __linux__
+		if (!this->data.empty())
+			munmap((void *)this->data.data(), this->data.size());
+		if (this->fd >= 0)
+			close(this->fd);
+#endif
+	}
+
+#ifdef __linux__
+	static constexpr size_t HUGE_PAGE_SIZE = 2ull << 20;
+
+	// Map an arena, optionally at a 2MB-aligned address so that the
+	// kernel can back it with transparent huge pages. Alignment is done
+	// by reserving a larger area and trimming the unaligned head and tail.
+	static void* map_arena(size_t len, int flags, int fd, bool huge_pages)
+	{
+		if (!huge_pages)
+			return mmap(NULL, len, PROT_READ | PROT_WRITE, flags, fd, 0);
+
+		const size_t reserved = len + HUGE_PAGE_SIZE;
+		void* area = mmap(NULL, reserved, PROT_NONE,
+			MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+		if (area == MAP_FAILED)
+			return MAP_FAILED;
+		const uintptr_t begin = uintptr_t(area);
+		const uintptr_t aligned = (begin + HUGE_PAGE_SIZE - 1) & ~uintptr_t(HUGE_PAGE_SIZE - 1);
+		void* data = mmap((void *)aligned, len, PROT_READ | PROT_WRITE, flags | MAP_FIXED, fd, 0);
+		if (data == MAP_FAILED) {
+			munmap(area, reserved);
+			return MAP_FAILED;
+		}
+		if (aligned > begin)
+			munmap(area, aligned - begin);
+		if (begin + reserved > aligned + len)
+			munmap((void *)(aligned + len), begin + reserved - (aligned + len));
+		madvise(data, len, MADV_HUGEPAGE);
+		return data;
+	}
+#endif
+
+	template <int W>
+	void* Memory<W>::create_arena(size_t len, const MachineOptions<W>& options)
+	{
+#ifdef __linux__
+		this->m_arena.length = len;
+		this->m_arena.huge_pages = options.use_arena_huge_pages || options.use_arena_hugetlb;
+		if (options.use_arena_hugetlb) {
+			// Explicit huge pages are reserved up front, so that running
+			// out of them fails here instead of when faulting them in.
+			const size_t hlen = (len + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+			void* data = mmap(NULL, hlen, PROT_READ | PROT_WRITE,
+				MAP_ANONYMOUS | MAP_PRIVATE | MAP_HUGETLB, -1, 0);
+			if (data != MAP_FAILED) {
+				this->m_arena.length = hlen;
+				this->m_arena.hugetlb = true;
+				return data;
+			}
+		}
+		// A shared mapping of a memory file lets forks map a private view
+		// of the same file, getting copy-on-write from the kernel.
+		if (options.use_forkable_arena) {
+			const int fd = memfd_create("libriscv-arena", MFD_CLOEXEC);
+			if (fd >= 0) {
+				void* data = MAP_FAILED;
+				if (ftruncate(fd, len) == 0)
+					data = map_arena(len, MAP_SHARED | MAP_NORESERVE, fd, m_arena.huge_pages);
+				if (data != MAP_FAILED) {
+					this->m_arena.fd = fd;
+					this->m_arena.file_backed = true;
+					return data;
+				}
+				close(fd);
+			}
+		}
+		return map_arena(len, MAP_ANONYMOUS | MAP_PRIVATE | MAP_NORESERVE, -1, m_arena.huge_pages);
+#else
+		(void)options;
+		return new PageData[len / Page::size()];
+#endif
+	}
+
 	template <int W> RISCV_INTERNAL
 	void Memory<W>::reset()
 	{
@@ -166,6 +296,79 @@ namespace riscv
 		// serialization, machine options and machine forks
 	}
 
+	template <int W>
+	void Memory<W>::reset_to_parent(const Memory<W>& parent, bool borrow_pages)
+	{
+		std::sort(m_dirty_pages.begin(), m_dirty_pages.end());
+		const auto last = std::unique(m_dirty_pages.begin(), m_dirty_pages.end());
+		for (auto it = m_dirty_pages.begin(); it != last; ++it) {
+			if (borrow_pages)
+				m_pages.restore_from(parent.m_pages, *it);
+			else
+				m_pages.erase(*it);
+		}
+		m_dirty_pages.clear();
+
+#ifdef __linux__
+		// Pages loaned from our own file mappings were restored above
+		for (const auto& mapping : m_file_mappings)
+			munmap(mapping.data, mapping.length);
+		m_file_mappings.clear();
+		// Dropping our private copies of arena pages reveals the parents arena
+		if (m_arena.file_backed && m_arena.fd < 0) {
+			if constexpr (arena_dirty_tracking) {
+				for (const auto pageno : this->dirty_arena_pages())
+					madvise(&m_arena.data[pageno], Page::size(), MADV_DONTNEED);
+			} else {
+				madvise(m_arena.data, memory_arena_size(), MADV_DONTNEED);
+			}
+		}
+#endif
+		std::fill(m_arena_dirty.begin(), m_arena_dirty.end(), 0);
+
+		this->m_start_address = parent.m_start_address;
+		this->m_stack_address = parent.m_stack_address;
+		this->m_exit_address = parent.m_exit_address;
+		this->m_heap_address = parent.m_heap_address;
+		this->m_mmap_address = parent.m_mmap_address;
+		this->m_mmap_cache   = parent.m_mmap_cache;
+
+		// Drop execute segments created after the fork
+		this->m_exec = parent.m_exec;
+
+		this->invalidate_reset_cache();
+	}
+
+	template <int W>
+	bool Memory<W>::is_arena_page_dirty(address_t pageno) const noexcept
+	{
+		if (pageno >= m_arena.pages || m_arena_dirty.empty())
+			return false;
+		return (m_arena_dirty[pageno / 64] >> (pageno % 64)) & 1;
+	}
+
+	template <int W>
+	std::vector<address_type<W>> Memory<W>::dirty_arena_pages() const
+	{
+		std::vector<address_t> result;
+		for (size_t i = 0; i < m_arena_dirty.size(); i++) {
+			uint64_t bits = m_arena_dirty[i];
+			for (size_t bit = 0; bits != 0; bit++, bits >>= 1) {
+				if (bits & 1)
+					result.push_back(address_t(i * 64 + bit));
+			}
+		}
+		return result;
+	}
+
+	template <int W>
+	void Memory<W>::clear_arena_dirty_pages() noexcept
+	{
+		std::fill(m_arena_dirty.begin(), m_arena_dirty.end(), 0);
+		// Writes that hit the TLB are not tracked
+		this->invalidate_reset_cache();
+	}
+
 	template <int W>
 	void Memory<W>::clear_all_pages()
 	{
@@ -176,7 +379,7 @@ namespace riscv
 	template <int W> RISCV_INTERNAL
 	void Memory<W>::initial_paging()
 	{
-		if (m_pages.find(0) == m_pages.end()) {
+		if (m_pages.find(0) == nullptr) {
 			// add a guard page to catch zero-page accesses
 			install_shared_page(0, Page::guard_page());
 		}
@@ -242,7 +445,10 @@ namespace riscv
 		}
 
 		// Load into virtual memory
-		this->memcpy(vaddr, src, len);
+		if (m_program.fd >= 0)
+			this->binary_map_ph(hdr, vaddr, attr);
+		else
+			this->memcpy(vaddr, src, len);
 
 		if (options.protect_segments) {
 			this->set_page_attr(vaddr, len, attr);
@@ -255,6 +461,62 @@ namespace riscv
 		}
 	}
 
+	template <int W> RISCV_INTERNAL
+	void Memory<W>::binary_map_ph(const typename Elf::ProgramHeader* hdr,
+		const address_t vaddr, PageAttributes attr)
+	{
+		const char* src = m_binary.data() + hdr->p_offset;
+		const size_t len = hdr->p_filesz;
+		// Only whole pages that have the same alignment in the
+		// file as in memory can be mapped, the rest is copied.
+		const address_t begin = (vaddr + Page::size()-1) & ~address_t(Page::size()-1);
+		const address_t end = (vaddr + len) & ~address_t(Page::size()-1);
+		if ((vaddr - hdr->p_offset) % Page::size() != 0 || begin >= end) {
+			this->memcpy(vaddr, src, len);
+			return;
+		}
+		this->memcpy(vaddr, src, begin - vaddr);
+		this->memcpy(end, src + (end - vaddr), vaddr + len - end);
+
+		address_t addr = begin;
+		const size_t file_offset = hdr->p_offset + (begin - vaddr);
+		// Without a flat arena, pages are only visible through the page
+		// table, so the whole segment is loaned from the file instead.
+		const address_t arena_size = flat_readwrite_arena ? memory_arena_size() : 0;
+#ifdef __linux__
+		// Read-only segments in the arena are mapped directly from the
+		// file, and paged in by the kernel on first access. Writable
+		// segments are copied, as forks must see the masters writes.
+		// Forks of a forkable arena only see its memory file, so the
+		// segments are always copied into it.
+		const address_t arena_end = std::min(end, arena_size);
+		if (addr < arena_end && !attr.write && !m_arena.hugetlb && m_arena.fd < 0)
+		{
+			const size_t length = arena_end - addr;
+			void* data = mmap((char *)m_arena.data + addr, length, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_FIXED, m_program.fd, file_offset);
+			if (data != MAP_FAILED)
+				m_arena_mappings.push_back({ addr, file_offset, length });
+			else
+				this->memcpy(addr, src + (addr - vaddr), length);
+			addr = arena_end;
+		}
+#endif
+		if (addr < end && addr < arena_size) {
+			const address_t arena_end = std::min(end, arena_size);
+			this->memcpy(addr, src + (addr - vaddr), arena_end - addr);
+			addr = arena_end;
+		}
+		if (addr < end) {
+			// Pages outside of the arena are loaned from the file. Writable
+			// pages are copy-on-write, and get copied on the first write.
+			attr.is_cow = attr.write;
+			attr.write = false;
+			this->insert_non_owned_memory(addr,
+				(void *)(m_binary.data() + file_offset + (addr - begin)), end - addr, attr);
+		}
+	}
+
 	template <int W> RISCV_INTERNAL
 	void Memory<W>::serialize_execute_segment(
 		const MachineOptions<W>& options, const typename Elf::ProgramHeader* hdr, address_t vaddr)
@@ -462,29 +724,46 @@ namespace riscv
 		// Some machines don't need custom PF handlers
 		this->m_page_fault_handler = master.memory.m_page_fault_handler;
 
-		if (options.minimal_fork == false)
-		{
-			// Hardly any pages are dont_fork, so we estimate that
-			// all master pages will be loaned.
-			m_pages.reserve(master.memory.pages().size());
-
-			for (const auto& it : master.memory.pages())
+		const auto& arena = master.memory.m_arena;
+		typename PageTable<W>::Rebase rebase;
+		if (options.use_memory_arena && arena.data != nullptr) {
+#ifdef __linux__
+			if (arena.fd >= 0) {
+				// Map a private view of the masters arena. Pages are shared
+				// with the master until written to (kernel copy-on-write).
+				void* data = map_arena(arena.length, MAP_PRIVATE | MAP_NORESERVE, arena.fd, arena.huge_pages);
+				if (UNLIKELY(data == MAP_FAILED))
+					throw MachineException(OUT_OF_MEMORY, "Out of memory", arena.length);
+				this->m_arena.data = (PageData *)data;
+				this->m_arena.length = arena.length;
+				this->m_arena.file_backed = true;
+				this->m_arena.huge_pages = arena.huge_pages;
+				rebase = { arena.data, this->m_arena.data, arena.pages };
+			} else
+#endif
 			{
-				const auto& page = it.second;
-				// Skip pages marked as dont_fork
-				if (page.attr.dont_fork) continue;
-				// Make every page non-owning
-				auto attr = page.attr;
-				if (attr.write) {
-					attr.write = false;
-					attr.is_cow = true;
-				}
-				attr.non_owning = true;
-				m_pages.try_emplace(
-					it.first,
-					attr, page.m_page.get()
-				);
+				// Writes to the arena are visible to the master
+				this->m_arena.data = arena.data;
+				this->m_arena.borrowed = true;
+				this->m_arena.hugetlb = arena.hugetlb;
 			}
+			this->m_arena.pages = arena.pages;
+			this->m_arena.read_boundary = arena.read_boundary;
+			this->m_arena.write_boundary = arena.write_boundary;
+			this->m_arena.initial_rodata_end = arena.initial_rodata_end;
+			this->m_arena_mappings = master.memory.m_arena_mappings;
+			// Forks track their own arena writes
+			if constexpr (arena_dirty_tracking)
+				this->m_arena_dirty.resize(master.memory.m_arena_dirty.size());
+		}
+
+		if (options.minimal_fork == false)
+		{
+			// Borrow the page tables of the master machine. Each leaf
+			// table is materialized on first access, making every page
+			// non-owning and writable pages copy-on-write. Pages in the
+			// masters arena are loaned from our private view instead.
+			m_pages.fork_from(master.memory.pages(), rebase);
 		}
 		this->m_start_address = master.memory.m_start_address;
 		this->m_stack_address = master.memory.m_stack_address;
@@ -494,18 +773,7 @@ namespace riscv
 		this->m_mmap_cache   = master.memory.m_mmap_cache;
 
 		// Reference the same execute segments
-		this->m_exec_segs = master.memory.m_exec_segs;
-		for (size_t i = 0; i < m_exec_segs; i++) {
-			this->m_exec[i] = master.memory.m_exec[i];
-		}
-
-		if (options.use_memory_arena) {
-			this->m_arena.data = master.memory.m_arena.data;
-			this->m_arena.pages = master.memory.m_arena.pages;
-			this->m_arena.read_boundary = master.memory.m_arena.read_boundary;
-			this->m_arena.write_boundary = master.memory.m_arena.write_boundary;
-			this->m_arena.initial_rodata_end = master.memory.m_arena.initial_rodata_end;
-		}
+		this->m_exec = master.memory.m_exec;
 
 		// invalidate all cached pages, because references are invalidated
 		this->invalidate_reset_cache();
@@ -1,12 +1,14 @@
 #pragma once
 #include "elf.hpp"
 #include "page.hpp"
+#include "page_table.hpp"
 #include <cassert>
 #include <cstring>
 #include <string_view>
-#include <unordered_map>
 #include "decoded_exec_segment.hpp"
+#include "exec_segment_index.hpp"
 #include "mmap_cache.hpp"
+#include "tlb.hpp"
 #include "util/buffer.hpp" // <string>
 #include "util/function.hpp"
 #if RISCV_SPAN_AVAILABLE
@@ -18,6 +20,26 @@ namespace riscv
 	template<int W> struct Machine;
 	struct vBuffer { char* ptr; size_t len; };
 
+	// A RISC-V ELF program on disk, given as a path or an open file
+	// descriptor. The file is memory-mapped instead of read into memory.
+	struct ProgramFile {
+		explicit ProgramFile(std::string p) : path(std::move(p)) {}
+		explicit ProgramFile(int f) : fd(f) {}
+		std::string path;
+		int fd = -1;
+	};
+	// A memory-mapped ELF program, owned by the machine that mapped it
+	struct MappedProgram {
+		MappedProgram() = default;
+		MappedProgram(const ProgramFile&);
+		MappedProgram(MappedProgram&&) noexcept;
+		MappedProgram& operator= (MappedProgram&&) = delete;
+		~MappedProgram();
+
+		std::string_view data;
+		int fd = -1;
+	};
+
 	template<int W>
 	struct alignas(32) Memory
 	{
@@ -29,7 +51,6 @@ namespace riscv
 		static constexpr address_t BRK_MAX      = RISCV_BRK_MEMORY_SIZE; // Default BRK size
 		static constexpr address_t DYLINK_BASE  = 0x40000; // Dynamic link base address
 		static constexpr address_t RWREAD_BEGIN = 0x1000; // Default rw-arena rodata start
-		static constexpr size_t    MAX_EXECUTE_SEGS = 8;
 
 		template <typename T>
 		T read(address_t src);
@@ -99,6 +120,12 @@ namespace riscv
 		bool mmap_relax(address_t addr, address_t size, address_t new_size);
 		// Unmap a memory range
 		bool mmap_unmap(address_t addr, address_t size);
+		// Map a range of a host file into memory without copying it. Pages are
+		// read from the file on first access, and writes are private to the
+		// machine. Returns false when the range has to be copied instead.
+		bool mmap_file(address_t addr, address_t size, int fd, uint64_t offset, PageAttributes);
+		// Restore ordinary memory where files were mapped in a memory range
+		void munmap_file(address_t addr, address_t size);
 
 
 		Machine<W>& machine() noexcept { return this->m_machine; }
@@ -153,6 +180,9 @@ namespace riscv
 		Page& allocate_page(address_t page, Args&& ...);
 		void  invalidate_cache(address_t pageno, Page*) const noexcept;
 		void  invalidate_reset_cache() const noexcept;
+		// Software TLB hit/miss counters (requires RISCV_TLB_STATS)
+		const auto& tlb_stats() const noexcept { return m_tlb.stats(); }
+		void reset_tlb_stats() noexcept { m_tlb.reset_stats(); }
 		void  free_pages(address_t, size_t len);
 		bool  free_pageno(address_t pageno);
 
@@ -189,13 +219,35 @@ namespace riscv
 		std::shared_ptr<DecodedExecuteSegment<W>>& exec_segment_for(address_t vaddr);
 		const std::shared_ptr<DecodedExecuteSegment<W>>& exec_segment_for(address_t vaddr) const;
 		DecodedExecuteSegment<W>& create_execute_segment(const MachineOptions<W>&, const void* data, address_t addr, size_t len, bool is_initial, bool is_likely_jit = false);
-		size_t cached_execute_segments() const noexcept { return m_exec_segs; }
+		// Decode the page of a lazily decoded segment that contains pc, unless
+		// it is already decoded. Returns false if pc is an invalid instruction.
+		bool decode_execute_page(DecodedExecuteSegment<W>&, address_t pc);
+		// Copy the page that contains pc from guest memory into a JIT execute
+		// segment, if it changed, so that it is decoded again when entered.
+		// Returns true if the page had changed.
+		bool refresh_execute_page(DecodedExecuteSegment<W>&, address_t pc);
+		// Refresh every JIT execute segment page in the given range, eg. after
+		// FENCE.I or riscv_flush_icache. Returns the number of changed pages.
+		size_t invalidate_execute_pages(address_t addr = 0, address_t len = ~address_t(0));
+		size_t cached_execute_segments() const noexcept { return m_exec.size(); }
 		// Evict all execute segments, also disabling the main execute segment
 		void evict_execute_segments();
 		void evict_execute_segment(DecodedExecuteSegment<W>&);
 #ifdef RISCV_BINARY_TRANSLATION
 		std::vector<address_t> gather_jump_hints() const;
 #endif
+		// Block profiling: The blocks of all execute segments that have been
+		// entered, sorted by instructions executed, hottest first. Requires
+		// RISCV_BLOCK_PROFILING, otherwise the profile is always empty.
+		// Shared execute segments count the blocks of every machine using them.
+		struct BlockProfile {
+			address_t address;
+			Callsite  callsite;
+			uint64_t  count;        // Times the block was entered
+			uint64_t  instructions; // Instructions executed in the block
+		};
+		std::vector<BlockProfile> block_profile(size_t max_blocks = SIZE_MAX) const;
+		void reset_block_profile();
 
 		const auto& binary() const noexcept { return m_binary; }
 		void reset();
@@ -210,6 +262,27 @@ namespace riscv
 		address_t memory_arena_write_boundary() const noexcept { return this->m_arena.write_boundary; }
 		address_t initial_rodata_end() const noexcept { return this->m_arena.initial_rodata_end; }
 
+		/// @brief Check if a page in the flat read-write arena has been written
+		/// to since the memory was created, or since the dirty pages were last
+		/// cleared. Requires RISCV_ARENA_DIRTY_TRACKING.
+		/// @param pageno The page number to check
+		/// @return True if the arena page is dirty
+		bool is_arena_page_dirty(address_t pageno) const noexcept;
+		/// @brief Gather the page numbers of all dirty arena pages, in order.
+		/// @return A sorted list of dirty arena page numbers
+		std::vector<address_t> dirty_arena_pages() const;
+		/// @brief Forget all dirty arena pages, starting a new tracking period.
+		/// Serialization only includes arena pages that are dirty, so clearing
+		/// makes the next serialization a delta against the cleared state.
+		void clear_arena_dirty_pages() noexcept;
+
+		/// @brief Rewind a forked memory to the state of the memory it was
+		/// forked from. Only pages changed since the fork are visited.
+		/// Used by Machine::reset_to_parent().
+		/// @param parent The memory this memory was forked from
+		/// @param borrow_pages False for minimal forks, which don't borrow pages
+		void reset_to_parent(const Memory& parent, bool borrow_pages);
+
 		// Serializes the current memory state to an existing vector
 		// Returns the final size of the serialized state
 		size_t serialize_to(std::vector<uint8_t>& vec) const;
@@ -217,11 +290,27 @@ namespace riscv
 		void deserialize_from(const std::vector<uint8_t>&, const SerializedMachine<W>&);
 
 		Memory(Machine<W>&, std::string_view, MachineOptions<W>);
+		Memory(Machine<W>&, const ProgramFile&, MachineOptions<W>);
 		Memory(Machine<W>&, const Machine<W>&, MachineOptions<W>);
 		~Memory();
 	private:
+		Memory(Machine<W>&, std::string_view, MappedProgram, MachineOptions<W>);
 		void clear_all_pages();
 		void initial_paging();
+		void* create_arena(size_t len, const MachineOptions<W>&);
+		bool  madvise_discard(void* ptr, size_t len);
+		// Forks remember which pages they have changed
+		void mark_dirty(address_t pageno) {
+			if (!m_original_machine && (m_dirty_pages.empty() || m_dirty_pages.back() != pageno))
+				m_dirty_pages.push_back(pageno);
+		}
+		// Arena writes bypass the page table, so they are tracked in a bitmap
+		void mark_arena_dirty(address_t pageno) noexcept {
+			if constexpr (arena_dirty_tracking) {
+				if (pageno < m_arena.pages)
+					m_arena_dirty[pageno / 64] |= uint64_t(1) << (pageno % 64);
+			}
+		}
 		[[noreturn]] static void protection_fault(address_t);
 		const PageData& cached_readable_page(address_t, size_t) const;
 		PageData& cached_writable_page(address_t);
@@ -255,6 +344,7 @@ namespace riscv
 		// ELF loader
 		void binary_loader(const MachineOptions<W>&);
 		void binary_load_ph(const MachineOptions<W>&, const typename Elf::ProgramHeader*, address_t vaddr);
+		void binary_map_ph(const typename Elf::ProgramHeader*, address_t vaddr, PageAttributes);
 		void serialize_execute_segment(const MachineOptions<W>&, const typename Elf::ProgramHeader*, address_t vaddr);
 		void generate_decoder_cache(const MachineOptions<W>&, std::shared_ptr<DecodedExecuteSegment<W>>&, bool is_initial);
 		// Machine copy-on-write fork
@@ -268,15 +358,18 @@ namespace riscv
 
 		Machine<W>& m_machine;
 
-		mutable CachedPage<W, const PageData> m_rd_cache;
-		mutable CachedPage<W, PageData> m_wr_cache;
+		// Software TLB for reads and writes outside of the arena
+		mutable PageTLB<W, PageData, TLBSize> m_tlb;
 
-		std::unordered_map<address_t, Page> m_pages;
+		PageTable<W> m_pages;
+		// Pages changed since this machine was forked
+		std::vector<address_t> m_dirty_pages;
 
 		const bool m_original_machine;
 		bool m_is_dynamic = false;
 		address_t elf_base_address(address_t offset) const;
 
+		MappedProgram m_program;
 		const std::string_view m_binary;
 
 		// Memory map cache
@@ -291,9 +384,9 @@ namespace riscv
 #endif
 
 		// Execute segments
-		std::array<std::shared_ptr<DecodedExecuteSegment<W>>, MAX_EXECUTE_SEGS> m_exec;
-		size_t m_exec_segs = 0;
-		std::shared_ptr<DecodedExecuteSegment<W>>& next_execute_segment();
+		ExecuteSegmentIndex<W> m_exec;
+		std::shared_ptr<DecodedExecuteSegment<W>>& insert_execute_segment(const MachineOptions<W>&, std::shared_ptr<DecodedExecuteSegment<W>>);
+		bool refresh_page(DecodedExecuteSegment<W>&, size_t page, bool force);
 
 		// Linear arena at start of memory (mmap-backed)
 		struct {
@@ -302,7 +395,29 @@ namespace riscv
 			address_t write_boundary = 0;
 			address_t initial_rodata_end = 0;
 			size_t    pages = 0;
+			size_t    length = 0;     // Size of the mapping
+			int  fd = -1;             // Memory file backing a forkable arena
+			bool file_backed = false; // Arena is a view of a memory file
+			bool borrowed = false;    // Arena belongs to the machine we forked from
+			bool huge_pages = false;  // Arena is advised to use huge pages
+			bool hugetlb = false;     // Arena is made of explicit huge pages
 		} m_arena;
+		// One bit per arena page, set on write (RISCV_ARENA_DIRTY_TRACKING)
+		std::vector<uint64_t> m_arena_dirty;
+		// File ranges mapped privately into an arena that is not forkable
+		struct ArenaFileMapping {
+			size_t arena_offset;
+			size_t file_offset;
+			size_t length;
+		};
+		std::vector<ArenaFileMapping> m_arena_mappings;
+		// Host file mappings that pages outside of the arena are loaned from
+		struct FileMapping {
+			address_t addr;
+			size_t    length;
+			void*     data;
+		};
+		std::vector<FileMapping> m_file_mappings;
 
 		friend struct CPU<W>;
 	};
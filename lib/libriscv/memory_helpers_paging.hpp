@@ -8,6 +8,7 @@ void Memory<W>::memset(address_t dst, uint8_t value, size_t len)
 		const size_t offset = dst & (Page::size()-1); // offset within page
 		const size_t size = std::min(Page::size() - offset, len);
 		auto& page = this->create_writable_pageno(dst / Page::size(), size != Page::size());
+		this->mark_arena_dirty(dst / Page::size());
 
 		std::memset(page.data() + offset, value, size);
 
@@ -25,6 +26,7 @@ void Memory<W>::memcpy(address_t dst, const void* vsrc, size_t len)
 		const size_t offset = dst & (Page::size()-1); // offset within page
 		const size_t size = std::min(Page::size() - offset, len);
 		auto& page = this->create_writable_pageno(dst / Page::size(), size != Page::size());
+		this->mark_arena_dirty(dst / Page::size());
 
 		std::copy(src, src + size, page.data() + offset);
 
@@ -370,6 +372,7 @@ size_t Memory<W>::gather_writable_buffers_from_range(
 		const size_t offset = addr & (Page::SIZE-1);
 		const size_t size = std::min(Page::SIZE - offset, len);
 		auto& page = create_writable_pageno(page_number(addr));
+		mark_arena_dirty(page_number(addr));
 
 		auto* ptr = (char*) &page.data()[offset];
 		if (last && ptr == last->ptr + last->len) {
@@ -61,6 +61,7 @@ T& Memory<W>::writable_read(address_t address)
 
 	if constexpr (flat_readwrite_arena) {
 		if (LIKELY(address - initial_rodata_end() < memory_arena_write_boundary())) {
+			mark_arena_dirty(page_number(address));
 			return *(T *)&((char*)m_arena.data)[RISCV_SPECSAFE(address)];
 		}
 		[[unlikely]];
@@ -94,6 +95,7 @@ void Memory<W>::write(address_t address, T value)
 	}
 	else if constexpr (flat_readwrite_arena) {
 		if (LIKELY(address - initial_rodata_end() < memory_arena_write_boundary())) {
+			mark_arena_dirty(page_number(address));
 #ifdef RISCV_EXT_VECTOR
 			if constexpr (sizeof(T) >= 32) {
 				// Reads and writes using vectors might have alignment requirements
@@ -107,15 +109,17 @@ void Memory<W>::write(address_t address, T value)
 	}
 
 	const auto pageno = page_number(address);
-	auto& entry = m_wr_cache;
-	if (entry.pageno == pageno) {
-		entry.page->template aligned_write<T>(offset, value);
+	if (auto* data = m_tlb.writable(pageno); LIKELY(data != nullptr)) {
+		data->template aligned_write<T>(offset, value);
 		return;
 	}
 
 	auto& page = create_writable_pageno(pageno);
+	// Later writes through the TLB are not tracked, so
+	// clearing the dirty pages also flushes the TLB.
+	mark_arena_dirty(pageno);
 	if (LIKELY(page.attr.is_cacheable())) {
-		entry = {pageno, &page.page()};
+		m_tlb.insert(pageno, &page.page(), page.attr.read, true);
 	} else if constexpr (memory_traps_enabled && sizeof(T) <= 16) {
 		if (UNLIKELY(page.has_trap())) {
 			page.trap(offset, sizeof(T) | TRAP_WRITE, value);
@@ -157,9 +161,8 @@ inline void Memory<W>::set_exit_address(address_t addr)
 template <int W>
 inline std::shared_ptr<DecodedExecuteSegment<W>>& Memory<W>::exec_segment_for(address_t vaddr)
 {
-	for (size_t i = 0; i < m_exec_segs; i++) {
-		auto& segment = m_exec[i];
-		if (segment && segment->is_within(vaddr)) return segment;
-	}
+	auto* segment = m_exec.find(vaddr);
+	if (segment != nullptr)
+		return *segment;
 	return CPU<W>::empty_execute_segment();
 }
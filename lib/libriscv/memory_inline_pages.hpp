@@ -3,13 +3,14 @@ template <int W> inline
 const PageData& Memory<W>::cached_readable_page(address_t address, size_t len) const
 {
 	const auto pageno = page_number(address);
-	auto& entry = m_rd_cache;
-	if (entry.pageno == pageno)
-		return *entry.page;
+	if (const auto* data = m_tlb.readable(pageno); LIKELY(data != nullptr))
+		return *data;
 
 	auto& page = get_readable_pageno(pageno);
 	if (LIKELY(page.attr.is_cacheable())) {
-		entry = {pageno, &page.page()};
+		// Pages from the read fault handler may be shared (eg. the zero page),
+		// so a read-fill never grants write access through the TLB.
+		m_tlb.insert(pageno, const_cast<PageData*>(&page.page()), true, false);
 	} else if constexpr (memory_traps_enabled) {
 		if (UNLIKELY(page.has_trap())) {
 			page.trap(address & (Page::size()-1), len | TRAP_READ, 0);
@@ -22,12 +23,12 @@ template <int W> inline
 PageData& Memory<W>::cached_writable_page(address_t address)
 {
 	const auto pageno = page_number(address);
-	auto& entry = m_wr_cache;
-	if (entry.pageno == pageno)
-		return *entry.page;
+	if (auto* data = m_tlb.writable(pageno); LIKELY(data != nullptr))
+		return *data;
 	auto& page = create_writable_pageno(pageno);
+	mark_arena_dirty(pageno);
 	if (LIKELY(page.attr.is_cacheable()))
-		entry = {pageno, &page.page()};
+		m_tlb.insert(pageno, &page.page(), page.attr.read, true);
 	return page.page();
 }
 
@@ -41,9 +42,9 @@ inline const Page& Memory<W>::get_page(const address_t address) const
 template <int W>
 inline const Page& Memory<W>::get_exec_pageno(const address_t pageno) const
 {
-	auto it = m_pages.find(pageno);
-	if (LIKELY(it != m_pages.end())) {
-		return it->second;
+	const Page* page = m_pages.find(pageno);
+	if (LIKELY(page != nullptr)) {
+		return *page;
 	}
 	CPU<W>::trigger_exception(EXECUTION_SPACE_PROTECTION_FAULT, pageno * Page::size());
 }
@@ -51,9 +52,9 @@ inline const Page& Memory<W>::get_exec_pageno(const address_t pageno) const
 template <int W>
 inline const Page& Memory<W>::get_pageno(const address_t pageno) const
 {
-	auto it = m_pages.find(pageno);
-	if (LIKELY(it != m_pages.end())) {
-		return it->second;
+	const Page* page = m_pages.find(pageno);
+	if (LIKELY(page != nullptr)) {
+		return *page;
 	}
 
 	return m_page_readf_handler(*this, pageno);
@@ -62,19 +63,15 @@ inline const Page& Memory<W>::get_pageno(const address_t pageno) const
 template <int W> inline void
 Memory<W>::invalidate_cache(address_t pageno, Page* page) const noexcept
 {
-	// NOTE: It is only possible to keep the write page as long as
-	// the page tables are node-based. In that case, we only have
-	// to invalidate the read page when it matches.
-	if (m_rd_cache.pageno == pageno) {
-		m_rd_cache.pageno = (address_t)-1;
-	}
+	// Pages never move inside the page table, so only the
+	// TLB entry that maps this page number can be stale.
+	m_tlb.invalidate(pageno);
 	(void)page;
 }
 template <int W> inline void
 Memory<W>::invalidate_reset_cache() const noexcept
 {
-	m_rd_cache.pageno = (address_t)-1;
-	m_wr_cache.pageno = (address_t)-1;
+	m_tlb.invalidate_all();
 }
 
 template <int W>
@@ -86,9 +83,10 @@ Page& Memory<W>::allocate_page(const address_t page, Args&&... args)
 		std::forward<Args> (args)...
 	);
 	// Invalidate only this page
-	this->invalidate_cache(page, &it.first->second);
+	this->invalidate_cache(page, it.first);
+	this->mark_dirty(page);
 	// Return new default-writable page
-	return it.first->second;
+	return *it.first;
 }
 
 template <int W>
@@ -1,5 +1,13 @@
 #include "machine.hpp"
 #include "internal_common.hpp"
+#include <algorithm>
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace riscv
 {
@@ -32,6 +40,10 @@ namespace riscv
 		{
 			// If relaxation happened, invalidate intersecting cache entries.
 			this->mmap_cache().invalidate(addr, size);
+			// A free range that now ends at the top can be relaxed as well
+			const auto below = this->mmap_cache().remove_ending_at(this->m_mmap_address);
+			if (!below.empty())
+				this->m_mmap_address = below.addr;
 		}
 		else if (addr >= this->mmap_start())
 		{
@@ -41,6 +53,174 @@ namespace riscv
 		return relaxed;
 	}
 
+#ifdef __linux__
+	// Reads a file range, zeroing what is beyond the end of the file
+	static bool read_file_range(int fd, uint64_t offset, char* dst, size_t length)
+	{
+		while (length > 0) {
+			const ssize_t bytes = pread(fd, dst, length, offset);
+			if (bytes < 0 && errno == EINTR)
+				continue;
+			if (bytes < 0)
+				return false;
+			if (bytes == 0) {
+				std::memset(dst, 0, length);
+				break;
+			}
+			dst += bytes;
+			offset += bytes;
+			length -= bytes;
+		}
+		return true;
+	}
+#endif
+
+	template <int W>
+	bool Memory<W>::mmap_file(address_t addr, address_t size,
+		int fd, uint64_t offset, PageAttributes attr)
+	{
+#ifdef __linux__
+		struct stat st;
+		if (size == 0 || addr % Page::size() != 0 || offset % Page::size() != 0)
+			return false;
+		if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || offset >= uint64_t(st.st_size))
+			return false;
+		// Pages entirely beyond the end of the file would fault in the host
+		const uint64_t file_pages = (st.st_size - offset + PageMask) & ~uint64_t(PageMask);
+		const address_t end = addr + address_t(std::min(uint64_t(size), file_pages));
+		if (end < addr)
+			return false;
+		// Without a flat arena, pages are only visible through the page
+		// table, so the whole range is loaned from the file instead.
+		const address_t arena_size = flat_readwrite_arena ? memory_arena_size() : 0;
+		const address_t arena_end = std::clamp(arena_size, addr, end);
+
+		// Only the owner of the arena can change its mappings
+		if (addr < arena_end &&
+			(m_arena.borrowed || m_arena.hugetlb || (m_arena.file_backed && m_arena.fd < 0)))
+			return false;
+		void* data = nullptr;
+		if (arena_end < end) {
+			data = mmap(NULL, end - arena_end, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+				fd, offset + (arena_end - addr));
+			if (data == MAP_FAILED)
+				return false;
+		}
+		this->munmap_file(addr, size);
+
+		if (addr < arena_end) {
+			char* dst = (char *)m_arena.data + addr;
+			bool mapped = false;
+			if (m_arena.fd >= 0) {
+				// Forks of a forkable arena only see its memory file, and
+				// must see every write of the master, so the file contents
+				// are copied into it instead of being mapped privately
+				mapped = read_file_range(fd, offset, dst, arena_end - addr);
+			} else if (mmap(dst, arena_end - addr, PROT_READ | PROT_WRITE,
+					MAP_PRIVATE | MAP_FIXED, fd, offset) != MAP_FAILED)
+			{
+				m_arena_mappings.push_back({ addr, offset, arena_end - addr });
+				mapped = true;
+			}
+			if (!mapped) {
+				if (data != nullptr)
+					munmap(data, end - arena_end);
+				return false;
+			}
+			// The file contents are part of the arena state now
+			for (address_t pageno = page_number(addr); pageno < page_number(arena_end); pageno++)
+				this->mark_arena_dirty(pageno);
+			this->set_page_attr(addr, arena_end - addr, attr);
+		}
+		if (data != nullptr) {
+			// Writable pages are copy-on-write, and get copied on the first write
+			PageAttributes file_attr = attr;
+			file_attr.is_cow = attr.write;
+			file_attr.write = false;
+			this->free_pages(arena_end, end - arena_end);
+			this->insert_non_owned_memory(arena_end, data, end - arena_end, file_attr);
+			m_file_mappings.push_back({ arena_end, end - arena_end, data });
+		}
+		// The rest of the range is beyond the end of the file
+		if (end < addr + size) {
+			this->memdiscard(end, addr + size - end, true);
+			this->set_page_attr(end, addr + size - end, attr);
+		}
+		return true;
+#else
+		(void)addr; (void)size; (void)fd; (void)offset; (void)attr;
+		return false;
+#endif
+	}
+
+	template <int W>
+	void Memory<W>::munmap_file(address_t addr, address_t size)
+	{
+#ifdef __linux__
+		const address_t end = addr + size;
+		for (size_t i = 0; i < m_file_mappings.size();) {
+			const auto mapping = m_file_mappings[i];
+			const address_t begin = std::max(addr, mapping.addr);
+			const address_t until = std::min(end, address_t(mapping.addr + mapping.length));
+			if (begin >= until) {
+				i++;
+				continue;
+			}
+			// No page may be loaned from the mapping when it goes away
+			this->free_pages(begin, until - begin);
+			munmap((char *)mapping.data + (begin - mapping.addr), until - begin);
+
+			// Keep what remains of the host mapping on either side
+			m_file_mappings.erase(m_file_mappings.begin() + i);
+			if (until < mapping.addr + mapping.length) {
+				const size_t skip = until - mapping.addr;
+				m_file_mappings.insert(m_file_mappings.begin() + i,
+					{ until, mapping.length - skip, (char *)mapping.data + skip });
+				i++;
+			}
+			if (begin > mapping.addr) {
+				m_file_mappings.insert(m_file_mappings.begin() + i,
+					{ mapping.addr, size_t(begin - mapping.addr), mapping.data });
+				i++;
+			}
+		}
+
+		// Only the owner of the arena can change its mappings
+		if (m_arena.borrowed || (m_arena.file_backed && m_arena.fd < 0))
+			return;
+		for (size_t i = 0; i < m_arena_mappings.size();) {
+			const auto mapping = m_arena_mappings[i];
+			const size_t begin = std::max(size_t(addr), mapping.arena_offset);
+			const size_t until = std::min(size_t(end), mapping.arena_offset + mapping.length);
+			if (begin >= until) {
+				i++;
+				continue;
+			}
+			// Put the original arena memory back in place of the file
+			void* data = mmap((char *)m_arena.data + begin, until - begin, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+			if (data == MAP_FAILED)
+				throw MachineException(OUT_OF_MEMORY, "Unable to unmap file", until - begin);
+
+			// Keep what remains of the file range on either side
+			m_arena_mappings.erase(m_arena_mappings.begin() + i);
+			if (until < mapping.arena_offset + mapping.length) {
+				const size_t skip = until - mapping.arena_offset;
+				m_arena_mappings.insert(m_arena_mappings.begin() + i,
+					{ until, mapping.file_offset + skip, mapping.length - skip });
+				i++;
+			}
+			if (begin > mapping.arena_offset) {
+				m_arena_mappings.insert(m_arena_mappings.begin() + i,
+					{ mapping.arena_offset, mapping.file_offset, begin - mapping.arena_offset });
+				i++;
+			}
+		}
+#else
+		(void)addr; (void)size;
+#endif
+	}
+
 	INSTANTIATE_32_IF_ENABLED(Memory);
 	INSTANTIATE_64_IF_ENABLED(Memory);
 	INSTANTIATE_128_IF_ENABLED(Memory);
@@ -23,9 +23,8 @@ namespace riscv
 	template <int W>
 	Page& Memory<W>::create_writable_pageno(const address_t pageno, bool init)
 	{
-		auto it = m_pages.find(pageno);
-		if (LIKELY(it != m_pages.end())) {
-			Page& page = it->second;
+		if (Page* found = m_pages.find(pageno); LIKELY(found != nullptr)) {
+			Page& page = *found;
 			if (LIKELY(page.attr.write)) {
 				return page;
 			} else if (page.attr.is_cow) {
@@ -33,6 +32,7 @@ namespace riscv
 				// The page may be read-cached at this time
 				// and the page data has likely changed now.
 				this->invalidate_cache(pageno, &page);
+				this->mark_dirty(pageno);
 				return page;
 			}
 		} else {
@@ -49,9 +49,9 @@ namespace riscv
 	template <int W>
 	void Memory<W>::set_pageno_attr(const address_t pageno, PageAttributes attr)
 	{
-		auto it = pages().find(pageno);
-		if (it != pages().end()) {
-			auto& page = it->second;
+		this->mark_dirty(pageno);
+		if (Page* found = m_pages.find(pageno); found != nullptr) {
+			auto& page = *found;
 			// Keep non-owning and is_cow attributes
 			const bool is_cow = page.attr.is_cow;
 			page.attr.apply_regular_attributes(attr);
@@ -88,9 +88,6 @@ namespace riscv
 	template <int W>
 	void Memory<W>::memdiscard(address_t dst, size_t len, bool ignore_protections)
 	{
-#ifndef MADV_DONTNEED
-		static constexpr int MADV_DONTNEED = 0x4;
-#endif
 		while (len > 0)
 		{
 			const size_t offset = dst & (Page::size()-1); // offset within page
@@ -99,26 +96,22 @@ namespace riscv
 
 			// We only use the page table now because we have previously
 			// checked special regions.
-			auto it = m_pages.find(pageno);
+			Page* found = m_pages.find(pageno);
 			// If we don't find a page, we can treat it as a CoW zero page
-			if (it != m_pages.end()) {
-				Page& page = it->second;
+			if (found != nullptr) {
+				Page& page = *found;
 				if (page.is_cow_page()) {
 					// This is the zero-page
 				} else {
 					if (page.attr.is_cow) {
 						m_page_write_handler(*this, pageno, page);
+						this->mark_dirty(pageno);
 					}
 					if (page.attr.write || ignore_protections) {
+						this->mark_arena_dirty(pageno);
 
-						if constexpr (MADVISE_ENABLED) {
-							// madvise "fast-path" (XXX: doesn't scale on busy server)
-							if (offset == 0 && size == Page::size()) {
-								madvise(page.data(), Page::size(), MADV_DONTNEED);
-							} else {
-								std::memset(page.data() + offset, 0, size);
-							}
-						} else {
+						// madvise "fast-path" (XXX: doesn't scale on busy server)
+						if (offset != 0 || size != Page::size() || !madvise_discard(page.data(), Page::size())) {
 							// Zero the existing writable page
 							std::memset(page.data() + offset, 0, size);
 						}
@@ -132,15 +125,16 @@ namespace riscv
 				if (flat_readwrite_arena && pageno < this->m_arena.pages)
 				{
 					// Fast-path using madvise
-					if constexpr (MADVISE_ENABLED) {
-						// XXX: doesn't scale on busy server
-						if (offset == 0 && size == Page::size()) {
-							address_t new_dst = dst + (len & ~address_t(Page::size()-1));
-							new_dst = std::min(new_dst, (address_t)memory_arena_size());
-							const size_t new_size = new_dst - dst;
+					// XXX: doesn't scale on busy server
+					if (offset == 0 && size == Page::size()) {
+						address_t new_dst = dst + (len & ~address_t(Page::size()-1));
+						new_dst = std::min(new_dst, (address_t)memory_arena_size());
+						const size_t new_size = new_dst - dst;
 
-							auto* baseptr = &((uint8_t *)m_arena.data)[dst];
-							madvise(baseptr, Page::size(), MADV_DONTNEED);
+						auto* baseptr = &((uint8_t *)m_arena.data)[dst];
+						if (madvise_discard(baseptr, new_size)) {
+							for (address_t p = pageno; p < page_number(new_dst); p++)
+								this->mark_arena_dirty(p);
 
 							dst += new_size;
 							len -= new_size;
@@ -152,6 +146,7 @@ namespace riscv
 					// Unfortunately we don't know if this page is untouched,
 					// but we can use MADV_DONTNEED
 					if (page.attr.write || ignore_protections) {
+						this->mark_arena_dirty(pageno);
 						std::memset(page.data() + offset, 0, size);
 					} else if (!ignore_protections) {
 						this->protection_fault(dst);
@@ -167,9 +162,49 @@ namespace riscv
 		}
 	}
 
+	template <int W>
+	bool Memory<W>::madvise_discard(void* ptr, size_t len)
+	{
+#ifndef MADV_DONTNEED
+		static constexpr int MADV_DONTNEED = 0x4;
+#endif
+		if constexpr (!MADVISE_ENABLED)
+			return false;
+		const uintptr_t offset = uintptr_t(ptr) - uintptr_t(m_arena.data);
+		const bool in_arena = offset < memory_arena_size();
+		// Explicit huge pages can only be discarded whole
+		if (in_arena && m_arena.hugetlb)
+			return false;
+		// Memory mapped from a file would read back the file
+		if (in_arena) {
+			for (const auto& mapping : m_arena_mappings) {
+				if (offset < mapping.arena_offset + mapping.length && offset + len > mapping.arena_offset)
+					return false;
+			}
+		}
+		if (uintptr_t(ptr) - uintptr_t(m_binary.data()) < m_binary.size())
+			return false;
+		for (const auto& mapping : m_file_mappings) {
+			if (uintptr_t(ptr) - uintptr_t(mapping.data) < mapping.length)
+				return false;
+		}
+		if (!in_arena || !m_arena.file_backed) {
+			// Private anonymous memory reads back as zeroes
+			return madvise(ptr, len, MADV_DONTNEED) == 0;
+		}
+#ifdef MADV_REMOVE
+		// Free the backing file pages of a forkable arena
+		if (m_arena.fd >= 0)
+			return madvise(ptr, len, MADV_REMOVE) == 0;
+#endif
+		// A private view of the file would read back the masters data
+		return false;
+	}
+
 	template <int W>
 	bool Memory<W>::free_pageno(address_t pageno)
 	{
+		this->mark_dirty(pageno);
 		return m_pages.erase(pageno) != 0;
 	}
 
@@ -262,15 +297,16 @@ namespace riscv
 			pageno,
 			attr, const_cast<PageData*> (shared_page.m_page.get())
 		);
+		this->mark_dirty(pageno);
 		// TODO: Can be improved by invalidating more intelligently
 		this->invalidate_reset_cache();
 		// try overwriting instead, if emplace failed
 		if (res.second == false) {
-			Page& page = res.first->second;
+			Page& page = *res.first;
 			new (&page) Page{attr, const_cast<PageData*> (shared_page.m_page.get())};
 			return page;
 		}
-		return res.first->second;
+		return *res.first;
 	}
 
 	template <int W>
@@ -289,6 +325,7 @@ namespace riscv
 				pageno,
 				attr, pdata
 			);
+			this->mark_dirty(pageno);
 		}
 		// TODO: Can be improved by invalidating more intelligently
 		this->invalidate_reset_cache();
@@ -326,10 +363,7 @@ namespace riscv
 					total += Page::size();
 		}
 
-		for (const auto& exec : m_exec) {
-			if (exec)
-				total += exec->size_bytes();
-		}
+		total += m_exec.size_bytes();
 
 		return total;
 	}
@@ -1,10 +1,17 @@
-#include <array>
+#include <algorithm>
 #include <cstdint>
-#include <vector>
+#include <iterator>
+#include <map>
+#include <set>
+#include <utility>
 #include "types.hpp"
 
 namespace riscv
 {
+	// Free ranges in the mmap area. The ranges are kept in address order,
+	// so that freed memory coalesces with both of its neighbours, and in
+	// size order, so that allocations are best-fit. Every operation is
+	// logarithmic in the number of free ranges.
 	template <int W>
 	struct MMapCache
 	{
@@ -15,71 +22,105 @@ namespace riscv
 			address_t size = 0u;
 
 			constexpr bool empty() const noexcept { return size == 0u; }
-			// Invalidate if one of the ranges is in the other (both ways!)
-			constexpr bool within(address_t mem, address_t memsize) const noexcept {
-				return ((this->addr >= mem) && (this->addr + this->size <= mem + memsize))
-					|| ((mem >= this->addr) && (mem + memsize <= this->addr + this->size));
-			}
-			constexpr bool equals(address_t mem, address_t memsize) const noexcept {
-				return (this->addr == mem) && (this->addr + this->size == mem + memsize);
-			}
 		};
 
+		// Allocate from the smallest free range that fits
 		Range find(address_t size)
 		{
-			auto it = m_lines.begin();
-			while (it != m_lines.end())
-			{
-				auto& r = *it;
-				if (!r.empty())
-				{
-					if (r.size >= size) {
-						const Range result { r.addr, size };
-						if (r.size > size) {
-							r.addr += size;
-							r.size -= size;
-						} else {
-							m_lines.erase(it);
-						}
-						return result;
-					}
-				}
-				++it;
-			}
-			return Range{};
+			if (size == 0u)
+				return Range{};
+			auto it = m_by_size.lower_bound({size, 0});
+			if (it == m_by_size.end())
+				return Range{};
+
+			const Range r { it->second, it->first };
+			this->remove(m_by_addr.find(r.addr));
+			if (r.size > size)
+				this->add(r.addr + size, r.size - size);
+			return Range{ r.addr, size };
 		}
 
+		// Remove a memory range from the free ranges, splitting
+		// the ranges that only partially overlap with it
 		void invalidate(address_t addr, address_t size)
 		{
-			auto it = m_lines.begin();
-			while (it != m_lines.end())
+			const address_t end = addr + size;
+			auto it = m_by_addr.upper_bound(addr);
+			if (it != m_by_addr.begin())
+				--it;
+			while (it != m_by_addr.end() && it->first < end)
 			{
-				const auto r = *it;
-				if (r.within(addr, size))
-				{
-					bool equals = r.equals(addr, size);
-					it = m_lines.erase(it);
-					if (equals) return;
+				const Range r { it->first, it->second };
+				if (r.addr + r.size <= addr) {
+					++it;
+					continue;
 				}
-				else ++it;
+				it = this->remove(it);
+				if (r.addr < addr)
+					this->add(r.addr, addr - r.addr);
+				if (r.addr + r.size > end)
+					it = this->add(end, r.addr + r.size - end);
 			}
 		}
 
+		// Free a memory range, merging it with adjacent and overlapping ranges
 		void insert(address_t addr, address_t size)
 		{
-			/* Extend the back range? */
-			if (!m_lines.empty()) {
-				if (m_lines.back().addr + m_lines.back().size == addr) {
-					m_lines.back().size += size;
-					return;
+			if (size == 0u)
+				return;
+			address_t begin = addr;
+			address_t end   = addr + size;
+
+			auto it = m_by_addr.upper_bound(addr);
+			if (it != m_by_addr.begin()) {
+				const auto prev = std::prev(it);
+				if (prev->first + prev->second >= begin) {
+					begin = prev->first;
+					end = std::max(end, address_t(prev->first + prev->second));
+					this->remove(prev);
 				}
 			}
+			while (it != m_by_addr.end() && it->first <= end) {
+				end = std::max(end, address_t(it->first + it->second));
+				it = this->remove(it);
+			}
+			this->add(begin, end - begin);
+		}
 
-			m_lines.push_back({addr, size});
+		// Remove and return the free range that ends at the given address
+		Range remove_ending_at(address_t end)
+		{
+			auto it = m_by_addr.lower_bound(end);
+			if (it == m_by_addr.begin())
+				return Range{};
+			--it;
+			if (it->first + it->second != end)
+				return Range{};
+			const Range r { it->first, it->second };
+			this->remove(it);
+			return r;
 		}
 
+		size_t ranges() const noexcept { return m_by_addr.size(); }
+		bool empty() const noexcept { return m_by_addr.empty(); }
+
 	private:
-		std::vector<Range> m_lines {};
+		using addr_iterator = typename std::map<address_t, address_t>::iterator;
+
+		addr_iterator add(address_t addr, address_t size)
+		{
+			m_by_size.insert({size, addr});
+			return m_by_addr.emplace(addr, size).first;
+		}
+		addr_iterator remove(addr_iterator it)
+		{
+			m_by_size.erase({it->second, it->first});
+			return m_by_addr.erase(it);
+		}
+
+		// Address -> size, and (size, address) for best-fit
+		std::map<address_t, address_t> m_by_addr {};
+		std::set<std::pair<address_t, address_t>> m_by_size {};
 	};
 
 } // riscv
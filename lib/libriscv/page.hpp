@@ -1,5 +1,6 @@
 #pragma once
 #include "common.hpp"
+#include "page_pool.hpp"
 #include "types.hpp"
 #include <cassert>
 #include <memory>
@@ -76,6 +77,21 @@ struct alignas(4096) PageData {
 	PageData(const std::array<uint8_t, PageSize>& data) noexcept : buffer8{data} {}
 	enum Initialization { INITIALIZED, UNINITIALIZED };
 	PageData(Initialization i) noexcept { if (i == INITIALIZED) buffer8 = {}; }
+
+	// Page data is recycled through the page pool
+	static void* operator new(std::size_t size) {
+		assert(size == sizeof(PageData)); (void)size;
+		return PagePool::allocate();
+	}
+	static void* operator new(std::size_t size, std::align_val_t) {
+		return operator new(size);
+	}
+	static void operator delete(void* ptr) noexcept {
+		PagePool::deallocate(ptr);
+	}
+	static void operator delete(void* ptr, std::align_val_t) noexcept {
+		PagePool::deallocate(ptr);
+	}
 };
 
 struct Page
@@ -0,0 +1,223 @@
+#include "page_pool.hpp"
+
+#include "page.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace riscv
+{
+	static constexpr size_t MAGAZINE_SIZE = 64;
+	static constexpr size_t DEFAULT_CAPACITY = 2048; // 8MB of free pages
+	static constexpr std::align_val_t PAGE_ALIGN { alignof(PageData) };
+
+	struct Depot {
+		std::mutex mtx;
+		std::vector<void*> pages;
+		std::atomic<size_t> capacity { DEFAULT_CAPACITY };
+
+		std::atomic<uint64_t> allocations { 0 };
+		std::atomic<uint64_t> reused { 0 };
+		std::atomic<uint64_t> deallocations { 0 };
+		std::atomic<uint64_t> released { 0 };
+		std::atomic<uint64_t> system_alloc_ns { 0 };
+	};
+	static Depot& depot()
+	{
+		// Never destroyed, as pages may be freed during static destruction
+		static Depot* d = new Depot;
+		return *d;
+	}
+
+	// The magazine is trivially destructible, so that it remains
+	// usable (but disabled) after it has been flushed on thread exit.
+	struct Magazine {
+		size_t count;
+		bool registered;
+		bool disabled;
+		void* items[MAGAZINE_SIZE];
+	};
+	static thread_local Magazine t_magazine {};
+
+	static void system_free(void* page) noexcept
+	{
+		::operator delete(page, PAGE_ALIGN);
+	}
+
+	// Moves pages into the depot, freeing what does not fit
+	static void push_to_depot(void** pages, size_t count) noexcept
+	{
+		auto& d = depot();
+		size_t accepted = 0;
+		{
+			std::lock_guard<std::mutex> lock(d.mtx);
+			const size_t capacity = d.capacity.load(std::memory_order_relaxed);
+			if (d.pages.size() < capacity) {
+				accepted = std::min(count, capacity - d.pages.size());
+				try {
+					d.pages.insert(d.pages.end(), pages, pages + accepted);
+				} catch (...) {
+					accepted = 0;
+				}
+			}
+		}
+		for (size_t i = accepted; i < count; i++)
+			system_free(pages[i]);
+		if (accepted < count)
+			d.released.fetch_add(count - accepted, std::memory_order_relaxed);
+	}
+
+	static Magazine& magazine()
+	{
+		auto& m = t_magazine;
+		if (UNLIKELY(!m.registered)) {
+			m.registered = true;
+			// Return the magazine to the depot when the thread exits
+			static thread_local struct Flusher {
+				~Flusher() {
+					push_to_depot(t_magazine.items, t_magazine.count);
+					t_magazine.count = 0;
+					t_magazine.disabled = true;
+				}
+			} flusher;
+			(void)flusher;
+		}
+		return m;
+	}
+
+	void* PagePool::allocate()
+	{
+		auto& d = depot();
+		d.allocations.fetch_add(1, std::memory_order_relaxed);
+
+		auto& m = magazine();
+		if (LIKELY(m.count > 0)) {
+			d.reused.fetch_add(1, std::memory_order_relaxed);
+			return m.items[--m.count];
+		}
+		// Refill half of the magazine from the depot
+		if (!m.disabled) {
+			std::lock_guard<std::mutex> lock(d.mtx);
+			const size_t n = std::min(MAGAZINE_SIZE / 2, d.pages.size());
+			std::copy(d.pages.end() - n, d.pages.end(), m.items);
+			d.pages.resize(d.pages.size() - n);
+			m.count = n;
+		}
+		if (m.count > 0) {
+			d.reused.fetch_add(1, std::memory_order_relaxed);
+			return m.items[--m.count];
+		}
+
+		const auto t0 = std::chrono::steady_clock::now();
+		void* page = ::operator new(sizeof(PageData), PAGE_ALIGN);
+		const auto t1 = std::chrono::steady_clock::now();
+		d.system_alloc_ns.fetch_add(
+			std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count(),
+			std::memory_order_relaxed);
+		return page;
+	}
+
+	void PagePool::deallocate(void* page) noexcept
+	{
+		if (page == nullptr)
+			return;
+		auto& d = depot();
+		d.deallocations.fetch_add(1, std::memory_order_relaxed);
+
+		auto& m = magazine();
+		if (LIKELY(!m.disabled && d.capacity.load(std::memory_order_relaxed) > 0)) {
+			if (UNLIKELY(m.count == MAGAZINE_SIZE)) {
+				// Move the upper half of a full magazine to the depot
+				push_to_depot(&m.items[MAGAZINE_SIZE / 2], MAGAZINE_SIZE / 2);
+				m.count = MAGAZINE_SIZE / 2;
+			}
+			m.items[m.count++] = page;
+			return;
+		}
+		push_to_depot(&page, 1);
+	}
+
+	void PagePool::deallocate_bulk(void** pages, size_t count) noexcept
+	{
+		if (count == 0)
+			return;
+		auto& d = depot();
+		d.deallocations.fetch_add(count, std::memory_order_relaxed);
+
+		auto& m = magazine();
+		if (!m.disabled && d.capacity.load(std::memory_order_relaxed) > 0) {
+			while (count > 0 && m.count < MAGAZINE_SIZE)
+				m.items[m.count++] = pages[--count];
+		}
+		push_to_depot(pages, count);
+	}
+
+	void PagePool::set_capacity(size_t pages) noexcept
+	{
+		auto& d = depot();
+		d.capacity.store(pages, std::memory_order_relaxed);
+
+		std::vector<void*> excess;
+		{
+			std::lock_guard<std::mutex> lock(d.mtx);
+			if (d.pages.size() > pages) {
+				excess.assign(d.pages.begin() + pages, d.pages.end());
+				d.pages.resize(pages);
+			}
+		}
+		for (void* page : excess)
+			system_free(page);
+		d.released.fetch_add(excess.size(), std::memory_order_relaxed);
+	}
+
+	size_t PagePool::capacity() noexcept
+	{
+		return depot().capacity.load(std::memory_order_relaxed);
+	}
+
+	void PagePool::trim() noexcept
+	{
+		// The calling threads magazine is emptied too
+		auto& m = magazine();
+		push_to_depot(m.items, m.count);
+		m.count = 0;
+
+		auto& d = depot();
+		std::vector<void*> pages;
+		{
+			std::lock_guard<std::mutex> lock(d.mtx);
+			pages.swap(d.pages);
+		}
+		for (void* page : pages)
+			system_free(page);
+		d.released.fetch_add(pages.size(), std::memory_order_relaxed);
+	}
+
+	PagePool::Stats PagePool::stats() noexcept
+	{
+		auto& d = depot();
+		Stats stats;
+		stats.allocations = d.allocations.load(std::memory_order_relaxed);
+		stats.reused = d.reused.load(std::memory_order_relaxed);
+		stats.deallocations = d.deallocations.load(std::memory_order_relaxed);
+		stats.released = d.released.load(std::memory_order_relaxed);
+		stats.system_alloc_ns = d.system_alloc_ns.load(std::memory_order_relaxed);
+		std::lock_guard<std::mutex> lock(d.mtx);
+		stats.depot_pages = d.pages.size();
+		return stats;
+	}
+
+	void PagePool::reset_stats() noexcept
+	{
+		auto& d = depot();
+		d.allocations.store(0, std::memory_order_relaxed);
+		d.reused.store(0, std::memory_order_relaxed);
+		d.deallocations.store(0, std::memory_order_relaxed);
+		d.released.store(0, std::memory_order_relaxed);
+		d.system_alloc_ns.store(0, std::memory_order_relaxed);
+	}
+
+} // riscv
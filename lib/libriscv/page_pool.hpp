@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace riscv
+{
+	// A process-wide pool of page data, shared by every machine and
+	// all of their forks. Each thread keeps a small magazine of free
+	// pages that it allocates from and frees into without locking.
+	// Full and empty magazines exchange pages with a shared depot in
+	// batches, and the depot returns pages to the system allocator
+	// once it holds more than its capacity.
+	struct PagePool
+	{
+		struct Stats {
+			uint64_t allocations = 0;   // Pages handed out by the pool
+			uint64_t reused = 0;        // ... of which were recycled
+			uint64_t deallocations = 0; // Pages given back to the pool
+			uint64_t released = 0;      // Pages freed to the system allocator
+			uint64_t system_alloc_ns = 0; // Time spent allocating from the system
+			uint64_t depot_pages = 0;   // Free pages currently in the depot
+
+			// Estimated time saved by recycling pages, in nanoseconds
+			uint64_t estimated_saved_ns() const noexcept {
+				const uint64_t misses = allocations - reused;
+				return (misses != 0) ? reused * system_alloc_ns / misses : 0;
+			}
+		};
+
+		// Returns uninitialized, page-aligned memory for one PageData
+		static void* allocate();
+		static void  deallocate(void*) noexcept;
+		// Returns many pages at once, taking the depot lock only once
+		static void  deallocate_bulk(void** pages, size_t count) noexcept;
+
+		// Maximum number of free pages kept in the depot. Zero disables pooling.
+		static void   set_capacity(size_t pages) noexcept;
+		static size_t capacity() noexcept;
+		// Releases all free pages in the depot to the system allocator
+		static void   trim() noexcept;
+
+		static Stats stats() noexcept;
+		static void  reset_stats() noexcept;
+	};
+
+} // riscv
@@ -0,0 +1,519 @@
+#pragma once
+#include "page.hpp"
+#include <atomic>
+#include <bit>
+#include <map>
+
+namespace riscv
+{
+	/// A radix page table mapping page numbers to pages.
+	///
+	/// Pages live inside fixed-size leaf tables, which are reached through
+	/// a root table (32-bit) or a root and a middle table (64- and 128-bit).
+	/// Addresses outside of what the radix tree covers are kept in a small
+	/// ordered overflow map of leaves.
+	///
+	/// Leaves and middle tables are reference-counted, so that a fork can
+	/// borrow the entire tree of another machine by copying only the root.
+	/// A borrowed leaf is materialized into a private leaf the first time
+	/// the fork touches it, turning every page into a non-owning (and
+	/// copy-on-write when writable) loan of the original page.
+	template <int W>
+	struct PageTable
+	{
+		using address_t = address_type<W>;
+		static constexpr unsigned PAGE_BITS = std::countr_zero(PageSize);
+		static constexpr unsigned LEAF_BITS = 9;
+		static constexpr unsigned MID_BITS  = (W == 4) ? 0 : 9;
+		// 32-bit: The root covers the whole address space
+		// 64-bit: The root covers 2^40 bytes, the rest goes into overflow
+		static constexpr unsigned ROOT_BITS = (W == 4) ? (32 - PAGE_BITS - LEAF_BITS) : 10;
+		static constexpr unsigned LOW_BITS  = ROOT_BITS + MID_BITS + LEAF_BITS;
+		static constexpr size_t LEAF_SIZE = size_t(1) << LEAF_BITS;
+		static constexpr size_t MID_SIZE  = size_t(1) << MID_BITS;
+		static constexpr size_t ROOT_SIZE = size_t(1) << ROOT_BITS;
+		static constexpr address_t LEAF_MASK = LEAF_SIZE - 1;
+		static constexpr address_t MID_MASK  = MID_SIZE - 1;
+		// Tag bit on a node pointer: The node belongs to another table
+		static constexpr uintptr_t BORROWED = 0x1;
+
+		struct Leaf {
+			std::atomic<uint32_t> refs {1};
+			uint32_t count = 0;
+			std::array<uint64_t, LEAF_SIZE / 64> present {};
+			union Slot {
+				Slot() {}
+				~Slot() {}
+				Page page;
+			};
+			std::array<Slot, LEAF_SIZE> slots;
+
+			bool has(size_t i) const noexcept { return (present[i / 64] >> (i % 64)) & 1; }
+			Page* get(size_t i) noexcept { return has(i) ? &slots[i].page : nullptr; }
+			void set(size_t i) noexcept { present[i / 64] |= uint64_t(1) << (i % 64); count++; }
+			void unset(size_t i) noexcept { present[i / 64] &= ~(uint64_t(1) << (i % 64)); count--; }
+			// Find the first present page at index i or later, or LEAF_SIZE
+			size_t next(size_t i) const noexcept {
+				while (i < LEAF_SIZE) {
+					const uint64_t bits = present[i / 64] >> (i % 64);
+					if (bits != 0)
+						return i + std::countr_zero(bits);
+					i = (i | 63) + 1;
+				}
+				return LEAF_SIZE;
+			}
+
+			Leaf() = default;
+			~Leaf() {
+				// Owned page data goes back to the page pool in one batch
+				std::array<void*, LEAF_SIZE> owned;
+				size_t n = 0;
+				for (size_t i = next(0); i < LEAF_SIZE; i = next(i + 1)) {
+					Page& page = slots[i].page;
+					if (!page.attr.non_owning && page.m_page != nullptr)
+						owned[n++] = page.m_page.release();
+					page.~Page();
+				}
+				PagePool::deallocate_bulk(owned.data(), n);
+			}
+		};
+		struct Mid {
+			std::atomic<uint32_t> refs {1};
+			std::array<uintptr_t, MID_SIZE> child {};
+		};
+		// Page data that a fork sees at another address, such as a
+		// private copy-on-write view of the memory arena. Pages loaned
+		// from the range keep their attributes and point into the view.
+		struct Rebase {
+			const PageData* from = nullptr;
+			PageData* to = nullptr;
+			size_t pages = 0;
+		};
+
+		/// @brief Find an existing page.
+		/// @param pageno The page number.
+		/// @return The page, or nullptr if there is no page.
+		/// @note Materializing a borrowed leaf does not change the visible
+		/// contents of the table, which is why lookups are const.
+		Page* find(address_t pageno) const
+		{
+			const uintptr_t leaf = leaf_for(pageno);
+			if (LIKELY((leaf & BORROWED) == 0)) {
+				if (leaf == 0)
+					return nullptr;
+				return ((Leaf *)leaf)->get(pageno & LEAF_MASK);
+			}
+			auto& self = const_cast<PageTable&> (*this);
+			return self.writable_leaf(pageno, false)->get(pageno & LEAF_MASK);
+		}
+
+		/// @brief Construct a page in-place, unless it already exists.
+		/// @return The page, and whether or not it was created.
+		template <typename... Args>
+		std::pair<Page*, bool> try_emplace(address_t pageno, Args&&... args)
+		{
+			Leaf* leaf = writable_leaf(pageno, true);
+			const size_t index = pageno & LEAF_MASK;
+			if (leaf->has(index))
+				return {&leaf->slots[index].page, false};
+			Page* page = new (&leaf->slots[index].page) Page(std::forward<Args> (args)...);
+			leaf->set(index);
+			m_size++;
+			return {page, true};
+		}
+
+		/// @brief Remove a page.
+		/// @return True if there was a page to remove.
+		bool erase(address_t pageno)
+		{
+			if (leaf_for(pageno) == 0)
+				return false;
+			Leaf* leaf = writable_leaf(pageno, false);
+			const size_t index = pageno & LEAF_MASK;
+			if (leaf == nullptr || !leaf->has(index))
+				return false;
+			leaf->slots[index].page.~Page();
+			leaf->unset(index);
+			m_size--;
+			return true;
+		}
+
+		/// @brief Rewind a page to how this table borrowed it from another
+		/// table, or remove it if the other table has no such page.
+		/// @param other The table that this table was forked from.
+		/// @param pageno The page number.
+		void restore_from(const PageTable& other, address_t pageno)
+		{
+			const Page* src = other.peek(pageno);
+			if (src == nullptr || src->attr.dont_fork) {
+				this->erase(pageno);
+				return;
+			}
+			Leaf* leaf = writable_leaf(pageno, true);
+			const size_t index = pageno & LEAF_MASK;
+			if (leaf->has(index)) {
+				leaf->slots[index].page.~Page();
+			} else {
+				leaf->set(index);
+				m_size++;
+			}
+			this->loan(leaf->slots[index].page, *src);
+		}
+
+		size_t size() const noexcept { return m_size; }
+		bool empty() const noexcept { return m_size == 0; }
+
+		void clear()
+		{
+			for (auto& entry : m_root) {
+				release_top(entry);
+				entry = 0;
+			}
+			for (auto& it : m_overflow)
+				release_leaf(it.second);
+			m_overflow.clear();
+			m_size = 0;
+			m_borrowing = false;
+		}
+
+		/// @brief Borrow every page from another table. The cost is
+		/// proportional to the size of the root and the overflow map.
+		/// Pages marked dont_fork are skipped when leaves are materialized.
+		/// @param rebase Page data that this table sees at another address.
+		void fork_from(const PageTable& other, Rebase rebase = {})
+		{
+			this->clear();
+			this->m_rebase = rebase;
+			for (size_t i = 0; i < ROOT_SIZE; i++) {
+				const uintptr_t entry = other.m_root[i];
+				if (entry != 0) {
+					retain(entry);
+					m_root[i] = entry | BORROWED;
+				}
+			}
+			for (const auto& it : other.m_overflow) {
+				retain(it.second);
+				m_overflow.emplace(it.first, it.second | BORROWED);
+			}
+			this->m_size = other.m_size;
+			this->m_borrowing = true;
+		}
+
+		/// @brief Call func(pageno, page) for every page, in page order.
+		template <typename Func>
+		void for_each(Func func) const
+		{
+			for (auto it = begin(); it != end(); ++it) {
+				auto entry = *it;
+				func(entry.first, entry.second);
+			}
+		}
+
+		struct Entry {
+			address_t first;
+			Page& second;
+		};
+		struct iterator {
+			const PageTable* table;
+			address_t pageno;
+			Page* page;
+
+			Entry operator*() const noexcept { return {pageno, *page}; }
+			iterator& operator++() {
+				*this = table->next(pageno, true);
+				return *this;
+			}
+			bool operator==(const iterator& other) const noexcept { return page == other.page; }
+			bool operator!=(const iterator& other) const noexcept { return page != other.page; }
+		};
+		iterator begin() const {
+			if (UNLIKELY(m_borrowing))
+				const_cast<PageTable&> (*this).materialize_all();
+			return next(0, false);
+		}
+		iterator end() const noexcept { return {this, 0, nullptr}; }
+
+		PageTable() = default;
+		PageTable(const PageTable&) = delete;
+		PageTable& operator=(const PageTable&) = delete;
+		~PageTable() { this->clear(); }
+
+	private:
+		static Leaf* leaf_ptr(uintptr_t entry) noexcept { return (Leaf *)(entry & ~BORROWED); }
+		static Mid*  mid_ptr(uintptr_t entry) noexcept { return (Mid *)(entry & ~BORROWED); }
+		static constexpr bool in_overflow(address_t pageno) noexcept {
+			if constexpr (W == 4) return false;
+			else return (pageno >> LOW_BITS) != 0;
+		}
+
+		// Returns the tagged leaf pointer for a page, inheriting the
+		// borrowed tag from the middle table, if any.
+		uintptr_t leaf_for(address_t pageno) const noexcept
+		{
+			if constexpr (W == 4) {
+				return m_root[pageno >> LEAF_BITS];
+			} else {
+				if (UNLIKELY(in_overflow(pageno))) {
+					auto it = m_overflow.find(pageno >> LEAF_BITS);
+					return (it != m_overflow.end()) ? it->second : 0;
+				}
+				const uintptr_t mid = m_root[size_t(pageno >> (MID_BITS + LEAF_BITS))];
+				if (mid == 0)
+					return 0;
+				const uintptr_t leaf = mid_ptr(mid)->child[size_t((pageno >> LEAF_BITS) & MID_MASK)];
+				return (leaf != 0) ? (leaf | (mid & BORROWED)) : 0;
+			}
+		}
+
+		// The root entry is a leaf on 32-bit and a middle table otherwise
+		static void retain(uintptr_t entry) noexcept {
+			if constexpr (W == 4)
+				leaf_ptr(entry)->refs.fetch_add(1, std::memory_order_relaxed);
+			else
+				mid_ptr(entry)->refs.fetch_add(1, std::memory_order_relaxed);
+		}
+		static void release_top(uintptr_t entry) {
+			if (entry == 0)
+				return;
+			if constexpr (W == 4)
+				release_leaf(entry);
+			else
+				release_mid(entry);
+		}
+		static void release_leaf(uintptr_t entry) {
+			Leaf* leaf = leaf_ptr(entry);
+			if (leaf->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+				delete leaf;
+		}
+		static void release_mid(uintptr_t entry) {
+			Mid* mid = mid_ptr(entry);
+			if (mid->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+				for (const uintptr_t child : mid->child) {
+					if (child != 0) release_leaf(child);
+				}
+				delete mid;
+			}
+		}
+
+		// Returns a private middle table, copying a shared or borrowed one
+		uintptr_t& private_mid(uintptr_t& entry)
+		{
+			Mid* mid = mid_ptr(entry);
+			const bool borrowed = (entry & BORROWED) != 0;
+			if (borrowed || mid->refs.load(std::memory_order_acquire) > 1)
+			{
+				Mid* copy = new Mid;
+				for (size_t i = 0; i < MID_SIZE; i++) {
+					const uintptr_t child = mid->child[i];
+					if (child != 0) {
+						leaf_ptr(child)->refs.fetch_add(1, std::memory_order_relaxed);
+						copy->child[i] = child | (borrowed ? BORROWED : 0);
+					}
+				}
+				release_mid(entry);
+				entry = (uintptr_t)copy;
+			}
+			return entry;
+		}
+
+		// Returns the slot holding the leaf for a page. The path to
+		// the slot is made private. Returns nullptr when create is
+		// false and there is no leaf.
+		uintptr_t* leaf_slot(address_t pageno, bool create)
+		{
+			if constexpr (W == 4) {
+				(void)create;
+				return &m_root[pageno >> LEAF_BITS];
+			} else {
+				if (UNLIKELY(in_overflow(pageno))) {
+					auto it = m_overflow.find(pageno >> LEAF_BITS);
+					if (it == m_overflow.end()) {
+						if (!create) return nullptr;
+						it = m_overflow.emplace(pageno >> LEAF_BITS, 0).first;
+					}
+					return &it->second;
+				}
+				uintptr_t& entry = m_root[size_t(pageno >> (MID_BITS + LEAF_BITS))];
+				if (entry == 0) {
+					if (!create) return nullptr;
+					entry = (uintptr_t)new Mid;
+				}
+				return &mid_ptr(private_mid(entry))->child[size_t((pageno >> LEAF_BITS) & MID_MASK)];
+			}
+		}
+
+		// Returns a leaf that can be modified, creating it if needed.
+		Leaf* writable_leaf(address_t pageno, bool create)
+		{
+			uintptr_t* slot = leaf_slot(pageno, create);
+			if (slot == nullptr)
+				return nullptr;
+			const uintptr_t entry = *slot;
+			if (entry == 0) {
+				if (!create) return nullptr;
+				Leaf* leaf = new Leaf;
+				*slot = (uintptr_t)leaf;
+				return leaf;
+			}
+			if (entry & BORROWED) {
+				Leaf* leaf = materialize(leaf_ptr(entry));
+				release_leaf(entry);
+				*slot = (uintptr_t)leaf;
+				return leaf;
+			}
+			Leaf* leaf = leaf_ptr(entry);
+			if (UNLIKELY(leaf->refs.load(std::memory_order_acquire) > 1)) {
+				Leaf* own = detach(leaf);
+				release_leaf(entry);
+				*slot = (uintptr_t)own;
+				return own;
+			}
+			return leaf;
+		}
+
+		// Borrowed pages are non-owning, and writable pages become copy-on-write
+		static PageAttributes borrowed_attr(PageAttributes attr) noexcept
+		{
+			if (attr.write) {
+				attr.write = false;
+				attr.is_cow = true;
+			}
+			attr.non_owning = true;
+			return attr;
+		}
+
+		// Find a page without materializing borrowed leaves. A page found
+		// through a borrowed leaf still has the attributes of its owner.
+		const Page* peek(address_t pageno) const noexcept
+		{
+			const uintptr_t leaf = leaf_for(pageno);
+			if (leaf == 0)
+				return nullptr;
+			return leaf_ptr(leaf)->get(pageno & LEAF_MASK);
+		}
+
+		// Create a private leaf that loans every page from a borrowed leaf
+		Leaf* materialize(Leaf* src)
+		{
+			Leaf* leaf = new Leaf;
+			for (size_t i = src->next(0); i < LEAF_SIZE; i = src->next(i + 1))
+			{
+				const Page& page = src->slots[i].page;
+				// Skip pages marked as dont_fork
+				if (page.attr.dont_fork) {
+					m_size--;
+					continue;
+				}
+				this->loan(leaf->slots[i].page, page);
+				leaf->set(i);
+			}
+			return leaf;
+		}
+
+		// Construct a non-owning loan of a page from the table we forked from
+		void loan(Page& dst, const Page& src) const
+		{
+			const PageData* data = src.m_page.get();
+			const uintptr_t offset = uintptr_t(data) - uintptr_t(m_rebase.from);
+			if (offset < m_rebase.pages * sizeof(PageData)) {
+				PageAttributes attr = src.attr;
+				attr.non_owning = true;
+				new (&dst) Page(attr, m_rebase.to + offset / sizeof(PageData));
+				return;
+			}
+			new (&dst) Page(borrowed_attr(src.attr), src.m_page.get());
+		}
+
+		// Our own leaf is shared with a fork: Move the pages into a new
+		// leaf, leaving the old leaf with non-owning views of the same data.
+		static Leaf* detach(Leaf* src)
+		{
+			Leaf* leaf = new Leaf;
+			for (size_t i = src->next(0); i < LEAF_SIZE; i = src->next(i + 1))
+			{
+				Page& page = src->slots[i].page;
+				Page* copy = new (&leaf->slots[i].page) Page(page.attr, page.m_page.get());
+				copy->attr.non_owning = page.attr.non_owning;
+				copy->m_trap = page.m_trap;
+				page.attr.non_owning = true;
+				leaf->set(i);
+			}
+			return leaf;
+		}
+
+		void materialize_all()
+		{
+			for (size_t i = 0; i < ROOT_SIZE; i++) {
+				if (m_root[i] == 0)
+					continue;
+				if constexpr (W == 4) {
+					writable_leaf(address_t(i) << LEAF_BITS, false);
+				} else {
+					const Mid* mid = mid_ptr(private_mid(m_root[i]));
+					for (size_t j = 0; j < MID_SIZE; j++) {
+						if (mid->child[j] & BORROWED)
+							writable_leaf((address_t(i) << (MID_BITS + LEAF_BITS)) | (address_t(j) << LEAF_BITS), false);
+					}
+				}
+			}
+			for (auto& it : m_overflow) {
+				if (it.second & BORROWED)
+					writable_leaf(it.first << LEAF_BITS, false);
+			}
+			this->m_borrowing = false;
+		}
+
+		// Find the first page at pageno or later (after pageno when skip is true)
+		iterator next(address_t pageno, bool skip) const
+		{
+			if (skip) {
+				if (pageno == address_t(-1))
+					return end();
+				pageno++;
+			}
+			if (!in_overflow(pageno))
+			{
+				for (size_t r = size_t(pageno >> (MID_BITS + LEAF_BITS)); r < ROOT_SIZE; r++)
+				{
+					const uintptr_t entry = m_root[r];
+					if (entry != 0)
+					{
+						const address_t rbase = address_t(r) << (MID_BITS + LEAF_BITS);
+						size_t m = (pageno > rbase) ? size_t((pageno >> LEAF_BITS) & MID_MASK) : 0;
+						for (; m < MID_SIZE; m++)
+						{
+							const uintptr_t lentry = (W == 4) ? entry : mid_ptr(entry)->child[m];
+							if (lentry == 0)
+								continue;
+							const address_t lbase = rbase | (address_t(m) << LEAF_BITS);
+							Leaf* leaf = leaf_ptr(lentry);
+							const size_t i = leaf->next((pageno > lbase) ? size_t(pageno & LEAF_MASK) : 0);
+							if (i < LEAF_SIZE)
+								return {this, lbase | address_t(i), &leaf->slots[i].page};
+						}
+					}
+				}
+				pageno = address_t(ROOT_SIZE) << (MID_BITS + LEAF_BITS);
+			}
+			if constexpr (W != 4)
+			{
+				for (auto it = m_overflow.lower_bound(pageno >> LEAF_BITS); it != m_overflow.end(); ++it)
+				{
+					const address_t lbase = it->first << LEAF_BITS;
+					Leaf* leaf = leaf_ptr(it->second);
+					const size_t i = leaf->next((pageno > lbase) ? size_t(pageno & LEAF_MASK) : 0);
+					if (i < LEAF_SIZE)
+						return {this, lbase | address_t(i), &leaf->slots[i].page};
+				}
+			}
+			return end();
+		}
+
+		std::array<uintptr_t, ROOT_SIZE> m_root {};
+		std::map<address_t, uintptr_t> m_overflow;
+		size_t m_size = 0;
+		bool m_borrowing = false;
+		Rebase m_rebase;
+	};
+
+} // riscv
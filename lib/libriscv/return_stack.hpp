@@ -0,0 +1,73 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include "common.hpp"
+
+namespace riscv
+{
+	template <int W> struct DecoderData;
+
+	// A small circular return-address stack used by the dispatch loops.
+	// Calls push the return address together with its decoder entry, and
+	// a function return that matches the top entry can continue directly
+	// at that entry without validating the execute segment.
+	// Each entry belongs to the execute segment that was current when it
+	// was pushed, so the stack must be cleared when the segment changes,
+	// or when the dispatch switches to a live-patched decoder cache.
+	// The number of entries must be a power of two.
+	template <int W, unsigned N>
+	struct ReturnStack
+	{
+		using address_t = address_type<W>;
+		static_assert(N > 0 && (N & (N - 1)) == 0, "Return stack size must be a power of two");
+		// Never matches an aligned return address
+		static constexpr address_t NONE = (address_t)-1;
+
+		struct Entry {
+			address_t pc = NONE;
+			DecoderData<W>* decoder = nullptr;
+		};
+
+		struct Stats {
+			uint64_t returns = 0;
+			uint64_t misses = 0;
+		};
+
+		static constexpr unsigned size() noexcept { return N; }
+
+		// Return addresses outside of the execute segment are never predicted
+		void push(address_t pc, bool within_segment, DecoderData<W>* decoder) noexcept {
+			m_top = (m_top + 1) & (N - 1);
+			auto& e = m_entries[m_top];
+			e.pc = within_segment ? pc : NONE;
+			e.decoder = decoder;
+		}
+
+		// Returns the predicted decoder entry for pc, or nullptr on a miss.
+		// Entries outside of the current decoder cache [begin, end) are misses.
+		DecoderData<W>* pop(address_t pc, const DecoderData<W>* begin, const DecoderData<W>* end) noexcept {
+			auto& e = m_entries[m_top];
+			m_top = (m_top - 1) & (N - 1);
+			const bool hit = e.pc == pc &&
+				uintptr_t(e.decoder) - uintptr_t(begin) < uintptr_t(end) - uintptr_t(begin);
+			if constexpr (return_stack_stats_enabled) {
+				m_stats.returns ++;
+				m_stats.misses += !hit;
+			}
+			return hit ? e.decoder : nullptr;
+		}
+
+		void clear() noexcept {
+			m_entries = {};
+		}
+
+		const Stats& stats() const noexcept { return m_stats; }
+		void reset_stats() noexcept { m_stats = {}; }
+
+	private:
+		std::array<Entry, N> m_entries {};
+		unsigned m_top = 0;
+		Stats m_stats;
+	};
+
+} // riscv
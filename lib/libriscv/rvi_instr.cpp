@@ -1189,7 +1189,10 @@ static inline uint64_t MUL128(
 	}, DECODED_INSTR(OP32).printer);
 
 	INSTRUCTION(FENCE,
-	[] (auto&, rv32i_instruction /* instr */) RVINSTR_COLDATTR {
+	[] (auto& cpu, rv32i_instruction instr) RVINSTR_COLDATTR {
+		// FENCE.I: Instructions written by the program become visible
+		if (instr.Itype.funct3 == 0x1)
+			cpu.memory().invalidate_execute_pages();
 		// Do a full barrier, for now
 		std::atomic_thread_fence(std::memory_order_seq_cst);
 	},
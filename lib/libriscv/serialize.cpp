@@ -52,11 +52,16 @@ namespace riscv
 		for (const auto& it : memory.pages()) {
 			if (!it.second.is_cow_page()) datapage_count++;
 		}
+		// Arena pages may have been written without ever creating a page
+		unsigned arena_page_count = 0;
+		for (const auto pageno : memory.dirty_arena_pages()) {
+			if (memory.pages().find(pageno) == nullptr) arena_page_count++;
+		}
 
 		const SerializedMachine<W> header {
 			.magic    = MAGiC_V4LUE,
-			.n_pages  = (unsigned) memory.pages().size(),
-			.n_datapages = datapage_count,
+			.n_pages  = (unsigned) memory.pages().size() + arena_page_count,
+			.n_datapages = datapage_count + arena_page_count,
 			.reg_size = sizeof(Registers<W>),
 			.page_size = Page::size(),
 			.attr_size = sizeof(PageAttributes),
@@ -90,7 +95,8 @@ namespace riscv
 	size_t Memory<W>::serialize_to(std::vector<uint8_t>& vec) const
 	{
 		const size_t before = vec.size();
-		if (this->m_arena.pages > 0 && riscv::flat_readwrite_arena) {
+		// Without dirty tracking there is no way to tell which arena pages were written
+		if (this->m_arena.pages > 0 && riscv::flat_readwrite_arena && !riscv::arena_dirty_tracking) {
 			throw MachineException(
 				FEATURE_DISABLED, "Serialize is incompatible with flat read-write arena");
 		}
@@ -125,6 +131,22 @@ namespace riscv
 			vec.insert(vec.end(), page.data(), page.data() + sizeof(PageData));
 		}
 
+		// Dirty arena pages that are not in the page table
+		for (const auto pageno : this->dirty_arena_pages())
+		{
+			if (this->m_pages.find(pageno) != nullptr)
+				continue;
+			const SerializedPage spage {
+				.addr = static_cast<uint64_t>(pageno),
+				.attr = {},
+			};
+			auto* sptr = (const uint8_t*) &spage;
+			vec.insert(vec.end(), sptr, sptr + sizeof(SerializedPage));
+
+			const auto* data = this->m_arena.data[pageno].buffer8.data();
+			vec.insert(vec.end(), data, data + sizeof(PageData));
+		}
+
 		const size_t after = vec.size();
 		return after - before;
 	}
@@ -185,6 +207,12 @@ namespace riscv
 		// all pages will be completely replaced
 		this->clear_all_pages();
 		this->evict_execute_segments();
+		// The arena is not part of the paging system, so zero
+		// the pages that have changed and track restored pages
+		for (const auto pageno : this->dirty_arena_pages()) {
+			std::memset(this->m_arena.data[pageno].buffer8.data(), 0, sizeof(PageData));
+		}
+		std::fill(m_arena_dirty.begin(), m_arena_dirty.end(), 0);
 
 		size_t off = state.mem_offset;
 		for (size_t p = 0; p < state.n_pages; p++)
@@ -204,7 +232,8 @@ namespace riscv
 						page.addr,
 						new_attr, &this->m_arena.data[page.addr]
 					);
-					new_page = &result.first->second;
+					new_page = result.first;
+					this->mark_arena_dirty(page.addr);
 				}
 				else
 				{
@@ -213,7 +242,7 @@ namespace riscv
 						page.addr,
 						new_attr, PageData::UNINITIALIZED
 					);
-					new_page = &result.first->second;
+					new_page = result.first;
 				}
 				// Copy unaligned data into new PageData
 				const auto* data = &vec[off];
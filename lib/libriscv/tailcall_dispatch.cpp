@@ -36,13 +36,30 @@
 #define NEXT_C_INSTR() \
 	d += 1;            \
 	EXECUTE_CURRENT()
+// Step into the second instruction of a fused pair
+#define FUSED_INSTR() \
+	d += (compressed_enabled ? 2 : 1);
+#define FUSED_C_INSTR() \
+	d += 1;
 
 #define RETURN_VALUES()   \
 	{pc}
 #define UNUSED_FUNCTION() \
 	cpu.trigger_exception(ILLEGAL_OPCODE);
 
+// Blocks are counted by PC, as the decoder may still be
+// in the original decoder cache of a live-patched segment
+#ifdef RISCV_TIERED_TRANSLATION
+#define BLOCK_PROFILE()                                                   \
+	if (UNLIKELY(exec->tier_count(pc >> DecoderCache<W>::SHIFT, 1)))     \
+		cpu.tier_up(*exec);
+#else
+#define BLOCK_PROFILE()                                       \
+	if constexpr (block_profiling_enabled)                    \
+		exec->count_block(pc >> DecoderCache<W>::SHIFT);
+#endif
 #define BEGIN_BLOCK()                               \
+	BLOCK_PROFILE()                                 \
 	pc += d->block_bytes();                         \
 	counter.increment_counter(d->instruction_count());
 #define NEXT_BLOCK(len, OF)              \
@@ -71,8 +88,8 @@
 
 #define PERFORM_BRANCH()                \
 	if constexpr (VERBOSE_JUMPS) {      \
-		printf("Branch from 0x%lX to 0x%lX\n", \
-			pc, pc + fi.signed_imm());  \
+		fprintf(stderr, "Branch from 0x%lX to 0x%lX\n", \
+			long(pc), long(pc + fi.signed_imm())); \
 	}                                   \
 	pc += fi.signed_imm();              \
 	d += fi.signed_imm() >> DecoderCache<W>::SHIFT; \
@@ -82,8 +99,8 @@
 
 #define PERFORM_FORWARD_BRANCH()        \
 	if constexpr (VERBOSE_JUMPS) {      \
-		printf("Fwd. Branch from 0x%lX to 0x%lX\n", \
-			pc, pc + fi.signed_imm());  \
+		fprintf(stderr, "Fwd. Branch from 0x%lX to 0x%lX\n", \
+			long(pc), long(pc + fi.signed_imm())); \
 	}                                   \
 	NEXT_BLOCK(fi.signed_imm(), false)
 
@@ -91,6 +108,27 @@
 	OVERFLOW_CHECK(); \
 	UNCHECKED_JUMP();
 
+#define RETURN_STACK_PUSH(addr)                                    \
+	if constexpr (return_stack_enabled) {                          \
+		const addr_t ret_addr = (addr);                            \
+		cpu.return_stack().push(ret_addr,                          \
+			ret_addr - exec->exec_begin() < exec->exec_end() - exec->exec_begin(), \
+			&exec->decoder_cache()[ret_addr >> DecoderCache<W>::SHIFT]); \
+	}
+
+#define PREDICTED_RETURN()                             \
+	if constexpr (return_stack_enabled) {              \
+		auto* predicted = cpu.return_stack().pop(pc,   \
+			&exec->decoder_cache()[exec->exec_begin() >> DecoderCache<W>::SHIFT], \
+			&exec->decoder_cache()[exec->exec_end() >> DecoderCache<W>::SHIFT]); \
+		if (LIKELY(predicted != nullptr)) {            \
+			OVERFLOW_CHECK();                          \
+			d = predicted;                             \
+			BEGIN_BLOCK()                              \
+			EXECUTE_CURRENT()                          \
+		}                                              \
+	}
+
 
 namespace riscv
 {
@@ -111,6 +149,16 @@ namespace riscv
 		return results.exec;
 	}
 
+#if defined(RISCV_LIBTCC) || defined(RISCV_NATIVE_JIT)
+	template <int W> [[noreturn]] static void rethrow_current_exception(CPU<W>& cpu)
+	{
+		// We have an exception, so we need to rethrow it
+		const auto except = cpu.current_exception();
+		cpu.clear_current_exception();
+		std::rethrow_exception(except);
+	}
+#endif
+
 	template <int W>
 	using TcoRet = std::tuple<address_type<W>>;
 
@@ -147,31 +195,50 @@ namespace riscv
 		counter.apply(MACHINE());
 		// Invoke system call
 		cpu.machine().system_call(cpu.reg(REG_ECALL));
-		// Restore max counter
+		// Restore counters
 		counter.retrieve_counters(MACHINE());
-		// Clone-like system calls can change PC
-		if (UNLIKELY(pc != cpu.registers().pc))
+		if (UNLIKELY(counter.overflowed() || pc != cpu.registers().pc))
 		{
-			pc = cpu.registers().pc;
-			QUICK_EXEC_CHECK();
-			d = &exec->decoder_cache()[pc >> DecoderCache<W>::SHIFT];
+			// System calls are always full-length instructions
+			if constexpr (VERBOSE_JUMPS) {
+				if (pc != cpu.registers().pc)
+				fprintf(stderr, "SYSCALL jump from 0x%lX to 0x%lX\n",
+					long(pc), long(cpu.registers().pc + 4));
+			}
+			pc = cpu.registers().pc + 4;
+			OVERFLOW_CHECKED_JUMP();
 		}
-		NEXT_BLOCK(4, true);
+		NEXT_BLOCK(4, false);
 	}
 
 #ifdef RISCV_BINARY_TRANSLATION
 	INSTRUCTION(RV32I_BC_TRANSLATOR, translated_function) {
 		VIEW_INSTR();
-		auto new_values = 
-			exec->mapping_at(instr.whole)(CPU(), counter.value()-1, counter.max(), pc);
+		auto new_values =
+			exec->unchecked_mapping_at(instr.whole)(CPU(), counter.value()-1, counter.max(), pc);
+#ifdef RISCV_TIERED_TRANSLATION
+		// Instructions retired by translated code count towards the next tier
+		if (UNLIKELY(exec->tier_count(pc >> DecoderCache<W>::SHIFT, new_values.counter - (counter.value()-1))))
+			cpu.tier_up(*exec);
+#endif
 		counter.set_counters(new_values.counter, new_values.max_counter);
 		pc = REGISTERS().pc;
 		OVERFLOW_CHECK();
-		UNCHECKED_JUMP();
+		QUICK_EXEC_CHECK();
+		d = &exec->decoder_cache()[pc >> DecoderCache<W>::SHIFT];
+		// Translated code returning to the interpreter within its segment
+		if (exec->is_recording_slowpaths() && d->get_bytecode() != RV32I_BC_TRANSLATOR)
+			exec->insert_slowpath_address(pc);
+		BEGIN_BLOCK()
+		EXECUTE_CURRENT()
 	}
 	INSTRUCTION(RV32I_BC_LIVEPATCH, execute_livepatch) {
 		pc = pc - d->block_bytes();
+		// Predicted returns point into the original decoder cache
+		cpu.return_stack().clear();
 		auto* patched = &exec->patched_decoder_cache()[pc / DecoderCache<W>::DIVISOR];
+		// The rest of the original block was already counted
+		counter.increment_counter(patched->instruction_count() - d->instruction_count());
 		d = patched;
 		EXECUTE_CURRENT();
 	}
@@ -186,12 +253,11 @@ namespace riscv
 		// Invoke SYSTEM
 		cpu.machine().system(instr);
 		// Restore counters
-		counter.retrieve_max_counter(MACHINE());
-		if (UNLIKELY(pc != cpu.registers().pc))
+		counter.retrieve_counters(MACHINE());
+		if (UNLIKELY(counter.overflowed() || pc != cpu.registers().pc))
 		{
 			pc = cpu.registers().pc;
-			QUICK_EXEC_CHECK();
-			d = &exec->decoder_cache()[pc >> DecoderCache<W>::SHIFT];
+			OVERFLOW_CHECKED_JUMP();
 		}
 		// Overflow-check, next block
 		NEXT_BLOCK(4, true);
@@ -209,6 +275,19 @@ namespace riscv
 	{
 		// Calculate the current PC (mid block)
 		pc = (d - exec->decoder_cache()) << DecoderCache<W>::SHIFT;
+		// Pages of lazily decoded segments are decoded when first entered
+		if (exec->is_lazily_decoded() && MACHINE().memory.decode_execute_page(*exec, pc)) {
+			counter.increment_counter(-1);
+			d = &exec->decoder_cache()[pc >> DecoderCache<W>::SHIFT];
+			NEXT_BLOCK(0, false);
+		}
+		// JIT pages that were written to are decoded again on their own
+		if (exec->is_likely_jit() && MACHINE().memory.refresh_execute_page(*exec, pc)
+			&& MACHINE().memory.decode_execute_page(*exec, pc)) {
+			counter.increment_counter(-1);
+			d = &exec->decoder_cache()[pc >> DecoderCache<W>::SHIFT];
+			NEXT_BLOCK(0, false);
+		}
 		// Check if the instruction is still invalid
 		bool stale = false;
 		try {
@@ -218,10 +297,9 @@ namespace riscv
 			}
 		} catch (...) {}
 		if (stale) {
-			exec = resolve_execute_segment<W>(cpu, pc);
-			d = &exec->decoder_cache()[pc >> DecoderCache<W>::SHIFT];
-			NEXT_BLOCK(0, true);
+			MUSTTAIL return next_execute_segment(d, exec, cpu, pc, counter);
 		}
+		MACHINE().set_instruction_counter(counter.value());
 		cpu.registers().pc = pc;
 		cpu.trigger_exception(ILLEGAL_OPCODE, d->instr);
 	}
@@ -270,10 +348,15 @@ namespace riscv
 		[RV32I_BC_BGEU]    = rv32i_bgeu,
 		[RV32I_BC_BEQ_FW]  = rv32i_beq_fw,
 		[RV32I_BC_BNE_FW]  = rv32i_bne_fw,
+		[RV32I_BC_BLT_FW]  = rv32i_blt_fw,
+		[RV32I_BC_BGE_FW]  = rv32i_bge_fw,
+		[RV32I_BC_BLTU_FW] = rv32i_bltu_fw,
+		[RV32I_BC_BGEU_FW] = rv32i_bgeu_fw,
 
 		[RV32I_BC_JAL]     = rv32i_jal,
 		[RV32I_BC_JALR]    = rv32i_jalr,
 		[RV32I_BC_FAST_JAL] = rv32i_fast_jal,
+		[RV32I_BC_FAST_JAL_FW] = rv32i_fast_jal_fw,
 		[RV32I_BC_FAST_CALL] = rv32i_fast_call,
 
 		[RV32I_BC_OP_ADD]  = rv32i_op_add,
@@ -322,6 +405,9 @@ namespace riscv
 		[RV32C_BC_BEQZ]     = rv32c_beqz,
 		[RV32C_BC_BNEZ]     = rv32c_bnez,
 		[RV32C_BC_JMP]      = rv32c_jmp,
+		[RV32C_BC_BEQZ_FW]  = rv32c_beqz_fw,
+		[RV32C_BC_BNEZ_FW]  = rv32c_bnez_fw,
+		[RV32C_BC_JMP_FW]   = rv32c_jmp_fw,
 		[RV32C_BC_JR]       = rv32c_jr,
 		[RV32C_BC_JAL_ADDIW]= rv32c_jal_addiw,
 		[RV32C_BC_JALR]     = rv32c_jalr,
@@ -334,6 +420,30 @@ namespace riscv
 		[RV32C_BC_JUMPFUNC] = rv32c_jumpfunc,
 #endif
 
+		[RV32I_BC_FUSED_LUI_ADDI]    = rv32i_fused_lui_addi,
+		[RV32I_BC_FUSED_AUIPC_ADDI]  = rv32i_fused_auipc_addi,
+		[RV32I_BC_FUSED_AUIPC_LDW]   = rv32i_fused_auipc_ldw,
+		[RV32I_BC_FUSED_AUIPC_JALR]  = rv32i_fused_auipc_jalr,
+		[RV32I_BC_FUSED_ADDI_BRANCH] = rv32i_fused_addi_branch,
+		[RV32I_BC_FUSED_SLT_BRANCH]  = rv32i_fused_slt_branch,
+		[RV32I_BC_FUSED_SLTU_BRANCH] = rv32i_fused_sltu_branch,
+		[RV32I_BC_FUSED_ADD_LDW]     = rv32i_fused_add_ldw,
+		[RV32I_BC_FUSED_SH2ADD_LDW]  = rv32i_fused_sh2add_ldw,
+		[RV32I_BC_FUSED_LDW_LDW]     = rv32i_fused_ldw_ldw,
+		[RV32I_BC_FUSED_STW_STW]     = rv32i_fused_stw_stw,
+#ifdef RISCV_64I
+		[RV64I_BC_FUSED_LUI_ADDIW]   = rv64i_fused_lui_addiw,
+		[RV64I_BC_FUSED_AUIPC_LDD]   = rv64i_fused_auipc_ldd,
+		[RV64I_BC_FUSED_ADD_LDD]     = rv64i_fused_add_ldd,
+		[RV64I_BC_FUSED_SH3ADD_LDD]  = rv64i_fused_sh3add_ldd,
+		[RV64I_BC_FUSED_LDD_LDD]     = rv64i_fused_ldd_ldd,
+		[RV64I_BC_FUSED_STD_STD]     = rv64i_fused_std_std,
+#endif
+#ifdef RISCV_EXT_COMPRESSED
+		[RV32C_BC_FUSED_LDD_LDD]     = rv32c_fused_ldd_ldd,
+		[RV32C_BC_FUSED_STD_STD]     = rv32c_fused_std_std,
+#endif
+
 		[RV32I_BC_SYSCALL] = rv32i_syscall,
 		[RV32I_BC_STOP]    = rv32i_stop,
 		[RV32I_BC_NOP]     = rv32i_nop,
@@ -363,8 +473,8 @@ namespace riscv
 		};
 	}
 
-	template <int W> inline RISCV_HOT_PATH()
-	bool CPU<W>::simulate(address_t pc, uint64_t inscounter, uint64_t maxcounter)
+	template <int W> RISCV_HOT_PATH()
+	bool CPU<W>::simulate_tailcall(address_t pc, uint64_t inscounter, uint64_t maxcounter)
 	{
 		InstrCounter counter{inscounter, maxcounter};
 
@@ -386,16 +496,22 @@ namespace riscv
 
 		auto [new_pc] = EXECUTE_INSTR();
 
+#if defined(RISCV_LIBTCC) || defined(RISCV_NATIVE_JIT)
+		// We need to check if we have a current exception
+		if (UNLIKELY(CPU().has_current_exception()))
+			rethrow_current_exception(cpu);
+#endif
+
 		cpu.registers().pc = new_pc;
 		MACHINE().set_instruction_counter(counter.value());
 
 		// Machine stopped normally?
 		return counter.max() == 0;
 
-	} // CPU::simulate()
+	} // CPU::simulate_tailcall()
 
 	template <int W>
-	void CPU<W>::simulate_inaccurate(address_t pc)
+	void CPU<W>::simulate_tailcall_inaccurate(address_t pc)
 	{
 		InstrCounter counter{0, ~0ULL};
 
@@ -417,8 +533,13 @@ namespace riscv
 
 		auto [new_pc] = EXECUTE_INSTR();
 
+#if defined(RISCV_LIBTCC) || defined(RISCV_NATIVE_JIT)
+		if (UNLIKELY(CPU().has_current_exception()))
+			rethrow_current_exception(cpu);
+#endif
+
 		cpu.registers().pc = new_pc;
-	}
+	} // CPU::simulate_tailcall_inaccurate()
 
 	INSTANTIATE_32_IF_ENABLED(CPU);
 	INSTANTIATE_64_IF_ENABLED(CPU);
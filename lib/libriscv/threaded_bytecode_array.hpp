@@ -38,10 +38,15 @@ static constexpr void *computed_opcode[] = {
 	[RV32I_BC_BGEU] = &&rv32i_bgeu,
 	[RV32I_BC_BEQ_FW] = &&rv32i_beq_fw,
 	[RV32I_BC_BNE_FW] = &&rv32i_bne_fw,
+	[RV32I_BC_BLT_FW] = &&rv32i_blt_fw,
+	[RV32I_BC_BGE_FW] = &&rv32i_bge_fw,
+	[RV32I_BC_BLTU_FW] = &&rv32i_bltu_fw,
+	[RV32I_BC_BGEU_FW] = &&rv32i_bgeu_fw,
 
 	[RV32I_BC_JAL] = &&rv32i_jal,
 	[RV32I_BC_JALR] = &&rv32i_jalr,
 	[RV32I_BC_FAST_JAL] = &&rv32i_fast_jal,
+	[RV32I_BC_FAST_JAL_FW] = &&rv32i_fast_jal_fw,
 	[RV32I_BC_FAST_CALL] = &&rv32i_fast_call,
 
 	[RV32I_BC_OP_ADD] = &&rv32i_op_add,
@@ -90,6 +95,9 @@ static constexpr void *computed_opcode[] = {
 	[RV32C_BC_BEQZ] = &&rv32c_beqz,
 	[RV32C_BC_BNEZ] = &&rv32c_bnez,
 	[RV32C_BC_JMP] = &&rv32c_jmp,
+	[RV32C_BC_BEQZ_FW] = &&rv32c_beqz_fw,
+	[RV32C_BC_BNEZ_FW] = &&rv32c_bnez_fw,
+	[RV32C_BC_JMP_FW] = &&rv32c_jmp_fw,
 	[RV32C_BC_JR] = &&rv32c_jr,
 	[RV32C_BC_JAL_ADDIW] = &&rv32c_jal_addiw,
 	[RV32C_BC_JALR] = &&rv32c_jalr,
@@ -102,6 +110,30 @@ static constexpr void *computed_opcode[] = {
 	[RV32C_BC_JUMPFUNC] = &&rv32c_jumpfunc,
 #endif
 
+	[RV32I_BC_FUSED_LUI_ADDI] = &&rv32i_fused_lui_addi,
+	[RV32I_BC_FUSED_AUIPC_ADDI] = &&rv32i_fused_auipc_addi,
+	[RV32I_BC_FUSED_AUIPC_LDW] = &&rv32i_fused_auipc_ldw,
+	[RV32I_BC_FUSED_AUIPC_JALR] = &&rv32i_fused_auipc_jalr,
+	[RV32I_BC_FUSED_ADDI_BRANCH] = &&rv32i_fused_addi_branch,
+	[RV32I_BC_FUSED_SLT_BRANCH] = &&rv32i_fused_slt_branch,
+	[RV32I_BC_FUSED_SLTU_BRANCH] = &&rv32i_fused_sltu_branch,
+	[RV32I_BC_FUSED_ADD_LDW] = &&rv32i_fused_add_ldw,
+	[RV32I_BC_FUSED_SH2ADD_LDW] = &&rv32i_fused_sh2add_ldw,
+	[RV32I_BC_FUSED_LDW_LDW] = &&rv32i_fused_ldw_ldw,
+	[RV32I_BC_FUSED_STW_STW] = &&rv32i_fused_stw_stw,
+#ifdef RISCV_64I
+	[RV64I_BC_FUSED_LUI_ADDIW] = &&rv64i_fused_lui_addiw,
+	[RV64I_BC_FUSED_AUIPC_LDD] = &&rv64i_fused_auipc_ldd,
+	[RV64I_BC_FUSED_ADD_LDD] = &&rv64i_fused_add_ldd,
+	[RV64I_BC_FUSED_SH3ADD_LDD] = &&rv64i_fused_sh3add_ldd,
+	[RV64I_BC_FUSED_LDD_LDD] = &&rv64i_fused_ldd_ldd,
+	[RV64I_BC_FUSED_STD_STD] = &&rv64i_fused_std_std,
+#endif
+#ifdef RISCV_EXT_COMPRESSED
+	[RV32C_BC_FUSED_LDD_LDD] = &&rv32c_fused_ldd_ldd,
+	[RV32C_BC_FUSED_STD_STD] = &&rv32c_fused_std_std,
+#endif
+
 	[RV32I_BC_SYSCALL] = &&rv32i_syscall,
 	[RV32I_BC_STOP] = &&rv32i_stop,
 	[RV32I_BC_NOP] = &&rv32i_nop,
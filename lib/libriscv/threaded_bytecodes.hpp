@@ -45,12 +45,19 @@ namespace riscv
 		RV32I_BC_BGE,
 		RV32I_BC_BLTU,
 		RV32I_BC_BGEU,
+		// Forward branches and jumps cannot close a loop,
+		// so they skip the instruction limit check.
 		RV32I_BC_BEQ_FW,
 		RV32I_BC_BNE_FW,
+		RV32I_BC_BLT_FW,
+		RV32I_BC_BGE_FW,
+		RV32I_BC_BLTU_FW,
+		RV32I_BC_BGEU_FW,
 
 		RV32I_BC_JAL,
 		RV32I_BC_JALR,
 		RV32I_BC_FAST_JAL,
+		RV32I_BC_FAST_JAL_FW,
 		RV32I_BC_FAST_CALL,
 
 		RV32I_BC_OP_ADD,
@@ -99,6 +106,9 @@ namespace riscv
 		RV32C_BC_BEQZ,
 		RV32C_BC_BNEZ,
 		RV32C_BC_JMP,
+		RV32C_BC_BEQZ_FW,
+		RV32C_BC_BNEZ_FW,
+		RV32C_BC_JMP_FW,
 		RV32C_BC_JR,
 		RV32C_BC_JAL_ADDIW,
 		RV32C_BC_JALR,
@@ -111,6 +121,33 @@ namespace riscv
 		RV32C_BC_JUMPFUNC,
 #endif
 
+		// Superinstructions: A fused pair of instructions is
+		// dispatched once from the entry of the first instruction.
+		// The entry of the second instruction is left untouched.
+		RV32I_BC_FUSED_LUI_ADDI,
+		RV32I_BC_FUSED_AUIPC_ADDI,
+		RV32I_BC_FUSED_AUIPC_LDW,
+		RV32I_BC_FUSED_AUIPC_JALR,
+		RV32I_BC_FUSED_ADDI_BRANCH,
+		RV32I_BC_FUSED_SLT_BRANCH,
+		RV32I_BC_FUSED_SLTU_BRANCH,
+		RV32I_BC_FUSED_ADD_LDW,
+		RV32I_BC_FUSED_SH2ADD_LDW,
+		RV32I_BC_FUSED_LDW_LDW,
+		RV32I_BC_FUSED_STW_STW,
+#ifdef RISCV_64I
+		RV64I_BC_FUSED_LUI_ADDIW,
+		RV64I_BC_FUSED_AUIPC_LDD,
+		RV64I_BC_FUSED_ADD_LDD,
+		RV64I_BC_FUSED_SH3ADD_LDD,
+		RV64I_BC_FUSED_LDD_LDD,
+		RV64I_BC_FUSED_STD_STD,
+#endif
+#ifdef RISCV_EXT_COMPRESSED
+		RV32C_BC_FUSED_LDD_LDD,
+		RV32C_BC_FUSED_STD_STD,
+#endif
+
 		RV32I_BC_SYSCALL,
 		RV32I_BC_STOP,
 		RV32I_BC_NOP,
@@ -140,6 +177,94 @@ namespace riscv
 		BYTECODES_MAX
 	};
 	static_assert(BYTECODES_MAX <= 256, "A bytecode must fit in a byte");
+	// Stored in persistent decoder caches. Must be increased whenever
+	// bytecodes or the instruction bits they are given are changed.
+	static constexpr unsigned BYTECODE_VERSION = 3;
+
+	// Returns the bytecode of the first instruction of a fused
+	// pair, or the bytecode itself when it is not a superinstruction.
+	inline constexpr unsigned unfused_bytecode(unsigned bytecode) noexcept
+	{
+		switch (bytecode) {
+		case RV32I_BC_FUSED_LUI_ADDI:
+			return RV32I_BC_LUI;
+		case RV32I_BC_FUSED_AUIPC_ADDI:
+		case RV32I_BC_FUSED_AUIPC_LDW:
+		case RV32I_BC_FUSED_AUIPC_JALR:
+			return RV32I_BC_AUIPC;
+		case RV32I_BC_FUSED_ADDI_BRANCH:
+			return RV32I_BC_ADDI;
+		case RV32I_BC_FUSED_SLT_BRANCH:
+			return RV32I_BC_OP_SLT;
+		case RV32I_BC_FUSED_SLTU_BRANCH:
+			return RV32I_BC_OP_SLTU;
+		case RV32I_BC_FUSED_ADD_LDW:
+			return RV32I_BC_OP_ADD;
+		case RV32I_BC_FUSED_SH2ADD_LDW:
+			return RV32I_BC_OP_SH2ADD;
+		case RV32I_BC_FUSED_LDW_LDW:
+			return RV32I_BC_LDW;
+		case RV32I_BC_FUSED_STW_STW:
+			return RV32I_BC_STW;
+#ifdef RISCV_64I
+		case RV64I_BC_FUSED_LUI_ADDIW:
+			return RV32I_BC_LUI;
+		case RV64I_BC_FUSED_AUIPC_LDD:
+			return RV32I_BC_AUIPC;
+		case RV64I_BC_FUSED_ADD_LDD:
+			return RV32I_BC_OP_ADD;
+		case RV64I_BC_FUSED_SH3ADD_LDD:
+			return RV32I_BC_OP_SH3ADD;
+		case RV64I_BC_FUSED_LDD_LDD:
+			return RV32I_BC_LDD;
+		case RV64I_BC_FUSED_STD_STD:
+			return RV32I_BC_STD;
+#endif
+#ifdef RISCV_EXT_COMPRESSED
+		case RV32C_BC_FUSED_LDD_LDD:
+			return RV32C_BC_LDD;
+		case RV32C_BC_FUSED_STD_STD:
+			return RV32C_BC_STD;
+#endif
+		default:
+			return bytecode;
+		}
+	}
+
+	// Returns the variant of a branch or jump bytecode that skips the
+	// instruction limit check, used when the destination is ahead of it.
+	// Every loop then has at least one checked backward edge, and without
+	// a check execution only moves forward, so the instruction limit can
+	// be overshot by at most the length of the execute segment.
+	inline constexpr unsigned forward_bytecode(unsigned bytecode) noexcept
+	{
+		switch (bytecode) {
+		case RV32I_BC_BEQ:
+			return RV32I_BC_BEQ_FW;
+		case RV32I_BC_BNE:
+			return RV32I_BC_BNE_FW;
+		case RV32I_BC_BLT:
+			return RV32I_BC_BLT_FW;
+		case RV32I_BC_BGE:
+			return RV32I_BC_BGE_FW;
+		case RV32I_BC_BLTU:
+			return RV32I_BC_BLTU_FW;
+		case RV32I_BC_BGEU:
+			return RV32I_BC_BGEU_FW;
+		case RV32I_BC_FAST_JAL:
+			return RV32I_BC_FAST_JAL_FW;
+#ifdef RISCV_EXT_COMPRESSED
+		case RV32C_BC_BEQZ:
+			return RV32C_BC_BEQZ_FW;
+		case RV32C_BC_BNEZ:
+			return RV32C_BC_BNEZ_FW;
+		case RV32C_BC_JMP:
+			return RV32C_BC_JMP_FW;
+#endif
+		default:
+			return bytecode;
+		}
+	}
 
 	union FasterItype
 	{
@@ -119,10 +119,8 @@ namespace riscv
 				instr.whole = rewritten.whole;
 
 				// Forward branches can skip instr count check
-				if (imm > 0 && bytecode == RV32I_BC_BEQ)
-					return RV32I_BC_BEQ_FW;
-				if (imm > 0 && bytecode == RV32I_BC_BNE)
-					return RV32I_BC_BNE_FW;
+				if (imm > 0)
+					return forward_bytecode(bytecode);
 
 				return bytecode;
 			}
@@ -242,7 +240,7 @@ namespace riscv
 					else if (store_zero)
 					{
 						instr.whole = diff;
-						return RV32I_BC_FAST_JAL;
+						return (diff > 0) ? forward_bytecode(RV32I_BC_FAST_JAL) : unsigned(RV32I_BC_FAST_JAL);
 					}
 					else if (store_ra)
 					{
@@ -428,6 +426,8 @@ namespace riscv
 				rewritten.imm = imm;
 
 				instr.whole = rewritten.whole;
+				if (imm > 0)
+					return forward_bytecode(bytecode);
 				return bytecode;
 			}
 			case RV32C_BC_JMP:
@@ -454,6 +454,8 @@ namespace riscv
 				}
 
 				instr.whole = imm;
+				if (imm > 0 && bytecode == RV32C_BC_JMP)
+					return forward_bytecode(bytecode);
 				return bytecode;
 			}
 			case RV32C_BC_JALR: {
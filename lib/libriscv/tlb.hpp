@@ -0,0 +1,83 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include "common.hpp"
+
+namespace riscv
+{
+	// A direct-mapped software TLB that caches page data pointers for
+	// reads and writes. Each entry holds one tag per permission, so a
+	// page that was only read through is not writable through the TLB.
+	// The number of entries must be a power of two.
+	template <int W, typename T, unsigned N>
+	struct PageTLB
+	{
+		using address_t = address_type<W>;
+		static_assert(N > 0 && (N & (N - 1)) == 0, "TLB size must be a power of two");
+		static constexpr address_t NONE = (address_t)-1;
+
+		struct Entry {
+			address_t rd = NONE; // Page number if readable
+			address_t wr = NONE; // Page number if writable
+			T* page = nullptr;
+		};
+
+		struct Stats {
+			uint64_t reads = 0;
+			uint64_t read_misses = 0;
+			uint64_t writes = 0;
+			uint64_t write_misses = 0;
+		};
+
+		static constexpr unsigned size() noexcept { return N; }
+
+		Entry& entry(address_t pageno) noexcept {
+			return m_entries[pageno & (N - 1)];
+		}
+		const Entry& entry(address_t pageno) const noexcept {
+			return m_entries[pageno & (N - 1)];
+		}
+
+		// Returns the cached page, or nullptr on a miss
+		T* readable(address_t pageno) noexcept {
+			auto& e = entry(pageno);
+			if constexpr (tlb_stats_enabled) {
+				m_stats.reads ++;
+				m_stats.read_misses += (e.rd != pageno);
+			}
+			return (e.rd == pageno) ? e.page : nullptr;
+		}
+		T* writable(address_t pageno) noexcept {
+			auto& e = entry(pageno);
+			if constexpr (tlb_stats_enabled) {
+				m_stats.writes ++;
+				m_stats.write_misses += (e.wr != pageno);
+			}
+			return (e.wr == pageno) ? e.page : nullptr;
+		}
+
+		void insert(address_t pageno, T* page, bool readable, bool writable) noexcept {
+			auto& e = entry(pageno);
+			e.rd = readable ? pageno : NONE;
+			e.wr = writable ? pageno : NONE;
+			e.page = page;
+		}
+
+		void invalidate(address_t pageno) noexcept {
+			auto& e = entry(pageno);
+			if (e.rd == pageno || e.wr == pageno)
+				e = {};
+		}
+		void invalidate_all() noexcept {
+			m_entries = {};
+		}
+
+		const Stats& stats() const noexcept { return m_stats; }
+		void reset_stats() noexcept { m_stats = {}; }
+
+	private:
+		std::array<Entry, N> m_entries {};
+		Stats m_stats;
+	};
+
+} // riscv
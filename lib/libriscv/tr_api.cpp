@@ -22,6 +22,18 @@ namespace riscv {
 #define MISALIGNED_INSTRUCTION 4
 #define VISIBLE  __attribute__((visibility("default")))
 #define INTERNAL __attribute__((visibility("hidden")))
+// Translations compiled in shards share functions and global state
+#ifdef BINTR_SHARD
+#define BINTR_FUNC INTERNAL
+#if BINTR_SHARD > 0
+#define BINTR_GLOBAL extern INTERNAL
+#else
+#define BINTR_GLOBAL INTERNAL
+#endif
+#else
+#define BINTR_FUNC static
+#define BINTR_GLOBAL static
+#endif
 
 #if RISCV_TRANSLATION_DYLIB == 4
 	typedef uint32_t addr_t;
@@ -151,7 +163,7 @@ typedef struct {
 typedef void (*syscall_t) (CPU*);
 typedef void (*handler) (CPU*, uint32_t);
 
-static struct CallbackTable {
+struct CallbackTable {
 	addr_t (*mem_ld) (const CPU*, addr_t, unsigned);
 	void (*mem_st) (const CPU*, addr_t, addr_t, unsigned);
 	void (*vec_load)(const CPU*, int, addr_t);
@@ -173,7 +185,8 @@ static struct CallbackTable {
 	int (*ctzl) (uint64_t);
 	int (*cpop) (uint32_t);
 	int (*cpopl) (uint64_t);
-} api;
+};
+BINTR_GLOBAL struct CallbackTable api;
 #define INS_COUNTER(cpu) (*(uint64_t *)((uintptr_t)cpu + RISCV_INS_COUNTER_OFF))
 #define MAX_COUNTER(cpu) (*(uint64_t *)((uintptr_t)cpu + RISCV_MAX_COUNTER_OFF))
 #define ARENA_READ_BOUNDARY  (RISCV_ARENA_END - 0x1000)
@@ -181,7 +194,7 @@ static struct CallbackTable {
 #define ARENA_READABLE(x) ((x) - 0x1000 < ARENA_READ_BOUNDARY)
 #define ARENA_WRITABLE(x) ((x) - RISCV_ARENA_ROEND < ARENA_WRITE_BOUNDARY)
 
-INTERNAL static char* arena_ptr;
+BINTR_GLOBAL char* arena_ptr;
 //#define ARENA_AT(cpu, x)  (arena_ptr + (x))
 #define ARENA_AT(cpu, x)  (*(char **)((uintptr_t)cpu + RISCV_ARENA_OFF) + (x))
 
@@ -227,7 +240,7 @@ static inline uint64_t MUL128(
 	return (middle << 32) | (uint32_t)p00;
 }
 
-#ifndef EMBEDDABLE_CODE
+#if !defined(EMBEDDABLE_CODE) && !(defined(BINTR_SHARD) && BINTR_SHARD > 0)
 extern VISIBLE void init(struct CallbackTable* table, char* arena)
 {
 	api = *table;
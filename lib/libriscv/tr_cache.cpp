@@ -0,0 +1,281 @@
+#include "common.hpp"
+#include "util/crc32.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * Managed translation cache: A directory of compiled translations with an
+ * index that is shared by all processes using the directory. Each line of
+ * the index describes one translation:
+ *
+ *   hash compiler-flags translator-version size last-use
+ *
+ * Translations compiled with other flags or by another version of the
+ * translator are stale, and are removed when they are looked up. The least
+ * recently used translations are evicted to stay below a byte budget.
+ * The index is only read and written with index.lock held, and a new
+ * translation is compiled to a temporary file while holding a per-hash
+ * lock file, and then renamed into place, so that concurrent workers never
+ * see partial files and never compile the same translation twice.
+**/
+
+namespace riscv
+{
+	extern std::string compile_command(int arch, const std::string& cflags);
+	extern const std::string bintr_code;
+	// Bump this when the translator emits different code for the same program
+	static constexpr uint32_t TRANSLATOR_VERSION = 1;
+	// Lock files older than this belong to a worker that has gone away
+	static constexpr auto STALE_LOCK_TIME = std::chrono::minutes(10);
+	static constexpr char INDEX_MAGIC[] = "rvbintr-cache-v1";
+
+	struct CacheIndexEntry {
+		uint32_t hash;
+		uint32_t flags;
+		uint32_t version;
+		uint64_t size;
+		int64_t  last_use;
+	};
+	struct CacheIndex {
+		TranslationCacheStatistics stats;
+		std::vector<CacheIndexEntry> entries;
+
+		CacheIndexEntry* find(uint32_t hash) {
+			for (auto& entry : entries)
+				if (entry.hash == hash) return &entry;
+			return nullptr;
+		}
+		void erase(uint32_t hash) {
+			entries.erase(std::remove_if(entries.begin(), entries.end(),
+				[hash] (const auto& entry) { return entry.hash == hash; }), entries.end());
+		}
+	};
+
+	static uint32_t translator_version()
+	{
+		static const uint32_t version =
+			crc32c(TRANSLATOR_VERSION, bintr_code.c_str(), bintr_code.size());
+		return version;
+	}
+
+	static int64_t unix_time()
+	{
+		return std::chrono::duration_cast<std::chrono::seconds>(
+			std::chrono::system_clock::now().time_since_epoch()).count();
+	}
+
+	static std::string cache_filename(const std::string& directory, uint32_t hash, const char* suffix)
+	{
+		char buffer[64];
+		const int len = snprintf(buffer, sizeof(buffer), "/rvbintr-%08X%s", hash, suffix);
+		return directory + std::string(buffer, len);
+	}
+
+	// Holds index.lock, and reads and writes the index
+	struct CacheIndexLock {
+		CacheIndexLock(const std::string& directory)
+			: m_directory(directory)
+		{
+			mkdir(directory.c_str(), 0755);
+			m_fd = open((directory + "/index.lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+			if (m_fd >= 0 && flock(m_fd, LOCK_EX) != 0) {
+				close(m_fd);
+				m_fd = -1;
+			}
+		}
+		~CacheIndexLock() {
+			if (m_fd >= 0)
+				close(m_fd); // Also releases the lock
+		}
+		bool locked() const noexcept { return m_fd >= 0; }
+
+		CacheIndex read() const
+		{
+			CacheIndex index;
+			std::unique_ptr<FILE, int(*)(FILE*)> file { fopen((m_directory + "/index").c_str(), "r"), fclose };
+			if (file == nullptr)
+				return index;
+			char magic[32] = {};
+			unsigned long long hits, misses, stores, evictions;
+			if (fscanf(file.get(), "%31s %llu %llu %llu %llu", magic, &hits, &misses, &stores, &evictions) != 5
+				|| strcmp(magic, INDEX_MAGIC) != 0)
+				return index;
+			index.stats.hits = hits;
+			index.stats.misses = misses;
+			index.stats.stores = stores;
+			index.stats.evictions = evictions;
+
+			unsigned hash, flags, version;
+			unsigned long long size;
+			long long last_use;
+			while (fscanf(file.get(), "%x %x %x %llu %lld", &hash, &flags, &version, &size, &last_use) == 5) {
+				index.entries.push_back({hash, flags, version, size, last_use});
+			}
+			return index;
+		}
+
+		// The index is replaced atomically, so that a crash never leaves half of it
+		void write(const CacheIndex& index) const
+		{
+			const std::string filename = m_directory + "/index";
+			const std::string temporary = filename + ".tmp";
+			FILE* file = fopen(temporary.c_str(), "w");
+			if (file == nullptr)
+				return;
+			bool written = fprintf(file, "%s %llu %llu %llu %llu\n", INDEX_MAGIC,
+				(unsigned long long)index.stats.hits, (unsigned long long)index.stats.misses,
+				(unsigned long long)index.stats.stores, (unsigned long long)index.stats.evictions) > 0;
+			for (const auto& entry : index.entries) {
+				written = written && fprintf(file, "%08X %08X %08X %llu %lld\n",
+					entry.hash, entry.flags, entry.version,
+					(unsigned long long)entry.size, (long long)entry.last_use) > 0;
+			}
+			if (fclose(file) != 0 || !written || std::rename(temporary.c_str(), filename.c_str()) != 0)
+				std::remove(temporary.c_str());
+		}
+
+	private:
+		const std::string m_directory;
+		int m_fd = -1;
+	};
+
+	uint32_t translation_cache_flags(int arch, const std::string& cflags)
+	{
+		// The compiler and its flags, including CC and CFLAGS from the environment
+		const std::string command = compile_command(arch, cflags);
+		return crc32c(command.c_str(), command.size());
+	}
+
+	std::string translation_cache_lookup(const std::string& directory, uint32_t hash, uint32_t flags)
+	{
+		CacheIndexLock lock(directory);
+		if (!lock.locked())
+			return "";
+		CacheIndex index = lock.read();
+		const std::string filename = cache_filename(directory, hash, ".so");
+
+		auto* entry = index.find(hash);
+		if (entry != nullptr && entry->flags == flags && entry->version == translator_version()
+			&& access(filename.c_str(), R_OK) == 0)
+		{
+			entry->last_use = unix_time();
+			// Most recently used first, also within the same second
+			auto it = index.entries.begin() + (entry - index.entries.data());
+			std::rotate(index.entries.begin(), it, it + 1);
+			index.stats.hits++;
+			lock.write(index);
+			return filename;
+		}
+		// Stale translations are removed right away
+		if (entry != nullptr) {
+			unlink(filename.c_str());
+			index.erase(hash);
+		}
+		index.stats.misses++;
+		lock.write(index);
+		return "";
+	}
+
+	static bool is_stale_lock(const std::string& lockname)
+	{
+		struct stat st;
+		return stat(lockname.c_str(), &st) == 0
+			&& unix_time() - st.st_mtime > std::chrono::seconds(STALE_LOCK_TIME).count();
+	}
+
+	// Returns true when the lock was taken. Returns false after waiting
+	// for another worker that held the lock, which has now finished.
+	bool translation_cache_lock(const std::string& directory, uint32_t hash)
+	{
+		const std::string lockname = cache_filename(directory, hash, ".lock");
+		while (true) {
+			const int fd = open(lockname.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+			if (fd >= 0) {
+				close(fd);
+				return true;
+			}
+			if (errno != EEXIST)
+				return true; // Compile without the lock
+			if (is_stale_lock(lockname)) {
+				unlink(lockname.c_str());
+				continue;
+			}
+			// Another worker is compiling the same translation
+			while (access(lockname.c_str(), F_OK) == 0 && !is_stale_lock(lockname))
+				std::this_thread::sleep_for(std::chrono::milliseconds(50));
+			return false;
+		}
+	}
+
+	void translation_cache_unlock(const std::string& directory, uint32_t hash)
+	{
+		unlink(cache_filename(directory, hash, ".lock").c_str());
+	}
+
+	std::string translation_cache_temporary(const std::string& directory, uint32_t hash)
+	{
+		return cache_filename(directory, hash, ".so.tmp");
+	}
+
+	std::string translation_cache_insert(const std::string& directory, uint32_t hash, uint32_t flags,
+		const std::string& temporary, uint64_t max_bytes)
+	{
+		const std::string filename = cache_filename(directory, hash, ".so");
+		CacheIndexLock lock(directory);
+		struct stat st;
+		if (!lock.locked() || stat(temporary.c_str(), &st) != 0
+			|| std::rename(temporary.c_str(), filename.c_str()) != 0)
+		{
+			unlink(temporary.c_str());
+			translation_cache_unlock(directory, hash);
+			return "";
+		}
+		translation_cache_unlock(directory, hash);
+
+		CacheIndex index = lock.read();
+		index.erase(hash);
+		index.entries.insert(index.entries.begin(),
+			{hash, flags, translator_version(), uint64_t(st.st_size), unix_time()});
+		index.stats.stores++;
+
+		// Evict the least recently used translations, except the new one
+		std::stable_sort(index.entries.begin(), index.entries.end(),
+			[] (const auto& a, const auto& b) { return a.last_use > b.last_use; });
+		uint64_t total = 0;
+		auto it = index.entries.begin();
+		for (; it != index.entries.end(); ++it) {
+			total += it->size;
+			if (total > max_bytes && it != index.entries.begin())
+				break;
+		}
+		for (auto evict = it; evict != index.entries.end(); ++evict) {
+			unlink(cache_filename(directory, evict->hash, ".so").c_str());
+			index.stats.evictions++;
+		}
+		index.entries.erase(it, index.entries.end());
+		lock.write(index);
+		return filename;
+	}
+
+	TranslationCacheStatistics translation_cache_read_statistics(const std::string& directory)
+	{
+		CacheIndexLock lock(directory);
+		if (!lock.locked())
+			return {};
+		const CacheIndex index = lock.read();
+		TranslationCacheStatistics stats = index.stats;
+		stats.entries = index.entries.size();
+		for (const auto& entry : index.entries)
+			stats.bytes += entry.size;
+		return stats;
+	}
+}
@@ -1,6 +1,8 @@
 #include "common.hpp"
 
+#include <chrono>
 #include <cstring>
+#include <thread>
 #if defined(__MINGW32__) || defined(__MINGW64__) || defined(_MSC_VER)
 #include "win32/dlfcn.h"
 #else
@@ -51,6 +53,24 @@ namespace riscv
 			" -pipe " + extra_cflags();
 	}
 
+	static bool run_compiler(const std::string& command)
+	{
+		if (verbose()) {
+			printf("Command: %s\n", command.c_str());
+		}
+		FILE* f = popen(command.c_str(), "r");
+		if (f == nullptr) {
+			return false;
+		}
+		// get compiler output
+		char buffer[2048];
+		while (fgets(buffer, sizeof(buffer), f) != NULL) {
+			if (verbose())
+				fprintf(stderr, "%s", buffer);
+		}
+		return pclose(f) == 0;
+	}
+
 	void*
 	compile(const std::string& code, int arch, const std::string& cflags,
 		const std::string& outfile)
@@ -76,27 +96,91 @@ namespace riscv
 			 + std::string(namebuffer) + " 2>&1"; // redirect stderr
 
 		// compile the translated code
-		if (verbose()) {
-			printf("Command: %s\n", command.c_str());
-		}
-		FILE* f = popen(command.c_str(), "r");
-		if (f == nullptr) {
-			unlink(namebuffer);
-			return nullptr;
-		}
-		// get compiler output
-		char buffer[2048];
-		while (fgets(buffer, sizeof(buffer), f) != NULL) {
-			if (verbose())
-				fprintf(stderr, "%s", buffer);
-		}
-		pclose(f);
+		const bool success = run_compiler(command);
 
 		if (!keep_code()) {
 			// delete temporary code file
 			unlink(namebuffer);
 		}
 
+		if (!success)
+			return nullptr;
+		return dlopen(outfile.c_str(), RTLD_LAZY);
+	}
+
+	// Compiles each shard into an object file on its own thread, and then
+	// links the objects into one shared object. Shard 0 holds the tables.
+	void*
+	compile_shards(const std::vector<std::string>& shards, int arch, const std::string& cflags,
+		const std::string& outfile, bool timing)
+	{
+		using clock = std::chrono::steady_clock;
+		auto elapsed_ms = [] (clock::time_point t0) {
+			return std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+		};
+		std::vector<std::string> objects(shards.size());
+		std::vector<char> failed(shards.size(), true);
+		std::vector<std::thread> threads;
+		threads.reserve(shards.size());
+
+		for (size_t i = 0; i < shards.size(); i++) {
+			threads.emplace_back([&, i] {
+				const auto t0 = clock::now();
+				char codebuffer[64];
+				strncpy(codebuffer, "/tmp/rvtrcode-XXXXXX", sizeof(codebuffer));
+				char objbuffer[64];
+				strncpy(objbuffer, "/tmp/rvtrobj-XXXXXX", sizeof(objbuffer));
+				const int fd = mkstemp(codebuffer);
+				if (fd < 0) {
+					return;
+				}
+				const int objfd = mkstemp(objbuffer);
+				if (objfd < 0) {
+					close(fd);
+					unlink(codebuffer);
+					return;
+				}
+				close(objfd);
+				objects[i] = objbuffer;
+				// write translated code to temp file
+				const ssize_t len = write(fd, shards[i].c_str(), shards[i].size());
+				close(fd);
+				if (len == (ssize_t) shards[i].size()) {
+					failed[i] = !run_compiler(
+						compile_command(arch, cflags) + " -c -DBINTR_SHARD=" + std::to_string(i)
+						+ " -o " + objects[i] + " " + std::string(codebuffer) + " 2>&1");
+				}
+				if (!keep_code()) {
+					// delete temporary code file
+					unlink(codebuffer);
+				}
+				if (timing) {
+					printf(">> Shard %zu compilation took %.2f ms (%zu bytes)\n",
+						i, elapsed_ms(t0), shards[i].size());
+				}
+			});
+		}
+		for (auto& thread : threads)
+			thread.join();
+
+		const auto t0 = clock::now();
+		bool success = true;
+		std::string command = compiler() + " -s -shared -o " + outfile;
+		for (size_t i = 0; i < shards.size(); i++) {
+			success = success && !failed[i];
+			command += " " + objects[i];
+		}
+		success = success && run_compiler(command + " " + extra_cflags() + " 2>&1");
+		for (auto& object : objects) {
+			if (!object.empty())
+				unlink(object.c_str());
+		}
+		if (timing) {
+			printf(">> Linking %zu shards took %.2f ms\n", shards.size(), elapsed_ms(t0));
+		}
+
+		if (!success)
+			return nullptr;
 		return dlopen(outfile.c_str(), RTLD_LAZY);
 	}
 
@@ -136,28 +220,14 @@ namespace riscv
 			 + std::string(namebuffer) + " 2>&1"; // redirect stderr
 
 		// compile the translated code
-		if (verbose()) {
-			printf("MinGW Command: %s\n", command.c_str());
-		}
-		FILE* f = popen(command.c_str(), "r");
-		if (f == nullptr) {
-			unlink(namebuffer);
-			return false;
-		}
-		// get compiler output
-		char buffer[2048];
-		while (fgets(buffer, sizeof(buffer), f) != NULL) {
-			if (verbose())
-				fprintf(stderr, "%s", buffer);
-		}
-		pclose(f);
+		const bool success = run_compiler(command);
 
 		if (!keep_code()) {
 			// delete temporary code file
 			unlink(namebuffer);
 		}
 
-		return true;
+		return success;
 	}
 
 	extern void  tcc_close(void* state);
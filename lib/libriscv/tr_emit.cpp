@@ -151,6 +151,14 @@ struct Emitter
 	}
 	void store_loaded_registers() {
 		// Use the STORE_REGS macro to store the registers
+		if (uses_register_caching()) {
+			add_code("STORE_REGS_" + this->func + "();");
+			// The whole register file is visible outside of translated code
+			this->m_exposed_registers = ALL_REGISTERS;
+		}
+	}
+	void store_registers_on_exit() {
+		// Leaving translated code: Only the registers of this function are needed
 		if (uses_register_caching())
 			add_code("STORE_REGS_" + this->func + "();");
 	}
@@ -164,12 +172,13 @@ struct Emitter
 		if (uses_register_caching()) {
 			add_code("STORE_SYS_REGS_" + this->func + "();");
 			this->m_used_store_syscalls = true;
+			this->m_exposed_registers |= SYSCALL_REGISTERS;
 		}
 	}
 
 	void exit_function(const std::string& new_pc, bool add_bracket = false)
 	{
-		this->store_loaded_registers();
+		this->store_registers_on_exit();
 		const char* return_code = (tinfo.ignore_instruction_limit) ? "return (ReturnValues){0, max_counter};" : "return (ReturnValues){counter, max_counter};";
 		add_code(
 			(new_pc != "cpu->pc") ? "cpu->pc = " + new_pc + ";" : "",
@@ -239,6 +248,18 @@ struct Emitter
 	bool gpr_exists_at(int reg) const noexcept { return this->gpr_exists.at(reg); }
 	auto& get_gpr_exists() const noexcept { return this->gpr_exists; }
 
+	// The register footprint of this function: registers that it or its
+	// direct callees read or write, or that are exposed to the outside
+	// (eg. system calls), as a bitmask
+	uint32_t register_footprint() const noexcept {
+		uint32_t regs = this->m_exposed_registers | this->m_callee_footprint;
+		for (int reg = 1; reg < 32; reg++)
+			if (gpr_exists[reg]) regs |= 1u << reg;
+		return regs;
+	}
+	// Registers that are spilled to cpu->r for each direct call
+	const auto& get_call_footprints() const noexcept { return this->m_call_footprints; }
+
 	bool uses_flat_memory_arena() noexcept {
 		return riscv::flat_readwrite_arena && tinfo.arena_ptr != 0;
 	}
@@ -345,7 +366,9 @@ struct Emitter
 	}
 	void memory_store(std::string type, int reg, int32_t imm, std::string value)
 	{
-		if (uses_flat_memory_arena()) {
+		// Arena dirty tracking happens in the store callback
+		const bool direct_arena_stores = uses_flat_memory_arena() && !riscv::arena_dirty_tracking;
+		if (direct_arena_stores) {
 			address_t absolute_vaddr = 0;
 			if (reg == REG_GP && tinfo.gp != 0x0) {
 				absolute_vaddr = tinfo.gp + imm;
@@ -364,7 +387,7 @@ struct Emitter
 		{
 			add_code("*(" + type + "*)" + arena_at(address) + " = " + value + ";");
 		}
-		else if (uses_flat_memory_arena()) {
+		else if (direct_arena_stores) {
 			add_code(
 				"if (LIKELY(ARENA_WRITABLE(" + address + ")))",
 				"  *(" + type + "*)" + arena_at(address) + " = " + value + ";",
@@ -445,7 +468,6 @@ struct Emitter
 
 	const std::string get_func() const noexcept { return this->func; }
 	void emit();
-	rv32i_instruction emit_rvc();
 
 private:
 	static std::string speculation_safe(const std::string& address) {
@@ -511,6 +533,11 @@ private:
 	uint64_t m_instr_counter = 0;
 	uint32_t m_zero_insn_counter = 0;
 	bool m_used_store_syscalls = false;
+	static constexpr uint32_t ALL_REGISTERS = ~uint32_t(1);
+	static constexpr uint32_t SYSCALL_REGISTERS = 0xFFu << 10; // A0-A7
+	uint32_t m_exposed_registers = 0;
+	uint32_t m_callee_footprint = 0;
+	std::vector<uint32_t> m_call_footprints;
 
 	std::array<bool, 32> gpr_exists {};
 	// Register tracking
@@ -572,8 +599,25 @@ inline void Emitter<W>::emit_branch(const BranchInfo& binfo, const std::string&
 template <int W>
 inline bool Emitter<W>::emit_function_call(address_t target_funcaddr, address_t dest_pc)
 {
-	// Store the registers
-	this->store_loaded_registers();
+	// Only the footprint of the callee is spilled to cpu->r. The rest
+	// of the registers stay in locals until we really exit. Callees are
+	// emitted before their callers, so an unknown footprint (eg. calling
+	// ourselves) spills everything.
+	uint32_t footprint = ALL_REGISTERS;
+	if (tinfo.register_footprints != nullptr) {
+		auto it = tinfo.register_footprints->find(target_funcaddr);
+		if (it != tinfo.register_footprints->end())
+			footprint = it->second;
+	}
+	this->m_callee_footprint |= footprint;
+	const bool partial_spill = uses_register_caching() && footprint != ALL_REGISTERS;
+	const std::string call_id = this->func + "_" + std::to_string(this->m_call_footprints.size());
+	if (partial_spill) {
+		this->m_call_footprints.push_back(footprint);
+		add_code("STORE_CALL_REGS_" + call_id + "();");
+	} else {
+		this->store_registers_on_exit();
+	}
 
 	auto target_func = funclabel<W>("f", target_funcaddr);
 	add_forward(target_func);
@@ -588,7 +632,10 @@ inline bool Emitter<W>::emit_function_call(address_t target_funcaddr, address_t
 	}
 
 	// Restore the registers
-	this->reload_all_registers();
+	if (partial_spill)
+		add_code("LOAD_CALL_REGS_" + call_id + "();");
+	else
+		this->reload_all_registers();
 
 	if (tinfo.trace_instructions) {
 		code += "api.trace(cpu, \"" + this->func + "\", cpu->pc, max_counter);\n";
@@ -597,9 +644,13 @@ inline bool Emitter<W>::emit_function_call(address_t target_funcaddr, address_t
 	// Hope and pray that the next PC is local to this block
 	if (!tinfo.ignore_instruction_limit) {
 		add_code("if (" + LOOP_EXPRESSION + ") { pc = cpu->pc; goto " + this->func + "_jumptbl; }");
+		if (partial_spill)
+			this->store_registers_on_exit();
 		add_code("return (ReturnValues){counter, max_counter};");
 	} else {
 		add_code("if (max_counter) { pc = cpu->pc; goto " + this->func + "_jumptbl; }");
+		if (partial_spill)
+			this->store_registers_on_exit();
 		add_code("return (ReturnValues){0, 0};");
 	}
 	return true;
@@ -758,7 +809,7 @@ void Emitter<W>::emit()
 		if (instr.is_compressed()) {
 			// Compressed 16-bit instructions
 			auto original = instr.whole;
-			instr = this->emit_rvc();
+			instr = expand_compressed<W>(instr);
 
 			if (instr.is_compressed())
 			{
@@ -1938,6 +1989,9 @@ CPU<W>::emit(std::string& code, const TransInfo<W>& tinfo)
 {
 	Emitter<W> e(tinfo);
 	e.emit();
+	// Record the footprint for the callers of this function
+	if (tinfo.register_footprints != nullptr)
+		(*tinfo.register_footprints)[tinfo.basepc] = e.register_footprint();
 
 	// Create register push and pop macros
 	if (tinfo.use_register_caching) {
@@ -1976,6 +2030,25 @@ CPU<W>::emit(std::string& code, const TransInfo<W>& tinfo)
 			}
 			code += "  ;\n";
 		}
+		// Footprint-limited spilling for direct calls to other translated functions
+		for (size_t call = 0; call < e.get_call_footprints().size(); call++) {
+			const uint32_t footprint = e.get_call_footprints()[call];
+			const std::string call_id = e.get_func() + "_" + std::to_string(call);
+			code += "#define STORE_CALL_REGS_" + call_id + "() \\\n";
+			for (size_t reg = 1; reg < 32; reg++) {
+				if (e.gpr_exists_at(reg) && (footprint & (1u << reg))) {
+					code += "  cpu->r[" + std::to_string(reg) + "] = " + e.loaded_regname(reg) + "; \\\n";
+				}
+			}
+			code += "  ;\n";
+			code += "#define LOAD_CALL_REGS_" + call_id + "() \\\n";
+			for (size_t reg = 1; reg < 32; reg++) {
+				if (e.gpr_exists_at(reg) && (footprint & (1u << reg))) {
+					code += "  " + e.loaded_regname(reg) + " = cpu->r[" + std::to_string(reg) + "]; \\\n";
+				}
+			}
+			code += "  ;\n";
+		}
 		code += "#define LOAD_SYS_REGS_" + e.get_func() + "() \\\n";
 		for (size_t reg = 10; reg < 12; reg++) {
 			if (e.gpr_exists_at(reg)) {
@@ -1987,11 +2060,11 @@ CPU<W>::emit(std::string& code, const TransInfo<W>& tinfo)
 
 	// Forward declarations
 	for (const auto& entry : e.get_forward_declared()) {
-		code += "static ReturnValues " + entry + "(CPU*, uint64_t, uint64_t, addr_t);\n";
+		code += "BINTR_FUNC ReturnValues " + entry + "(CPU*, uint64_t, uint64_t, addr_t);\n";
 	}
 
 	// Function header
-	code += "static ReturnValues " + e.get_func() + "(CPU* cpu, uint64_t counter, uint64_t max_counter, addr_t pc) {\n";
+	code += "BINTR_FUNC ReturnValues " + e.get_func() + "(CPU* cpu, uint64_t counter, uint64_t max_counter, addr_t pc) {\n";
 
 	// Function GPRs
 	if (tinfo.use_register_caching) {
@@ -4,10 +4,12 @@
 #  define RISCV_HAS_BITOPS
 # endif
 #endif
+#include <algorithm>
 #include <cmath>
 #include <chrono>
 #include <fstream>
 #include <mutex>
+#include <thread>
 #if defined(__MINGW32__) || defined(__MINGW64__) || defined(_MSC_VER)
 # define YEP_IS_WINDOWS 1
 # include "win32/dlfcn.h"
@@ -40,6 +42,8 @@ namespace riscv
 {
 	static constexpr bool VERBOSE_BLOCKS = false;
 	static constexpr bool SCAN_FOR_GP = true;
+	// Smaller translations are always compiled in one compiler invocation
+	static constexpr size_t SHARDED_COMPILATION_MINIMUM = 128 * 1024;
 
 	static inline timespec time_now();
 	static inline long nanodiff(timespec, timespec);
@@ -52,22 +56,21 @@ namespace riscv
 		}
 	extern void  dylib_close(void* dylib, bool is_libtcc);
 	extern void* dylib_lookup(void* dylib, const char*, bool is_libtcc);
+	// libtcc uses global state, so we need to serialize compilation
+	static std::mutex libtcc_mutex;
 
 	template <int W>
 	using binary_translation_init_func = void (*)(const CallbackTable<W>&, void*);
 	template <int W>
 	static CallbackTable<W> create_bintr_callback_table(DecodedExecuteSegment<W>&);
+	template <int W>
+	static void apply_translation_mappings(const MachineOptions<W>&, DecodedExecuteSegment<W>&,
+		const Mapping<W>*, unsigned, const bintr_block_func<W>*, unsigned, bool);
 
 	// Translations that are embeddable in the binary will be added as a source
 	// file directly in the project, which allows it to run global constructors.
 	// The constructor will register the translation with the binary translator,
 	// and we can check against this list when loading translations.
-	template <int W>
-	struct Mapping {
-		address_type<W> addr;
-		unsigned mapping_index;
-	};
-
 	// This implementation is designed to make sure it's not a global constructor
 	// instead it will get zeroed from BSS
 	static constexpr size_t MAX_EMBEDDED = 12;
@@ -284,6 +287,21 @@ int CPU<W>::load_translation(const MachineOptions<W>& options,
 		return -1;
 
 	void* dylib = nullptr;
+#ifndef _WIN32
+	if (!libtcc_enabled && options.translation_cache && !options.translation_cache_directory.empty())
+	{
+		extern uint32_t translation_cache_flags(int arch, const std::string& cflags);
+		extern std::string translation_cache_lookup(const std::string&, uint32_t hash, uint32_t flags);
+		const std::string cached = translation_cache_lookup(options.translation_cache_directory,
+			checksum, translation_cache_flags(W, cflags));
+		if (options.verbose_loader) {
+			printf("libriscv: Translation cache %s for hash %08X\n", cached.empty() ? "miss" : "hit", checksum);
+		}
+		// A miss is compiled into the cache directory by try_translate()
+		snprintf(filebuffer, sizeof(filebuffer), "%s", cached.c_str());
+	}
+#endif
+	if (filebuffer[0] != 0)
 	{
 		TIME_POINT(t7);
 		// Probably not needed, but on Windows there might be some issues
@@ -305,6 +323,13 @@ int CPU<W>::load_translation(const MachineOptions<W>& options,
 		if (must_compile)
 			return 1;
 	}
+#ifdef RISCV_NATIVE_JIT
+	// The same goes for the native JIT, which needs no compiler
+	if (options.translate_native_jit && W != 16) {
+		if (must_compile)
+			return 1;
+	}
+#endif
 
 #ifndef _MSC_VER
 	// If cross compilation is enabled, we should check if all results exist
@@ -456,6 +481,17 @@ if constexpr (SCAN_FOR_GP) {
 		}
 	}
 
+	// Tiered translation only translates the blocks that are hot enough
+	auto is_hot_block = [&output] (address_t begin, address_t end) -> bool {
+		if (output.block_counts == nullptr)
+			return true;
+		for (address_t addr = begin; addr < end; addr += DecoderCache<W>::DIVISOR) {
+			if (output.block_counts[addr / DecoderCache<W>::DIVISOR] >= output.min_block_count)
+				return true;
+		}
+		return false;
+	};
+
 	for (address_t pc = basepc; pc < endbasepc && icounter < options.translate_instr_max; )
 	{
 		const auto block = pc;
@@ -556,7 +592,7 @@ if constexpr (SCAN_FOR_GP) {
 
 		// Process block and add it for emission
 		const size_t length = block_instructions.size();
-		if (length > 0 && icounter + length < options.translate_instr_max)
+		if (length > 0 && icounter + length < options.translate_instr_max && is_hot_block(block, block_end))
 		{
 			if constexpr (VERBOSE_BLOCKS) {
 				printf("Block found at %#lX -> %#lX. Length: %zu\n", long(block), long(block_end), length);
@@ -597,17 +633,54 @@ if constexpr (SCAN_FOR_GP) {
 		printf(">> Code block detection %ld ns\n", nanodiff(t2, t3));
 	}
 
+#ifdef RISCV_NATIVE_JIT
+	// Machine code generation, skipping C code entirely
+	if constexpr (W != 16) {
+		if (output.native) {
+			for (auto& block : blocks)
+				block.blocks = &blocks;
+			this->emit_native(options, blocks, create_bintr_callback_table(exec), *output.native);
+
+			if (options.translate_timing) {
+				TIME_POINT(t4);
+				printf(">> Native code generation took %ld ns\n", nanodiff(t3, t4));
+			}
+			if (verbose) {
+				printf("libriscv: Emitted %zu native instructions, %zu blocks and %zu functions (%zu bytes). GP=0x%lX\n",
+					icounter, blocks.size(), output.native->handlers.size(), output.native->code_size, (long) gp);
+			}
+			return;
+		}
+	}
+#endif
+
 	// Code generation
 	auto& dlmappings = output.mappings;
 	extern const std::string bintr_code;
 	output.code = std::make_shared<std::string>(bintr_code);
 
-	for (auto& block : blocks)
-	{
+	// With register caching, direct calls only spill the register
+	// footprint of the callee. Functions only call forward, so emitting
+	// the blocks backwards gives each caller the footprints it needs.
+	std::unordered_map<address_type<W>, uint32_t> register_footprints;
+	for (auto& block : blocks) {
 		block.blocks = &blocks;
-		auto result = emit(*output.code, block);
+		if (options.translate_use_register_caching)
+			block.register_footprints = &register_footprints;
+	}
+	std::vector<std::string> block_code(blocks.size());
+	std::vector<std::vector<TransMapping<W>>> block_mappings(blocks.size());
+	for (size_t i = blocks.size(); i-- > 0; )
+	{
+		block_mappings[i] = emit(block_code[i], blocks[i]);
+	}
+
+	for (size_t i = 0; i < blocks.size(); i++)
+	{
+		output.block_offsets.push_back(output.code->size());
+		*output.code += block_code[i];
 
-		for (auto& mapping : result) {
+		for (auto& mapping : block_mappings[i]) {
 			dlmappings.push_back(std::move(mapping));
 		}
 	}
@@ -731,6 +804,96 @@ void CPU<W>::produce_embeddable_code(const MachineOptions<W>& options, DecodedEx
 	embed_file << "}\n";
 }
 
+// Split the code into shards of about the same size, at block boundaries.
+// The first shard also declares every handler and holds the mapping tables.
+template <int W>
+static std::vector<std::string> shard_translation(const TransOutput<W>& output, unsigned shards)
+{
+	const std::string& code = *output.code;
+	const size_t header_end = output.block_offsets.front();
+	const size_t shard_size = (code.size() - header_end) / shards + 1;
+
+	std::vector<std::string> result;
+	size_t begin = header_end;
+	for (size_t i = 1; i <= output.block_offsets.size(); i++)
+	{
+		const size_t end = (i < output.block_offsets.size()) ? output.block_offsets[i] : code.size();
+		if (end - begin >= shard_size || end == code.size()) {
+			result.push_back(code.substr(0, header_end) + code.substr(begin, end - begin));
+			begin = end;
+		}
+	}
+
+	std::unordered_set<std::string> declared;
+	for (const auto& mapping : output.mappings) {
+		if (declared.insert(mapping.symbol).second)
+			result.front() += "BINTR_FUNC ReturnValues " + mapping.symbol + "(CPU*, uint64_t, uint64_t, addr_t);\n";
+	}
+	result.front() += output.footer;
+	return result;
+}
+
+template <int W>
+static void* compile_translation(const MachineOptions<W>& options, const TransOutput<W>& output,
+	const std::string& cflags, const std::string& filename)
+{
+	extern void* compile(const std::string&, int arch, const std::string& cflags, const std::string&);
+	extern void* compile_shards(const std::vector<std::string>&, int arch, const std::string& cflags, const std::string&, bool timing);
+
+	const size_t code_size = output.code->size();
+	unsigned shards = (options.translate_compiler_shards != 0)
+		? options.translate_compiler_shards : std::thread::hardware_concurrency();
+	shards = std::min<size_t>({shards, output.block_offsets.size(), code_size / SHARDED_COMPILATION_MINIMUM});
+	if (shards > 1) {
+		if (options.translate_timing) {
+			printf(">> Compiling %zu bytes of code in %u shards\n", code_size, shards);
+		}
+		return compile_shards(shard_translation(output, shards), W, cflags, filename, options.translate_timing);
+	}
+	return compile(*output.code + output.footer, W, cflags, filename);
+}
+
+#ifndef _WIN32
+// Compile into the managed translation cache. When another worker is already
+// compiling the same translation, wait for it and load its result instead.
+template <int W>
+static void* compile_into_cache(const MachineOptions<W>& options, const TransOutput<W>& output,
+	const std::string& cflags, uint32_t hash)
+{
+	extern uint32_t translation_cache_flags(int arch, const std::string& cflags);
+	extern std::string translation_cache_lookup(const std::string&, uint32_t hash, uint32_t flags);
+	extern bool translation_cache_lock(const std::string&, uint32_t hash);
+	extern void translation_cache_unlock(const std::string&, uint32_t hash);
+	extern std::string translation_cache_temporary(const std::string&, uint32_t hash);
+	extern std::string translation_cache_insert(const std::string&, uint32_t hash, uint32_t flags, const std::string&, uint64_t max_bytes);
+	const auto& directory = options.translation_cache_directory;
+	const uint32_t flags = translation_cache_flags(W, cflags);
+
+	while (!translation_cache_lock(directory, hash)) {
+		const std::string cached = translation_cache_lookup(directory, hash, flags);
+		if (!cached.empty()) {
+			if (options.verbose_loader) {
+				printf("libriscv: Translation cache hit for hash %08X after waiting\n", hash);
+			}
+			return dlopen(cached.c_str(), RTLD_LAZY);
+		}
+	}
+
+	const std::string temporary = translation_cache_temporary(directory, hash);
+	void* dylib = compile_translation(options, output, cflags, temporary);
+	if (dylib == nullptr) {
+		unlink(temporary.c_str());
+		translation_cache_unlock(directory, hash);
+		return nullptr;
+	}
+	const std::string filename = translation_cache_insert(directory, hash, flags, temporary, options.translation_cache_max_bytes);
+	if (options.verbose_loader && !filename.empty()) {
+		printf("libriscv: Stored translation %s\n", filename.c_str());
+	}
+	return dylib;
+}
+#endif
+
 template <int W>
 void CPU<W>::try_translate(const MachineOptions<W>& options, const std::string& filename,
 	std::shared_ptr<DecodedExecuteSegment<W>>& shared_segment) const
@@ -745,6 +908,12 @@ void CPU<W>::try_translate(const MachineOptions<W>& options, const std::string&
 
 	output.defines = create_defines_for(machine(), options);
 	const bool live_patch = options.translate_background_callback != nullptr;
+#ifdef RISCV_NATIVE_JIT
+	if constexpr (W != 16) {
+		if (options.translate_native_jit)
+			output.native = std::make_shared<NativeTranslation<W>>();
+	}
+#endif
 	void* arena = machine().memory.memory_arena_ptr_ref();
 
 	// Compilation step
@@ -755,6 +924,18 @@ void CPU<W>::try_translate(const MachineOptions<W>& options, const std::string&
 
 		this->binary_translate(options, *exec, output);
 
+#ifdef RISCV_NATIVE_JIT
+		if (output.native) {
+			if (!exec->is_binary_translated() && output.native->code != nullptr) {
+				activate_native(options, *exec, *output.native, live_patch);
+			}
+			if (options.translate_timing) {
+				TIME_POINT(t12);
+				printf(">> Binary translation totals %.2f ms\n", nanodiff(output.t0, t12) / 1e6);
+			}
+			return;
+		}
+#endif
 		//printf("*** Compiling translation from 0x%lX to 0x%lX ***\n",
 		//	long(shared_segment->exec_begin()), long(shared_segment->exec_end()));
 
@@ -774,20 +955,23 @@ void CPU<W>::try_translate(const MachineOptions<W>& options, const std::string&
 		TIME_POINT(t9);
 		if constexpr (libtcc_enabled) {
 			extern void* libtcc_compile(const std::string&, int arch, const std::unordered_map<std::string, std::string>& defines, const std::string&);
-			static std::mutex libtcc_mutex;
-			// libtcc uses global state, so we need to serialize compilation
 			std::lock_guard<std::mutex> lock(libtcc_mutex);
 			dylib = libtcc_compile(shared_library_code, W, output.defines, "");
 		} else {
-			extern void* compile(const std::string&, int arch, const std::string& cflags, const std::string&);
 			extern bool mingw_compile(const std::string&, int arch, const std::string& cflags, const std::string&, const MachineTranslationCrossOptions&);
 			const std::string cflags = defines_to_string(output.defines);
 
 			// If the binary translation has already been loaded, we can skip compilation
 			if (exec->is_binary_translated()) {
 				dylib = exec->binary_translation_so();
-			} else {
-				dylib = compile(shared_library_code, W, cflags, filename);
+			}
+		#ifndef _WIN32
+			else if (options.translation_cache && !options.translation_cache_directory.empty()) {
+				dylib = compile_into_cache(options, output, cflags, exec->translation_hash());
+			}
+		#endif
+			else {
+				dylib = compile_translation(options, output, cflags, filename);
 			}
 
 			// Optionally produce cross-compiled binaries
@@ -875,11 +1059,32 @@ void CPU<W>::activate_dylib(const MachineOptions<W>& options, DecodedExecuteSegm
 	// After this, we should automatically close the dylib on destruction
 	exec.set_binary_translated(dylib, is_libtcc);
 
+	apply_translation_mappings(options, exec, mappings, *no_mappings, handlers, *no_handlers, live_patch);
+
+	if (options.translate_timing) {
+		TIME_POINT(t12);
+		printf(">> Binary translation activation %ld ns\n", nanodiff(t11, t12));
+	}
+	if (options.verbose_loader) {
+		printf("libriscv: Activated %s binary translation with %u/%u mappings%s\n",
+			is_libtcc ? "libtcc" : "full",
+			*no_handlers, *no_mappings,
+			live_patch ? ", live-patching enabled" : "");
+	}
+}
+
+template <int W>
+static void apply_translation_mappings(const MachineOptions<W>& options, DecodedExecuteSegment<W>& exec,
+	const Mapping<W>* mappings, const unsigned nmappings,
+	const bintr_block_func<W>* handlers, const unsigned unique_mappings, bool live_patch)
+{
+	using address_t = address_type<W>;
 	// Helper to rebuild decoder blocks
 	std::unique_ptr<DecoderCache<W>[]> patched_decoder_cache = nullptr;
 	DecoderData<W>* patched_decoder = nullptr;
 	DecoderData<W>* decoder_begin   = nullptr;
 	std::vector<DecoderData<W>*> livepatch_bintr;
+	std::vector<bool> instruction_starts;
 	if (live_patch) {
 		patched_decoder_cache = std::make_unique<DecoderCache<W>[]>(exec.decoder_cache_size());
 		// Copy the decoder cache to the patched decoder cache
@@ -888,11 +1093,22 @@ void CPU<W>::activate_dylib(const MachineOptions<W>& options, DecodedExecuteSegm
 		patched_decoder = patched_decoder_cache[0].get_base() - exec.pagedata_base() / DecoderCache<W>::DIVISOR;
 		decoder_begin = &decoder_entry_at(patched_decoder, exec.exec_begin());
 		// Pre-allocate the livepatch_bintr vector
-		livepatch_bintr.reserve(*no_mappings);
+		livepatch_bintr.reserve(nmappings);
+		// Entries in the middle of an instruction carry no block information,
+		// so find where each instruction starts in order to skip over them
+		if constexpr (compressed_enabled) {
+			instruction_starts.resize((exec.exec_end() - exec.exec_begin()) / 2);
+			for (auto pc = exec.exec_begin(); pc < exec.exec_end(); ) {
+				instruction_starts[(pc - exec.exec_begin()) / 2] = true;
+				pc += read_instruction(exec.exec_data(), pc, exec.exec_end()).length();
+			}
+		}
 	}
-	std::unordered_map<bintr_block_func<W>, unsigned> block_indices;
-	const unsigned nmappings = *no_mappings;
-	const unsigned unique_mappings = *no_handlers;
+	auto is_instruction_start = [&] (const DecoderData<W>* dd) -> bool {
+		if constexpr (compressed_enabled)
+			return instruction_starts[dd - decoder_begin];
+		return true;
+	};
 
 	// Create N+1 mappings, where the last one is a catch-all for invalid mappings
 	exec.create_mappings(unique_mappings + 1);
@@ -926,8 +1142,13 @@ void CPU<W>::activate_dylib(const MachineOptions<W>& options, DecodedExecuteSegm
 					auto* last    = &entry;
 					auto* current = &entry;
 					auto last_block_bytes = entry.block_bytes();
-					while (current > decoder_begin && (current-1)->block_bytes() > last_block_bytes) {
-						current--;
+					while (current > decoder_begin) {
+						auto* prev = current - 1;
+						while (prev > decoder_begin && !is_instruction_start(prev))
+							prev--;
+						if (prev->block_bytes() <= last_block_bytes)
+							break;
+						current = prev;
 						last_block_bytes = current->block_bytes();
 					}
 
@@ -941,18 +1162,29 @@ void CPU<W>::activate_dylib(const MachineOptions<W>& options, DecodedExecuteSegm
 
 					// 4. Correct block_bytes() for all entries in the block
 					auto patched_addr = block_begin_addr;
+				#ifdef RISCV_EXT_C
+					// The instruction count of each entry depends on the
+					// number of instructions left until the end of the block
+					unsigned instructions_left = 0;
+					for (auto* dd = current; dd < last; dd++)
+						instructions_left += is_instruction_start(dd);
+				#endif
 					for (auto* dd = current; dd < last; dd++) {
 						// Get the patched decoder entry
 						auto& p = decoder_entry_at(patched_decoder, patched_addr);
 						p.idxend = last - dd;
 					#ifdef RISCV_EXT_C
-						p.icount = 0; // TODO: Implement C-ext icount for live-patching
+						// The translator entry at the end is counted as one instruction
+						p.icount = 0;
+						if (is_instruction_start(dd))
+							p.icount = p.idxend - instructions_left--;
 					#endif
 						patched_addr += (compressed_enabled) ? 2 : 4;
 					}
 
 					// 5. The last instruction will be replaced with a binary translation
 					// function, which will be the last instruction in the block.
+					unfuse_instruction_before(patched_decoder, exec.exec_begin(), addr);
 					auto& p = decoder_entry_at(patched_decoder, addr);
 					p.set_bytecode(RV32I_BC_TRANSLATOR);
 					p.set_invalid_handler();
@@ -966,6 +1198,7 @@ void CPU<W>::activate_dylib(const MachineOptions<W>& options, DecodedExecuteSegm
 				} else {
 					// Normal block-end hint that will be transformed into a translation
 					// bytecode if it passes a few more checks, later.
+					unfuse_instruction_before(exec.decoder_cache(), exec.exec_begin(), addr);
 					auto& entry = decoder_entry_at(exec.decoder_cache(), addr);
 					entry.set_bytecode(RV32I_BC_TRANSLATOR);
 					entry.set_invalid_handler();
@@ -1000,18 +1233,195 @@ void CPU<W>::activate_dylib(const MachineOptions<W>& options, DecodedExecuteSegm
 				dd->set_bytecode(RV32I_BC_LIVEPATCH);
 		}
 	}
+}
+
+#ifdef RISCV_NATIVE_JIT
+template <int W>
+void CPU<W>::activate_native(const MachineOptions<W>& options, DecodedExecuteSegment<W>& exec, NativeTranslation<W>& native, bool live_patch)
+{
+	TIME_POINT(t11);
+
+	// After this, the machine code is released together with the segment
+	exec.set_native_code(native.code);
+
+	apply_translation_mappings(options, exec, native.mappings.data(), native.mappings.size(),
+		native.handlers.data(), native.handlers.size(), live_patch);
 
 	if (options.translate_timing) {
 		TIME_POINT(t12);
 		printf(">> Binary translation activation %ld ns\n", nanodiff(t11, t12));
 	}
 	if (options.verbose_loader) {
-		printf("libriscv: Activated %s binary translation with %u/%u mappings%s\n",
-			is_libtcc ? "libtcc" : "full",
-			unique_mappings, nmappings,
+		printf("libriscv: Activated native binary translation with %zu/%zu mappings%s\n",
+			native.handlers.size(), native.mappings.size(),
 			live_patch ? ", live-patching enabled" : "");
 	}
 }
+#endif
+
+#ifdef RISCV_TIERED_TRANSLATION
+template <int W>
+bool CPU<W>::defer_translation(const MachineOptions<W>& options, DecodedExecuteSegment<W>& exec) const
+{
+	if (!options.translate_tiered)
+		return false;
+	// The first tier is translated during emulation, so it needs a fast backend
+	bool fast_backend = libtcc_enabled;
+#ifdef RISCV_NATIVE_JIT
+	fast_backend = fast_backend || (W != 16 && options.translate_native_jit);
+#endif
+	if (!fast_backend)
+		return false;
+
+	auto tiered = std::make_unique<TieredTranslation<W>>();
+	tiered->filename = options.translation_filename(
+		options.translation_prefix, exec.translation_hash(), "-hot" + options.translation_suffix);
+	exec.set_tiered_translation(std::move(tiered));
+	exec.set_tier_threshold(options.translate_tier1_threshold);
+
+	if (options.verbose_loader) {
+		printf("libriscv: Translation of 0x%lX-0x%lX is deferred until it is hot\n",
+			(long)exec.exec_begin(), (long)exec.exec_end());
+	}
+	return true;
+}
+
+// Replace the handlers of entries that are already translated. The decoder
+// cache and the mapping table stay the same, so machines can keep running.
+template <int W>
+static unsigned replace_translation_mappings(DecodedExecuteSegment<W>& exec,
+	const Mapping<W>* mappings, const unsigned nmappings, const bintr_block_func<W>* handlers)
+{
+	unsigned replaced = 0;
+	for (unsigned i = 0; i < nmappings; i++)
+	{
+		const auto addr = mappings[i].addr;
+		auto* handler = handlers[mappings[i].mapping_index];
+		if (!exec.is_within(addr) || handler == nullptr)
+			continue;
+		// The last mapping is the catch-all for invalid mappings
+		auto& entry = decoder_entry_at(exec.decoder_cache(), addr);
+		if (entry.get_bytecode() == RV32I_BC_TRANSLATOR && entry.instr + 1 < exec.translator_mappings()) {
+			exec.replace_mapping(entry.instr, handler);
+			replaced++;
+		}
+	}
+	return replaced;
+}
+
+template <int W>
+void CPU<W>::tier_up(DecodedExecuteSegment<W>& exec)
+{
+	auto* tiered = exec.tiered_translation();
+	if (tiered == nullptr) {
+		exec.set_tier_threshold(UINT64_MAX);
+		return;
+	}
+	// Another machine sharing the segment may already be doing this
+	std::unique_lock<std::mutex> lock(tiered->mutex, std::try_to_lock);
+	if (!lock.owns_lock())
+		return;
+	// Each tier is attempted once, and failing keeps the current tier
+	const unsigned tier = ++tiered->tier;
+	exec.set_tier_threshold(UINT64_MAX);
+	const auto& options = machine().options();
+	void* arena = machine().memory.memory_arena_ptr_ref();
+
+	TransOutput<W> output;
+	TIME_POINT(t0);
+	output.t0 = t0;
+	output.defines = create_defines_for(machine(), options);
+	output.block_counts = exec.block_counts();
+
+	try {
+		if (tier == 1)
+		{
+			// Tier 1: Everything that has run so far, using the fast backend
+			output.min_block_count = 1;
+#ifdef RISCV_NATIVE_JIT
+			if constexpr (W != 16) {
+				if (options.translate_native_jit)
+					output.native = std::make_shared<NativeTranslation<W>>();
+			}
+#endif
+			this->binary_translate(options, exec, output);
+
+#ifdef RISCV_NATIVE_JIT
+			if (output.native) {
+				if (output.native->code != nullptr)
+					activate_native(options, exec, *output.native, true);
+			} else
+#endif
+			if constexpr (libtcc_enabled) {
+				extern void* libtcc_compile(const std::string&, int arch, const std::unordered_map<std::string, std::string>& defines, const std::string&);
+				std::lock_guard<std::mutex> tcc_lock(libtcc_mutex);
+				void* dylib = libtcc_compile(*output.code + output.footer, W, output.defines, "");
+				if (dylib != nullptr)
+					activate_dylib(options, exec, dylib, arena, true, true);
+			}
+
+			if (options.translate_timing) {
+				TIME_POINT(t1);
+				printf(">> Tier 1 translation totals %.2f ms\n", nanodiff(t0, t1) / 1e6);
+			}
+			// Tier 2 is compiled in the background by the system compiler
+			if (exec.is_binary_translated() && !libtcc_enabled && options.translate_background_callback)
+				exec.set_tier_threshold(options.translate_tier2_threshold);
+		}
+		else if constexpr (!libtcc_enabled)
+		{
+			// Tier 2: The blocks that reached the tier 1 threshold, optimized
+			auto& shared_segment = machine().memory.exec_segment_for(exec.exec_begin());
+			if (tier != 2 || shared_segment.get() != &exec)
+				return;
+			output.min_block_count = options.translate_tier1_threshold;
+			this->binary_translate(options, exec, output);
+			if (output.mappings.empty())
+				return;
+
+			std::function<void()> compilation_step =
+			[options, cflags = defines_to_string(output.defines), output = std::move(output),
+			 filename = tiered->filename, arena, shared_segment = shared_segment] ()
+			{
+				TIME_POINT(t9);
+				void* dylib = compile_translation(options, output, cflags, filename);
+				// Only the hot blocks are in the shared object, so it is never cached
+				unlink(filename.c_str());
+				if (dylib == nullptr)
+					return;
+				if (options.translate_timing) {
+					TIME_POINT(t10);
+					printf(">> Tier 2 compilation took %.2f ms\n", nanodiff(t9, t10) / 1e6);
+				}
+
+				auto& exec = *shared_segment;
+				const uint32_t* no_mappings = (const uint32_t *)dylib_lookup(dylib, "no_mappings", false);
+				const auto* mappings = (const Mapping<W> *)dylib_lookup(dylib, "mappings", false);
+				const auto* handlers = (const bintr_block_func<W> *)dylib_lookup(dylib, "unique_mappings", false);
+				if (no_mappings == nullptr || mappings == nullptr || handlers == nullptr
+					|| !initialize_translated_segment(exec, dylib, arena, false))
+				{
+					dylib_close(dylib, false);
+					return;
+				}
+				// After this, the dylib is closed together with the segment
+				exec.set_binary_translated(dylib, false);
+
+				const unsigned replaced = replace_translation_mappings(exec, mappings, *no_mappings, handlers);
+				if (options.verbose_loader) {
+					printf("libriscv: Activated tier 2 binary translation with %u/%u mappings\n",
+						replaced, *no_mappings);
+				}
+			};
+			options.translate_background_callback(compilation_step);
+		}
+	} catch (const std::exception& e) {
+		if (options.verbose_loader) {
+			fprintf(stderr, "libriscv: Tier %u translation failed: %s\n", tier, e.what());
+		}
+	}
+}
+#endif
 
 template <int W>
 CallbackTable<W> create_bintr_callback_table(DecodedExecuteSegment<W>&)
@@ -1237,20 +1647,47 @@ std::string MachineOptions<W>::translation_filename(const std::string& prefix, u
 	return std::string(buffer, len);
 }
 
+template <int W>
+TranslationCacheStatistics MachineOptions<W>::translation_cache_statistics(const std::string& directory)
+{
+#ifndef _WIN32
+	extern TranslationCacheStatistics translation_cache_read_statistics(const std::string&);
+	return translation_cache_read_statistics(directory);
+#else
+	(void)directory;
+	return {};
+#endif
+}
+
 #ifdef RISCV_32I
 	template void CPU<4>::try_translate(const MachineOptions<4>&, const std::string&, std::shared_ptr<DecodedExecuteSegment<4>>&) const;
 	template int CPU<4>::load_translation(const MachineOptions<4>&, std::string*, DecodedExecuteSegment<4>&) const;
 	template std::string MachineOptions<4>::translation_filename(const std::string&, uint32_t, const std::string&);
+	template TranslationCacheStatistics MachineOptions<4>::translation_cache_statistics(const std::string&);
+#ifdef RISCV_TIERED_TRANSLATION
+	template bool CPU<4>::defer_translation(const MachineOptions<4>&, DecodedExecuteSegment<4>&) const;
+	template void CPU<4>::tier_up(DecodedExecuteSegment<4>&);
+#endif
 #endif
 #ifdef RISCV_64I
 	template void CPU<8>::try_translate(const MachineOptions<8>&, const std::string&, std::shared_ptr<DecodedExecuteSegment<8>>&) const;
 	template int CPU<8>::load_translation(const MachineOptions<8>&, std::string*, DecodedExecuteSegment<8>&) const;
 	template std::string MachineOptions<8>::translation_filename(const std::string&, uint32_t, const std::string&);
+	template TranslationCacheStatistics MachineOptions<8>::translation_cache_statistics(const std::string&);
+#ifdef RISCV_TIERED_TRANSLATION
+	template bool CPU<8>::defer_translation(const MachineOptions<8>&, DecodedExecuteSegment<8>&) const;
+	template void CPU<8>::tier_up(DecodedExecuteSegment<8>&);
+#endif
 #endif
 #ifdef RISCV_128I
 	template void CPU<16>::try_translate(const MachineOptions<16>&, const std::string&, std::shared_ptr<DecodedExecuteSegment<16>>&) const;
 	template int CPU<16>::load_translation(const MachineOptions<16>&, std::string*, DecodedExecuteSegment<16>&) const;
 	template std::string MachineOptions<16>::translation_filename(const std::string&, uint32_t, const std::string&);
+	template TranslationCacheStatistics MachineOptions<16>::translation_cache_statistics(const std::string&);
+#ifdef RISCV_TIERED_TRANSLATION
+	template bool CPU<16>::defer_translation(const MachineOptions<16>&, DecodedExecuteSegment<16>&) const;
+	template void CPU<16>::tier_up(DecodedExecuteSegment<16>&);
+#endif
 #endif
 
 	timespec time_now()
@@ -1,5 +1,6 @@
 #include "types.hpp"
 #include "rv32i_instr.hpp"
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
@@ -8,6 +9,26 @@ namespace riscv
 	template <int W>
 	struct TransInstr;
 
+	template <int W>
+	struct Mapping {
+		address_type<W> addr;
+		unsigned mapping_index;
+	};
+
+#ifdef RISCV_NATIVE_JIT
+	// Machine code produced by the native x86-64 backend
+	template <int W>
+	struct NativeTranslation
+	{
+		// Executable mapping holding all the emitted functions
+		std::shared_ptr<void> code;
+		size_t code_size = 0;
+		// One entry point per mapping, with the same ABI as dylib functions
+		std::vector<bintr_block_func<W>> handlers;
+		std::vector<Mapping<W>> mappings;
+	};
+#endif
+
 	template <int W>
 	struct TransOutput
 	{
@@ -15,7 +36,17 @@ namespace riscv
 		timespec t0;
 		std::shared_ptr<std::string> code;
 		std::string footer;
+		// Where the code of each block begins, so that it can be sharded
+		std::vector<size_t> block_offsets;
 		std::vector<TransMapping<W>> mappings;
+		// When set, only blocks where an entry has reached min_block_count
+		// are translated. The counts are indexed like the decoder cache.
+		const uint64_t* block_counts = nullptr;
+		uint64_t min_block_count = 0;
+#ifdef RISCV_NATIVE_JIT
+		// When set, machine code is emitted here instead of C code
+		std::shared_ptr<NativeTranslation<W>> native;
+#endif
 	};
 
 	template <int W>
@@ -42,5 +73,8 @@ namespace riscv
 		uintptr_t arena_ptr;
 		address_type<W> arena_roend;
 		address_type<W> arena_size;
+		// The register footprint of each emitted function (by base PC),
+		// used to limit spilling at direct calls with register caching
+		std::unordered_map<address_type<W>, uint32_t>* register_footprints = nullptr;
 	};
 }
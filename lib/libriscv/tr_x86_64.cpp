@@ -0,0 +1,1065 @@
+#include "machine.hpp"
+#include "decoder_cache.hpp"
+#include "instruction_list.hpp"
+#include "rv32i_instr.hpp"
+#include "rvfd.hpp"
+#include "tr_api.hpp"
+#include "tr_types.hpp"
+#ifdef RISCV_EXT_C
+#include "rvc.hpp"
+#endif
+#include <cstring>
+#include <sys/mman.h>
+
+/**
+ * The native JIT translates the same blocks as the C emitter, but
+ * directly into x86-64 machine code. Each mapping gets its own entry
+ * point with the same ABI as the functions in a translation dylib:
+ *
+ *   bintr_block_returns<W> f(CPU<W>&, uint64_t counter, uint64_t max_counter, address_t pc)
+ *
+ * Register assignment inside the emitted code:
+ *   RBX = CPU, RBP = callback table, R12 = counter, R13 = max counter,
+ *   R14 = memory arena base. RAX, RCX, RDX and RSI are scratch.
+ * Guest registers live in the CPU, and are loaded for each instruction.
+ * Instructions that are not emitted natively call their handler.
+**/
+
+namespace riscv
+{
+#ifdef RISCV_EXT_C
+#include "tr_emit_rvc.cpp"
+#endif
+
+namespace {
+	enum X86Reg : uint8_t {
+		RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+		R8 = 8, R9 = 9, R10 = 10, R11 = 11, R12 = 12, R13 = 13, R14 = 14, R15 = 15
+	};
+	enum X86Cond : uint8_t {
+		CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5,
+		CC_L = 0xC, CC_GE = 0xD,
+	};
+	// Extensions of the ALU group (0x81/0x83) and shift group (0xC1/0xD3)
+	enum : uint8_t { ALU_ADD = 0, ALU_OR = 1, ALU_AND = 4, ALU_SUB = 5, ALU_XOR = 6, ALU_CMP = 7 };
+	enum : uint8_t { SHIFT_SHL = 4, SHIFT_SHR = 5, SHIFT_SAR = 7 };
+	// Extensions of the unary group (0xF7)
+	enum : uint8_t { UNARY_NEG = 3, UNARY_MUL = 4, UNARY_IMUL = 5, UNARY_DIV = 6, UNARY_IDIV = 7 };
+
+	// The callback table is placed at the start of the executable mapping
+	static constexpr size_t CODE_OFFSET = (sizeof(CallbackTable<8>) + 63) & ~size_t(63);
+
+	struct Label {
+		int64_t pos = -1;
+		std::vector<size_t> fixups;
+	};
+
+	// Minimal x86-64 assembler, with rel32 labels
+	struct X86Assembler
+	{
+		std::vector<uint8_t> code;
+
+		size_t size() const noexcept { return code.size(); }
+		void emit8(uint8_t v) { code.push_back(v); }
+		void emit32(uint32_t v) {
+			for (int i = 0; i < 4; i++) code.push_back(v >> (i * 8));
+		}
+		void emit64(uint64_t v) {
+			for (int i = 0; i < 8; i++) code.push_back(v >> (i * 8));
+		}
+		void patch32(size_t at, uint32_t v) {
+			for (int i = 0; i < 4; i++) code[at + i] = v >> (i * 8);
+		}
+
+		void rex(bool w, unsigned reg, unsigned index, unsigned base) {
+			const uint8_t r = 0x40 | (w ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((index & 8) ? 2 : 0) | ((base & 8) ? 1 : 0);
+			if (r != 0x40)
+				emit8(r);
+		}
+		void modrm_rr(unsigned reg, unsigned rm) {
+			emit8(0xC0 | ((reg & 7) << 3) | (rm & 7));
+		}
+		// [base + disp32]
+		void modrm_mem(unsigned reg, unsigned base, int32_t disp) {
+			emit8(0x80 | ((reg & 7) << 3) | (base & 7));
+			if ((base & 7) == RSP)
+				emit8(0x24);
+			emit32(disp);
+		}
+		// [base + index], base must not be RBP or R13
+		void modrm_sib(unsigned reg, unsigned base, unsigned index, unsigned scale = 0) {
+			emit8(0x04 | ((reg & 7) << 3));
+			emit8((scale << 6) | ((index & 7) << 3) | (base & 7));
+		}
+
+		// op r/m, reg (opcode in the "MR" form, eg. 0x01 ADD, 0x39 CMP)
+		void op_rr(uint8_t opcode, bool w, X86Reg dst, X86Reg src) {
+			rex(w, src, 0, dst);
+			emit8(opcode);
+			modrm_rr(src, dst);
+		}
+		// op reg, [base + disp32] or op [base + disp32], reg
+		void op_mem(uint8_t opcode, bool w, X86Reg reg, X86Reg base, int32_t disp) {
+			rex(w, reg, 0, base);
+			emit8(opcode);
+			modrm_mem(reg, base, disp);
+		}
+		void alu_ri(uint8_t ext, bool w, X86Reg dst, int32_t imm) {
+			rex(w, 0, 0, dst);
+			if (imm >= -128 && imm <= 127) {
+				emit8(0x83); modrm_rr(ext, dst); emit8(imm);
+			} else {
+				emit8(0x81); modrm_rr(ext, dst); emit32(imm);
+			}
+		}
+		void mov_rr(bool w, X86Reg dst, X86Reg src) { op_rr(0x89, w, dst, src); }
+		void load(bool w, X86Reg dst, X86Reg base, int32_t disp) { op_mem(0x8B, w, dst, base, disp); }
+		void store(bool w, X86Reg base, int32_t disp, X86Reg src) { op_mem(0x89, w, src, base, disp); }
+		void store_imm(bool w, X86Reg base, int32_t disp, int32_t imm) {
+			rex(w, 0, 0, base);
+			emit8(0xC7);
+			modrm_mem(0, base, disp);
+			emit32(imm);
+		}
+		void mov_ri(X86Reg dst, uint64_t imm) {
+			if (imm <= 0xFFFFFFFFull) {
+				rex(false, 0, 0, dst);
+				emit8(0xB8 + (dst & 7)); emit32(imm);
+			} else if (int64_t(imm) == int32_t(imm)) {
+				rex(true, 0, 0, dst);
+				emit8(0xC7); modrm_rr(0, dst); emit32(imm);
+			} else {
+				rex(true, 0, 0, dst);
+				emit8(0xB8 + (dst & 7)); emit64(imm);
+			}
+		}
+		void zero(X86Reg dst) { op_rr(0x31, false, dst, dst); }
+		void shift_ri(uint8_t ext, bool w, X86Reg dst, uint8_t imm) {
+			rex(w, 0, 0, dst);
+			emit8(0xC1); modrm_rr(ext, dst); emit8(imm);
+		}
+		void shift_cl(uint8_t ext, bool w, X86Reg dst) {
+			rex(w, 0, 0, dst);
+			emit8(0xD3); modrm_rr(ext, dst);
+		}
+		void unary(uint8_t ext, bool w, X86Reg rm) {
+			rex(w, 0, 0, rm);
+			emit8(0xF7); modrm_rr(ext, rm);
+		}
+		void imul_rr(bool w, X86Reg dst, X86Reg src) {
+			rex(w, dst, 0, src);
+			emit8(0x0F); emit8(0xAF); modrm_rr(dst, src);
+		}
+		void sign_extend_rax_into_rdx(bool w) { rex(w, 0, 0, 0); emit8(0x99); }
+		// movzx/movsx dst, src (8- or 16-bit source), and movsxd
+		void extend(uint8_t opcode, bool w, X86Reg dst, X86Reg src) {
+			rex(w, dst, 0, src);
+			emit8(0x0F); emit8(opcode); modrm_rr(dst, src);
+		}
+		void movsxd(X86Reg dst, X86Reg src) {
+			rex(true, dst, 0, src);
+			emit8(0x63); modrm_rr(dst, src);
+		}
+		void setcc(uint8_t cc, X86Reg dst) {
+			rex(false, 0, 0, dst);
+			emit8(0x0F); emit8(0x90 + cc); modrm_rr(0, dst);
+		}
+		void lea(bool w, X86Reg dst, X86Reg base, int32_t disp) { op_mem(0x8D, w, dst, base, disp); }
+		void lea_scaled(bool w, X86Reg dst, X86Reg base, X86Reg index, unsigned scale) {
+			rex(w, dst, index, base);
+			emit8(0x8D);
+			modrm_sib(dst, base, index, scale);
+		}
+		void push(X86Reg r) { rex(false, 0, 0, r); emit8(0x50 + (r & 7)); }
+		void pop(X86Reg r)  { rex(false, 0, 0, r); emit8(0x58 + (r & 7)); }
+		void ret() { emit8(0xC3); }
+		void call_mem(X86Reg base, int32_t disp) {
+			rex(false, 0, 0, base);
+			emit8(0xFF);
+			modrm_mem(2, base, disp);
+		}
+
+		void bind(Label& label) {
+			label.pos = size();
+			for (auto at : label.fixups)
+				patch32(at, label.pos - (at + 4));
+			label.fixups.clear();
+		}
+		void rel32(Label& label) {
+			if (label.pos >= 0) {
+				emit32(label.pos - int64_t(size() + 4));
+			} else {
+				label.fixups.push_back(size());
+				emit32(0);
+			}
+		}
+		void jmp(Label& label) { emit8(0xE9); rel32(label); }
+		void jcc(uint8_t cc, Label& label) { emit8(0x0F); emit8(0x80 + cc); rel32(label); }
+	};
+
+	struct NativeOffsets {
+		int32_t reg[32];
+		int32_t pc;
+		int32_t ins_counter;
+		int32_t max_counter;
+		int32_t arena;
+	};
+
+	template <int W>
+	struct NativeEmitter
+	{
+		using address_t = address_type<W>;
+		static constexpr bool WIDE = (W == 8);
+		static constexpr unsigned XLEN = W * 8;
+		static constexpr address_t ALIGN_MASK = (compressed_enabled) ? 0x1 : 0x3;
+
+		NativeEmitter(X86Assembler& a, const TransInfo<W>& ti, const NativeOffsets& o, bool arena)
+			: as(a), tinfo(ti), off(o), use_arena(arena) {}
+
+		void emit();
+
+		// Entry points created for this block
+		std::vector<std::pair<address_t, size_t>> entries;
+
+	private:
+		address_t begin_pc() const noexcept { return tinfo.basepc; }
+		address_t end_pc() const noexcept { return tinfo.endpc; }
+		bool within_block(address_t addr) const noexcept { return addr >= begin_pc() && addr < end_pc(); }
+		bool counting() const noexcept { return !tinfo.ignore_instruction_limit; }
+		Label& label_for(address_t addr) { return m_labels[addr]; }
+
+		void increment_counter_so_far() {
+			const auto icount = m_instr_counter;
+			m_instr_counter = 0;
+			if (icount > 0 && counting())
+				as.alu_ri(ALU_ADD, true, R12, icount);
+		}
+
+		void load_reg(X86Reg dst, unsigned reg) {
+			if (reg == 0)
+				as.zero(dst);
+			else
+				as.load(WIDE, dst, RBX, off.reg[reg]);
+		}
+		// Load the lower 32 bits of a register, for the RV64 *W instructions
+		void load_reg32(X86Reg dst, unsigned reg) {
+			if (reg == 0)
+				as.zero(dst);
+			else
+				as.load(false, dst, RBX, off.reg[reg]);
+		}
+		void store_reg(unsigned reg, X86Reg src) {
+			if (reg != 0)
+				as.store(WIDE, RBX, off.reg[reg], src);
+		}
+		// Store a constant into the CPU at the given offset (clobbers RAX)
+		void store_value(int32_t disp, address_t value) {
+			if constexpr (W == 4) {
+				as.store_imm(false, RBX, disp, int32_t(value));
+			} else if (int64_t(value) == int32_t(value)) {
+				as.store_imm(true, RBX, disp, int32_t(value));
+			} else {
+				as.mov_ri(RAX, value);
+				as.store(true, RBX, disp, RAX);
+			}
+		}
+		void set_pc(address_t pc) { store_value(off.pc, pc); }
+		void reveal_counters() {
+			as.store(true, RBX, off.ins_counter, R12);
+			as.store(true, RBX, off.max_counter, R13);
+		}
+		void reload_counters() {
+			as.load(true, R12, RBX, off.ins_counter);
+			as.load(true, R13, RBX, off.max_counter);
+		}
+		void call_api(size_t member_offset) {
+			as.call_mem(RBP, member_offset);
+		}
+		// A stopped machine may also have a pending exception. The counters
+		// must have been revealed before the callback that may stop it.
+		void exit_if_stopped() {
+			reload_counters();
+			as.op_rr(0x85, true, R13, R13); // test r13, r13
+			as.jcc(CC_E, m_exception_exit);
+		}
+		void exit_function(address_t pc) {
+			set_pc(pc);
+			as.jmp(m_epilogue);
+		}
+		// Jump to a location in this block, checking the instruction
+		// limit when jumping backwards.
+		void jump_within(address_t dest) {
+			if (dest > pc() || !counting()) {
+				as.jmp(label_for(dest));
+			} else {
+				as.op_rr(0x39, true, R12, R13); // cmp r12, r13
+				as.jcc(CC_B, label_for(dest));
+				exit_function(dest);
+			}
+		}
+		void add_reentry_next() {
+			if (pc() + m_instr_length < end_pc())
+				m_mapping_labels.insert(m_idx + 1);
+		}
+		void trigger_exception(address_t pc, int exception) {
+			as.mov_rr(true, RDI, RBX);
+			as.mov_ri(RSI, pc);
+			as.mov_ri(RDX, exception);
+			call_api(offsetof(CallbackTable<W>, trigger_exception));
+			as.jmp(m_exception_exit);
+		}
+
+		void emit_system_call(bool ebreak);
+		void emit_handler_call();
+		void emit_branch();
+		void emit_load();
+		void emit_store();
+		bool emit_op_imm();
+		bool emit_op();
+		bool emit_op_imm32();
+		bool emit_op32();
+		void emit_divide(uint32_t op, bool w);
+		void arena_range_check(address_t lo, uint64_t size, Label& outside);
+
+		address_t pc() const noexcept { return m_pc; }
+
+		X86Assembler& as;
+		const TransInfo<W>& tinfo;
+		const NativeOffsets& off;
+		const bool use_arena;
+
+		rv32i_instruction instr;
+		address_t m_pc = 0;
+		int m_idx = 0;
+		unsigned m_instr_length = 4;
+		uint32_t m_instr_counter = 0;
+		uint32_t m_zero_insn_counter = 0;
+		std::unordered_set<unsigned> m_mapping_labels;
+		std::unordered_map<address_t, Label> m_labels;
+		Label m_epilogue;
+		Label m_exception_exit;
+	};
+
+	template <int W>
+	void NativeEmitter<W>::emit_system_call(bool ebreak)
+	{
+		this->increment_counter_so_far();
+		set_pc(pc());
+		reveal_counters();
+		if (ebreak)
+			as.mov_ri(RSI, SYSCALL_EBREAK);
+		else
+			load_reg32(RSI, REG_ECALL);
+		as.mov_rr(true, RDI, RBX);
+		call_api(offsetof(CallbackTable<W>, system_call));
+		reload_counters();
+		Label next;
+		as.op_rr(0x85, false, RAX, RAX); // test eax, eax
+		as.jcc(CC_E, next);
+		// The system call changed PC or stopped the machine: exit
+		as.load(WIDE, RAX, RBX, off.pc);
+		as.alu_ri(ALU_ADD, WIDE, RAX, 4);
+		as.store(WIDE, RBX, off.pc, RAX);
+		as.jmp(m_epilogue);
+		as.bind(next);
+	}
+
+	template <int W>
+	void NativeEmitter<W>::emit_handler_call()
+	{
+		// Anything not emitted natively is executed by its handler
+		const auto handler = CPU<W>::decode(instr).handler;
+		set_pc(pc());
+		as.mov_rr(true, RDI, RBX);
+		as.mov_ri(RSI, DecoderData<W>::handler_index_for(handler));
+		as.mov_ri(RDX, instr.whole);
+		call_api(offsetof(CallbackTable<W>, execute_handler));
+		as.op_rr(0x85, false, RAX, RAX);
+		as.jcc(CC_NE, m_exception_exit);
+	}
+
+	template <int W>
+	void NativeEmitter<W>::emit_branch()
+	{
+		uint8_t cc;
+		switch (instr.Btype.funct3) {
+		case 0x0: cc = CC_E; break;  // BEQ
+		case 0x1: cc = CC_NE; break; // BNE
+		case 0x4: cc = CC_L; break;  // BLT
+		case 0x5: cc = CC_GE; break; // BGE
+		case 0x6: cc = CC_B; break;  // BLTU
+		case 0x7: cc = CC_AE; break; // BGEU
+		default:
+			emit_handler_call();
+			return;
+		}
+		this->increment_counter_so_far();
+		load_reg(RAX, instr.Btype.rs1);
+		if (instr.Btype.rs2 == 0)
+			as.op_rr(0x85, WIDE, RAX, RAX); // test rax, rax
+		else
+			as.op_mem(0x3B, WIDE, RAX, RBX, off.reg[instr.Btype.rs2]); // cmp rax, [rs2]
+
+		const address_t dest = pc() + instr.Btype.signed_imm();
+		// The inverted condition skips over the taken path
+		Label not_taken;
+		if (dest & ALIGN_MASK) {
+			as.jcc(cc ^ 1, not_taken);
+			trigger_exception(pc(), MISALIGNED_INSTRUCTION);
+		} else if (within_block(dest) && (dest > pc() || !counting())) {
+			as.jcc(cc, label_for(dest));
+			return;
+		} else {
+			as.jcc(cc ^ 1, not_taken);
+			if (within_block(dest))
+				jump_within(dest);
+			else
+				exit_function(dest);
+		}
+		as.bind(not_taken);
+	}
+
+	template <int W>
+	void NativeEmitter<W>::arena_range_check(address_t lo, uint64_t size, Label& outside)
+	{
+		// RDX = RAX - lo, unsigned compare against the size of the range
+		if (int64_t(lo) <= INT32_MAX) {
+			as.lea(WIDE, RDX, RAX, -int32_t(lo));
+		} else {
+			as.mov_rr(WIDE, RDX, RAX);
+			as.mov_ri(RSI, lo);
+			as.op_rr(0x29, WIDE, RDX, RSI); // sub rdx, rsi
+		}
+		if (W == 4 || size <= INT32_MAX) {
+			as.rex(WIDE, 0, 0, RDX);
+			as.emit8(0x81); as.modrm_rr(ALU_CMP, RDX); as.emit32(size);
+		} else {
+			as.mov_ri(RSI, size);
+			as.op_rr(0x39, WIDE, RDX, RSI);
+		}
+		as.jcc(CC_AE, outside);
+	}
+
+	template <int W>
+	void NativeEmitter<W>::emit_load()
+	{
+		const unsigned funct3 = instr.Itype.funct3;
+		if (funct3 == 7 || (W == 4 && (funct3 == 3 || funct3 == 6))) {
+			emit_handler_call();
+			return;
+		}
+		const unsigned size = 1u << (funct3 & 3);
+		load_reg(RAX, instr.Itype.rs1);
+		if (instr.Itype.signed_imm() != 0)
+			as.alu_ri(ALU_ADD, WIDE, RAX, instr.Itype.signed_imm());
+
+		Label slow_path, done;
+		const bool fast_path = use_arena || encompassing_Nbit_arena != 0;
+		if (fast_path) {
+			if constexpr (encompassing_Nbit_arena != 0) {
+				if constexpr (encompassing_Nbit_arena < 32)
+					as.alu_ri(ALU_AND, false, RAX, int32_t(encompassing_arena_mask));
+			} else {
+				arena_range_check(0x1000, tinfo.arena_size - 0x1000, slow_path);
+			}
+			// Raw load from [R14 + RAX]
+			switch (size) {
+			case 1: as.rex(false, RAX, RAX, R14); as.emit8(0x0F); as.emit8(0xB6); break;
+			case 2: as.rex(false, RAX, RAX, R14); as.emit8(0x0F); as.emit8(0xB7); break;
+			case 4: as.rex(false, RAX, RAX, R14); as.emit8(0x8B); break;
+			case 8: as.rex(true, RAX, RAX, R14); as.emit8(0x8B); break;
+			}
+			as.modrm_sib(RAX, R14, RAX);
+		}
+		if (encompassing_Nbit_arena == 0) {
+			if (fast_path) {
+				as.jmp(done);
+				as.bind(slow_path);
+			}
+			// Setting PC may clobber RAX
+			as.mov_rr(WIDE, RSI, RAX);
+			set_pc(pc());
+			reveal_counters();
+			as.mov_rr(true, RDI, RBX);
+			as.mov_ri(RDX, size);
+			call_api(offsetof(CallbackTable<W>, mem_read));
+			exit_if_stopped();
+			as.bind(done);
+		}
+		if (instr.Itype.rd == 0)
+			return;
+		// Sign- or zero-extend the loaded value
+		switch (funct3) {
+		case 0x0: as.extend(0xBE, WIDE, RAX, RAX); break; // LB
+		case 0x1: as.extend(0xBF, WIDE, RAX, RAX); break; // LH
+		case 0x2: if (W == 8) as.movsxd(RAX, RAX); break; // LW
+		case 0x4: as.extend(0xB6, false, RAX, RAX); break; // LBU
+		case 0x5: as.extend(0xB7, false, RAX, RAX); break; // LHU
+		case 0x6: as.mov_rr(false, RAX, RAX); break; // LWU
+		}
+		store_reg(instr.Itype.rd, RAX);
+	}
+
+	template <int W>
+	void NativeEmitter<W>::emit_store()
+	{
+		const unsigned funct3 = instr.Stype.funct3;
+		if (funct3 > 3 || (W == 4 && funct3 == 3)) {
+			emit_handler_call();
+			return;
+		}
+		const unsigned size = 1u << funct3;
+		load_reg(RAX, instr.Stype.rs1);
+		if (instr.Stype.signed_imm() != 0)
+			as.alu_ri(ALU_ADD, WIDE, RAX, instr.Stype.signed_imm());
+		load_reg(RCX, instr.Stype.rs2);
+
+		Label slow_path, done;
+		const bool fast_path = encompassing_Nbit_arena != 0 || (use_arena && !arena_dirty_tracking);
+		if (fast_path) {
+			if constexpr (encompassing_Nbit_arena != 0) {
+				if constexpr (encompassing_Nbit_arena < 32)
+					as.alu_ri(ALU_AND, false, RAX, int32_t(encompassing_arena_mask));
+			} else {
+				arena_range_check(tinfo.arena_roend, tinfo.arena_size - tinfo.arena_roend, slow_path);
+			}
+			// Raw store to [R14 + RAX]
+			switch (size) {
+			case 1: as.rex(false, RCX, RAX, R14); as.emit8(0x88); break;
+			case 2: as.emit8(0x66); as.rex(false, RCX, RAX, R14); as.emit8(0x89); break;
+			case 4: as.rex(false, RCX, RAX, R14); as.emit8(0x89); break;
+			case 8: as.rex(true, RCX, RAX, R14); as.emit8(0x89); break;
+			}
+			as.modrm_sib(RCX, R14, RAX);
+		}
+		if (encompassing_Nbit_arena == 0) {
+			if (fast_path) {
+				as.jmp(done);
+				as.bind(slow_path);
+			}
+			// Setting PC may clobber RAX
+			as.mov_rr(WIDE, RSI, RAX);
+			as.mov_rr(WIDE, RDX, RCX);
+			set_pc(pc());
+			reveal_counters();
+			as.mov_rr(true, RDI, RBX);
+			as.mov_ri(RCX, size);
+			call_api(offsetof(CallbackTable<W>, mem_write));
+			exit_if_stopped();
+			as.bind(done);
+		}
+	}
+
+	template <int W>
+	bool NativeEmitter<W>::emit_op_imm()
+	{
+		const unsigned rd = instr.Itype.rd;
+		const int32_t imm = instr.Itype.signed_imm();
+		if (rd == 0)
+			return true;
+		switch (instr.Itype.funct3) {
+		case 0x0: // ADDI
+			if (instr.Itype.rs1 == 0) {
+				store_value(off.reg[rd], address_t(imm));
+				return true;
+			}
+			load_reg(RAX, instr.Itype.rs1);
+			if (imm != 0)
+				as.alu_ri(ALU_ADD, WIDE, RAX, imm);
+			break;
+		case 0x1: // SLLI
+			if (instr.Itype.high_bits() != 0)
+				return false;
+			load_reg(RAX, instr.Itype.rs1);
+			as.shift_ri(SHIFT_SHL, WIDE, RAX, instr.Itype.shift64_imm() & (XLEN - 1));
+			break;
+		case 0x2: // SLTI
+		case 0x3: // SLTIU
+			load_reg(RAX, instr.Itype.rs1);
+			as.alu_ri(ALU_CMP, WIDE, RAX, imm);
+			as.setcc(instr.Itype.funct3 == 0x2 ? CC_L : CC_B, RAX);
+			as.extend(0xB6, false, RAX, RAX);
+			break;
+		case 0x4: // XORI
+			load_reg(RAX, instr.Itype.rs1);
+			as.alu_ri(ALU_XOR, WIDE, RAX, imm);
+			break;
+		case 0x5: // SRLI / SRAI
+			if (instr.Itype.high_bits() != 0 && !instr.Itype.is_srai())
+				return false;
+			load_reg(RAX, instr.Itype.rs1);
+			as.shift_ri(instr.Itype.is_srai() ? SHIFT_SAR : SHIFT_SHR, WIDE, RAX,
+				instr.Itype.shift64_imm() & (XLEN - 1));
+			break;
+		case 0x6: // ORI
+			load_reg(RAX, instr.Itype.rs1);
+			as.alu_ri(ALU_OR, WIDE, RAX, imm);
+			break;
+		case 0x7: // ANDI
+			load_reg(RAX, instr.Itype.rs1);
+			as.alu_ri(ALU_AND, WIDE, RAX, imm);
+			break;
+		}
+		store_reg(rd, RAX);
+		return true;
+	}
+
+	template <int W>
+	void NativeEmitter<W>::emit_divide(uint32_t op, bool w)
+	{
+		// RAX = dividend, RCX = divisor, with the RISC-V results
+		// for division by zero and signed overflow
+		const bool is_signed = (op & 1) == 0;
+		const bool remainder = (op & 2) != 0;
+		Label by_zero, done;
+		as.op_rr(0x85, w, RCX, RCX);
+		as.jcc(CC_E, by_zero);
+		if (is_signed) {
+			Label regular;
+			as.alu_ri(ALU_CMP, w, RCX, -1);
+			as.jcc(CC_NE, regular);
+			// Dividing by -1 negates, which also handles overflow
+			if (remainder)
+				as.zero(RAX);
+			else
+				as.unary(UNARY_NEG, w, RAX);
+			as.jmp(done);
+			as.bind(regular);
+			as.sign_extend_rax_into_rdx(w);
+			as.unary(UNARY_IDIV, w, RCX);
+		} else {
+			as.zero(RDX);
+			as.unary(UNARY_DIV, w, RCX);
+		}
+		if (remainder)
+			as.mov_rr(w, RAX, RDX);
+		as.jmp(done);
+		as.bind(by_zero);
+		// Division by zero gives all bits set, and the remainder is the dividend
+		if (!remainder) {
+			if (w)
+				as.mov_ri(RAX, ~uint64_t(0));
+			else
+				as.mov_ri(RAX, 0xFFFFFFFF);
+		}
+		as.bind(done);
+	}
+
+	template <int W>
+	bool NativeEmitter<W>::emit_op()
+	{
+		const unsigned rd = instr.Rtype.rd;
+		if (rd == 0)
+			return true;
+		const uint32_t op = instr.Rtype.jumptable_friendly_op();
+		switch (op) {
+		case 0x0: case 0x200: case 0x1: case 0x2: case 0x3: case 0x4:
+		case 0x5: case 0x205: case 0x6: case 0x7:
+		case 0x10: case 0x11: case 0x13:
+		case 0x14: case 0x15: case 0x16: case 0x17:
+		case 0x102: case 0x104: case 0x106:
+			break;
+		default:
+			return false;
+		}
+		load_reg(RAX, instr.Rtype.rs1);
+		load_reg(RCX, instr.Rtype.rs2);
+		switch (op) {
+		case 0x0: as.op_rr(0x01, WIDE, RAX, RCX); break; // ADD
+		case 0x200: as.op_rr(0x29, WIDE, RAX, RCX); break; // SUB
+		case 0x1: as.shift_cl(SHIFT_SHL, WIDE, RAX); break; // SLL
+		case 0x2: // SLT
+		case 0x3: // SLTU
+			as.op_rr(0x39, WIDE, RAX, RCX);
+			as.setcc(op == 0x2 ? CC_L : CC_B, RAX);
+			as.extend(0xB6, false, RAX, RAX);
+			break;
+		case 0x4: as.op_rr(0x31, WIDE, RAX, RCX); break; // XOR
+		case 0x5: as.shift_cl(SHIFT_SHR, WIDE, RAX); break; // SRL
+		case 0x205: as.shift_cl(SHIFT_SAR, WIDE, RAX); break; // SRA
+		case 0x6: as.op_rr(0x09, WIDE, RAX, RCX); break; // OR
+		case 0x7: as.op_rr(0x21, WIDE, RAX, RCX); break; // AND
+		case 0x10: as.imul_rr(WIDE, RAX, RCX); break; // MUL
+		case 0x11: // MULH
+		case 0x13: // MULHU
+			as.unary(op == 0x11 ? UNARY_IMUL : UNARY_MUL, WIDE, RCX);
+			as.mov_rr(WIDE, RAX, RDX);
+			break;
+		case 0x14: case 0x15: case 0x16: case 0x17: // DIV, DIVU, REM, REMU
+			emit_divide(op, WIDE);
+			break;
+		case 0x102: as.lea_scaled(WIDE, RAX, RCX, RAX, 1); break; // SH1ADD
+		case 0x104: as.lea_scaled(WIDE, RAX, RCX, RAX, 2); break; // SH2ADD
+		case 0x106: as.lea_scaled(WIDE, RAX, RCX, RAX, 3); break; // SH3ADD
+		}
+		store_reg(rd, RAX);
+		return true;
+	}
+
+	template <int W>
+	bool NativeEmitter<W>::emit_op_imm32()
+	{
+		if (instr.Itype.rd == 0)
+			return true;
+		const uint32_t upper = instr.Itype.imm & 0xFE0;
+		switch (instr.Itype.funct3) {
+		case 0x0: // ADDIW
+			load_reg32(RAX, instr.Itype.rs1);
+			as.alu_ri(ALU_ADD, false, RAX, instr.Itype.signed_imm());
+			break;
+		case 0x1: // SLLIW
+			if (upper != 0)
+				return false;
+			load_reg32(RAX, instr.Itype.rs1);
+			as.shift_ri(SHIFT_SHL, false, RAX, instr.Itype.shift_imm());
+			break;
+		case 0x5: // SRLIW / SRAIW
+			if (upper != 0 && upper != 0x400)
+				return false;
+			load_reg32(RAX, instr.Itype.rs1);
+			as.shift_ri(upper ? SHIFT_SAR : SHIFT_SHR, false, RAX, instr.Itype.shift_imm());
+			break;
+		default:
+			return false;
+		}
+		as.movsxd(RAX, RAX);
+		store_reg(instr.Itype.rd, RAX);
+		return true;
+	}
+
+	template <int W>
+	bool NativeEmitter<W>::emit_op32()
+	{
+		if (instr.Rtype.rd == 0)
+			return true;
+		const uint32_t op = instr.Rtype.jumptable_friendly_op();
+		switch (op) {
+		case 0x0: case 0x200: case 0x1: case 0x5: case 0x205:
+		case 0x10: case 0x14: case 0x15: case 0x16: case 0x17:
+			break;
+		default:
+			return false;
+		}
+		load_reg32(RAX, instr.Rtype.rs1);
+		load_reg32(RCX, instr.Rtype.rs2);
+		switch (op) {
+		case 0x0: as.op_rr(0x01, false, RAX, RCX); break; // ADDW
+		case 0x200: as.op_rr(0x29, false, RAX, RCX); break; // SUBW
+		case 0x1: as.shift_cl(SHIFT_SHL, false, RAX); break; // SLLW
+		case 0x5: as.shift_cl(SHIFT_SHR, false, RAX); break; // SRLW
+		case 0x205: as.shift_cl(SHIFT_SAR, false, RAX); break; // SRAW
+		case 0x10: as.imul_rr(false, RAX, RCX); break; // MULW
+		default: // DIVW, DIVUW, REMW, REMUW
+			emit_divide(op, false);
+			break;
+		}
+		as.movsxd(RAX, RAX);
+		store_reg(instr.Rtype.rd, RAX);
+		return true;
+	}
+
+	template <int W>
+	void NativeEmitter<W>::emit()
+	{
+		// Every location that can be jumped to gets a label
+		std::vector<address_t> mapping_addrs { begin_pc() };
+		auto next_pc = tinfo.basepc;
+
+		for (int i = 0; i < int(tinfo.instr.size()); i++) {
+			this->m_idx = i;
+			this->instr = tinfo.instr[i];
+			this->m_pc = next_pc;
+			if constexpr (compressed_enabled)
+				this->m_instr_length = this->instr.length();
+			else
+				this->m_instr_length = 4;
+			next_pc = this->m_pc + this->m_instr_length;
+
+			if (this->instr.is_illegal()) {
+				this->m_zero_insn_counter ++;
+			} else if (this->m_zero_insn_counter >= 4) {
+				// After a ream of zero instructions, we predict a jump target
+				this->m_zero_insn_counter = 0;
+				m_mapping_labels.insert(i);
+			}
+
+			const bool is_mapping = i > 0 && (m_mapping_labels.count(i) || tinfo.global_jump_locations.count(pc()));
+			if (is_mapping || i == 0 || tinfo.jump_locations.count(pc()) || m_labels.count(pc())) {
+				this->increment_counter_so_far();
+				as.bind(label_for(pc()));
+				if (is_mapping)
+					mapping_addrs.push_back(pc());
+			}
+
+			this->m_instr_counter += 1;
+
+			if (tinfo.ebreak_locations->count(pc()))
+				this->emit_system_call(true);
+
+#ifdef RISCV_EXT_C
+			if (instr.is_compressed()) {
+				instr = expand_compressed<W>(instr);
+				if (instr.is_compressed()) {
+					// Unexpanded instruction (except all-zeroes, which is illegal)
+					if (m_zero_insn_counter <= 1 || instr.half[0] != 0x0)
+						trigger_exception(pc(), ILLEGAL_OPCODE);
+					continue;
+				}
+			}
+#endif
+			if (instr.is_illegal()) {
+				if (m_zero_insn_counter <= 1)
+					trigger_exception(pc(), ILLEGAL_OPCODE);
+				continue;
+			}
+
+			bool handled = true;
+			switch (instr.opcode()) {
+			case RV32I_LOAD:
+				emit_load();
+				break;
+			case RV32I_STORE:
+				emit_store();
+				break;
+			case RV32I_BRANCH:
+				emit_branch();
+				break;
+			case RV32I_JALR: {
+				this->increment_counter_so_far();
+				load_reg(RAX, instr.Itype.rs1);
+				if (instr.Itype.signed_imm() != 0)
+					as.alu_ri(ALU_ADD, WIDE, RAX, instr.Itype.signed_imm());
+				as.alu_ri(ALU_AND, WIDE, RAX, int32_t(~ALIGN_MASK));
+				// RS1 was read before RD is written
+				if (instr.Itype.rd != 0) {
+					as.mov_rr(WIDE, RCX, RAX);
+					store_value(off.reg[instr.Itype.rd], pc() + m_instr_length);
+					as.mov_rr(WIDE, RAX, RCX);
+				}
+				as.store(WIDE, RBX, off.pc, RAX);
+				as.jmp(m_epilogue);
+				this->add_reentry_next();
+				} break;
+			case RV32I_JAL: {
+				this->increment_counter_so_far();
+				if (instr.Jtype.rd != 0)
+					store_value(off.reg[instr.Jtype.rd], pc() + m_instr_length);
+				const address_t dest = (pc() + instr.Jtype.jump_offset()) & ~ALIGN_MASK;
+				if (within_block(dest))
+					jump_within(dest);
+				else
+					exit_function(dest);
+				// Code after calls and loops is often jumped to
+				if (instr.Jtype.rd != 0 || (within_block(dest) && dest <= pc()))
+					this->add_reentry_next();
+				} break;
+			case RV32I_OP_IMM:
+				handled = emit_op_imm();
+				break;
+			case RV32I_OP:
+				handled = emit_op();
+				break;
+			case RV64I_OP_IMM32:
+				handled = W == 8 && emit_op_imm32();
+				break;
+			case RV64I_OP32:
+				handled = W == 8 && emit_op32();
+				break;
+			case RV32I_LUI:
+				if (instr.Utype.rd != 0)
+					store_value(off.reg[instr.Utype.rd], address_t(instr.Utype.upper_imm()));
+				break;
+			case RV32I_AUIPC:
+				if (instr.Utype.rd != 0)
+					store_value(off.reg[instr.Utype.rd], pc() + instr.Utype.upper_imm());
+				break;
+			case RV32I_FENCE:
+				break;
+			case RV32I_SYSTEM:
+				if (instr.Itype.funct3 == 0x0 && instr.Itype.imm < 2) {
+					// ECALL and EBREAK
+					this->emit_system_call(instr.Itype.imm == 1);
+				} else if (instr.Itype.funct3 == 0x0 && (instr.Itype.imm == 261 || instr.Itype.imm == 0x7FF)) {
+					// WFI and STOP: Immediate stop at PC + 4
+					this->increment_counter_so_far();
+					as.zero(R13);
+					exit_function(pc() + 4);
+					this->add_reentry_next();
+				} else {
+					// CSRs and other system functions
+					this->increment_counter_so_far();
+					set_pc(pc());
+					reveal_counters();
+					as.mov_rr(true, RDI, RBX);
+					as.mov_ri(RSI, instr.whole);
+					call_api(offsetof(CallbackTable<W>, system));
+					reload_counters();
+					as.op_rr(0x85, true, R13, R13);
+					as.jcc(CC_E, m_epilogue);
+				}
+				break;
+			default:
+				handled = false;
+			}
+			if (!handled)
+				emit_handler_call();
+		}
+		// If the block ends without a jump, continue at the end
+		this->increment_counter_so_far();
+		exit_function(end_pc());
+
+		// Jumps to locations without a label (eg. into the middle of an
+		// instruction) are left to the dispatch loop
+		for (auto& it : m_labels) {
+			if (it.second.pos < 0) {
+				as.bind(it.second);
+				exit_function(it.first);
+			}
+		}
+
+		// A raised exception is returned with a zero max counter
+		as.bind(m_exception_exit);
+		as.zero(R13);
+		as.bind(m_epilogue);
+		if (counting())
+			as.mov_rr(true, RAX, R12);
+		else
+			as.zero(RAX);
+		as.mov_rr(true, RDX, R13);
+		as.pop(R14); as.pop(R13); as.pop(R12); as.pop(RBP); as.pop(RBX);
+		as.ret();
+
+		// Entry points: five pushes keep the stack 16-byte aligned for calls
+		for (auto addr : mapping_addrs) {
+			entries.push_back({addr, as.size()});
+			as.push(RBX); as.push(RBP); as.push(R12); as.push(R13); as.push(R14);
+			as.mov_rr(true, RBX, RDI);
+			as.mov_rr(true, R12, RSI);
+			as.mov_rr(true, R13, RDX);
+			// lea rbp, [rip - distance to the callback table]
+			as.emit8(0x48); as.emit8(0x8D); as.emit8(0x2D);
+			as.emit32(-int32_t(CODE_OFFSET + as.size() + 4));
+			if (use_arena || encompassing_Nbit_arena != 0)
+				as.load(true, R14, RBX, off.arena);
+			as.jmp(label_for(addr));
+		}
+	}
+
+	// Machine code can't unwind exceptions, so callbacks that may throw are
+	// replaced by ones that record the exception and stop the machine instead
+	template <int W>
+	CallbackTable<W> nothrow_callbacks(CallbackTable<W> table)
+	{
+		table.mem_read = [] (CPU<W>& cpu, address_type<W> addr, unsigned size) -> address_type<W> {
+			try {
+				switch (size) {
+				case 1: return cpu.machine().memory.template read<uint8_t>(addr);
+				case 2: return cpu.machine().memory.template read<uint16_t>(addr);
+				case 4: return cpu.machine().memory.template read<uint32_t>(addr);
+				case 8: return cpu.machine().memory.template read<uint64_t>(addr);
+				default: throw MachineException(ILLEGAL_OPERATION, "Invalid memory read size", size);
+				}
+			} catch (...) {
+				cpu.set_current_exception(std::current_exception());
+				cpu.machine().stop();
+				return 0;
+			}
+		};
+		table.mem_write = [] (CPU<W>& cpu, address_type<W> addr, address_type<W> value, unsigned size) {
+			try {
+				switch (size) {
+				case 1: cpu.machine().memory.template write<uint8_t>(addr, value); break;
+				case 2: cpu.machine().memory.template write<uint16_t>(addr, value); break;
+				case 4: cpu.machine().memory.template write<uint32_t>(addr, value); break;
+				case 8: cpu.machine().memory.template write<uint64_t>(addr, value); break;
+				default: throw MachineException(ILLEGAL_OPERATION, "Invalid memory write size", size);
+				}
+			} catch (...) {
+				cpu.set_current_exception(std::current_exception());
+				cpu.machine().stop();
+			}
+		};
+		table.system = [] (CPU<W>& cpu, uint32_t instr) {
+			try {
+				cpu.machine().system(rv32i_instruction{instr});
+			} catch (...) {
+				cpu.set_current_exception(std::current_exception());
+				cpu.machine().stop();
+			}
+		};
+		table.trigger_exception = [] (CPU<W>& cpu, address_type<W> pc, int e) {
+			cpu.registers().pc = pc;
+			try {
+				cpu.trigger_exception(e);
+			} catch (...) {
+				cpu.set_current_exception(std::current_exception());
+				cpu.machine().stop();
+			}
+		};
+		return table;
+	}
+} // anonymous namespace
+
+template <int W>
+void CPU<W>::emit_native(const MachineOptions<W>& options, const std::vector<TransInfo<W>>& blocks,
+	const CallbackTable<W>& callbacks, NativeTranslation<W>& output) const
+{
+	static_assert(sizeof(CallbackTable<W>) <= CODE_OFFSET);
+	// Offsets are relative to the CPU, which is the first argument
+	auto& self = const_cast<CPU<W>&>(*this);
+	NativeOffsets offsets;
+	for (unsigned i = 0; i < 32; i++)
+		offsets.reg[i] = uintptr_t(&self.reg(i)) - uintptr_t(this);
+	offsets.pc = uintptr_t(&self.registers().pc) - uintptr_t(this);
+	auto counters = self.machine().get_counters();
+	offsets.ins_counter = uintptr_t(&counters.first) - uintptr_t(this);
+	offsets.max_counter = uintptr_t(&counters.second) - uintptr_t(this);
+	offsets.arena = uintptr_t(&machine().memory.memory_arena_ptr_ref()) - uintptr_t(this);
+
+	const bool use_arena = flat_readwrite_arena && options.translation_use_arena
+		&& machine().memory.memory_arena_ptr_ref() != nullptr;
+
+	X86Assembler as;
+	std::vector<std::pair<address_t, size_t>> entries;
+	for (auto& block : blocks) {
+		NativeEmitter<W> e(as, block, offsets, use_arena);
+		e.emit();
+		entries.insert(entries.end(), e.entries.begin(), e.entries.end());
+	}
+
+	// The mapping is writable only until the code has been copied in
+	const size_t total = CODE_OFFSET + as.size();
+	void* mem = mmap(nullptr, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED) {
+		if (options.verbose_loader)
+			fprintf(stderr, "libriscv: Failed to allocate %zu bytes for native code\n", total);
+		return;
+	}
+	const auto table = nothrow_callbacks(callbacks);
+	std::memcpy(mem, &table, sizeof(table));
+	std::memcpy((char *)mem + CODE_OFFSET, as.code.data(), as.size());
+	if (mprotect(mem, total, PROT_READ | PROT_EXEC) != 0) {
+		if (options.verbose_loader)
+			fprintf(stderr, "libriscv: Failed to make native code executable\n");
+		munmap(mem, total);
+		return;
+	}
+	output.code = std::shared_ptr<void>(mem, [total] (void* p) { munmap(p, total); });
+	output.code_size = as.size();
+
+	output.handlers.reserve(entries.size());
+	output.mappings.reserve(entries.size());
+	for (auto& entry : entries) {
+		output.mappings.push_back({entry.first, unsigned(output.handlers.size())});
+		output.handlers.push_back(
+			reinterpret_cast<bintr_block_func<W>>((char *)mem + CODE_OFFSET + entry.second));
+	}
+}
+
+#ifdef RISCV_32I
+	template void CPU<4>::emit_native(const MachineOptions<4>&, const std::vector<TransInfo<4>>&, const CallbackTable<4>&, NativeTranslation<4>&) const;
+#endif
+#ifdef RISCV_64I
+	template void CPU<8>::emit_native(const MachineOptions<8>&, const std::vector<TransInfo<8>>&, const CallbackTable<8>&, NativeTranslation<8>&) const;
+#endif
+} // riscv
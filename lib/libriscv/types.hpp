@@ -94,6 +94,13 @@ namespace riscv
 	template <int W>
 	struct TransOutput;
 
+#ifdef RISCV_NATIVE_JIT
+	template <int W>
+	struct CallbackTable;
+	template <int W>
+	struct NativeTranslation;
+#endif
+
 	template <int W>
 	struct TransMapping {
 		address_type<W> addr;
@@ -1,6 +1,7 @@
 #include "../common.hpp"
 
 #include <cstring>
+#include <vector>
 #include "dlfcn.h"
 
 namespace riscv
@@ -15,6 +16,17 @@ namespace riscv
 		return nullptr;
 	}
 
+	void* compile_shards(const std::vector<std::string>& shards, int arch, const std::string& cflags, const std::string& outfile, bool timing)
+	{
+		(void)shards;
+		(void)arch;
+		(void)cflags;
+		(void)outfile;
+		(void)timing;
+
+		return nullptr;
+	}
+
 	void* dylib_lookup(void* dylib, const char* symbol, bool)
 	{
 		return dlsym(dylib, symbol);
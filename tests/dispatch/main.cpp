@@ -0,0 +1,114 @@
+#include <libriscv/machine.hpp>
+#include <chrono>
+#include <fstream>
+#include <inttypes.h>
+static std::vector<uint8_t> load_file(const std::string&);
+static constexpr uint64_t MAX_MEMORY = 680ul << 20;
+static constexpr uint64_t MAX_INSTRUCTIONS = 2'000'000'000ul;
+static constexpr int TIMING_RUNS = 5;
+static const std::string elfdir {ELFDIR};
+
+struct Result {
+	double   runtime_ms = 1e30;
+	uint64_t instructions = 0;
+	int64_t  exit_code = 0;
+};
+
+template <int W>
+static riscv::MachineOptions<W> options(bool tailcall)
+{
+	return {
+		.memory_max = MAX_MEMORY,
+		.use_tailcall_dispatch = tailcall
+	};
+}
+
+// Best-of-N emulation time in milliseconds
+template <int W>
+static Result measure(const std::string& name, const std::vector<uint8_t>& binary, bool tailcall)
+{
+	Result result;
+	for (int i = 0; i < TIMING_RUNS; i++)
+	{
+		riscv::Machine<W> machine { binary, options<W>(tailcall) };
+		machine.setup_linux_syscalls();
+		machine.fds().permit_filesystem = false;
+		machine.fds().permit_sockets = false;
+		machine.setup_posix_threads();
+		machine.setup_linux({name}, {"LC_TYPE=C", "LC_ALL=C", "USER=root"});
+		machine.set_printer([] (const auto&, const char*, size_t) {});
+
+		const auto t0 = std::chrono::high_resolution_clock::now();
+		try {
+			machine.simulate(MAX_INSTRUCTIONS);
+		} catch (const std::exception& e) {
+			fprintf(stderr, "%s: %s\n", name.c_str(), e.what());
+		}
+		const auto t1 = std::chrono::high_resolution_clock::now();
+		const std::chrono::duration<double, std::milli> runtime = t1 - t0;
+		result.runtime_ms = std::min(result.runtime_ms, runtime.count());
+		result.instructions = machine.instruction_counter();
+		result.exit_code = machine.return_value();
+	}
+	return result;
+}
+
+template <int W>
+static void run_workload(const std::string& name, const std::vector<uint8_t>& binary)
+{
+	const auto threaded = measure<W>(name, binary, false);
+	if constexpr (!riscv::tailcall_dispatch_enabled) {
+		printf("%-28s insn=%-11" PRIu64 " %8.2fms\n",
+			name.c_str(), threaded.instructions, threaded.runtime_ms);
+		return;
+	}
+	const auto tailcall = measure<W>(name, binary, true);
+	// Multi-threaded programs (eg. Go) may not retire the same
+	// number of instructions on every run, so only compare results
+	const bool same = threaded.exit_code == tailcall.exit_code;
+
+	printf("%-28s insn=%-11" PRIu64 " threaded %8.2fms  tailcall %8.2fms (%+6.2f%%)%s\n",
+		name.c_str(), threaded.instructions, threaded.runtime_ms, tailcall.runtime_ms,
+		100.0 * (threaded.runtime_ms / tailcall.runtime_ms - 1.0),
+		same ? "" : "  MISMATCH");
+}
+
+int main(int argc, char** argv)
+{
+	if constexpr (!riscv::tailcall_dispatch_enabled)
+		fprintf(stderr, "Tail-call dispatch is not built in, timing threaded dispatch only\n");
+
+	std::vector<std::string> workloads;
+	for (int i = 1; i < argc; i++)
+		workloads.push_back(argv[i]);
+	if (workloads.empty()) {
+		workloads = {
+			elfdir + "/tinycc-rv64g-fib",
+			elfdir + "/golang-riscv64-hello-world",
+			elfdir + "/rust-riscv64-hello-world",
+			elfdir + "/zig-riscv64-hello-world",
+			elfdir + "/newlib-rv32gb-hello-world",
+			elfdir + "/newlib-rv64gb-hello-world",
+		};
+	}
+
+	for (const auto& path : workloads)
+	{
+		const auto binary = load_file(path);
+		const auto name = path.substr(path.find_last_of('/') + 1);
+		// ELF class: 1 = 32-bit, 2 = 64-bit
+		if (binary.size() > 4 && binary[4] == 1)
+			run_workload<riscv::RISCV32>(name, binary);
+		else
+			run_workload<riscv::RISCV64>(name, binary);
+	}
+	return 0;
+}
+
+std::vector<uint8_t> load_file(const std::string& filename)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file)
+		throw std::runtime_error("Could not open file: " + filename);
+	return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), {});
+}
@@ -0,0 +1,16 @@
+#!/bin/bash
+# Compares threaded and tail-call dispatch on the same programs.
+# Tail-call dispatch requires Clang 13 or later.
+# Usage: ./run.sh [elfs...]
+# Eg. ./run.sh ../../binaries/measure_mips/fib
+set -e
+THIS_DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+BUILD_DIR=$THIS_DIR/.build
+CXX=${CXX:-clang++}
+
+mkdir -p $BUILD_DIR
+pushd $BUILD_DIR > /dev/null
+cmake .. -DCMAKE_BUILD_TYPE=Release -DCMAKE_CXX_COMPILER=$CXX -DRISCV_TAILCALL_DISPATCH=ON > /dev/null
+make -j4 > /dev/null
+popd > /dev/null
+$BUILD_DIR/dispatchbench "$@"
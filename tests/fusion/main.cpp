@@ -0,0 +1,126 @@
+#include <libriscv/machine.hpp>
+#include <libriscv/decoder_cache.hpp>
+#include <chrono>
+#include <fstream>
+#include <inttypes.h>
+static std::vector<uint8_t> load_file(const std::string&);
+static constexpr uint64_t MAX_MEMORY = 680ul << 20;
+static constexpr uint64_t MAX_INSTRUCTIONS = 2'000'000'000ul;
+static constexpr int TIMING_RUNS = 5;
+static const std::string elfdir {ELFDIR};
+
+template <int W>
+static riscv::MachineOptions<W> options(bool fuse)
+{
+	return {
+		.memory_max = MAX_MEMORY,
+		.use_shared_execute_segments = false,
+		.fuse_instructions = fuse
+	};
+}
+
+template <int W>
+static void setup_machine(riscv::Machine<W>& machine, const std::string& name)
+{
+	machine.setup_linux_syscalls();
+	machine.fds().permit_filesystem = false;
+	machine.fds().permit_sockets = false;
+	machine.setup_posix_threads();
+	machine.setup_linux({name}, {"LC_TYPE=C", "LC_ALL=C", "USER=root"});
+	machine.set_printer([] (const auto&, const char*, size_t) {});
+}
+
+// Best-of-N emulation time in milliseconds
+template <int W>
+static double measure_runtime(const std::string& name, const std::vector<uint8_t>& binary, bool fuse)
+{
+	double best = 1e30;
+	for (int i = 0; i < TIMING_RUNS; i++)
+	{
+		riscv::Machine<W> machine { binary, options<W>(fuse) };
+		setup_machine(machine, name);
+		const auto t0 = std::chrono::high_resolution_clock::now();
+		try {
+			machine.simulate(MAX_INSTRUCTIONS);
+		} catch (const std::exception& e) {
+			fprintf(stderr, "%s: %s\n", name.c_str(), e.what());
+		}
+		const auto t1 = std::chrono::high_resolution_clock::now();
+		const std::chrono::duration<double, std::milli> runtime = t1 - t0;
+		best = std::min(best, runtime.count());
+	}
+	return best;
+}
+
+// Steps through the program one instruction at a time. Each time a
+// fused entry is reached, the dispatch of the next instruction is saved.
+template <int W>
+static void run_workload(const std::string& name, const std::vector<uint8_t>& binary)
+{
+	riscv::Machine<W> machine { binary, options<W>(true) };
+	setup_machine(machine, name);
+	machine.set_max_instructions(MAX_INSTRUCTIONS);
+	uint64_t fused_dispatches = 0;
+	try {
+		while (!machine.stopped() && machine.instruction_counter() < MAX_INSTRUCTIONS)
+		{
+			const auto pc = machine.cpu.pc();
+			if (!machine.cpu.current_execute_segment().is_within(pc))
+				machine.cpu.next_execute_segment(pc);
+			auto& exec = machine.cpu.current_execute_segment();
+			const auto& entry = exec.decoder_cache()[pc / riscv::DecoderCache<W>::DIVISOR];
+			if (riscv::unfused_bytecode(entry.get_bytecode()) != entry.get_bytecode())
+				fused_dispatches++;
+			machine.cpu.step_one();
+		}
+	} catch (const std::exception& e) {
+		fprintf(stderr, "%s: %s\n", name.c_str(), e.what());
+	}
+	const uint64_t instructions = machine.instruction_counter();
+	const uint64_t dispatches = instructions - fused_dispatches;
+
+	const double unfused_ms = measure_runtime<W>(name, binary, false);
+	const double fused_ms   = measure_runtime<W>(name, binary, true);
+
+	printf("%-28s insn=%-11" PRIu64 " dispatch=%-11" PRIu64 " (-%5.2f%%)  %8.2fms -> %8.2fms\n",
+		name.c_str(), instructions, dispatches,
+		100.0 * double(fused_dispatches) / double(instructions),
+		unfused_ms, fused_ms);
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<std::string> workloads;
+	for (int i = 1; i < argc; i++)
+		workloads.push_back(argv[i]);
+	if (workloads.empty()) {
+		workloads = {
+			elfdir + "/tinycc-rv64g-fib",
+			elfdir + "/golang-riscv64-hello-world",
+			elfdir + "/rust-riscv64-hello-world",
+			elfdir + "/zig-riscv64-hello-world",
+			elfdir + "/newlib-rv32gb-hello-world",
+			elfdir + "/newlib-rv64gb-hello-world",
+		};
+	}
+
+	for (const auto& path : workloads)
+	{
+		const auto binary = load_file(path);
+		const auto name = path.substr(path.find_last_of('/') + 1);
+		// ELF class: 1 = 32-bit, 2 = 64-bit
+		if (binary.size() > 4 && binary[4] == 1)
+			run_workload<riscv::RISCV32>(name, binary);
+		else
+			run_workload<riscv::RISCV64>(name, binary);
+	}
+	return 0;
+}
+
+std::vector<uint8_t> load_file(const std::string& filename)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file)
+		throw std::runtime_error("Could not open file: " + filename);
+	return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), {});
+}
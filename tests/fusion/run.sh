@@ -0,0 +1,14 @@
+#!/bin/bash
+# Measures how many bytecode dispatches superinstruction fusion
+# removes, and the resulting emulation time. Usage: ./run.sh [elfs...]
+# Eg. ./run.sh ../../binaries/measure_mips/fib
+set -e
+THIS_DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+BUILD_DIR=$THIS_DIR/.build
+
+mkdir -p $BUILD_DIR
+pushd $BUILD_DIR > /dev/null
+cmake .. -DCMAKE_BUILD_TYPE=Release > /dev/null
+make -j4 > /dev/null
+popd > /dev/null
+$BUILD_DIR/fusionbench "$@"
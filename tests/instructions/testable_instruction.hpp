@@ -31,7 +31,7 @@ namespace riscv
 		// execute instruction
 		machine.cpu.reg(insn.reg) = insn.initial_value;
 		machine.cpu.step_one();
-		// There is a max number of execute segments. Evict the latest to avoid the max limit check
+		// Evict the segment, so that the next test decodes its own instruction
 		machine.cpu.memory().evict_execute_segment(des);
 		// call instruction validation callback
 		if ( callback(machine.cpu, insn) ) return true;
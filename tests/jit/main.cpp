@@ -0,0 +1,108 @@
+#include <libriscv/machine.hpp>
+#include <chrono>
+#include <inttypes.h>
+static constexpr uint64_t MAX_INSTRUCTIONS = 2'000'000'000ul;
+static constexpr int TIMING_RUNS = 5;
+static constexpr uint32_t EMITTER_ADDR = 0x10000;
+static constexpr uint32_t JIT_ADDR  = 0x100000;
+static constexpr uint32_t JIT_SIZE  = 1u << 20;
+static constexpr uint32_t CHUNK_SIZE = 16;
+
+// The guest JIT emits one function per chunk, flushes the instruction
+// cache for it like __builtin___clear_cache() does on Linux, and calls it:
+//   for (i = chunks; i != 0; i--) {
+//       chunk[0] = li a0, (i & 0x7ff); chunk[1] = ret;
+//       riscv_flush_icache(chunk, chunk + 8, 0);
+//       sum += chunk();
+//       chunk += 16;
+//   }
+static const std::array<uint32_t, 17> emitter {
+	0x7ff4f293, //        andi    t0,s1,2047
+	0x01429293, //        slli    t0,t0,20
+	0x0072e2b3, //        or      t0,t0,t2
+	0x00542023, //        sw      t0,0(s0)
+	0x01c42223, //        sw      t3,4(s0)
+	0x00040513, //        mv      a0,s0
+	0x00840593, //        addi    a1,s0,8
+	0x10300893, //        li      a7,259
+	0x00000073, //        ecall
+	0x000400e7, //        jalr    s0
+	0x00a90933, //        add     s2,s2,a0
+	0x01040413, //        addi    s0,s0,16
+	0xfff48493, //        addi    s1,s1,-1
+	0xfc0496e3, //        bnez    s1,<loop>
+	0x00090513, //        mv      a0,s2
+	0x05d00893, //        li      a7,93
+	0x00000073, //        ecall
+};
+
+static void run_chunks(uint32_t chunks)
+{
+	double best = 1e30;
+	uint64_t instructions = 0;
+	size_t segments = 0, decoded_pages = 0;
+	for (int i = 0; i < TIMING_RUNS; i++)
+	{
+		static const std::vector<uint8_t> empty;
+		riscv::Machine<riscv::RISCV32> machine { empty, {
+			.use_shared_execute_segments = false
+		} };
+		machine.setup_linux_syscalls();
+		machine.copy_to_guest(EMITTER_ADDR, emitter.data(), sizeof(emitter));
+		machine.memory.set_page_attr(EMITTER_ADDR, riscv::Page::size(), {
+			.read = true,
+			.write = false,
+			.exec = true
+		});
+		machine.memory.set_page_attr(JIT_ADDR, JIT_SIZE, {
+			.read = true,
+			.write = true,
+			.exec = true
+		});
+		machine.cpu.reg(8)  = JIT_ADDR;   // s0: chunk
+		machine.cpu.reg(9)  = chunks;     // s1: i
+		machine.cpu.reg(18) = 0;          // s2: sum
+		machine.cpu.reg(7)  = 0x00000513; // t2: li a0, 0
+		machine.cpu.reg(28) = 0x00008067; // t3: ret
+		machine.cpu.jump(EMITTER_ADDR);
+
+		const auto t0 = std::chrono::high_resolution_clock::now();
+		machine.simulate(MAX_INSTRUCTIONS);
+		const auto t1 = std::chrono::high_resolution_clock::now();
+		const std::chrono::duration<double, std::milli> runtime = t1 - t0;
+		best = std::min(best, runtime.count());
+
+		uint32_t expected = 0;
+		for (uint32_t c = 1; c <= chunks; c++)
+			expected += c & 0x7ff;
+		if (machine.return_value<uint32_t>() != expected) {
+			fprintf(stderr, "Wrong result: %u, expected %u\n",
+				machine.return_value<uint32_t>(), expected);
+			exit(1);
+		}
+		instructions = machine.instruction_counter();
+		segments = machine.memory.cached_execute_segments();
+		decoded_pages = machine.memory.exec_segment_for(JIT_ADDR)->decoded_pages();
+	}
+
+	printf("chunks=%-7u insn=%-9" PRIu64 " segments=%zu decoded_pages=%-4zu %9.2fms %8.2fus/chunk\n",
+		chunks, instructions, segments, decoded_pages, best, 1000.0 * best / chunks);
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<uint32_t> counts;
+	for (int i = 1; i < argc; i++)
+		counts.push_back(std::stoul(argv[i]));
+	if (counts.empty())
+		counts = { 256, 1024, 4096 };
+
+	for (const uint32_t chunks : counts) {
+		if (chunks == 0 || chunks > JIT_SIZE / CHUNK_SIZE) {
+			fprintf(stderr, "Chunks must be between 1 and %u\n", JIT_SIZE / CHUNK_SIZE);
+			return 1;
+		}
+		run_chunks(chunks);
+	}
+	return 0;
+}
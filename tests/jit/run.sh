@@ -0,0 +1,14 @@
+#!/bin/bash
+# Measures how quickly a guest JIT can emit and run small code chunks
+# in a readable, writable and executable region.
+# Usage: ./run.sh [chunks...]
+set -e
+THIS_DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+BUILD_DIR=$THIS_DIR/.build
+
+mkdir -p $BUILD_DIR
+pushd $BUILD_DIR > /dev/null
+cmake .. -DCMAKE_BUILD_TYPE=Release > /dev/null
+make -j4 > /dev/null
+popd > /dev/null
+$BUILD_DIR/jitbench $@
@@ -0,0 +1,95 @@
+#include <libriscv/machine.hpp>
+#include <chrono>
+#include <fstream>
+#include <inttypes.h>
+#include <random>
+static std::vector<uint8_t> load_file(const std::string&);
+static constexpr uint64_t MAX_MEMORY = 1ull << 30;
+static constexpr uint64_t OPERATIONS = 1'000'000ul;
+static const std::string elfdir {ELFDIR};
+using Machine = riscv::Machine<riscv::RISCV64>;
+
+static uint64_t system_call(Machine& machine, int number, std::array<uint64_t, 6> args)
+{
+	for (size_t i = 0; i < args.size(); i++)
+		machine.cpu.reg(riscv::REG_ARG0 + i) = args[i];
+	machine.system_call(number);
+	return machine.return_value<uint64_t>();
+}
+
+// Allocator-like churn: mostly small mappings, some medium
+// and a few large ones, freed in random order.
+static void run_churn(const std::vector<uint8_t>& binary, size_t live_target)
+{
+	Machine machine { binary, {
+		.memory_max = MAX_MEMORY,
+		.use_memory_arena = false
+	} };
+	machine.setup_linux_syscalls();
+
+	std::mt19937_64 rng { 1234 };
+	auto random_pages = [&] () -> uint64_t {
+		const unsigned kind = rng() % 100;
+		if (kind < 70) return 1 + rng() % 4;
+		if (kind < 95) return 8 + rng() % 57;
+		return 256;
+	};
+	struct Mapping { uint64_t addr; uint64_t size; };
+	std::vector<Mapping> live;
+	uint64_t live_bytes = 0;
+	uint64_t peak_area = 0;
+	const uint64_t mmap_start = machine.memory.mmap_start();
+
+	const auto t0 = std::chrono::high_resolution_clock::now();
+	for (uint64_t i = 0; i < OPERATIONS; i++)
+	{
+		if (live.size() < live_target && (live.size() < live_target / 2 || rng() % 2 == 0)) {
+			const uint64_t size = random_pages() * riscv::Page::size();
+			// mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0)
+			const uint64_t addr = system_call(machine, 222, {0, size, 3, 0x4022, uint64_t(-1), 0});
+			if (addr == uint64_t(-1)) {
+				fprintf(stderr, "mmap failed after %" PRIu64 " operations\n", i);
+				return;
+			}
+			live.push_back({addr, size});
+			live_bytes += size;
+		} else {
+			const size_t idx = rng() % live.size();
+			const auto m = live[idx];
+			live[idx] = live.back();
+			live.pop_back();
+			system_call(machine, 215, {m.addr, m.size, 0, 0, 0, 0});
+			live_bytes -= m.size;
+		}
+		peak_area = std::max(peak_area, uint64_t(machine.memory.mmap_address() - mmap_start));
+	}
+	const auto t1 = std::chrono::high_resolution_clock::now();
+	const std::chrono::duration<double, std::nano> runtime = t1 - t0;
+
+	printf("live=%-6zu  %7.1f ns/op  free ranges=%-6zu  peak area=%6.1fMB  live=%6.1fMB\n",
+		live_target, runtime.count() / OPERATIONS,
+		machine.memory.mmap_cache().ranges(),
+		peak_area / 1048576.0, live_bytes / 1048576.0);
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<size_t> live_targets;
+	for (int i = 1; i < argc; i++)
+		live_targets.push_back(std::stoul(argv[i]));
+	if (live_targets.empty())
+		live_targets = { 64, 512, 4096, 16384 };
+
+	const auto binary = load_file(elfdir + "/newlib-rv64gb-hello-world");
+	for (const size_t live : live_targets)
+		run_churn(binary, live);
+	return 0;
+}
+
+std::vector<uint8_t> load_file(const std::string& filename)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file)
+		throw std::runtime_error("Could not open file: " + filename);
+	return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), {});
+}
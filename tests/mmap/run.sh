@@ -0,0 +1,13 @@
+#!/bin/bash
+# Measures guest mmap/munmap churn, as done by allocators
+# like jemalloc, mimalloc and the Go runtime.
+set -e
+THIS_DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+BUILD_DIR=$THIS_DIR/.build
+
+mkdir -p $BUILD_DIR
+pushd $BUILD_DIR > /dev/null
+cmake .. -DCMAKE_BUILD_TYPE=Release > /dev/null
+make -j4 > /dev/null
+popd > /dev/null
+$BUILD_DIR/mmapbench "$@"
@@ -0,0 +1,88 @@
+#include <libriscv/machine.hpp>
+#include <chrono>
+#include <fstream>
+#include <inttypes.h>
+static std::vector<uint8_t> load_file(const std::string&);
+static constexpr uint64_t MAX_MEMORY = 680ul << 20;
+static constexpr uint64_t MAX_INSTRUCTIONS = 2'000'000'000ul;
+static constexpr int TIMING_RUNS = 5;
+static const std::string elfdir {ELFDIR};
+
+template <int W>
+static void run_workload(const std::string& name, const std::vector<uint8_t>& binary)
+{
+	double best = 1e30;
+	uint64_t instructions = 0;
+	uint64_t returns = 0, misses = 0;
+	for (int i = 0; i < TIMING_RUNS; i++)
+	{
+		riscv::Machine<W> machine { binary, {
+			.memory_max = MAX_MEMORY,
+			.use_shared_execute_segments = false
+		} };
+		machine.setup_linux_syscalls();
+		machine.fds().permit_filesystem = false;
+		machine.fds().permit_sockets = false;
+		machine.setup_posix_threads();
+		machine.setup_linux({name}, {"LC_TYPE=C", "LC_ALL=C", "USER=root"});
+		machine.set_printer([] (const auto&, const char*, size_t) {});
+
+		const auto t0 = std::chrono::high_resolution_clock::now();
+		try {
+			machine.simulate(MAX_INSTRUCTIONS);
+		} catch (const std::exception& e) {
+			fprintf(stderr, "%s: %s\n", name.c_str(), e.what());
+		}
+		const auto t1 = std::chrono::high_resolution_clock::now();
+		const std::chrono::duration<double, std::milli> runtime = t1 - t0;
+		best = std::min(best, runtime.count());
+		instructions = machine.instruction_counter();
+		returns = machine.cpu.return_stack_stats().returns;
+		misses  = machine.cpu.return_stack_stats().misses;
+	}
+
+	const double hit_rate = (returns != 0)
+		? 100.0 * double(returns - misses) / double(returns) : 0.0;
+	printf("%-28s insn=%-11" PRIu64 " returns=%-10" PRIu64 " hit=%6.2f%%  %8.2fms\n",
+		name.c_str(), instructions, returns, hit_rate, best);
+}
+
+int main(int argc, char** argv)
+{
+	static_assert(riscv::return_stack_stats_enabled, "Build with RISCV_RETURN_STACK_STATS=ON");
+	printf("Return stack entries: %u\n", riscv::ReturnStackSize);
+
+	std::vector<std::string> workloads;
+	for (int i = 1; i < argc; i++)
+		workloads.push_back(argv[i]);
+	if (workloads.empty()) {
+		workloads = {
+			elfdir + "/tinycc-rv64g-fib",
+			elfdir + "/golang-riscv64-hello-world",
+			elfdir + "/rust-riscv64-hello-world",
+			elfdir + "/zig-riscv64-hello-world",
+			elfdir + "/newlib-rv32gb-hello-world",
+			elfdir + "/newlib-rv64gb-hello-world",
+		};
+	}
+
+	for (const auto& path : workloads)
+	{
+		const auto binary = load_file(path);
+		const auto name = path.substr(path.find_last_of('/') + 1);
+		// ELF class: 1 = 32-bit, 2 = 64-bit
+		if (binary.size() > 4 && binary[4] == 1)
+			run_workload<riscv::RISCV32>(name, binary);
+		else
+			run_workload<riscv::RISCV64>(name, binary);
+	}
+	return 0;
+}
+
+std::vector<uint8_t> load_file(const std::string& filename)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file)
+		throw std::runtime_error("Could not open file: " + filename);
+	return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), {});
+}
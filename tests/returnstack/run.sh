@@ -0,0 +1,18 @@
+#!/bin/bash
+# Measures the return-address stack hit rate and emulation time
+# on the unit test workloads for a range of stack sizes.
+# Usage: ./run.sh [sizes...] (0 disables return prediction)
+set -e
+THIS_DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+SIZES=${@:-0 4 8 16 32}
+
+for size in $SIZES; do
+	BUILD_DIR=$THIS_DIR/.build_$size
+	mkdir -p $BUILD_DIR
+	pushd $BUILD_DIR > /dev/null
+	cmake .. -DCMAKE_BUILD_TYPE=Release -DRISCV_RETURN_STACK_SIZE=$size > /dev/null
+	make -j4 > /dev/null
+	popd > /dev/null
+	echo "== Return stack entries: $size"
+	$BUILD_DIR/rasbench
+done
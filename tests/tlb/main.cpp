@@ -0,0 +1,82 @@
+#include <libriscv/machine.hpp>
+#include <chrono>
+#include <fstream>
+#include <inttypes.h>
+static std::vector<uint8_t> load_file(const std::string&);
+static constexpr uint64_t MAX_MEMORY = 680ul << 20;
+static constexpr uint64_t MAX_INSTRUCTIONS = 100'000'000ul;
+static const std::string elfdir {ELFDIR};
+
+template <int W>
+static void run_workload(const std::string& name, const std::vector<uint8_t>& binary)
+{
+	// Without the flat arena every load and store goes through the TLB
+	riscv::Machine<W> machine { binary, {
+		.memory_max = MAX_MEMORY,
+		.use_memory_arena = false
+	} };
+	machine.setup_linux_syscalls();
+	machine.fds().permit_filesystem = false;
+	machine.fds().permit_sockets = false;
+	machine.setup_posix_threads();
+	machine.setup_linux({name}, {"LC_TYPE=C", "LC_ALL=C", "USER=root"});
+	machine.set_printer([] (const auto&, const char*, size_t) {});
+
+	const auto t0 = std::chrono::high_resolution_clock::now();
+	try {
+		machine.simulate(MAX_INSTRUCTIONS);
+	} catch (const std::exception& e) {
+		fprintf(stderr, "%s: %s\n", name.c_str(), e.what());
+	}
+	const auto t1 = std::chrono::high_resolution_clock::now();
+	const std::chrono::duration<double, std::milli> runtime = t1 - t0;
+
+	const auto& stats = machine.memory.tlb_stats();
+	auto rate = [] (uint64_t misses, uint64_t total) {
+		return (total != 0) ? 100.0 * double(misses) / double(total) : 0.0;
+	};
+	printf("%-28s insn=%-10" PRIu64 " reads=%-10" PRIu64 " miss=%6.2f%%  writes=%-10" PRIu64 " miss=%6.2f%%  %.2fms\n",
+		name.c_str(), machine.instruction_counter(),
+		stats.reads, rate(stats.read_misses, stats.reads),
+		stats.writes, rate(stats.write_misses, stats.writes),
+		runtime.count());
+}
+
+int main(int argc, char** argv)
+{
+	static_assert(riscv::tlb_stats_enabled, "Build with RISCV_TLB_STATS=ON");
+	printf("TLB entries: %u\n", riscv::TLBSize);
+
+	std::vector<std::string> workloads;
+	for (int i = 1; i < argc; i++)
+		workloads.push_back(argv[i]);
+	if (workloads.empty()) {
+		workloads = {
+			elfdir + "/golang-riscv64-hello-world",
+			elfdir + "/rust-riscv64-hello-world",
+			elfdir + "/zig-riscv64-hello-world",
+			elfdir + "/newlib-rv32gb-hello-world",
+			elfdir + "/newlib-rv64gb-hello-world",
+		};
+	}
+
+	for (const auto& path : workloads)
+	{
+		const auto binary = load_file(path);
+		const auto name = path.substr(path.find_last_of('/') + 1);
+		// ELF class: 1 = 32-bit, 2 = 64-bit
+		if (binary.size() > 4 && binary[4] == 1)
+			run_workload<riscv::RISCV32>(name, binary);
+		else
+			run_workload<riscv::RISCV64>(name, binary);
+	}
+	return 0;
+}
+
+std::vector<uint8_t> load_file(const std::string& filename)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file)
+		throw std::runtime_error("Could not open file: " + filename);
+	return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), {});
+}
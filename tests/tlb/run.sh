@@ -0,0 +1,17 @@
+#!/bin/bash
+# Measures the software TLB miss rate on the unit test workloads
+# for a range of TLB sizes. Usage: ./run.sh [sizes...]
+set -e
+THIS_DIR="$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )"
+SIZES=${@:-1 2 4 8 16 32}
+
+for size in $SIZES; do
+	BUILD_DIR=$THIS_DIR/.build_$size
+	mkdir -p $BUILD_DIR
+	pushd $BUILD_DIR > /dev/null
+	cmake .. -DCMAKE_BUILD_TYPE=Release -DRISCV_TLB_SIZE=$size > /dev/null
+	make -j4 > /dev/null
+	popd > /dev/null
+	echo "== TLB entries: $size"
+	$BUILD_DIR/tlbbench
+done
@@ -0,0 +1,256 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <libriscv/machine.hpp>
+#include <libriscv/decoder_cache.hpp>
+static constexpr uint64_t MAX_INSTRUCTIONS = 1'000;
+static constexpr uint64_t CODE = 0x1000;
+static constexpr uint64_t DATA = 0x2000; // auipc rd,1 in the first instruction
+static constexpr uint32_t ECALL = 0x00000073;
+using namespace riscv;
+
+// A fused instruction pair at CODE, followed by the rest of the program
+struct FusedPair {
+	const char* name;
+	unsigned bytecode;
+	std::vector<uint32_t> code;
+	std::vector<std::pair<int, uint64_t>> registers;
+	std::vector<std::pair<uint64_t, uint64_t>> memory;
+};
+
+static const std::vector<FusedPair> fused_pairs {
+	{"LUI+ADDI", RV32I_BC_FUSED_LUI_ADDI, {
+		0x12345537, //        lui     a0,0x12345
+		0x67850513, //        addi    a0,a0,1656
+		ECALL,
+	}, {{REG_ARG0, 0x12345678}}, {}},
+	{"LUI+ADDIW", RV64I_BC_FUSED_LUI_ADDIW, {
+		0x800005b7, //        lui     a1,0x80000
+		0xfff5859b, //        addiw   a1,a1,-1
+		ECALL,
+	}, {{REG_ARG1, 0x7FFFFFFF}}, {}},
+	{"AUIPC+ADDI", RV32I_BC_FUSED_AUIPC_ADDI, {
+		0x00000617, //        auipc   a2,0x0
+		0x01060613, //        addi    a2,a2,16
+		ECALL,
+	}, {{REG_ARG2, CODE + 16}}, {}},
+	{"AUIPC+LW", RV32I_BC_FUSED_AUIPC_LDW, {
+		0x00001697, //        auipc   a3,0x1
+		0x0046a683, //        lw      a3,4(a3)
+		ECALL,
+	}, {{REG_ARG3, 0xFFFFFFFF80000001}}, {}},
+	{"AUIPC+LD", RV64I_BC_FUSED_AUIPC_LDD, {
+		0x00001717, //        auipc   a4,0x1
+		0x00873703, //        ld      a4,8(a4)
+		ECALL,
+	}, {{REG_ARG4, 0x1122334455667788}}, {}},
+	{"AUIPC+JALR", RV32I_BC_FUSED_AUIPC_JALR, {
+		0x00000297, //        auipc   t0,0x0
+		0x00c280e7, //        jalr    ra,12(t0)
+		0x00100a13, //        li      s4,1
+		ECALL,
+	}, {{REG_RA, CODE + 8}, {5, CODE}, {20, 0}}, {}},
+	{"ADDI+BNE", RV32I_BC_FUSED_ADDI_BRANCH, {
+		0xfff30313, // loop:  addi    t1,t1,-1
+		0xfe031ee3, //        bnez    t1,loop
+		ECALL,
+	}, {{6, 0}}, {}},
+	{"ADDI+BEQ", RV32I_BC_FUSED_ADDI_BRANCH, {
+		0x00138393, //        addi    t2,t2,1
+		0x00b38463, //        beq     t2,a1,done
+		0x00100a13, //        li      s4,1
+		ECALL,      // done:
+	}, {{7, 8}, {20, 0}}, {}},
+	{"SLT+BNE", RV32I_BC_FUSED_SLT_BRANCH, {
+		0x00c7ae33, //        slt     t3,a5,a2
+		0x000e1463, //        bnez    t3,done
+		0x00100a13, //        li      s4,1
+		ECALL,      // done:
+	}, {{28, 1}, {20, 0}}, {}},
+	{"SLTU+BNE", RV32I_BC_FUSED_SLTU_BRANCH, {
+		0x00c7beb3, //        sltu    t4,a5,a2
+		0x000e9463, //        bnez    t4,done
+		0x00100a13, //        li      s4,1
+		ECALL,      // done:
+	}, {{29, 0}, {20, 1}}, {}},
+	{"ADD+LW", RV32I_BC_FUSED_ADD_LDW, {
+		0x00b50f33, //        add     t5,a0,a1
+		0x000f2f03, //        lw      t5,0(t5)
+		ECALL,
+	}, {{30, 0x55667788}}, {}},
+	{"SH2ADD+LW", RV32I_BC_FUSED_SH2ADD_LDW, {
+		0x20a64fb3, //        sh2add  t6,a2,a0
+		0x000faf83, //        lw      t6,0(t6)
+		ECALL,
+	}, {{31, 0x11223344}}, {}},
+	{"ADD+LD", RV64I_BC_FUSED_ADD_LDD, {
+		0x00b50933, //        add     s2,a0,a1
+		0x00893903, //        ld      s2,8(s2)
+		ECALL,
+	}, {{18, 0x8877665544332211}}, {}},
+	{"SH3ADD+LD", RV64I_BC_FUSED_SH3ADD_LDD, {
+		0x20a869b3, //        sh3add  s3,a6,a0
+		0x0009b983, //        ld      s3,0(s3)
+		ECALL,
+	}, {{19, 0x8877665544332211}}, {}},
+	{"LW+LW", RV32I_BC_FUSED_LDW_LDW, {
+		0x00052a83, //        lw      s5,0(a0)
+		0x00452b03, //        lw      s6,4(a0)
+		ECALL,
+	}, {{21, 0x12345678}, {22, 0xFFFFFFFF80000001}}, {}},
+	{"LD+LD", RV64I_BC_FUSED_LDD_LDD, {
+		0x01853c03, //        ld      s8,24(a0)
+		0x000c3c83, //        ld      s9,0(s8)
+		ECALL,
+	}, {{24, DATA}, {25, 0x8000000112345678}}, {}},
+	{"SW+SW", RV32I_BC_FUSED_STW_STW, {
+		0x02b52023, //        sw      a1,32(a0)
+		0x02c52223, //        sw      a2,36(a0)
+		ECALL,
+	}, {}, {{DATA + 32, 0x0000000300000008}}},
+	{"SD+SD", RV64I_BC_FUSED_STD_STD, {
+		0x02f53423, //        sd      a5,40(a0)
+		0x02a53823, //        sd      a0,48(a0)
+		ECALL,
+	}, {}, {{DATA + 40, ~uint64_t(0)}, {DATA + 48, DATA}}},
+#ifdef RISCV_EXT_COMPRESSED
+	{"C.LDSP+C.LDSP", RV32C_BC_FUSED_LDD_LDD, {
+		0x674266a2, //        c.ldsp  a3,8(sp); c.ldsp a4,16(sp)
+		ECALL,
+	}, {{REG_ARG3, 0x1122334455667788}, {REG_ARG4, 0x8877665544332211}}, {}},
+	{"C.SD+C.SD", RV32C_BC_FUSED_STD_STD, {
+		0xe130fd0c, //        c.sd    a1,56(a0); c.sd a2,64(a0)
+		ECALL,
+	}, {}, {{DATA + 56, 8}, {DATA + 64, 3}}},
+#endif
+};
+
+static std::unique_ptr<Machine<RISCV64>> create_machine(const std::vector<uint32_t>& code,
+	MachineOptions<RISCV64> options = {})
+{
+	// Machines with the same code would otherwise share the decoded segment
+	options.use_shared_execute_segments = false;
+	auto m = std::make_unique<Machine<RISCV64>>(options);
+	auto& machine = *m;
+	machine.setup_minimal_syscalls();
+
+	machine.copy_to_guest(CODE, code.data(), code.size() * 4);
+	machine.memory.set_page_attr(CODE, Page::size(), { .read = false, .write = false, .exec = true });
+	const uint32_t words[] = { 0x12345678, 0x80000001 };
+	const uint64_t dwords[] = { 0x1122334455667788, 0x8877665544332211, DATA };
+	machine.copy_to_guest(DATA, words, sizeof(words));
+	machine.copy_to_guest(DATA + sizeof(words), dwords, sizeof(dwords));
+
+	machine.cpu.reg(REG_SP) = DATA;
+	machine.cpu.reg(REG_ARG0) = DATA;
+	machine.cpu.reg(REG_ARG1) = 8;
+	machine.cpu.reg(REG_ARG2) = 3;
+	machine.cpu.reg(REG_ARG5) = -1;
+	machine.cpu.reg(REG_ARG6) = 2;
+	machine.cpu.reg(REG_ARG7) = 93; // exit
+	machine.cpu.reg(6) = 5; // t1: loop counter
+	machine.cpu.reg(7) = 7; // t2
+	machine.cpu.jump(CODE);
+	return m;
+}
+
+static unsigned bytecode_at(Machine<RISCV64>& machine, uint64_t addr)
+{
+	auto* decoder = machine.cpu.current_execute_segment().decoder_cache();
+	return decoder[addr / DecoderCache<RISCV64>::DIVISOR].get_bytecode();
+}
+
+TEST_CASE("Fused instruction pairs give the same results", "[Fusion]")
+{
+	for (const auto& pair : fused_pairs)
+	{
+		INFO(pair.name);
+		auto fused_machine = create_machine(pair.code);
+		auto unfused_machine = create_machine(pair.code, { .fuse_instructions = false });
+		auto& fused = *fused_machine;
+		auto& unfused = *unfused_machine;
+		fused.simulate(MAX_INSTRUCTIONS);
+		unfused.simulate(MAX_INSTRUCTIONS);
+
+		REQUIRE(bytecode_at(fused, CODE) == pair.bytecode);
+		REQUIRE(bytecode_at(unfused, CODE) == unfused_bytecode(pair.bytecode));
+
+		for (const auto& [reg, value] : pair.registers) {
+			REQUIRE(fused.cpu.reg(reg) == value);
+		}
+		for (const auto& [addr, value] : pair.memory) {
+			REQUIRE(fused.memory.read<uint64_t>(addr) == value);
+		}
+		// Everything else is the same as without fusion
+		for (int reg = 0; reg < 32; reg++) {
+			REQUIRE(fused.cpu.reg(reg) == unfused.cpu.reg(reg));
+		}
+		REQUIRE(fused.cpu.pc() == unfused.cpu.pc());
+		REQUIRE(fused.instruction_counter() == unfused.instruction_counter());
+		for (uint64_t addr = DATA; addr < DATA + 128; addr += 8) {
+			REQUIRE(fused.memory.read<uint64_t>(addr) == unfused.memory.read<uint64_t>(addr));
+		}
+	}
+}
+
+TEST_CASE("Jumping into the middle of a fused pair", "[Fusion]")
+{
+	const auto& pair = fused_pairs.at(0); // LUI+ADDI
+	auto m = create_machine(pair.code);
+	auto& machine = *m;
+	machine.simulate(MAX_INSTRUCTIONS);
+	REQUIRE(bytecode_at(machine, CODE) == RV32I_BC_FUSED_LUI_ADDI);
+
+	// Only the ADDI is executed
+	machine.cpu.reg(REG_ARG0) = 0x1000;
+	machine.cpu.jump(CODE + 4);
+	machine.simulate(MAX_INSTRUCTIONS);
+	REQUIRE(machine.cpu.reg(REG_ARG0) == 0x1000 + 0x678);
+	REQUIRE(machine.instruction_counter() == 2);
+}
+
+TEST_CASE("Breakpoints split fused pairs", "[Fusion]")
+{
+	const auto& pair = fused_pairs.at(0); // LUI+ADDI
+	static uint64_t break_pc = 0;
+	static uint64_t break_a0 = 0;
+	auto on_ebreak = [] (Machine<RISCV64>& machine) {
+		break_pc = machine.cpu.pc();
+		break_a0 = machine.cpu.reg(REG_ARG0);
+		machine.stop();
+	};
+
+	SECTION("EBREAK installed on the second instruction")
+	{
+		auto m = create_machine(pair.code);
+		auto& machine = *m;
+		machine.install_syscall_handler(SYSCALL_EBREAK, on_ebreak);
+		// Run once, so that the pair is fused
+		machine.simulate(MAX_INSTRUCTIONS);
+		REQUIRE(bytecode_at(machine, CODE) == RV32I_BC_FUSED_LUI_ADDI);
+
+		machine.cpu.install_ebreak_at(CODE + 4);
+		REQUIRE(bytecode_at(machine, CODE) == RV32I_BC_LUI);
+
+		break_pc = break_a0 = 0;
+		machine.cpu.jump(CODE);
+		machine.simulate(MAX_INSTRUCTIONS);
+		// The LUI ran, but the ADDI was replaced by the breakpoint. The
+		// block was decoded without it, so the PC is not exact here.
+		REQUIRE(break_pc != 0);
+		REQUIRE(break_a0 == 0x12345000);
+	}
+	SECTION("EBREAK location given to the decoder")
+	{
+		auto m = create_machine(pair.code, {
+			.ebreak_locations = { address_type<RISCV64>(CODE + 4) }
+		});
+		auto& machine = *m;
+		machine.install_syscall_handler(SYSCALL_EBREAK, on_ebreak);
+
+		break_pc = break_a0 = 0;
+		machine.simulate(MAX_INSTRUCTIONS);
+		REQUIRE(bytecode_at(machine, CODE) == RV32I_BC_LUI);
+		REQUIRE(break_pc == CODE + 4);
+		REQUIRE(break_a0 == 0x12345000);
+	}
+}
@@ -493,3 +493,198 @@ TEST_CASE("Crashing payload #6", "[Micro]")
 	}
 	REQUIRE(exception_thrown);
 }
+
+TEST_CASE("Execute across many execute segments", "[Micro]")
+{
+	static constexpr int SEGMENTS = 32;
+	constexpr uint32_t V = 0x10000;
+	const std::array<uint32_t, 4> hop {
+		0x00150513, //        addi    a0,a0,1
+		0x00002337, //        lui     t1,0x2
+		0x006282b3, //        add     t0,t0,t1
+		0x00028067, //        jr      t0 (next segment)
+	};
+	const std::array<uint32_t, 3> last {
+		0x00150513, //        addi    a0,a0,1
+		0x05d00893, //        li      a7,93
+		0x00000073, //        ecall
+	};
+
+	auto create_program = [&] (riscv::Machine<RISCV32>& machine) {
+		// Every other page is executable, so each page becomes its own segment
+		for (int i = 0; i < SEGMENTS; i++) {
+			const uint32_t addr = V + i * 0x2000;
+			if (i < SEGMENTS-1)
+				machine.copy_to_guest(addr, hop.data(), sizeof(hop));
+			else
+				machine.copy_to_guest(addr, last.data(), sizeof(last));
+			machine.memory.set_page_attr(addr, riscv::Page::size(), {
+				.read = false,
+				.write = false,
+				.exec = true
+			});
+		}
+		machine.setup_minimal_syscalls();
+		machine.cpu.reg(REG_T0) = V;
+		machine.cpu.jump(V);
+	};
+
+	// There is no limit on the number of execute segments
+	riscv::Machine<RISCV32> machine { empty };
+	create_program(machine);
+	machine.simulate(MAX_CYCLES);
+	REQUIRE(machine.return_value() == SEGMENTS);
+	REQUIRE(machine.memory.cached_execute_segments() == SEGMENTS);
+	for (int i = 0; i < SEGMENTS; i++) {
+		const uint32_t addr = V + i * 0x2000;
+		REQUIRE(machine.memory.exec_segment_for(addr)->exec_begin() == addr);
+	}
+	REQUIRE(machine.memory.exec_segment_for(V + 0x1000)->empty());
+
+	// With a budget, the least recently used segments are evicted
+	const auto budget = 4 * machine.memory.exec_segment_for(V)->size_bytes();
+	riscv::Machine<RISCV32> limited { empty, { .execute_segments_memory_max = budget } };
+	create_program(limited);
+	limited.simulate(MAX_CYCLES);
+	REQUIRE(limited.return_value() == SEGMENTS);
+	REQUIRE(limited.memory.cached_execute_segments() <= 4);
+	REQUIRE(!limited.memory.exec_segment_for(V + (SEGMENTS-1) * 0x2000)->empty());
+	REQUIRE(limited.memory.exec_segment_for(V)->empty());
+}
+
+TEST_CASE("Rewrite code in a JIT execute segment", "[Micro]")
+{
+	constexpr uint32_t V = 0x10000;
+	auto make_return = [] (uint32_t value) {
+		return std::array<uint32_t, 3> {
+			(value << 20) | 0x513, // li      a0,value
+			0x05d00893,            // li      a7,93
+			0x00000073,            // ecall
+		};
+	};
+	const std::array<uint32_t, 2> fence_jump {
+		0x0000100f, //        fence.i
+		0x00028067, //        jr      t0
+	};
+
+	riscv::Machine<RISCV32> machine { empty };
+	machine.setup_minimal_syscalls();
+	// Readable, writable and executable pages are JIT execute segments
+	machine.memory.set_page_attr(V, 2 * riscv::Page::size(), {
+		.read = true,
+		.write = true,
+		.exec = true
+	});
+	auto run = [&] (uint32_t pc) {
+		machine.cpu.jump(pc);
+		machine.simulate(MAX_CYCLES);
+		return machine.return_value();
+	};
+
+	auto code = make_return(1);
+	machine.copy_to_guest(V, code.data(), sizeof(code));
+	REQUIRE(run(V) == 1);
+	auto* segment = machine.memory.exec_segment_for(V).get();
+	REQUIRE(segment->is_likely_jit());
+	REQUIRE(segment->decoded_pages() == 1);
+
+	// New code written into the decoded page is found without a new segment
+	code = make_return(2);
+	machine.copy_to_guest(V + 64, code.data(), sizeof(code));
+	REQUIRE(run(V + 64) == 2);
+	REQUIRE(machine.memory.exec_segment_for(V).get() == segment);
+	REQUIRE(machine.memory.cached_execute_segments() == 1);
+
+	// Rewritten code is executed after FENCE.I
+	code = make_return(3);
+	machine.copy_to_guest(V, code.data(), sizeof(code));
+	REQUIRE(run(V) == 1);
+	machine.copy_to_guest(V + riscv::Page::size(), fence_jump.data(), sizeof(fence_jump));
+	machine.cpu.reg(REG_T0) = V;
+	REQUIRE(run(V + riscv::Page::size()) == 3);
+	REQUIRE(machine.memory.exec_segment_for(V).get() == segment);
+	REQUIRE(segment->decoded_pages() == 2);
+}
+
+TEST_CASE("Count block executions", "[Micro]")
+{
+	constexpr uint32_t V = 0x10000;
+	const std::array<uint32_t, 7> program {
+		0x00000513, //        li      a0,0
+		0x00a00293, //        li      t0,10
+		0x00150513, // loop:  addi    a0,a0,1
+		0xfff28293, //        addi    t0,t0,-1
+		0xfe029ce3, //        bnez    t0,loop
+		0x05d00893, //        li      a7,93
+		0x00000073, //        ecall
+	};
+
+	riscv::Machine<RISCV32> machine { empty };
+	machine.copy_to_guest(V, program.data(), sizeof(program));
+	machine.memory.set_page_attr(V, riscv::Page::size(), {
+		.read = false,
+		.write = false,
+		.exec = true
+	});
+	machine.setup_minimal_syscalls();
+	machine.cpu.jump(V);
+	machine.simulate(MAX_CYCLES);
+	REQUIRE(machine.return_value() == 10);
+
+	const auto profile = machine.memory.block_profile();
+	if constexpr (!riscv::block_profiling_enabled) {
+		REQUIRE(profile.empty());
+		return;
+	}
+	// The loop is entered 9 times by its branch, after the first
+	// iteration that is part of the block at the start
+	REQUIRE(profile.size() == 3);
+	REQUIRE(profile[0].address == V + 8);
+	REQUIRE(profile[0].count == 9);
+	REQUIRE(profile[0].instructions == 27);
+	uint64_t instructions = 0;
+	for (const auto& block : profile)
+		instructions += block.instructions;
+	REQUIRE(instructions == machine.instruction_counter());
+
+	machine.memory.reset_block_profile();
+	REQUIRE(machine.memory.block_profile().empty());
+}
+
+TEST_CASE("Instruction limit with forward branches in a loop", "[Micro]")
+{
+	constexpr uint32_t V = 0x10000;
+	const std::array<uint32_t, 9> program {
+		0x00000513, //        li      a0,0
+		0x3e800293, //        li      t0,1000
+		0x0012f313, // loop:  andi    t1,t0,1
+		0x00030463, //        beqz    t1,skip
+		0x00150513, //        addi    a0,a0,1
+		0xfff28293, // skip:  addi    t0,t0,-1
+		0xfe0298e3, //        bnez    t0,loop
+		0x05d00893, //        li      a7,93
+		0x00000073, //        ecall
+	};
+
+	riscv::Machine<RISCV32> machine { empty };
+	machine.copy_to_guest(V, program.data(), sizeof(program));
+	machine.memory.set_page_attr(V, riscv::Page::size(), {
+		.read = false,
+		.write = false,
+		.exec = true
+	});
+	machine.setup_minimal_syscalls();
+	machine.cpu.jump(V);
+
+	// Only the backward branch checks the limit, which must still
+	// stop the loop shortly after the limit has been reached
+	unsigned stops = 0;
+	for (uint64_t limit = 100; !machine.simulate<false>(limit, machine.instruction_counter()); limit += 100) {
+		REQUIRE(machine.instruction_counter() >= limit);
+		REQUIRE(machine.instruction_counter() - limit < program.size());
+		stops ++;
+	}
+	REQUIRE(stops > 0);
+	REQUIRE(machine.return_value() == 500);
+	REQUIRE(machine.instruction_counter() == 2 + 1000 * 4 + 500 + 2);
+}
@@ -0,0 +1,406 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <libriscv/machine.hpp>
+#ifdef __linux__
+#include <fcntl.h>
+#endif
+extern std::vector<uint8_t> load_file(const std::string& filename);
+using namespace riscv;
+static const uint64_t MAX_MEMORY = 64ul << 20;
+static const std::string cwd {SRCDIR};
+
+TEST_CASE("Page table lookups", "[Paging]")
+{
+	riscv::Machine<RISCV64> machine { std::string_view{}, {
+		.memory_max = MAX_MEMORY,
+		.use_memory_arena = false
+	} };
+	// Low, high and overflow (outside of the radix root) addresses
+	static constexpr std::array<uint64_t, 4> addrs {
+		0x10000, 0x200000, 0xC000000000, 0x7FFFFFFFF000
+	};
+	for (const auto addr : addrs)
+		machine.memory.write<uint64_t>(addr, addr ^ 0xFFFF);
+	for (const auto addr : addrs)
+		REQUIRE(machine.memory.read<uint64_t>(addr) == (addr ^ 0xFFFF));
+
+	REQUIRE(machine.memory.pages_active() == addrs.size());
+	REQUIRE(machine.memory.owned_pages_active() == addrs.size());
+
+	// Pages are visited in order
+	size_t i = 0;
+	for (const auto& it : machine.memory.pages()) {
+		REQUIRE(it.first == Memory<RISCV64>::page_number(addrs.at(i)));
+		i++;
+	}
+	REQUIRE(i == addrs.size());
+
+	// Freeing pages makes them read as zeroes again
+	machine.memory.free_pages(0xC000000000, Page::size());
+	REQUIRE(machine.memory.pages_active() == addrs.size() - 1);
+	REQUIRE(machine.memory.read<uint64_t>(0xC000000000) == 0);
+	REQUIRE(machine.memory.read<uint64_t>(0x7FFFFFFFF000) == (0x7FFFFFFFF000 ^ 0xFFFF));
+}
+
+TEST_CASE("Forks borrow page tables copy-on-write", "[Paging]")
+{
+	riscv::Machine<RISCV64> machine { std::string_view{}, {
+		.memory_max = MAX_MEMORY,
+		.use_memory_arena = false
+	} };
+	static constexpr uint64_t LOW  = 0x10000;
+	static constexpr uint64_t HIGH = 0x7FFFFFFFF000;
+	static constexpr uint64_t SECRET = 0x20000;
+	machine.memory.write<uint32_t>(LOW, 1);
+	machine.memory.write<uint32_t>(HIGH, 2);
+	machine.memory.write<uint32_t>(SECRET, 3);
+	machine.memory.create_writable_pageno(Memory<RISCV64>::page_number(SECRET)).attr.dont_fork = true;
+
+	for (int i = 0; i < 3; i++)
+	{
+		riscv::Machine<RISCV64> fork { machine, { .use_memory_arena = false } };
+		REQUIRE(fork.memory.read<uint32_t>(LOW) == 1);
+		REQUIRE(fork.memory.read<uint32_t>(HIGH) == 2);
+		// Pages marked dont_fork are not visible in forks
+		REQUIRE(fork.memory.read<uint32_t>(SECRET) == 0);
+
+		// Borrowed pages are non-owning and copy-on-write
+		const auto& page = fork.memory.get_page(LOW);
+		REQUIRE(page.attr.non_owning);
+		REQUIRE(page.attr.is_cow);
+		REQUIRE(!page.attr.write);
+
+		fork.memory.write<uint32_t>(LOW, 10);
+		fork.memory.write<uint32_t>(HIGH, 20);
+		REQUIRE(fork.memory.read<uint32_t>(LOW) == 10);
+		REQUIRE(fork.memory.read<uint32_t>(HIGH) == 20);
+
+		// A fork of a fork sees the writes of its parent
+		riscv::Machine<RISCV64> fork2 { fork, { .use_memory_arena = false } };
+		REQUIRE(fork2.memory.read<uint32_t>(LOW) == 10);
+		fork2.memory.write<uint32_t>(LOW, 100);
+		REQUIRE(fork2.memory.read<uint32_t>(LOW) == 100);
+		REQUIRE(fork.memory.read<uint32_t>(LOW) == 10);
+	}
+	// The main machine is unchanged
+	REQUIRE(machine.memory.read<uint32_t>(LOW) == 1);
+	REQUIRE(machine.memory.read<uint32_t>(HIGH) == 2);
+	REQUIRE(machine.memory.read<uint32_t>(SECRET) == 3);
+	REQUIRE(machine.memory.owned_pages_active() == 3);
+
+	// New pages in the main machine are not visible in older forks
+	riscv::Machine<RISCV64> fork { machine, { .use_memory_arena = false } };
+	machine.memory.write<uint32_t>(LOW + Page::size(), 4);
+	REQUIRE(fork.memory.read<uint32_t>(LOW + Page::size()) == 0);
+	REQUIRE(fork.memory.read<uint32_t>(LOW) == 1);
+}
+
+TEST_CASE("Forks recycle page data through the page pool", "[Paging]")
+{
+	riscv::Machine<RISCV64> machine { std::string_view{}, {
+		.memory_max = MAX_MEMORY,
+		.use_memory_arena = false
+	} };
+	static constexpr uint64_t BASE = 0x100000;
+	static constexpr size_t PAGES = 32;
+	for (size_t i = 0; i < PAGES; i++)
+		machine.memory.write<uint32_t>(BASE + i * Page::size(), i);
+
+	// Warm up the pool with one fork
+	{
+		riscv::Machine<RISCV64> fork { machine, { .use_memory_arena = false } };
+		for (size_t i = 0; i < PAGES; i++)
+			fork.memory.write<uint32_t>(BASE + i * Page::size(), 0);
+	}
+	PagePool::reset_stats();
+
+	for (int f = 0; f < 4; f++)
+	{
+		riscv::Machine<RISCV64> fork { machine, { .use_memory_arena = false } };
+		for (size_t i = 0; i < PAGES; i++) {
+			// Recycled page data is copied from the parent on write
+			REQUIRE(fork.memory.read<uint32_t>(BASE + i * Page::size()) == i);
+			fork.memory.write<uint32_t>(BASE + i * Page::size(), 1000 + i);
+		}
+	}
+	const auto stats = PagePool::stats();
+	REQUIRE(stats.allocations >= 4 * PAGES);
+	REQUIRE(stats.reused == stats.allocations);
+	REQUIRE(stats.deallocations == stats.allocations);
+}
+
+TEST_CASE("Forks can be reset to their parent", "[Paging]")
+{
+	riscv::Machine<RISCV64> machine { std::string_view{}, {
+		.memory_max = MAX_MEMORY,
+		.use_memory_arena = false
+	} };
+	static constexpr uint64_t BASE = 0x100000;
+	static constexpr size_t PAGES = 16;
+	for (size_t i = 0; i < PAGES; i++)
+		machine.memory.write<uint32_t>(BASE + i * Page::size(), i);
+	machine.cpu.reg(REG_ARG0) = 1234;
+
+	riscv::Machine<RISCV64> fork { machine, { .use_memory_arena = false } };
+	for (int round = 0; round < 3; round++)
+	{
+		// Copy-on-write, new pages, protections and freed pages
+		fork.memory.write<uint32_t>(BASE, 100);
+		fork.memory.write<uint32_t>(BASE + PAGES * Page::size(), 200);
+		fork.memory.set_page_attr(BASE + Page::size(), Page::size(), {.read = false});
+		fork.memory.free_pages(BASE + 2 * Page::size(), Page::size());
+		fork.cpu.reg(REG_ARG0) = 0;
+		fork.set_instruction_counter(5000);
+
+		fork.reset_to_parent();
+
+		REQUIRE(fork.cpu.reg(REG_ARG0) == 1234);
+		REQUIRE(fork.instruction_counter() == machine.instruction_counter());
+		REQUIRE(fork.memory.pages_active() == machine.memory.pages_active());
+		for (size_t i = 0; i < PAGES; i++)
+			REQUIRE(fork.memory.read<uint32_t>(BASE + i * Page::size()) == i);
+		REQUIRE(fork.memory.read<uint32_t>(BASE + PAGES * Page::size()) == 0);
+		REQUIRE(fork.memory.get_page(BASE + Page::size()).attr.read);
+		REQUIRE(fork.memory.get_page(BASE).attr.non_owning);
+	}
+	REQUIRE(machine.memory.read<uint32_t>(BASE) == 0);
+
+	// Only forks can be reset
+	REQUIRE_THROWS(machine.reset_to_parent());
+}
+
+TEST_CASE("Reset forks can run a program again", "[Paging]")
+{
+	const auto binary = load_file(cwd + "/elf/newlib-rv64gb-hello-world");
+
+	riscv::Machine<RISCV64> machine { binary, { .memory_max = MAX_MEMORY } };
+	machine.setup_linux_syscalls();
+	machine.setup_linux(
+		{"newlib-rv64gb-hello-world"},
+		{"LC_TYPE=C", "LC_ALL=C", "USER=root"});
+
+	riscv::Machine<RISCV64> fork { machine, { .use_memory_arena = false } };
+	std::string text;
+	fork.set_userdata(&text);
+	fork.set_printer([] (const auto& m, const char* data, size_t size) {
+		m.template get_userdata<std::string> ()->append(data, data + size);
+	});
+
+	fork.simulate(10'000'000ul);
+	REQUIRE(fork.return_value() == 666);
+	const auto first_text = text;
+	const auto first_counter = fork.instruction_counter();
+
+	fork.reset_to_parent();
+	text.clear();
+	fork.simulate(10'000'000ul);
+	REQUIRE(fork.return_value() == 666);
+	REQUIRE(text == first_text);
+	REQUIRE(fork.instruction_counter() == first_counter);
+}
+
+TEST_CASE("Free mmap ranges are best-fit and coalesced", "[Memory]")
+{
+	MMapCache<RISCV64> cache;
+	cache.insert(0x10000, 0x4000);
+	cache.insert(0x20000, 0x1000);
+	cache.insert(0x30000, 0x2000);
+
+	// The smallest range that fits is used
+	auto r = cache.find(0x1000);
+	REQUIRE((r.addr == 0x20000 && r.size == 0x1000));
+	r = cache.find(0x1000);
+	REQUIRE((r.addr == 0x30000 && r.size == 0x1000));
+	REQUIRE(cache.find(0x8000).empty());
+	REQUIRE(cache.ranges() == 2);
+
+	// Freed ranges merge with both neighbours
+	cache.insert(0x14000, 0x1C000);
+	cache.insert(0x30000, 0x1000);
+	REQUIRE(cache.ranges() == 1);
+	// Freeing a range twice does not make it available twice
+	cache.insert(0x18000, 0x1000);
+	REQUIRE(cache.ranges() == 1);
+	r = cache.find(0x22000);
+	REQUIRE((r.addr == 0x10000 && r.size == 0x22000));
+	REQUIRE(cache.empty());
+
+	// Invalidation splits partially overlapping ranges
+	cache.insert(0x10000, 0x10000);
+	cache.invalidate(0x14000, 0x1000);
+	REQUIRE(cache.ranges() == 2);
+	r = cache.find(0x5000);
+	REQUIRE((r.addr == 0x15000 && r.size == 0x5000));
+
+	// Unmapping the top of the mmap area also releases free ranges below it
+	const auto binary = load_file(cwd + "/elf/newlib-rv64gb-hello-world");
+	Machine<RISCV64> machine { binary, { .memory_max = MAX_MEMORY } };
+	const auto a = machine.memory.mmap_allocate(0x1000);
+	const auto b = machine.memory.mmap_allocate(0x1000);
+	const auto c = machine.memory.mmap_allocate(0x1000);
+	REQUIRE(!machine.memory.mmap_unmap(b, 0x1000));
+	REQUIRE(machine.memory.mmap_unmap(c, 0x1000));
+	REQUIRE(machine.memory.mmap_address() == b);
+	REQUIRE(machine.memory.mmap_cache().empty());
+	REQUIRE(a < b);
+}
+
+#ifdef __linux__
+TEST_CASE("Forks get a private copy-on-write arena", "[Paging]")
+{
+	if constexpr (!riscv::flat_readwrite_arena)
+		return;
+	const auto binary = load_file(cwd + "/elf/newlib-rv64gb-hello-world");
+
+	riscv::Machine<RISCV64> machine { binary, {
+		.memory_max = MAX_MEMORY,
+		.use_forkable_arena = true
+	} };
+	machine.setup_linux_syscalls();
+	machine.setup_linux(
+		{"newlib-rv64gb-hello-world"},
+		{"LC_TYPE=C", "LC_ALL=C", "USER=root"});
+	const auto addr = machine.memory.heap_address();
+	machine.memory.write<uint64_t>(addr, 1234);
+
+	riscv::Machine<RISCV64> fork1 { machine };
+	riscv::Machine<RISCV64> fork2 { machine };
+	REQUIRE(fork1.memory.uses_flat_memory_arena());
+	REQUIRE(fork1.memory.memory_arena_ptr() != machine.memory.memory_arena_ptr());
+	REQUIRE(fork1.memory.read<uint64_t>(addr) == 1234);
+
+	// Writes are private to each fork
+	fork1.memory.write<uint64_t>(addr, 5678);
+	fork1.memory.memcpy(addr + 8, "Hello", 6);
+	REQUIRE(machine.memory.read<uint64_t>(addr) == 1234);
+	REQUIRE(fork2.memory.read<uint64_t>(addr) == 1234);
+	REQUIRE(fork1.memory.memstring(addr + 8) == "Hello");
+	REQUIRE(fork2.memory.memstring(addr + 8).empty());
+
+	// Discarded fork memory reads back as zeroes
+	fork2.memory.memdiscard(addr & ~uint64_t(Page::size()-1), Page::size(), false);
+	REQUIRE(fork2.memory.read<uint64_t>(addr) == 0);
+	REQUIRE(machine.memory.read<uint64_t>(addr) == 1234);
+
+	// Both forks can run the program in their own arena
+	for (auto* fork : {&fork1, &fork2}) {
+		fork->set_printer([] (const auto&, const char*, size_t) {});
+		fork->simulate(10'000'000ul);
+		REQUIRE(fork->return_value() == 666);
+	}
+
+	fork1.reset_to_parent();
+	REQUIRE(fork1.memory.read<uint64_t>(addr) == 1234);
+	REQUIRE(fork1.memory.memstring(addr + 8).empty());
+}
+
+TEST_CASE("Arenas can use huge pages", "[Paging]")
+{
+	if constexpr (!riscv::flat_readwrite_arena)
+		return;
+	const auto binary = load_file(cwd + "/elf/newlib-rv64gb-hello-world");
+
+	// Explicit huge pages fall back to transparent huge pages
+	// when the host has not reserved enough of them
+	for (const bool hugetlb : {false, true})
+	{
+		riscv::Machine<RISCV64> machine { binary, {
+			.memory_max = MAX_MEMORY,
+			.use_forkable_arena = true,
+			.use_arena_huge_pages = !hugetlb,
+			.use_arena_hugetlb = hugetlb
+		} };
+		REQUIRE(machine.memory.uses_flat_memory_arena());
+		REQUIRE(uintptr_t(machine.memory.memory_arena_ptr()) % (2ul << 20) == 0);
+
+		machine.setup_linux_syscalls();
+		machine.setup_linux(
+			{"newlib-rv64gb-hello-world"},
+			{"LC_TYPE=C", "LC_ALL=C", "USER=root"});
+		machine.set_printer([] (const auto&, const char*, size_t) {});
+
+		riscv::Machine<RISCV64> fork { machine };
+		fork.simulate(10'000'000ul);
+		REQUIRE(fork.return_value() == 666);
+		machine.simulate(10'000'000ul);
+		REQUIRE(machine.return_value() == 666);
+	}
+}
+
+TEST_CASE("Guests can map files without copying", "[Paging]")
+{
+	const auto binary = load_file(cwd + "/elf/newlib-rv64gb-hello-world");
+	const std::string filename = cwd + "/elf/golang-riscv64-hello-world";
+	const auto contents = load_file(filename);
+	static constexpr uint64_t OFFSET = 4 * Page::size();
+	static constexpr uint64_t LENGTH = 64 * Page::size();
+	REQUIRE(contents.size() > OFFSET + LENGTH);
+
+	for (const bool use_memory_arena : {true, false})
+	for (const bool use_forkable_arena : {true, false})
+	for (const int prot : {1, 3}) // PROT_READ, PROT_READ | PROT_WRITE
+	{
+		riscv::Machine<RISCV64> machine { binary, {
+			.memory_max = MAX_MEMORY,
+			.use_memory_arena = use_memory_arena,
+			.use_forkable_arena = use_forkable_arena
+		} };
+		machine.setup_linux_syscalls();
+		machine.fds().permit_filesystem = true;
+		const int vfd = machine.fds().assign_file(open(filename.c_str(), O_RDONLY));
+
+		auto syscall = [&] (int number, std::array<uint64_t, 6> args) {
+			for (size_t i = 0; i < args.size(); i++)
+				machine.cpu.reg(REG_ARG0 + i) = args[i];
+			machine.system_call(number);
+			return machine.return_value<uint64_t>();
+		};
+		const size_t owned_pages = machine.memory.owned_pages_active();
+		// mmap(NULL, LENGTH, prot, MAP_PRIVATE, vfd, OFFSET)
+		const uint64_t addr = syscall(222, {0, LENGTH, uint64_t(prot), 0x2, uint64_t(vfd), OFFSET});
+		REQUIRE(addr != uint64_t(-1));
+		// Nothing is copied until the pages are touched
+		REQUIRE(machine.memory.owned_pages_active() == owned_pages);
+
+		std::vector<uint8_t> mapped(LENGTH);
+		machine.memory.memcpy_out(mapped.data(), addr, LENGTH);
+		REQUIRE(std::equal(mapped.begin(), mapped.end(), contents.begin() + OFFSET));
+
+		// Forks see the same file contents
+		riscv::Machine<RISCV64> fork { machine };
+		std::vector<uint8_t> forked(LENGTH);
+		fork.memory.memcpy_out(forked.data(), addr, LENGTH);
+		REQUIRE(forked == mapped);
+
+		if (prot & 2) {
+			// Writes are private to the machine
+			machine.memory.write<uint8_t>(addr, ~contents[OFFSET]);
+			REQUIRE(machine.memory.read<uint8_t>(addr) == uint8_t(~contents[OFFSET]));
+			REQUIRE(load_file(filename) == contents);
+		}
+
+		// Later forks see the writes of the machine, also after
+		// mprotect(addr, LENGTH, PROT_READ | PROT_WRITE)
+		REQUIRE(syscall(226, {addr, LENGTH, 3, 0, 0, 0}) == 0);
+		const uint64_t written = addr + Page::size();
+		machine.memory.write<uint8_t>(written, ~contents[OFFSET + Page::size()]);
+		riscv::Machine<RISCV64> fork2 { machine };
+		REQUIRE(fork2.memory.read<uint8_t>(written) == uint8_t(~contents[OFFSET + Page::size()]));
+
+		// Unmapping the middle of the range keeps the rest of it
+		static constexpr uint64_t HOLE = 16 * Page::size();
+		REQUIRE(syscall(215, {addr + HOLE, HOLE, 0, 0, 0, 0}) == 0);
+		REQUIRE(syscall(222, {addr + HOLE, HOLE, 3, 0x32, uint64_t(-1), 0}) == addr + HOLE);
+		machine.memory.memcpy_out(mapped.data(), addr, LENGTH);
+		REQUIRE(std::equal(mapped.begin() + 2 * HOLE, mapped.end(), contents.begin() + OFFSET + 2 * HOLE));
+		REQUIRE(std::all_of(mapped.begin() + HOLE, mapped.begin() + 2 * HOLE, [] (uint8_t b) { return b == 0; }));
+		REQUIRE(std::equal(mapped.begin() + 2 * Page::size(), mapped.begin() + HOLE, contents.begin() + OFFSET + 2 * Page::size()));
+
+		// munmap(addr, LENGTH), then mmap(addr, LENGTH, ..., MAP_FIXED | MAP_ANONYMOUS)
+		REQUIRE(syscall(215, {addr, LENGTH, 0, 0, 0, 0}) == 0);
+		REQUIRE(syscall(222, {addr, LENGTH, 3, 0x32, uint64_t(-1), 0}) == addr);
+		REQUIRE(machine.memory.read<uint64_t>(addr) == 0);
+		REQUIRE(machine.memory.read<uint64_t>(addr + LENGTH - 8) == 0);
+	}
+}
+#endif
@@ -94,6 +94,37 @@ TEST_CASE("Caches must be invalidated", "[Memory]")
 	}(), Catch::Matchers::ContainsSubstring("Protection fault"));
 }
 
+TEST_CASE("TLB keeps multiple pages cached", "[Memory]")
+{
+	if constexpr (riscv::TLBSize < 2)
+		return;
+
+	Machine<RISCV32> machine { empty, {.use_memory_arena = false} };
+	static constexpr uint32_t V2 = V + Page::size();
+
+	// Alternate between two pages, caching both
+	machine.memory.write<uint32_t> (V, 1);
+	machine.memory.write<uint32_t> (V2, 2);
+	REQUIRE(machine.memory.read<uint32_t> (V) == 1);
+	REQUIRE(machine.memory.read<uint32_t> (V2) == 2);
+	machine.memory.set_page_attr(V, 2*Page::size(), {.read = false, .write = false, .exec = false});
+	// Both pages are still in the TLB
+	REQUIRE(machine.memory.read<uint32_t> (V) == 1);
+	REQUIRE(machine.memory.read<uint32_t> (V2) == 2);
+	machine.memory.write<uint32_t> (V2, 3);
+
+	// Invalidating one page leaves the other cached
+	machine.memory.invalidate_cache(Memory<RISCV32>::page_number(V), nullptr);
+	REQUIRE_THROWS_WITH([&] {
+		machine.memory.read<uint32_t> (V);
+	}(), Catch::Matchers::ContainsSubstring("Protection fault"));
+	REQUIRE(machine.memory.read<uint32_t> (V2) == 3);
+
+	machine.memory.invalidate_reset_cache();
+	REQUIRE_THROWS_WITH([&] {
+		machine.memory.write<uint32_t> (V2, 4);
+	}(), Catch::Matchers::ContainsSubstring("Protection fault"));
+}
 
 TEST_CASE("Writes to read-only segment", "[Memory]")
 {
@@ -0,0 +1,157 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <libriscv/machine.hpp>
+#include <libriscv/decoder_cache.hpp>
+using namespace riscv;
+
+static constexpr uint64_t MAX_INSTRUCTIONS = 10'000'000ull;
+static constexpr uint64_t CODE  = 0x1000;
+static constexpr uint64_t CODE2 = 0x40000;
+static constexpr uint64_t STACK = 0x20000;
+using Stack = ReturnStack<RISCV64, 4>;
+
+TEST_CASE("Return stack predicts matching returns", "[ReturnStack]")
+{
+	DecoderData<RISCV64> decoder[64] {};
+	const auto* begin = &decoder[0];
+	const auto* end = &decoder[64];
+	Stack stack;
+
+	stack.push(0x100, true, &decoder[1]);
+	stack.push(0x200, true, &decoder[2]);
+	REQUIRE(stack.pop(0x200, begin, end) == &decoder[2]);
+	REQUIRE(stack.pop(0x100, begin, end) == &decoder[1]);
+
+	// A return to somewhere else is a miss, and consumes the entry
+	stack.push(0x100, true, &decoder[1]);
+	stack.push(0x200, true, &decoder[2]);
+	REQUIRE(stack.pop(0x300, begin, end) == nullptr);
+	REQUIRE(stack.pop(0x100, begin, end) == &decoder[1]);
+
+	// Return addresses outside of the execute segment are never predicted
+	stack.push(0x100, false, &decoder[1]);
+	REQUIRE(stack.pop(0x100, begin, end) == nullptr);
+
+	// Deeper calls overwrite the oldest entries
+	for (unsigned i = 1; i <= 6; i++)
+		stack.push(i * 0x100, true, &decoder[i]);
+	for (unsigned i = 6; i > 2; i--)
+		REQUIRE(stack.pop(i * 0x100, begin, end) == &decoder[i]);
+	REQUIRE(stack.pop(0x200, begin, end) == nullptr);
+	REQUIRE(stack.pop(0x100, begin, end) == nullptr);
+
+	stack.push(0x100, true, &decoder[1]);
+	stack.clear();
+	REQUIRE(stack.pop(0x100, begin, end) == nullptr);
+}
+
+TEST_CASE("Return stack rejects entries from another decoder cache", "[ReturnStack]")
+{
+	// Eg. the original decoder cache of a live-patched segment
+	DecoderData<RISCV64> original[64] {};
+	DecoderData<RISCV64> patched[64] {};
+	Stack stack;
+
+	stack.push(0x100, true, &original[8]);
+	REQUIRE(stack.pop(0x100, &patched[0], &patched[64]) == nullptr);
+	stack.push(0x100, true, &patched[8]);
+	REQUIRE(stack.pop(0x100, &patched[0], &patched[64]) == &patched[8]);
+	// The end of the decoder cache is not a valid entry
+	stack.push(0x100, true, &patched[64]);
+	REQUIRE(stack.pop(0x100, &patched[0], &patched[64]) == nullptr);
+}
+
+static void add_code(Machine<RISCV64>& machine, uint64_t addr, const std::vector<uint32_t>& code)
+{
+	machine.copy_to_guest(addr, code.data(), code.size() * 4);
+	machine.memory.set_page_attr(addr, Page::size(), { .read = false, .write = false, .exec = true });
+}
+
+// Runs the program with both the precise and the inaccurate dispatch
+template <typename Setup>
+static void run_both(Setup setup, uint64_t expected_a0)
+{
+	for (const bool precise : {true, false})
+	{
+		INFO("Precise dispatch: " << precise);
+		Machine<RISCV64> machine;
+		machine.setup_minimal_syscalls();
+		setup(machine);
+		machine.cpu.reg(REG_SP) = STACK;
+		if (precise) {
+			machine.cpu.jump(CODE);
+			machine.simulate(MAX_INSTRUCTIONS);
+		} else {
+			machine.cpu.simulate_inaccurate(CODE);
+		}
+		REQUIRE(machine.cpu.reg(REG_ARG0) == expected_a0);
+	}
+}
+
+TEST_CASE("Calls deeper than the return stack", "[ReturnStack]")
+{
+	run_both([] (auto& machine) {
+		add_code(machine, CODE, {
+			0x00000513, //        li      a0,0
+			0x02800593, //        li      a1,40
+			0x00c000ef, //        jal     f
+			0x05d00893, //        li      a7,93
+			0x00000073, //        ecall
+			0xff010113, // f:     addi    sp,sp,-16
+			0x00113423, //        sd      ra,8(sp)
+			0x00150513, //        addi    a0,a0,1
+			0xfff58593, //        addi    a1,a1,-1
+			0x00058463, //        beqz    a1,1f
+			0xfedff0ef, //        jal     f
+			0x00813083, // 1:     ld      ra,8(sp)
+			0x01010113, //        addi    sp,sp,16
+			0x00008067, //        ret
+		});
+	}, 40);
+}
+
+TEST_CASE("Returning somewhere else than the call site", "[ReturnStack]")
+{
+	run_both([] (auto& machine) {
+		add_code(machine, CODE, {
+			0x00000513, //        li      a0,0
+			0x00400313, //        li      t1,4
+			0x028000ef, // 1:     jal     h
+			0xfff30313, //        addi    t1,t1,-1
+			0xfe031ce3, //        bnez    t1,1b
+			0x024000ef, //        jal     g
+			0x06f00513, //        li      a0,111
+			0x05d00893, //        li      a7,93
+			0x00000073, //        ecall
+			0x3e850513, // other: addi    a0,a0,1000
+			0x05d00893, //        li      a7,93
+			0x00000073, //        ecall
+			0x00150513, // h:     addi    a0,a0,1
+			0x00008067, //        ret
+			0x00000097, // g:     auipc   ra,0
+			0xfec08093, //        addi    ra,ra,-20 (other)
+			0x00008067, //        ret
+		});
+	}, 1004);
+}
+
+TEST_CASE("Returning into another execute segment", "[ReturnStack]")
+{
+	run_both([] (auto& machine) {
+		add_code(machine, CODE, {
+			0x00000513, //        li      a0,0
+			0x00300313, //        li      t1,3
+			0x000402b7, //        lui     t0,0x40
+			0x000280e7, // 1:     jalr    t0
+			0x00150513, //        addi    a0,a0,1
+			0xfff30313, //        addi    t1,t1,-1
+			0xfe031ae3, //        bnez    t1,1b
+			0x05d00893, //        li      a7,93
+			0x00000073, //        ecall
+		});
+		add_code(machine, CODE2, {
+			0x00a50513, //        addi    a0,a0,10
+			0x00008067, //        ret
+		});
+	}, 33);
+}
@@ -163,3 +163,40 @@ TEST_CASE("Serialized state from another place", "[Serialize]")
 	restored_machine.simulate(MAX_INSTRUCTIONS);
 	REQUIRE(restored_machine.return_value<int>() == 666);
 }
+
+TEST_CASE("Arena dirty pages are tracked and serialized", "[Serialize]")
+{
+	if constexpr (!riscv::arena_dirty_tracking)
+		return;
+	static constexpr uint64_t V = 0x10000;
+
+	riscv::Machine<RISCV64> machine { empty, { .memory_max = MAX_MEMORY } };
+	REQUIRE(machine.memory.uses_flat_memory_arena());
+	machine.memory.clear_arena_dirty_pages();
+	REQUIRE(machine.memory.dirty_arena_pages().empty());
+
+	// Writes through the arena fast-path and through memcpy
+	machine.memory.write<uint32_t>(V, 0xDEADBEEF);
+	machine.memory.memcpy(V + 3 * Page::size(), "Hello", 6);
+	REQUIRE(machine.memory.is_arena_page_dirty(V / Page::size()));
+	REQUIRE(!machine.memory.is_arena_page_dirty(V / Page::size() + 1));
+	REQUIRE(machine.memory.dirty_arena_pages() ==
+		std::vector<uint64_t>{ V / Page::size(), V / Page::size() + 3 });
+
+	// Only dirty arena pages are serialized
+	std::vector<uint8_t> state;
+	machine.serialize_to(state);
+	REQUIRE(state.size() < 4 * sizeof(PageData));
+
+	riscv::Machine<RISCV64> restored { empty, { .memory_max = MAX_MEMORY } };
+	restored.memory.write<uint32_t>(V + Page::size(), 1234);
+	REQUIRE(restored.deserialize_from(state) == 0);
+	REQUIRE(restored.memory.read<uint32_t>(V) == 0xDEADBEEF);
+	REQUIRE(restored.memory.memstring(V + 3 * Page::size()) == "Hello");
+	// Changes made before deserializing are gone
+	REQUIRE(restored.memory.read<uint32_t>(V + Page::size()) == 0);
+	REQUIRE(!restored.memory.is_arena_page_dirty(V / Page::size() + 1));
+
+	machine.memory.clear_arena_dirty_pages();
+	REQUIRE(machine.memory.dirty_arena_pages().empty());
+}
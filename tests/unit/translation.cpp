@@ -0,0 +1,276 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <libriscv/machine.hpp>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <thread>
+static const uint64_t MAX_MEMORY = 8ul << 20; /* 8MB */
+static const uint64_t MAX_INSTRUCTIONS = 10'000'000ul;
+static constexpr uint64_t CODE_ADDR = 0x1000;
+using namespace riscv;
+
+// Translate the execute segments created by the tests right away
+static MachineOptions<RISCV64> translation_options()
+{
+	MachineOptions<RISCV64> options { .memory_max = MAX_MEMORY };
+#ifdef RISCV_BINARY_TRANSLATION
+	options.translate_future_segments = true;
+	options.translation_cache = false;
+#ifdef RISCV_TIERED_TRANSLATION
+	options.translate_tiered = false;
+#endif
+#endif
+	return options;
+}
+
+// Sums up (a0 + 3) ^ 5 in a loop of 250432 iterations
+static const std::array<uint32_t, 9> loop_program {
+	0x0003d337, //        lui     t1,0x3d
+	0x24030313, //        addi    t1,t1,576
+	0x00000513, //        li      a0,0
+	0x00350513, // loop:  addi    a0,a0,3
+	0x00554513, //        xori    a0,a0,5
+	0xfff30313, //        addi    t1,t1,-1
+	0xfe031ae3, //        bnez    t1,loop
+	0x05d00893, //        li      a7,93
+	0x00000073, //        ecall
+};
+static constexpr uint64_t LOOP_RESULT = 500864;
+
+template <size_t N>
+static void install_program(Machine<RISCV64>& machine, const std::array<uint32_t, N>& program)
+{
+	machine.setup_minimal_syscalls();
+	machine.cpu.init_execute_area(program.data(), CODE_ADDR, N * 4);
+	machine.cpu.jump(CODE_ADDR);
+}
+
+TEST_CASE("Translated memory accesses outside of the arena", "[Translation]")
+{
+	// strlen() of a string far outside of the memory arena,
+	// which is only reachable through the page tables
+	static const std::array<uint32_t, 10> strlen_program {
+		0x00100593, //        li      a1,1
+		0x02659593, //        slli    a1,a1,38
+		0x00000513, //        li      a0,0
+		0x0005c283, // loop:  lbu     t0,0(a1)
+		0x00028863, //        beqz    t0,done
+		0x00150513, //        addi    a0,a0,1
+		0x00158593, //        addi    a1,a1,1
+		0xff1ff06f, //        j       loop
+		0x05d00893, // done:  li      a7,93
+		0x00000073, //        ecall
+	};
+	const uint64_t STRING_ADDR = 1ull << 38;
+	const std::string text = "abcdefghijklmnopqrstuvwxyz";
+
+	Machine<RISCV64> machine { translation_options() };
+	install_program(machine, strlen_program);
+	machine.copy_to_guest(STRING_ADDR, text.c_str(), text.size() + 1);
+
+	machine.simulate(MAX_INSTRUCTIONS);
+	REQUIRE(machine.return_value() == text.size());
+
+	// Run it again after the machine has stopped normally
+	machine.cpu.jump(CODE_ADDR);
+	machine.simulate(MAX_INSTRUCTIONS);
+	REQUIRE(machine.return_value() == text.size());
+}
+
+#ifdef RISCV_TIERED_TRANSLATION
+TEST_CASE("Tiered translation promotes hot code", "[Translation]")
+{
+	auto options = translation_options();
+	options.translate_tiered = true;
+	options.translate_tier1_threshold = 100;
+
+	Machine<RISCV64> machine { options };
+	install_program(machine, loop_program);
+	machine.simulate(MAX_INSTRUCTIONS);
+	REQUIRE(machine.return_value() == LOOP_RESULT);
+
+	auto& exec = machine.cpu.current_execute_segment();
+	REQUIRE(exec.tiered_translation() != nullptr);
+	REQUIRE(exec.tiered_translation()->tier >= 1);
+	// The fast backend is the native JIT or libtcc
+	REQUIRE(exec.is_binary_translated() == (native_jit_enabled || libtcc_enabled));
+
+	// The live-patched translation gives the same result
+	machine.cpu.jump(CODE_ADDR);
+	machine.simulate(MAX_INSTRUCTIONS);
+	REQUIRE(machine.return_value() == LOOP_RESULT);
+}
+
+TEST_CASE("Tier 2 replaces running translations", "[Translation]")
+{
+	if constexpr (!native_jit_enabled || libtcc_enabled)
+		return;
+	std::vector<std::thread> compilations;
+	std::atomic<bool> compiled = false;
+	auto options = translation_options();
+	options.translate_tiered = true;
+	options.translate_tier1_threshold = 100;
+	options.translate_tier2_threshold = 10'000;
+	// The optimizing compilation runs while the machine keeps running
+	options.translate_background_callback = [&] (auto& compilation_step) {
+		compilations.emplace_back([&compiled, step = compilation_step] {
+			step();
+			compiled = true;
+		});
+	};
+
+	Machine<RISCV64> machine { options };
+	install_program(machine, loop_program);
+	machine.simulate(MAX_INSTRUCTIONS);
+	REQUIRE(machine.return_value() == LOOP_RESULT);
+	REQUIRE(compilations.size() == 1);
+
+	// Keep calling the translated code while its mappings are replaced
+	while (!compiled) {
+		machine.cpu.jump(CODE_ADDR);
+		machine.simulate(MAX_INSTRUCTIONS);
+		REQUIRE(machine.return_value() == LOOP_RESULT);
+	}
+	for (auto& thread : compilations)
+		thread.join();
+	auto& exec = machine.cpu.current_execute_segment();
+	REQUIRE(exec.tiered_translation()->tier == 2);
+	// The compiled shared object now owns the replaced mappings
+	REQUIRE(exec.binary_translation_so() != nullptr);
+
+	machine.cpu.jump(CODE_ADDR);
+	machine.simulate(MAX_INSTRUCTIONS);
+	REQUIRE(machine.return_value() == LOOP_RESULT);
+}
+#endif
+
+#ifdef RISCV_BINARY_TRANSLATION
+// Encoders for the generated programs
+static uint32_t itype(uint32_t funct3, int rd, int rs1, int32_t imm) {
+	return (uint32_t(imm) << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | 0b0010011;
+}
+static uint32_t jal(int rd, int32_t offset) {
+	const uint32_t imm = offset;
+	return ((imm >> 20) & 1) << 31 | ((imm >> 1) & 0x3FF) << 21 | ((imm >> 11) & 1) << 20
+		| ((imm >> 12) & 0xFF) << 12 | (rd << 7) | 0b1101111;
+}
+static constexpr uint32_t RET = 0x00008067;
+
+// A loop calling many small functions, so that the translation is big
+// enough to be compiled in several shards
+static std::vector<uint32_t> generate_call_program(int functions, int length)
+{
+	std::vector<uint32_t> code {
+		itype(0x0, REG_ARG0, 0, 0),    //        li      a0,0
+		itype(0x0, 18, 0, 100),        //        li      s2,100
+	};
+	const size_t loop = code.size();
+	// Each call is patched once the functions are placed
+	for (int i = 0; i < functions; i++)
+		code.push_back(0);
+	code.push_back(itype(0x0, 18, 18, -1));      //        addi    s2,s2,-1
+	code.push_back(0x00090463);                  //        beqz    s2,+8
+	code.push_back(jal(0, int32_t(loop - code.size()) * 4)); // j loop
+	code.push_back(itype(0x0, REG_ARG7, 0, 93)); //        li      a7,93
+	code.push_back(0x00000073);                  //        ecall
+
+	for (int i = 0; i < functions; i++) {
+		code.at(loop + i) = jal(REG_RA, int32_t(code.size() - (loop + i)) * 4);
+		for (int j = 0; j < length; j++) {
+			code.push_back(itype(0x0, REG_ARG0, REG_ARG0, (i * 31 + j) & 0x3FF)); // addi
+			code.push_back(itype(0x4, REG_ARG0, REG_ARG0, (i + j * 17) & 0x3FF)); // xori
+		}
+		code.push_back(RET);
+	}
+	return code;
+}
+
+TEST_CASE("Sharded compilation gives the same results", "[Translation]")
+{
+	const auto program = generate_call_program(200, 32);
+	auto run = [&] (bool translate, unsigned shards) {
+		auto options = translation_options();
+		options.translate_enabled = translate;
+		options.translate_compiler_shards = shards;
+#ifdef RISCV_NATIVE_JIT
+		options.translate_native_jit = false;
+#endif
+		Machine<RISCV64> machine { options };
+		machine.setup_minimal_syscalls();
+		machine.cpu.init_execute_area(program.data(), CODE_ADDR, program.size() * 4);
+		machine.cpu.jump(CODE_ADDR);
+		machine.simulate(MAX_INSTRUCTIONS);
+		REQUIRE(machine.cpu.current_execute_segment().is_binary_translated() == translate);
+		return machine.return_value();
+	};
+	const auto expected = run(false, 1);
+	// About 370KB of code is emitted, which is compiled in 2 shards
+	REQUIRE(run(true, 1) == expected);
+	REQUIRE(run(true, 4) == expected);
+}
+
+// Counts the register stores of each spill macro in the emitted code
+static std::map<std::string, size_t> count_spills(std::istream& code)
+{
+	std::map<std::string, size_t> spills;
+	std::string line;
+	size_t* counter = nullptr;
+	while (std::getline(code, line)) {
+		if (line.rfind("#define STORE_REGS_", 0) == 0 || line.rfind("#define STORE_CALL_REGS_", 0) == 0) {
+			counter = &spills[line.substr(8, line.find('(') - 8)];
+		} else if (counter != nullptr && line.find("cpu->r[") != std::string::npos) {
+			(*counter)++;
+		} else {
+			counter = nullptr;
+		}
+	}
+	return spills;
+}
+
+TEST_CASE("Direct calls only spill the callee footprint", "[Translation]")
+{
+	const auto program = generate_call_program(50, 16);
+	const std::string prefix = (std::filesystem::temp_directory_path() / "rvfootprint-").string();
+	auto run = [&] (bool translate) {
+		auto options = translation_options();
+		options.translate_enabled = translate;
+		options.translate_use_register_caching = true;
+		options.cross_compile.push_back(MachineTranslationEmbeddableCodeOptions{prefix, ".c"});
+#ifdef RISCV_NATIVE_JIT
+		options.translate_native_jit = false;
+#endif
+		Machine<RISCV64> machine { options };
+		machine.setup_minimal_syscalls();
+		machine.cpu.init_execute_area(program.data(), CODE_ADDR, program.size() * 4);
+		machine.cpu.jump(CODE_ADDR);
+		machine.simulate(MAX_INSTRUCTIONS);
+		return std::make_pair(machine.return_value(), machine.cpu.current_execute_segment().translation_hash());
+	};
+	const auto expected = run(false).first;
+	const auto [result, hash] = run(true);
+	REQUIRE(result == expected);
+
+	const auto filename = MachineOptions<RISCV64>::translation_filename(prefix, hash, ".c");
+	std::ifstream code(filename);
+	REQUIRE(code.is_open());
+	const auto spills = count_spills(code);
+	code.close();
+	std::filesystem::remove(filename);
+
+	// The callees only access A0 and RA, so the loop counter in S2
+	// stays in a local across each call
+	size_t calls = 0;
+	for (const auto& [name, stores] : spills) {
+		const auto split = name.rfind('_');
+		if (name.rfind("STORE_CALL_REGS_", 0) != 0)
+			continue;
+		const std::string func = name.substr(16, split - 16);
+		REQUIRE(stores == 2);
+		REQUIRE(stores < spills.at("STORE_REGS_" + func));
+		calls++;
+	}
+	REQUIRE(calls > 0);
+}
+#endif
@@ -0,0 +1,157 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include <libriscv/machine.hpp>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <unistd.h>
+using namespace riscv;
+
+// The managed translation cache, see tr_cache.cpp
+namespace riscv
+{
+	extern std::string translation_cache_lookup(const std::string&, uint32_t hash, uint32_t flags);
+	extern bool translation_cache_lock(const std::string&, uint32_t hash);
+	extern void translation_cache_unlock(const std::string&, uint32_t hash);
+	extern std::string translation_cache_temporary(const std::string&, uint32_t hash);
+	extern std::string translation_cache_insert(const std::string&, uint32_t hash, uint32_t flags, const std::string&, uint64_t max_bytes);
+}
+static constexpr uint32_t FLAGS = 0x1234;
+
+// A fresh cache directory that is removed at the end of the test
+struct CacheDirectory {
+	CacheDirectory() {
+		std::string path = (std::filesystem::temp_directory_path() / "rvcache-XXXXXX").string();
+		REQUIRE(mkdtemp(path.data()) != nullptr);
+		this->name = path;
+	}
+	~CacheDirectory() {
+		std::filesystem::remove_all(name);
+	}
+	TranslationCacheStatistics statistics() const {
+		return MachineOptions<RISCV64>::translation_cache_statistics(name);
+	}
+	std::string name;
+};
+
+// Stores a fake translation of the given size, the way a compiling worker does
+static std::string store(const CacheDirectory& dir, uint32_t hash, size_t size, uint64_t max_bytes = 1ull << 20)
+{
+	REQUIRE(translation_cache_lock(dir.name, hash));
+	const std::string temporary = translation_cache_temporary(dir.name, hash);
+	std::ofstream(temporary) << std::string(size, 'x');
+	return translation_cache_insert(dir.name, hash, FLAGS, temporary, max_bytes);
+}
+
+TEST_CASE("Translation cache counts hits, misses and stores", "[TranslationCache]")
+{
+	CacheDirectory dir;
+	REQUIRE(translation_cache_lookup(dir.name, 0xA, FLAGS).empty());
+
+	const std::string filename = store(dir, 0xA, 1000);
+	REQUIRE(!filename.empty());
+	REQUIRE(std::filesystem::file_size(filename) == 1000);
+	// The temporary file was renamed into place, and the lock released
+	REQUIRE(!std::filesystem::exists(translation_cache_temporary(dir.name, 0xA)));
+	REQUIRE(translation_cache_lock(dir.name, 0xA));
+	translation_cache_unlock(dir.name, 0xA);
+
+	REQUIRE(translation_cache_lookup(dir.name, 0xA, FLAGS) == filename);
+	REQUIRE(translation_cache_lookup(dir.name, 0xA, FLAGS) == filename);
+
+	const auto stats = dir.statistics();
+	REQUIRE(stats.hits == 2);
+	REQUIRE(stats.misses == 1);
+	REQUIRE(stats.stores == 1);
+	REQUIRE(stats.evictions == 0);
+	REQUIRE(stats.entries == 1);
+	REQUIRE(stats.bytes == 1000);
+}
+
+TEST_CASE("Translation cache evicts the least recently used", "[TranslationCache]")
+{
+	CacheDirectory dir;
+	const uint64_t max_bytes = 3000;
+	const std::string first = store(dir, 0x1, 1000, max_bytes);
+	const std::string second = store(dir, 0x2, 1000, max_bytes);
+	store(dir, 0x3, 1000, max_bytes);
+	REQUIRE(dir.statistics().evictions == 0);
+
+	// Using the oldest translation makes the second one the least recently used
+	REQUIRE(translation_cache_lookup(dir.name, 0x1, FLAGS) == first);
+	store(dir, 0x4, 1000, max_bytes);
+
+	auto stats = dir.statistics();
+	REQUIRE(stats.evictions == 1);
+	REQUIRE(stats.entries == 3);
+	REQUIRE(stats.bytes == max_bytes);
+	REQUIRE(!std::filesystem::exists(second));
+	REQUIRE(translation_cache_lookup(dir.name, 0x2, FLAGS).empty());
+	REQUIRE(translation_cache_lookup(dir.name, 0x1, FLAGS) == first);
+
+	// A translation bigger than the budget is kept on its own
+	store(dir, 0x5, 5000, max_bytes);
+	stats = dir.statistics();
+	REQUIRE(stats.evictions == 4);
+	REQUIRE(stats.entries == 1);
+	REQUIRE(stats.bytes == 5000);
+}
+
+TEST_CASE("Translation cache removes stale translations", "[TranslationCache]")
+{
+	CacheDirectory dir;
+	// Compiled with other flags
+	const std::string filename = store(dir, 0xB, 1000);
+	REQUIRE(translation_cache_lookup(dir.name, 0xB, FLAGS + 1).empty());
+	REQUIRE(!std::filesystem::exists(filename));
+	REQUIRE(dir.statistics().entries == 0);
+
+	// Compiled by another version of the translator
+	store(dir, 0xB, 1000);
+	const std::string index_filename = dir.name + "/index";
+	std::string index;
+	{
+		std::ifstream file(index_filename);
+		index.assign(std::istreambuf_iterator<char>(file), {});
+	}
+	// Each entry is: hash flags version size last-use
+	const auto entry = index.find("0000000B 00001234 ");
+	REQUIRE(entry != std::string::npos);
+	index.replace(entry + 18, 8, "00000000");
+	std::ofstream(index_filename) << index;
+
+	REQUIRE(translation_cache_lookup(dir.name, 0xB, FLAGS).empty());
+	REQUIRE(!std::filesystem::exists(filename));
+
+	const auto stats = dir.statistics();
+	REQUIRE(stats.misses == 2);
+	REQUIRE(stats.stores == 2);
+	REQUIRE(stats.entries == 0);
+	REQUIRE(stats.bytes == 0);
+}
+
+TEST_CASE("Translation cache waits for the worker holding the lock", "[TranslationCache]")
+{
+	CacheDirectory dir;
+	REQUIRE(translation_cache_lock(dir.name, 0xC));
+
+	std::atomic<bool> waiting = true;
+	bool took_lock = true;
+	std::thread worker([&] {
+		took_lock = translation_cache_lock(dir.name, 0xC);
+		waiting = false;
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(200));
+	REQUIRE(waiting);
+
+	// The other worker finishes without taking the lock, and can now
+	// look up the translation that we stored
+	const std::string temporary = translation_cache_temporary(dir.name, 0xC);
+	std::ofstream(temporary) << std::string(1000, 'x');
+	REQUIRE(!translation_cache_insert(dir.name, 0xC, FLAGS, temporary, 1ull << 20).empty());
+	worker.join();
+	REQUIRE(!took_lock);
+	REQUIRE(!translation_cache_lookup(dir.name, 0xC, FLAGS).empty());
+}
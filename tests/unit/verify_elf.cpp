@@ -1,5 +1,8 @@
 #include <catch2/catch_test_macros.hpp>
 #include <libriscv/machine.hpp>
+#include <libriscv/decoder_cache.hpp>
+#include <filesystem>
+#include <fstream>
 extern std::vector<uint8_t> load_file(const std::string& filename);
 static const uint64_t MAX_MEMORY = 680ul << 20; /* 680MB */
 static const uint64_t MAX_INSTRUCTIONS = 10'000'000ul;
@@ -224,3 +227,251 @@ TEST_CASE("RV32 Execute-Only Hello World", "[Verify]")
 	REQUIRE(machine.return_value() == 123);
 	REQUIRE(state.text == "Hello, World!");
 }
+
+TEST_CASE("Memory-mapped Golang Hello World", "[Verify]")
+{
+	const std::string filename = cwd + "/elf/golang-riscv64-hello-world";
+
+	for (const bool use_memory_arena : {true, false})
+	{
+		// The machine maps the ELF file itself, instead of copying segments
+		riscv::Machine<RISCV64> machine { ProgramFile{filename}, {
+			.memory_max = MAX_MEMORY,
+			.use_memory_arena = use_memory_arena
+		} };
+		machine.setup_linux_syscalls();
+		machine.fds().permit_filesystem = false;
+		machine.fds().permit_sockets = false;
+		machine.setup_posix_threads();
+		machine.setup_linux(
+			{"golang-riscv64-hello-world"},
+			{"LC_TYPE=C", "LC_ALL=C", "USER=root"});
+
+		std::string text;
+		machine.set_userdata(&text);
+		machine.set_printer([] (const auto& m, const char* data, size_t size) {
+			m.template get_userdata<std::string> ()->append(data, size);
+		});
+
+		machine.simulate(MAX_INSTRUCTIONS);
+
+		REQUIRE(machine.return_value() == 0);
+		REQUIRE(text == "hello world");
+	}
+}
+
+TEST_CASE("Forks of memory-mapped programs", "[Verify]")
+{
+	const auto binary = load_file(cwd + "/elf/newlib-rv64gb-hello-world");
+
+	for (const bool use_memory_arena : {true, false})
+	{
+		riscv::Machine<RISCV64> machine { ProgramFile{cwd + "/elf/newlib-rv64gb-hello-world"}, {
+			.memory_max = MAX_MEMORY,
+			.use_memory_arena = use_memory_arena
+		} };
+		machine.setup_linux_syscalls();
+		machine.setup_linux(
+			{"newlib-rv64gb-hello-world"},
+			{"LC_TYPE=C", "LC_ALL=C", "USER=root"});
+		machine.set_printer([] (const auto&, const char*, size_t) {});
+
+		// Loaded segments match a machine that copied them
+		riscv::Machine<RISCV64> reference { binary, {
+			.memory_max = MAX_MEMORY,
+			.use_memory_arena = use_memory_arena
+		} };
+		for (const char* section : {".text", ".rodata", ".data"}) {
+			const auto addr = machine.memory.resolve_section(section);
+			REQUIRE(addr != 0x0);
+			std::vector<uint8_t> mapped(8192), copied(8192);
+			machine.memory.memcpy_out(mapped.data(), addr, mapped.size());
+			reference.memory.memcpy_out(copied.data(), addr, copied.size());
+			REQUIRE(mapped == copied);
+		}
+
+		// Forks run the program from the masters mapping
+		for (int i = 0; i < 2; i++) {
+			riscv::Machine<RISCV64> fork { machine };
+			fork.set_printer([] (const auto&, const char*, size_t) {});
+			fork.simulate(MAX_INSTRUCTIONS);
+			REQUIRE(fork.return_value() == 666);
+		}
+		machine.simulate(MAX_INSTRUCTIONS);
+		REQUIRE(machine.return_value() == 666);
+	}
+}
+
+TEST_CASE("Lazily decoded execute segments", "[Verify]")
+{
+	for (const char* name : {"rust-riscv64-hello-world", "zig-riscv64-hello-world", "newlib-rv64gb-hello-world"})
+	{
+		const auto binary = load_file(cwd + "/elf/" + name);
+		struct Result {
+			std::string text;
+			uint64_t instructions = 0;
+			size_t decoded_pages = 0;
+			size_t total_pages = 0;
+		};
+		auto run = [&] (bool lazy) {
+			riscv::MachineOptions<RISCV64> options {
+				.memory_max = MAX_MEMORY,
+				.use_shared_execute_segments = false,
+				.lazy_decoding = lazy
+			};
+#ifdef RISCV_BINARY_TRANSLATION
+			// The translator decodes the whole execute segment up front
+			options.translate_enabled = false;
+#endif
+			riscv::Machine<RISCV64> machine { binary, options };
+			machine.setup_linux_syscalls();
+			machine.fds().permit_filesystem = false;
+			machine.fds().permit_sockets = false;
+			machine.setup_posix_threads();
+			machine.setup_linux({name}, {"LC_TYPE=C", "LC_ALL=C", "USER=root"});
+
+			Result result;
+			machine.set_userdata(&result.text);
+			machine.set_printer([] (const auto& m, const char* data, size_t size) {
+				m.template get_userdata<std::string> ()->append(data, size);
+			});
+			machine.simulate(MAX_INSTRUCTIONS);
+			result.instructions = machine.instruction_counter();
+			const auto& exec = machine.cpu.current_execute_segment();
+			result.decoded_pages = exec.decoded_pages();
+			result.total_pages = exec.decoder_cache_size();
+			return result;
+		};
+		const Result eager = run(false);
+		const Result lazy = run(true);
+
+		REQUIRE(!eager.text.empty());
+		REQUIRE(lazy.text == eager.text);
+		REQUIRE(lazy.instructions == eager.instructions);
+		// Only the pages that were executed are decoded
+		REQUIRE(eager.decoded_pages == eager.total_pages);
+		REQUIRE(lazy.decoded_pages > 0);
+		REQUIRE(lazy.decoded_pages < lazy.total_pages);
+	}
+}
+
+TEST_CASE("Parallel decoding matches serial decoding", "[Verify]")
+{
+	for (const char* name : {"golang-riscv64-hello-world", "rust-riscv64-hello-world", "newlib-rv64gb-hello-world"})
+	{
+		const auto binary = load_file(cwd + "/elf/" + name);
+		auto options = [] (unsigned threads) {
+			return riscv::MachineOptions<RISCV64> {
+				.memory_max = MAX_MEMORY,
+				.use_shared_execute_segments = false,
+				.decoder_threads = threads
+			};
+		};
+		const riscv::Machine<RISCV64> serial { binary, options(1) };
+		riscv::Machine<RISCV64> parallel { binary, options(4) };
+
+		const auto& exec1 = serial.cpu.current_execute_segment();
+		const auto& exec2 = parallel.cpu.current_execute_segment();
+		REQUIRE(exec1.exec_begin() == exec2.exec_begin());
+		REQUIRE(exec1.exec_end() == exec2.exec_end());
+		// Large enough to be decoded in parallel
+		REQUIRE(exec1.exec_end() - exec1.exec_begin() >= 256 * 1024);
+
+		constexpr unsigned DIVISOR = riscv::compressed_enabled ? 2 : 4;
+		size_t mismatches = 0;
+		for (auto pc = exec1.exec_begin(); pc < exec1.exec_end(); pc += DIVISOR)
+		{
+			const auto& entry1 = exec1.decoder_cache()[pc / DIVISOR];
+			const auto& entry2 = exec2.decoder_cache()[pc / DIVISOR];
+			if (entry1.get_bytecode() != entry2.get_bytecode()
+				|| entry1.m_handler != entry2.m_handler
+				|| entry1.block_bytes() != entry2.block_bytes()
+				|| entry1.instruction_count() != entry2.instruction_count()
+				|| entry1.instr != entry2.instr)
+				mismatches++;
+		}
+		REQUIRE(mismatches == 0);
+
+		// The parallel-decoded program still runs
+		parallel.setup_linux_syscalls();
+		parallel.fds().permit_filesystem = false;
+		parallel.fds().permit_sockets = false;
+		parallel.setup_posix_threads();
+		parallel.setup_linux({name}, {"LC_TYPE=C", "LC_ALL=C", "USER=root"});
+		std::string text;
+		parallel.set_userdata(&text);
+		parallel.set_printer([] (const auto& m, const char* data, size_t size) {
+			m.template get_userdata<std::string> ()->append(data, size);
+		});
+		parallel.simulate(MAX_INSTRUCTIONS);
+		REQUIRE(text.find("ello") != std::string::npos);
+	}
+}
+
+TEST_CASE("Persistent decoder cache", "[Verify]")
+{
+	const auto directory = std::filesystem::temp_directory_path() / "libriscv-decoder-cache-test";
+	std::filesystem::remove_all(directory);
+	std::filesystem::create_directories(directory);
+
+	const char* name = "rust-riscv64-hello-world";
+	const auto binary = load_file(cwd + "/elf/" + name);
+	auto options = [&] (bool persistent) {
+		return riscv::MachineOptions<RISCV64> {
+			.memory_max = MAX_MEMORY,
+			.use_shared_execute_segments = false,
+			.decoder_cache_directory = persistent ? directory.string() : ""
+		};
+	};
+	auto same_decoding = [] (const auto& m1, const auto& m2) {
+		const auto& exec1 = m1.cpu.current_execute_segment();
+		const auto& exec2 = m2.cpu.current_execute_segment();
+		constexpr unsigned DIVISOR = riscv::compressed_enabled ? 2 : 4;
+		for (auto pc = exec1.exec_begin(); pc < exec1.exec_end(); pc += DIVISOR)
+		{
+			const auto& entry1 = exec1.decoder_cache()[pc / DIVISOR];
+			const auto& entry2 = exec2.decoder_cache()[pc / DIVISOR];
+			if (entry1.get_bytecode() != entry2.get_bytecode()
+				|| entry1.m_handler != entry2.m_handler
+				|| entry1.block_bytes() != entry2.block_bytes()
+				|| entry1.instruction_count() != entry2.instruction_count()
+				|| entry1.instr != entry2.instr)
+				return false;
+		}
+		return true;
+	};
+	const riscv::Machine<RISCV64> reference { binary, options(false) };
+	{
+		// The first machine decodes and stores the decoder cache
+		const riscv::Machine<RISCV64> machine { binary, options(true) };
+		REQUIRE(same_decoding(reference, machine));
+	}
+	const auto files = std::distance(std::filesystem::directory_iterator(directory), {});
+	REQUIRE(files == 1);
+	const auto filename = std::filesystem::directory_iterator(directory)->path();
+
+	// The second machine loads it
+	riscv::Machine<RISCV64> machine { binary, options(true) };
+	REQUIRE(same_decoding(reference, machine));
+
+	machine.setup_linux_syscalls();
+	machine.setup_linux({name}, {"LC_TYPE=C", "LC_ALL=C", "USER=root"});
+	std::string text;
+	machine.set_userdata(&text);
+	machine.set_printer([] (const auto& m, const char* data, size_t size) {
+		m.template get_userdata<std::string> ()->append(data, size);
+	});
+	machine.simulate(MAX_INSTRUCTIONS);
+	REQUIRE(text.find("ello") != std::string::npos);
+
+	// A damaged decoder cache is decoded again
+	{
+		std::fstream file(filename, std::ios::in | std::ios::out | std::ios::binary);
+		file.seekp(4096);
+		file.put(0x55);
+	}
+	const riscv::Machine<RISCV64> damaged { binary, options(true) };
+	REQUIRE(same_decoding(reference, damaged));
+
+	std::filesystem::remove_all(directory);
+}